@@ -3,4 +3,6 @@ AM_CFLAGS =  -fstack-protector -Wall -pedantic \
         -Werror-implicit-function-declaration \
         -Wformat -Wformat-security -Werror=format-security \
         -Wno-conversion -Werror \
-        -DDATADIR=\"$(datadir)\"
+        -DDATADIR=\"$(datadir)\" \
+        -DLIBEXECDIR=\"$(libexecdir)\" \
+        -DBINDIR=\"$(bindir)\"
@@ -0,0 +1,58 @@
+#!/bin/bash
+# Compare the directory listing backends on a synthetic tree:
+#   ./enumerator_benchmark.sh [TREE]
+# The tree is built on first use, ENTRIES entries (default 1M) in
+# directories of 1000, and kept for later runs. Its files are all .txt,
+# so the walk neither opens nor tags any of them, and only listing is
+# measured. For each backend this prints wall time over RUNS runs from an
+# empty database, cold when run as root, then the syscalls of one run
+# under strace -c and its heap allocations under valgrind, where those
+# are installed.
+set -e
+
+entries="${ENTRIES:-1000000}"
+runs="${RUNS:-3}"
+bin="${BUDGIE:-budgie-indexer}"
+tree="${1:-/var/tmp/budgie-enumerator-tree}"
+tmp=$(mktemp -d)
+db="$tmp/bench.db"
+trap 'rm -rf "$tmp"' EXIT
+
+if [ ! -d "$tree" ]; then
+        echo "Building $entries entries in $tree"
+        per_dir=1000
+        for d in $(seq -f "%05g" 0 $((entries / per_dir - 1))); do
+                mkdir -p "$tree/$d"
+                (cd "$tree/$d" && touch $(seq -f "%04g.txt" 1 $((per_dir - 1))))
+        done
+fi
+
+for backend in gio getdents; do
+        for run in $(seq "$runs"); do
+                rm -f "$db"
+                if [ "$(id -u)" = "0" ]; then
+                        sync
+                        echo 3 > /proc/sys/vm/drop_caches
+                fi
+                echo -n "$backend #$run: "
+                "$bin" --scan-only --db "$db" --dirs "$tree" --backend "$backend" \
+                        --in-process | grep "^Scan finished"
+        done
+
+        if command -v strace > /dev/null; then
+                rm -f "$db"
+                strace -f -c -o "$tmp/strace" "$bin" --scan-only --db "$db" \
+                        --dirs "$tree" --backend "$backend" --in-process > /dev/null
+                echo "$backend syscalls:"
+                grep -E " (getdents64|openat|newfstatat|fstat|statx|lstat|close|total)$" \
+                        "$tmp/strace"
+        fi
+
+        if command -v valgrind > /dev/null; then
+                rm -f "$db"
+                echo -n "$backend allocations: "
+                G_SLICE=always-malloc valgrind "$bin" --scan-only --db "$db" \
+                        --dirs "$tree" --backend "$backend" --in-process 2>&1 \
+                        > /dev/null | grep -o "total heap usage: .*"
+        fi
+done
@@ -0,0 +1,27 @@
+#!/bin/bash
+# Time a cold tag backfill in each I/O order, as root:
+#   ./scan_benchmark.sh /mnt/disk/Music [runs]
+# Every run starts from an empty database and an empty page cache.
+set -e
+
+dir="$1"
+runs="${2:-3}"
+bin="${BUDGIE:-budgie-indexer}"
+db=$(mktemp -d)/bench.db
+
+if [ -z "$dir" ] || [ "$(id -u)" != "0" ]; then
+        echo "Usage: sudo $0 DIR [RUNS]" >&2
+        exit 1
+fi
+
+for order in path inode extent; do
+        for run in $(seq "$runs"); do
+                rm -f "$db"
+                sync
+                echo 3 > /proc/sys/vm/drop_caches
+                echo -n "$order #$run: "
+                "$bin" --scan-only --db "$db" --dirs "$dir" --io-order "$order" \
+                        --drop-caches | grep "^Scan finished"
+        done
+done
+rm -rf "$(dirname "$db")"
@@ -55,8 +55,8 @@ static void budgie_control_bar_init(BudgieControlBar *self)
         GtkToolItem *control_item;
         GtkToolItem *control_video_item;
         GtkWidget *repeat, *random;
-        GtkWidget *reload;
-        GtkToolItem *reload_item;
+        GtkWidget *reload, *stop_scan;
+        GtkToolItem *reload_item, *stop_scan_item;
         GtkWidget *full_screen;
         GtkWidget *aspect;
         GtkWidget *settings;
@@ -213,6 +213,19 @@ static void budgie_control_bar_init(BudgieControlBar *self)
         gtk_container_add(GTK_CONTAINER(reload_item), reload);
         gtk_container_add(GTK_CONTAINER(self), GTK_WIDGET(reload_item));
 
+        /* stop scan, only shown while a reload runs */
+        stop_scan = new_button_with_icon(self->icon_theme, "process-stop-symbolic",
+                TRUE, FALSE, "Stop updating the media library");
+        data = g_malloc(sizeof(guint));
+        *data = BUDGIE_ACTION_STOP_SCAN;
+        g_object_set_data_full(G_OBJECT(stop_scan), "budgie", data, g_free);
+        g_signal_connect(stop_scan, "clicked", G_CALLBACK(handler_cb), self);
+        gtk_widget_set_no_show_all(stop_scan, TRUE);
+        stop_scan_item = gtk_tool_item_new();
+        self->stop_scan = stop_scan;
+        gtk_container_add(GTK_CONTAINER(stop_scan_item), stop_scan);
+        gtk_container_add(GTK_CONTAINER(self), GTK_WIDGET(stop_scan_item));
+
         /* settings */
         settings = new_button_with_icon(self->icon_theme, "preferences-system-symbolic",
                 TRUE, TRUE, "Preferences");
@@ -295,6 +308,9 @@ void budgie_control_bar_set_action_enabled(BudgieControlBar *self,
                 case BUDGIE_ACTION_PAUSE:
                         wid = GTK_WIDGET(self->pause);
                         break;
+                case BUDGIE_ACTION_STOP_SCAN:
+                        wid = GTK_WIDGET(self->stop_scan);
+                        break;
                 case BUDGIE_ACTION_SETTINGS:
                         wid = GTK_WIDGET(self->settings);
                         break;
@@ -48,6 +48,7 @@ typedef enum {
         BUDGIE_ACTION_PAUSE,
         BUDGIE_ACTION_PREVIOUS,
         BUDGIE_ACTION_NEXT,
+        BUDGIE_ACTION_STOP_SCAN,
         BUDGIE_MAX_ACTIONS
 } BudgieAction;
 
@@ -57,6 +58,7 @@ struct _BudgieControlBar {
 
         GtkIconTheme *icon_theme;
         GtkWidget *reload;
+        GtkWidget *stop_scan;
         GtkWidget *video_controls;
         GtkWidget *full_screen;
 
@@ -0,0 +1,931 @@
+/*
+ * budgie-indexer.c
+ *
+ * Copyright 2013 Ikey Doherty <ikey.doherty@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ *
+ *
+ */
+#define _GNU_SOURCE
+#include <errno.h>
+#include <fcntl.h>
+#include <locale.h>
+#include <signal.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/file.h>
+#include <unistd.h>
+#include <gio/gio.h>
+#include <gio/gunixsocketaddress.h>
+#include <glib-unix.h>
+#include <glib/gstdio.h>
+
+#include "config.h"
+#include "common.h"
+#include "indexer/budgie-indexer-protocol.h"
+#include "scanner/budgie-enumerator.h"
+#include "scanner/budgie-head-reader.h"
+#include "scanner/budgie-io-order.h"
+#include "scanner/budgie-library-watcher.h"
+#include "scanner/budgie-scanner.h"
+#include "scanner/budgie-tag-pool.h"
+#include "scanner/budgie-tag-reader.h"
+
+/* With no player connected and no scan running, wait this long for one */
+#define INDEXER_IDLE_EXIT_SEC 30
+
+/* Scan progress is passed on to players at most this often */
+#define INDEXER_PROGRESS_USEC (G_USEC_PER_SEC / 10)
+
+/* A player that lets this many messages pile up has stopped reading */
+#define INDEXER_PEER_BACKLOG 1024
+
+static gboolean once = FALSE;
+static gboolean scan_only = FALSE;
+static gchar *db_path = NULL;
+static gchar **scan_dirs = NULL;
+static gchar *tag_mode = NULL;
+static gchar *io_order = NULL;
+static gchar *tag_io = NULL;
+static gchar *backend = NULL;
+static gboolean drop_caches = FALSE;
+static gboolean in_process = FALSE;
+
+/* Indexed by BudgieTagMode */
+static const gchar *tag_modes[] = { "native", "taglib", "verify" };
+
+/* Indexed by BudgieIOOrder */
+static const gchar *io_orders[] = { "auto", "path", "inode", "extent" };
+
+/* Indexed by BudgieTagIO */
+static const gchar *tag_ios[] = { "pread", "uring" };
+
+/* Indexed by BudgieEnumeratorBackend */
+static const gchar *backends[] = { "gio", "getdents" };
+
+static GOptionEntry entries[] = {
+        { "once", 0, 0, G_OPTION_ARG_NONE, &once,
+          "Update the library and exit once no player needs us. If an indexer "
+          "is already running, ask it to rescan instead", NULL },
+        { "scan-only", 0, 0, G_OPTION_ARG_NONE, &scan_only,
+          "Update the media library in the foreground and print how long it "
+          "took, without serving players", NULL },
+        { "db", 0, 0, G_OPTION_ARG_FILENAME, &db_path,
+          "Database file to use with --scan-only", "PATH" },
+        { "dirs", 0, 0, G_OPTION_ARG_FILENAME_ARRAY, &scan_dirs,
+          "Directory to scan with --scan-only, instead of the configured ones. "
+          "May be given more than once", "DIR" },
+        { "tags", 0, 0, G_OPTION_ARG_STRING, &tag_mode,
+          "How --scan-only reads tags: native, taglib, or verify to compare "
+          "the two", "MODE" },
+        { "io-order", 0, 0, G_OPTION_ARG_STRING, &io_order,
+          "Order --scan-only reads files for their tags in: auto, path, inode "
+          "or extent", "ORDER" },
+        { "tag-io", 0, 0, G_OPTION_ARG_STRING, &tag_io,
+          "How --scan-only reads files for their tags: pread from each "
+          "tagger, or uring to batch them through io_uring", "IO" },
+        { "backend", 0, 0, G_OPTION_ARG_STRING, &backend,
+          "How --scan-only lists directories: gio, or getdents on Linux",
+          "BACKEND" },
+        { "drop-caches", 0, 0, G_OPTION_ARG_NONE, &drop_caches,
+          "Drop the page cache before --scan-only reads tags, to time a cold "
+          "backfill. Needs root", NULL },
+        { "in-process", 0, 0, G_OPTION_ARG_NONE, &in_process,
+          "Read tags with --scan-only in this process, rather than in "
+          BUDGIE_TAG_WORKER " helpers", NULL },
+        { NULL }
+};
+
+/* The running indexer. Everything but the scan thread lives in the main loop */
+typedef struct Indexer {
+        GMainLoop *loop;
+        GSettings *settings;
+        BudgieScanner *scanner;
+        BudgieLibraryWatcher *watcher;
+        GSocketService *service;
+        GList *peers; /**<Connected players */
+        GCancellable *cancel; /**<Stops the running scan */
+        gboolean scanning;
+        gboolean pending_scan; /**<A full scan was asked for during a scan */
+        gboolean pending_roots; /**<Media directories changed during a scan */
+        gboolean quitting;
+        gint64 last_progress;
+        ScanPhase last_phase;
+        guint idle_id;
+} Indexer;
+
+/* One connected player */
+typedef struct IndexerPeer {
+        Indexer *indexer;
+        GSocketConnection *connection;
+        GDataInputStream *input;
+        GCancellable *cancel;
+        GQueue *outbox; /**<Messages not yet written, the head in flight */
+        gboolean reading;
+        gboolean writing;
+        gboolean closed;
+} IndexerPeer;
+
+/* One scan, run in its own thread */
+typedef struct IndexerJob {
+        Indexer *indexer;
+        gchar **roots;
+        gboolean roots_only;
+        GCancellable *cancel;
+} IndexerJob;
+
+/* Handed from the scan thread to the main loop */
+typedef struct IndexerUpdate {
+        Indexer *indexer;
+        BudgieScanProgress progress;
+        guint n_tagged;
+} IndexerUpdate;
+
+static void indexer_scan(Indexer *self, gboolean roots_only);
+static void peer_read(IndexerPeer *peer);
+static void peer_flush(IndexerPeer *peer);
+
+/**
+ * The configured media directories, or the same defaults the player
+ * picks on its first run
+ */
+static gchar **media_dirs_get(GSettings *settings)
+{
+        const gchar *defaults[3];
+        gchar **dirs;
+
+        dirs = g_settings_get_strv(settings, BUDGIE_MEDIA_DIRS);
+        if (g_strv_length(dirs) > 0) {
+                return dirs;
+        }
+        g_strfreev(dirs);
+        defaults[0] = g_get_user_special_dir(G_USER_DIRECTORY_MUSIC);
+        defaults[1] = g_get_user_special_dir(G_USER_DIRECTORY_VIDEOS);
+        defaults[2] = NULL;
+        if (!defaults[0]) {
+                defaults[0] = defaults[1];
+                defaults[1] = NULL;
+        }
+        return g_strdupv((gchar**)defaults);
+}
+
+static gboolean idle_exit_cb(gpointer data)
+{
+        Indexer *self = data;
+
+        self->idle_id = 0;
+        if (!self->scanning && !self->peers) {
+                g_main_loop_quit(self->loop);
+        }
+        return FALSE;
+}
+
+/**
+ * Arrange to exit once nobody needs us. A timer run only waits for the
+ * players it woke up; otherwise a player starting soon after is spared
+ * starting us again
+ */
+static void indexer_check_idle(Indexer *self)
+{
+        if (self->quitting || self->scanning || self->peers || self->idle_id > 0) {
+                return;
+        }
+        self->idle_id = g_timeout_add_seconds(once ? 0 : INDEXER_IDLE_EXIT_SEC,
+                idle_exit_cb, self);
+}
+
+static void indexer_cancel_idle(Indexer *self)
+{
+        if (self->idle_id > 0) {
+                g_source_remove(self->idle_id);
+                self->idle_id = 0;
+        }
+}
+
+/* Free a closed peer once no operation is left holding it */
+static void peer_free_if_done(IndexerPeer *peer)
+{
+        if (peer->reading || peer->writing) {
+                return;
+        }
+        g_io_stream_close(G_IO_STREAM(peer->connection), NULL, NULL);
+        g_object_unref(peer->input);
+        g_object_unref(peer->connection);
+        g_object_unref(peer->cancel);
+        g_queue_free_full(peer->outbox, g_free);
+        g_free(peer);
+}
+
+static void peer_close(IndexerPeer *peer)
+{
+        Indexer *self = peer->indexer;
+
+        if (peer->closed) {
+                return;
+        }
+        peer->closed = TRUE;
+        self->peers = g_list_remove(self->peers, peer);
+        g_cancellable_cancel(peer->cancel);
+        peer_free_if_done(peer);
+        indexer_check_idle(self);
+}
+
+static void peer_written_cb(GObject *source, GAsyncResult *res, gpointer userdata)
+{
+        IndexerPeer *peer = userdata;
+        gboolean ok;
+
+        ok = g_output_stream_write_all_finish(G_OUTPUT_STREAM(source), res, NULL, NULL);
+        peer->writing = FALSE;
+        if (peer->closed) {
+                peer_free_if_done(peer);
+                return;
+        }
+        if (!ok) {
+                peer_close(peer);
+                return;
+        }
+        g_free(g_queue_pop_head(peer->outbox));
+        peer_flush(peer);
+}
+
+/**
+ * Write out the next queued message. Writes are asynchronous, so a
+ * player that is busy or stuck never holds up the scan it is told about
+ */
+static void peer_flush(IndexerPeer *peer)
+{
+        GOutputStream *output;
+        const gchar *message;
+
+        if (peer->writing || g_queue_is_empty(peer->outbox)) {
+                return;
+        }
+        message = g_queue_peek_head(peer->outbox);
+        output = g_io_stream_get_output_stream(G_IO_STREAM(peer->connection));
+        peer->writing = TRUE;
+        g_output_stream_write_all_async(output, message, strlen(message),
+                G_PRIORITY_DEFAULT, peer->cancel, peer_written_cb, peer);
+}
+
+static void peer_send(IndexerPeer *peer, const gchar *message)
+{
+        if (g_queue_get_length(peer->outbox) >= INDEXER_PEER_BACKLOG) {
+                g_message("Dropping a player that stopped reading");
+                peer_close(peer);
+                return;
+        }
+        g_queue_push_tail(peer->outbox, g_strdup(message));
+        peer_flush(peer);
+}
+
+static void indexer_broadcast(Indexer *self, const gchar *verb, const gchar * const *args)
+{
+        GList *elem, *next;
+        gchar *message;
+
+        message = budgie_indexer_message_new(verb, args);
+        for (elem = self->peers; elem; elem = next) {
+                /* Sending may drop the peer */
+                next = elem->next;
+                peer_send(elem->data, message);
+        }
+        g_free(message);
+}
+
+static void indexer_handle(Indexer *self, const gchar *line)
+{
+        gchar **fields;
+
+        fields = budgie_indexer_message_parse(line);
+        if (!fields[0]) {
+                g_strfreev(fields);
+                return;
+        }
+        if (g_str_equal(fields[0], BUDGIE_INDEXER_SCAN)) {
+                indexer_scan(self, FALSE);
+        } else if (g_str_equal(fields[0], BUDGIE_INDEXER_STOP)) {
+                self->pending_scan = FALSE;
+                if (self->cancel) {
+                        g_cancellable_cancel(self->cancel);
+                }
+        } else if (g_str_equal(fields[0], BUDGIE_INDEXER_PRIORITIZE)) {
+                budgie_scanner_prioritize(self->scanner, fields + 1);
+        } else {
+                g_warning("Unknown request from a player: %s", fields[0]);
+        }
+        g_strfreev(fields);
+}
+
+static void peer_read_cb(GObject *source, GAsyncResult *res, gpointer userdata)
+{
+        IndexerPeer *peer = userdata;
+        gchar *line;
+
+        line = g_data_input_stream_read_line_finish(G_DATA_INPUT_STREAM(source),
+                res, NULL, NULL);
+        peer->reading = FALSE;
+        if (peer->closed) {
+                g_free(line);
+                peer_free_if_done(peer);
+                return;
+        }
+        /* The player went away */
+        if (!line) {
+                peer_close(peer);
+                return;
+        }
+        indexer_handle(peer->indexer, line);
+        g_free(line);
+        peer_read(peer);
+}
+
+static void peer_read(IndexerPeer *peer)
+{
+        peer->reading = TRUE;
+        g_data_input_stream_read_line_async(peer->input, G_PRIORITY_DEFAULT,
+                peer->cancel, peer_read_cb, peer);
+}
+
+static gboolean incoming_cb(GSocketService *service,
+                            GSocketConnection *connection,
+                            GObject *source,
+                            gpointer userdata)
+{
+        Indexer *self = userdata;
+        IndexerPeer *peer;
+        const gchar *state[2];
+        gchar *message;
+
+        peer = g_new0(IndexerPeer, 1);
+        peer->indexer = self;
+        peer->connection = g_object_ref(connection);
+        peer->input = g_data_input_stream_new(
+                g_io_stream_get_input_stream(G_IO_STREAM(connection)));
+        peer->cancel = g_cancellable_new();
+        peer->outbox = g_queue_new();
+        self->peers = g_list_prepend(self->peers, peer);
+        indexer_cancel_idle(self);
+
+        /* So a player opened mid-scan shows it */
+        state[0] = self->scanning ? "scanning" : "idle";
+        state[1] = NULL;
+        message = budgie_indexer_message_new(BUDGIE_INDEXER_STATE, state);
+        peer_send(peer, message);
+        g_free(message);
+
+        peer_read(peer);
+        return TRUE;
+}
+
+static gboolean progress_idle(gpointer data)
+{
+        IndexerUpdate *update = data;
+        Indexer *self = update->indexer;
+        BudgieScanProgress *progress = &update->progress;
+        gchar *args[5];
+        gint64 now;
+        guint i;
+
+        /* A new phase always goes through, so players see each one */
+        now = g_get_monotonic_time();
+        if (now - self->last_progress >= INDEXER_PROGRESS_USEC ||
+                progress->phase != self->last_phase) {
+                args[0] = g_strdup_printf("%d", progress->phase);
+                args[1] = g_strdup_printf("%" G_GUINT64_FORMAT, progress->n_dirs);
+                args[2] = g_strdup_printf("%" G_GUINT64_FORMAT, progress->n_media);
+                args[3] = g_strdup_printf("%" G_GUINT64_FORMAT, progress->n_tagged);
+                args[4] = NULL;
+                indexer_broadcast(self, BUDGIE_INDEXER_PROGRESS, (const gchar * const *)args);
+                for (i = 0; args[i]; i++) {
+                        g_free(args[i]);
+                }
+                self->last_progress = now;
+                self->last_phase = progress->phase;
+        }
+        g_free(update);
+        return FALSE;
+}
+
+/* Called from the scan thread, about once a frame */
+static void scan_progress_cb(BudgieScanner *scanner, gpointer progress, gpointer userdata)
+{
+        IndexerUpdate *update;
+
+        update = g_new0(IndexerUpdate, 1);
+        update->indexer = userdata;
+        update->progress = *(BudgieScanProgress*)progress;
+        g_idle_add(progress_idle, update);
+}
+
+static gboolean tags_updated_idle(gpointer data)
+{
+        IndexerUpdate *update = data;
+        gchar *args[2];
+
+        args[0] = g_strdup_printf("%u", update->n_tagged);
+        args[1] = NULL;
+        indexer_broadcast(update->indexer, BUDGIE_INDEXER_TAGS, (const gchar * const *)args);
+        g_free(args[0]);
+        g_free(update);
+        return FALSE;
+}
+
+/* Called from the scan thread, after each committed backfill round */
+static void tags_updated_cb(BudgieScanner *scanner, guint n_tagged, gpointer userdata)
+{
+        IndexerUpdate *update;
+
+        update = g_new0(IndexerUpdate, 1);
+        update->indexer = userdata;
+        update->n_tagged = n_tagged;
+        g_idle_add(tags_updated_idle, update);
+}
+
+static void library_changed_cb(BudgieLibraryWatcher *watcher,
+                               guint updated,
+                               guint removed,
+                               gpointer userdata)
+{
+        Indexer *self = userdata;
+        gchar *args[3];
+
+        args[0] = g_strdup_printf("%u", updated);
+        args[1] = g_strdup_printf("%u", removed);
+        args[2] = NULL;
+        indexer_broadcast(self, BUDGIE_INDEXER_CHANGED, (const gchar * const *)args);
+        g_free(args[0]);
+        g_free(args[1]);
+}
+
+/* Queued behind the last update from the scan thread */
+static gboolean scan_done_idle(gpointer data)
+{
+        IndexerJob *job = data;
+        Indexer *self = job->indexer;
+
+        self->scanning = FALSE;
+        g_clear_object(&self->cancel);
+        g_strfreev(job->roots);
+        g_object_unref(job->cancel);
+        g_free(job);
+
+        indexer_broadcast(self, BUDGIE_INDEXER_DONE, NULL);
+        if (self->quitting) {
+                g_main_loop_quit(self->loop);
+        } else if (self->pending_scan) {
+                /* Covers changed directories too */
+                self->pending_scan = FALSE;
+                self->pending_roots = FALSE;
+                indexer_scan(self, FALSE);
+        } else if (self->pending_roots) {
+                self->pending_roots = FALSE;
+                indexer_scan(self, TRUE);
+        } else {
+                indexer_check_idle(self);
+        }
+        return FALSE;
+}
+
+static gpointer scan_thread(gpointer data)
+{
+        IndexerJob *job = data;
+        BudgieScanner *scanner = job->indexer->scanner;
+        BudgieDB *db;
+
+        db = budgie_db_new();
+        /* Cleared once the library is up to date. Whatever this job
+         * commits stays, so if it is cut short the next one skips it */
+        budgie_db_store_checkpoint(db, g_get_real_time());
+        if (job->roots_only) {
+                budgie_scanner_sync_roots(scanner, db, job->roots, job->cancel);
+        } else {
+                budgie_scanner_scan(scanner, db, job->roots, job->cancel);
+        }
+        if (!g_cancellable_is_cancelled(job->cancel)) {
+                budgie_scanner_backfill(scanner, db, job->cancel);
+        }
+        if (!g_cancellable_is_cancelled(job->cancel)) {
+                budgie_db_clear_checkpoint(db);
+        }
+        g_object_unref(db);
+
+        g_idle_add(scan_done_idle, job);
+        return NULL;
+}
+
+/**
+ * Start a scan, or, with one running, remember to follow it with another.
+ * roots_only scans just the media directories added or removed since
+ * the last scan
+ */
+static void indexer_scan(Indexer *self, gboolean roots_only)
+{
+        IndexerJob *job;
+
+        if (self->quitting) {
+                return;
+        }
+        if (self->scanning) {
+                if (roots_only) {
+                        self->pending_roots = TRUE;
+                } else {
+                        self->pending_scan = TRUE;
+                }
+                return;
+        }
+        indexer_cancel_idle(self);
+        self->scanning = TRUE;
+        self->cancel = g_cancellable_new();
+
+        job = g_new0(IndexerJob, 1);
+        job->indexer = self;
+        job->roots = media_dirs_get(self->settings);
+        job->roots_only = roots_only;
+        job->cancel = g_object_ref(self->cancel);
+
+        indexer_broadcast(self, BUDGIE_INDEXER_STARTED, NULL);
+        g_thread_unref(g_thread_new("budgie-indexer-scan", scan_thread, job));
+}
+
+static void settings_changed(GSettings *settings, gchar *key, gpointer userdata)
+{
+        Indexer *self = userdata;
+        gchar **strv;
+
+        if (g_str_equal(key, BUDGIE_MEDIA_DIRS)) {
+                strv = media_dirs_get(settings);
+                budgie_library_watcher_set_roots(self->watcher, strv);
+                g_strfreev(strv);
+                /* Only the added and removed directories need work */
+                indexer_scan(self, TRUE);
+        } else if (g_str_equal(key, BUDGIE_SCAN_MAX_FILES)) {
+                /* Picked up by the next scan */
+                g_object_set(self->scanner, "max-files-per-second",
+                        g_settings_get_uint(settings, BUDGIE_SCAN_MAX_FILES), NULL);
+        } else if (g_str_equal(key, BUDGIE_SCAN_MAX_MB)) {
+                g_object_set(self->scanner, "max-mb-per-second",
+                        g_settings_get_uint(settings, BUDGIE_SCAN_MAX_MB), NULL);
+        } else if (g_str_equal(key, BUDGIE_SCAN_IGNORE)) {
+                strv = g_settings_get_strv(settings, BUDGIE_SCAN_IGNORE);
+                g_object_set(self->scanner, "ignore-patterns", strv, NULL);
+                g_strfreev(strv);
+        }
+}
+
+/* SIGTERM or SIGINT; stop the scan and exit once it has wound down */
+static gboolean terminate_cb(gpointer data)
+{
+        Indexer *self = data;
+
+        self->quitting = TRUE;
+        if (self->scanning) {
+                g_cancellable_cancel(self->cancel);
+        } else {
+                g_main_loop_quit(self->loop);
+        }
+        return TRUE;
+}
+
+/**
+ * Ask the indexer that holds the lock to rescan, as a timer run found
+ * one already going
+ */
+static int request_scan(const gchar *socket_path)
+{
+        GSocketClient *client;
+        GSocketConnection *connection;
+        GSocketAddress *address;
+        GOutputStream *output;
+        GError *error = NULL;
+        gchar *message;
+        int ret = EXIT_SUCCESS;
+
+        client = g_socket_client_new();
+        address = g_unix_socket_address_new(socket_path);
+        connection = g_socket_client_connect(client, G_SOCKET_CONNECTABLE(address),
+                NULL, &error);
+        g_object_unref(address);
+        g_object_unref(client);
+        if (!connection) {
+                g_printerr("Unable to reach the running indexer: %s\n", error->message);
+                g_error_free(error);
+                return EXIT_FAILURE;
+        }
+
+        message = budgie_indexer_message_new(BUDGIE_INDEXER_SCAN, NULL);
+        output = g_io_stream_get_output_stream(G_IO_STREAM(connection));
+        if (!g_output_stream_write_all(output, message, strlen(message), NULL, NULL, &error)) {
+                g_printerr("Unable to reach the running indexer: %s\n", error->message);
+                g_error_free(error);
+                ret = EXIT_FAILURE;
+        }
+        g_free(message);
+        g_io_stream_close(G_IO_STREAM(connection), NULL, NULL);
+        g_object_unref(connection);
+
+        return ret;
+}
+
+/**
+ * Whether the last library update was cut short, by a crash, a stop or
+ * the session ending, and should be picked up again
+ */
+static gboolean update_interrupted(void)
+{
+        BudgieDB *db;
+        GDateTime *date;
+        gchar *when;
+        gint64 started;
+        gboolean ret;
+
+        db = budgie_db_new();
+        ret = budgie_db_get_checkpoint(db, &started);
+        g_object_unref(db);
+        if (ret) {
+                date = g_date_time_new_from_unix_local(started / G_USEC_PER_SEC);
+                when = g_date_time_format(date, "%c");
+                g_message("Resuming the library update started %s", when);
+                g_free(when);
+                g_date_time_unref(date);
+        }
+        return ret;
+}
+
+/**
+ * Serve players until nobody needs us. Only the holder of the lock
+ * writes the library, so a second indexer leaves straight away
+ */
+static int run_indexer(void)
+{
+        Indexer self = { 0 };
+        GSocketAddress *address;
+        GError *error = NULL;
+        gchar *lock_path, *socket_path;
+        gchar **strv;
+        int lock_fd;
+        int ret = EXIT_SUCCESS;
+
+        lock_path = budgie_indexer_lock_path();
+        socket_path = budgie_indexer_socket_path();
+        lock_fd = open(lock_path, O_RDWR | O_CREAT | O_CLOEXEC, 0600);
+        if (lock_fd < 0) {
+                g_printerr("Unable to open %s: %s\n", lock_path, g_strerror(errno));
+                ret = EXIT_FAILURE;
+                goto end;
+        }
+        if (flock(lock_fd, LOCK_EX | LOCK_NB) != 0) {
+                if (once) {
+                        ret = request_scan(socket_path);
+                } else {
+                        g_message("%s is already running", BUDGIE_INDEXER);
+                }
+                goto end;
+        }
+
+        /* Left behind by an indexer that didn't exit cleanly */
+        g_unlink(socket_path);
+        self.service = g_socket_service_new();
+        address = g_unix_socket_address_new(socket_path);
+        if (!g_socket_listener_add_address(G_SOCKET_LISTENER(self.service), address,
+                G_SOCKET_TYPE_STREAM, G_SOCKET_PROTOCOL_DEFAULT, NULL, NULL, &error)) {
+                g_printerr("Unable to listen on %s: %s\n", socket_path, error->message);
+                g_error_free(error);
+                g_object_unref(address);
+                g_object_unref(self.service);
+                ret = EXIT_FAILURE;
+                goto end;
+        }
+        g_object_unref(address);
+
+        self.loop = g_main_loop_new(NULL, FALSE);
+        self.settings = g_settings_new(BUDGIE_SCHEMA);
+        g_signal_connect(self.settings, "changed", G_CALLBACK(settings_changed), &self);
+
+        /* Keep out of the way of playback */
+        self.scanner = budgie_scanner_new(0);
+        g_object_set(self.scanner, "background", TRUE,
+                "max-files-per-second",
+                g_settings_get_uint(self.settings, BUDGIE_SCAN_MAX_FILES),
+                "max-mb-per-second",
+                g_settings_get_uint(self.settings, BUDGIE_SCAN_MAX_MB), NULL);
+        strv = g_settings_get_strv(self.settings, BUDGIE_SCAN_IGNORE);
+        g_object_set(self.scanner, "ignore-patterns", strv, NULL);
+        g_strfreev(strv);
+        g_signal_connect(self.scanner, "tags-updated", G_CALLBACK(tags_updated_cb), &self);
+        g_signal_connect(self.scanner, "progress", G_CALLBACK(scan_progress_cb), &self);
+
+        /* Pick up changes as they happen, rather than on the next scan */
+        self.watcher = budgie_library_watcher_new();
+        g_signal_connect(self.watcher, "changed", G_CALLBACK(library_changed_cb), &self);
+        strv = media_dirs_get(self.settings);
+        budgie_library_watcher_set_roots(self.watcher, strv);
+        g_strfreev(strv);
+
+        g_signal_connect(self.service, "incoming", G_CALLBACK(incoming_cb), &self);
+        g_socket_service_start(self.service);
+        g_unix_signal_add(SIGTERM, terminate_cb, &self);
+        g_unix_signal_add(SIGINT, terminate_cb, &self);
+
+        if (once || update_interrupted()) {
+                indexer_scan(&self, FALSE);
+        } else {
+                indexer_check_idle(&self);
+        }
+        g_main_loop_run(self.loop);
+        self.quitting = TRUE;
+
+        /* Stop taking players before giving up the lock */
+        g_socket_service_stop(self.service);
+        g_socket_listener_close(G_SOCKET_LISTENER(self.service));
+        g_unlink(socket_path);
+        while (self.peers) {
+                peer_close(self.peers->data);
+        }
+        g_object_unref(self.service);
+        g_object_unref(self.watcher);
+        g_object_unref(self.scanner);
+        g_object_unref(self.settings);
+        g_main_loop_unref(self.loop);
+
+end:
+        if (lock_fd >= 0) {
+                close(lock_fd);
+        }
+        g_free(lock_path);
+        g_free(socket_path);
+        return ret;
+}
+
+/**
+ * Empty the page cache, so the files read next come from storage. Dentry
+ * and inode caches are kept, as a walk would have just filled them
+ */
+static gboolean drop_page_cache(void)
+{
+        GError *error = NULL;
+
+        sync();
+        if (!g_file_set_contents("/proc/sys/vm/drop_caches", "1", 1, &error)) {
+                g_printerr("Unable to drop the page cache: %s\n", error->message);
+                g_error_free(error);
+                return FALSE;
+        }
+        return TRUE;
+}
+
+/**
+ * Scan the media directories into the database in the foreground, and
+ * time it
+ */
+static int run_scan_only(void)
+{
+        GSettings *settings;
+        BudgieScanner *scanner;
+        BudgieDB *db;
+        gchar **dirs = NULL;
+        BudgieTagMode mode = BUDGIE_TAGS_DEFAULT;
+        BudgieIOOrder order = BUDGIE_IO_ORDER_DEFAULT;
+        BudgieTagIO io = BUDGIE_TAG_IO_DEFAULT;
+        BudgieEnumeratorBackend lister = BUDGIE_ENUMERATOR_DEFAULT;
+        gint64 start, tags_start;
+        guint n_stored, n_tagged;
+        int ret = EXIT_SUCCESS;
+
+        if (tag_mode) {
+                for (mode = 0; mode < BUDGIE_TAGS_MAX; mode++) {
+                        if (g_str_equal(tag_mode, tag_modes[mode])) {
+                                break;
+                        }
+                }
+                if (mode == BUDGIE_TAGS_MAX) {
+                        g_printerr("Unknown tag mode: %s\n", tag_mode);
+                        return EXIT_FAILURE;
+                }
+        }
+        if (io_order) {
+                for (order = 0; order < BUDGIE_IO_ORDER_MAX; order++) {
+                        if (g_str_equal(io_order, io_orders[order])) {
+                                break;
+                        }
+                }
+                if (order == BUDGIE_IO_ORDER_MAX) {
+                        g_printerr("Unknown I/O order: %s\n", io_order);
+                        return EXIT_FAILURE;
+                }
+        }
+        if (tag_io) {
+                for (io = 0; io < BUDGIE_TAG_IO_MAX; io++) {
+                        if (g_str_equal(tag_io, tag_ios[io])) {
+                                break;
+                        }
+                }
+                if (io == BUDGIE_TAG_IO_MAX) {
+                        g_printerr("Unknown tag I/O: %s\n", tag_io);
+                        return EXIT_FAILURE;
+                }
+        }
+        if (backend) {
+                for (lister = 0; lister < BUDGIE_ENUMERATOR_MAX; lister++) {
+                        if (g_str_equal(backend, backends[lister])) {
+                                break;
+                        }
+                }
+                if (lister == BUDGIE_ENUMERATOR_MAX) {
+                        g_printerr("Unknown backend: %s\n", backend);
+                        return EXIT_FAILURE;
+                }
+        }
+
+        if (scan_dirs) {
+                dirs = g_strdupv(scan_dirs);
+        } else {
+                settings = g_settings_new(BUDGIE_SCHEMA);
+                dirs = media_dirs_get(settings);
+                g_object_unref(settings);
+        }
+        if (g_strv_length(dirs) == 0) {
+                g_printerr("No media directories to scan\n");
+                g_strfreev(dirs);
+                return EXIT_FAILURE;
+        }
+
+        start = g_get_monotonic_time();
+        db = db_path ? budgie_db_new_for_path(db_path) : budgie_db_new();
+        scanner = budgie_scanner_new(0);
+        g_object_set(scanner, "tag-mode", mode, "io-order", order, "tag-io", io,
+                "backend", lister, "isolate-tags", !in_process, NULL);
+
+        n_stored = budgie_scanner_scan(scanner, db, dirs, NULL);
+        if (drop_caches && !drop_page_cache()) {
+                ret = EXIT_FAILURE;
+                goto end;
+        }
+        tags_start = g_get_monotonic_time();
+        n_tagged = budgie_scanner_backfill(scanner, db, NULL);
+
+        g_print("Scan finished in %.2fs: %u new or changed files stored, %u tagged in %.2fs\n",
+                (g_get_monotonic_time() - start) / (gdouble)G_USEC_PER_SEC,
+                n_stored, n_tagged,
+                (g_get_monotonic_time() - tags_start) / (gdouble)G_USEC_PER_SEC);
+
+end:
+        g_object_unref(scanner);
+        g_object_unref(db);
+        g_strfreev(dirs);
+
+        return ret;
+}
+
+int main(int argc, char **argv)
+{
+        GOptionContext *context;
+        GError *error = NULL;
+        int ret;
+
+        setlocale(LC_ALL, "");
+
+        context = g_option_context_new("- Keep the Budgie media library up to date");
+        g_option_context_add_main_entries(context, entries, NULL);
+        if (!g_option_context_parse(context, &argc, &argv, &error)) {
+                g_printerr("%s\n", error->message);
+                g_error_free(error);
+                g_option_context_free(context);
+                return EXIT_FAILURE;
+        }
+        g_option_context_free(context);
+
+        if (scan_only) {
+                ret = run_scan_only();
+        } else {
+                if (db_path || scan_dirs || tag_mode || io_order || tag_io ||
+                        backend || drop_caches || in_process) {
+                        g_printerr("--db, --dirs, --tags, --io-order, --tag-io, "
+                                "--backend, --drop-caches and --in-process are "
+                                "only used with --scan-only\n");
+                }
+                ret = run_indexer();
+        }
+
+        g_free(db_path);
+        g_strfreev(scan_dirs);
+        g_free(tag_mode);
+        g_free(io_order);
+        g_free(tag_io);
+        g_free(backend);
+        return ret;
+}
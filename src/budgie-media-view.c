@@ -45,6 +45,7 @@ static void item_activated_cb(GtkWidget *widget,
 static void button_clicked_cb(GtkWidget *widget, gpointer userdata);
 static void list_selection_cb(GtkListBox *list, GtkListBoxRow *row,
                               gpointer userdata);
+static void list_scrolled_cb(GtkAdjustment *adjustment, gpointer userdata);
 
 static GdkPixbuf *beautify(GdkPixbuf **source,
                            GdkPixbuf *base,
@@ -99,6 +100,12 @@ static void budgie_media_view_class_init(BudgieMediaViewClass *klass)
                 G_TYPE_OBJECT, G_SIGNAL_RUN_FIRST,
                 0, NULL, NULL, NULL, G_TYPE_NONE,
                 1, G_TYPE_POINTER);
+
+        /* NULL terminated paths of untagged rows that came into view */
+        g_signal_new("tags-wanted",
+                G_TYPE_FROM_CLASS(klass), G_SIGNAL_RUN_FIRST,
+                0, NULL, NULL, NULL, G_TYPE_NONE,
+                1, G_TYPE_POINTER);
 }
 
 static gboolean update_db_t(gpointer userdata)
@@ -161,6 +168,7 @@ static void budgie_media_view_init(BudgieMediaView *self)
         GtkWidget *top_frame;
         GtkWidget *label;
         GtkWidget *info_box;
+        GtkAdjustment *adjustment;
 
         /* Main layout of view */
         top_frame = gtk_frame_new(NULL);
@@ -290,6 +298,14 @@ static void budgie_media_view_init(BudgieMediaView *self)
                 TRUE);
         gtk_container_add(GTK_CONTAINER(scroll), list);
         gtk_box_pack_start(GTK_BOX(view_page), scroll, TRUE, TRUE, 0);
+        self->list_scroll = scroll;
+
+        /* Rows scrolled into view, or laid out for the first time */
+        adjustment = gtk_scrolled_window_get_vadjustment(GTK_SCROLLED_WINDOW(scroll));
+        g_signal_connect(adjustment, "value-changed",
+                G_CALLBACK(list_scrolled_cb), self);
+        g_signal_connect(adjustment, "changed",
+                G_CALLBACK(list_scrolled_cb), self);
         g_object_set(scroll, "margin-top", 20, NULL);
         gtk_scrolled_window_set_shadow_type(GTK_SCROLLED_WINDOW(scroll),
                 GTK_SHADOW_NONE);
@@ -690,6 +706,8 @@ static GtkListBoxRow* set_display(BudgieMediaView *self, GPtrArray *results)
         GtkWidget *label;
         /* Info label */
         gchar *info_string = NULL;
+        gchar *count = NULL;
+        guint64 duration = 0;
 
         /* Do nothing when results is null */
         if (!results) {
@@ -705,11 +723,17 @@ static GtkListBoxRow* set_display(BudgieMediaView *self, GPtrArray *results)
                 self->results = NULL;
         }
 
-        g_ptr_array_sort(results, budgie_db_sort);
+        /* Albums play in track order */
+        if (self->mode == MEDIA_MODE_ALBUMS) {
+                g_ptr_array_sort(results, budgie_db_sort_tracks);
+        } else {
+                g_ptr_array_sort(results, budgie_db_sort);
+        }
 
         /* Extract the fields */
         for (i=0; i < results->len; i++) {
                 current = (MediaInfo*)results->pdata[i];
+                duration += current->duration;
                 label = budgie_media_label_new(current);
                 gtk_container_add(GTK_CONTAINER(self->list), label);
                 gtk_widget_set_halign(label, GTK_ALIGN_START);
@@ -760,13 +784,22 @@ static GtkListBoxRow* set_display(BudgieMediaView *self, GPtrArray *results)
                 default:
                         if (results->len == 0) {
                                 info_string = g_strdup_printf("No songs");
+                                break;
                         } else if (results->len == 1) {
-                                info_string = g_strdup_printf("%d song",
+                                count = g_strdup_printf("%d song",
                                         results->len);
                         } else {
-                                info_string = g_strdup_printf("%d songs",
+                                count = g_strdup_printf("%d songs",
                                        results->len);
                         }
+                        /* Running time of the album, when it is known */
+                        if (duration >= 60000) {
+                                info_string = g_strdup_printf("%s, %d min",
+                                        count, (int)((duration + 30000) / 60000));
+                                g_free(count);
+                        } else {
+                                info_string = count;
+                        }
                         break;
         }
 
@@ -802,6 +835,123 @@ static void list_selection_cb(GtkListBox *list, GtkListBoxRow *row,
 
 }
 
+/**
+ * Collect the labels of rows currently on screen
+ */
+static GPtrArray *visible_labels(BudgieMediaView *self)
+{
+        GtkAdjustment *adjustment;
+        GtkListBoxRow *row;
+        GtkAllocation alloc;
+        GPtrArray *ret;
+        gdouble top, bottom;
+        gint index;
+
+        ret = g_ptr_array_new();
+        if (!gtk_widget_get_mapped(self->list)) {
+                return ret;
+        }
+
+        adjustment = gtk_scrolled_window_get_vadjustment(
+                GTK_SCROLLED_WINDOW(self->list_scroll));
+        top = gtk_adjustment_get_value(adjustment);
+        bottom = top + gtk_adjustment_get_page_size(adjustment);
+
+        row = gtk_list_box_get_row_at_y(GTK_LIST_BOX(self->list), (gint)top);
+        if (!row) {
+                return ret;
+        }
+        index = gtk_list_box_row_get_index(row);
+        for (; row; row = gtk_list_box_get_row_at_index(GTK_LIST_BOX(self->list), ++index)) {
+                gtk_widget_get_allocation(GTK_WIDGET(row), &alloc);
+                if (alloc.y >= bottom) {
+                        break;
+                }
+                g_ptr_array_add(ret, gtk_bin_get_child(GTK_BIN(row)));
+        }
+        return ret;
+}
+
+static void list_scrolled_cb(GtkAdjustment *adjustment, gpointer userdata)
+{
+        BudgieMediaView *self;
+        BudgieMediaLabel *label;
+        GPtrArray *labels, *paths;
+        guint i;
+
+        self = BUDGIE_MEDIA_VIEW(userdata);
+        labels = visible_labels(self);
+        paths = g_ptr_array_new();
+        for (i = 0; i < labels->len; i++) {
+                label = labels->pdata[i];
+                if (!label->info->tagged) {
+                        g_ptr_array_add(paths, label->info->path);
+                }
+        }
+        g_ptr_array_add(paths, NULL);
+
+        /* The paths are only borrowed for the emission */
+        if (paths->len > 1) {
+                g_signal_emit_by_name(self, "tags-wanted", paths->pdata);
+        }
+        g_ptr_array_free(paths, TRUE);
+        g_ptr_array_free(labels, TRUE);
+}
+
+static inline void swap_string(gchar **a, gchar **b)
+{
+        gchar *swap = *a;
+
+        *a = *b;
+        *b = swap;
+}
+
+void budgie_media_view_refresh_tags(BudgieMediaView *self)
+{
+        BudgieMediaLabel *label;
+        MediaInfo *info, *stored;
+        GPtrArray *labels;
+        guint i;
+
+        if (!self->db) {
+                return;
+        }
+
+        labels = visible_labels(self);
+        for (i = 0; i < labels->len; i++) {
+                label = labels->pdata[i];
+                info = label->info;
+                if (info->tagged) {
+                        continue;
+                }
+                stored = budgie_db_get_media(self->db, info->path);
+                if (!stored) {
+                        continue;
+                }
+                if (!stored->tagged) {
+                        free_media_info(stored);
+                        continue;
+                }
+                /* In place, as results and the player share this info */
+                swap_string(&info->title, &stored->title);
+                swap_string(&info->artist, &stored->artist);
+                swap_string(&info->album, &stored->album);
+                swap_string(&info->band, &stored->band);
+                swap_string(&info->genre, &stored->genre);
+                info->track = stored->track;
+                info->disc = stored->disc;
+                info->year = stored->year;
+                info->duration = stored->duration;
+                info->bitrate = stored->bitrate;
+                info->sample_rate = stored->sample_rate;
+                info->channels = stored->channels;
+                info->tagged = TRUE;
+                free_media_info(stored);
+                g_object_set(label, "info", info, NULL);
+        }
+        g_ptr_array_free(labels, TRUE);
+}
+
 /**
  * TODO: CACHE!!!
  */
@@ -75,6 +75,7 @@ struct _BudgieMediaView {
         /* Tracks page */
         GtkWidget *image;
         GtkWidget *list;
+        GtkWidget *list_scroll;
         gchar *current_path;
         gint index;
 };
@@ -110,4 +111,9 @@ MediaInfo* budgie_media_view_get_info(BudgieMediaView *self,
 void budgie_media_view_set_active(BudgieMediaView *self,
                                   MediaInfo *active);
 
+/**
+ * Reload the rows on screen that were still waiting on their tags
+ */
+void budgie_media_view_refresh_tags(BudgieMediaView *self);
+
 #endif /* budgie_media_view_h */
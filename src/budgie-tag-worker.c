@@ -0,0 +1,54 @@
+/*
+ * budgie-tag-worker.c
+ *
+ * Copyright 2013 Ikey Doherty <ikey.doherty@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ *
+ *
+ */
+
+#include <stdlib.h>
+#include <unistd.h>
+#include <taglib/tag_c.h>
+
+#include "scanner/budgie-tag-pool.h"
+
+/**
+ * Helper process of a BudgieTagPool. Reads tags for the indexer, over the
+ * socket it was started with as stdin and stdout, until the indexer closes
+ * it. Should TagLib crash or hang on a file, only this process goes
+ */
+int main(int argc, char **argv)
+{
+        gint fd;
+
+        if (argc != 1 || isatty(STDIN_FILENO)) {
+                g_printerr("%s is started by budgie-indexer, not by hand\n", argv[0]);
+                return EXIT_FAILURE;
+        }
+        /* Strings are freed as they are read, see budgie-scanner.c */
+        taglib_set_string_management_enabled(FALSE);
+
+        /* Keep the socket to ourselves, so that nothing printed to
+         * stdout can end up in the middle of a reply */
+        fd = dup(STDIN_FILENO);
+        if (fd < 0 || dup2(STDERR_FILENO, STDOUT_FILENO) < 0) {
+                return EXIT_FAILURE;
+        }
+
+        return budgie_tag_pool_serve(fd) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -46,11 +46,14 @@
 #include "common.h"
 #include "budgie-window.h"
 #include "budgie-media-view.h"
+#include "indexer/budgie-indexer-client.h"
 
 /* Private storage */
 struct _BudgieWindowPrivate {
         const gchar *current_page;
         GSettings *settings;
+        BudgieIndexerClient *indexer; /* Scans and writes the library for us */
+        ScanPhase scan_phase; /* Phase of the running scan, as last reported */
         MediaInfo *media;
         gchar *uri;
         guint64 duration;
@@ -86,9 +89,6 @@ G_DEFINE_TYPE_WITH_PRIVATE(BudgieWindow, budgie_window, G_TYPE_OBJECT)
 /* BudgieWindow prototypes */
 static void init_styles(BudgieWindow *self);
 
-static void store_media(gpointer data1, gpointer data2);
-static gboolean load_media_t(gpointer data);
-static gpointer load_media(gpointer data);
 static gboolean update_media_view(gpointer data);
 
 /* Callbacks */
@@ -109,6 +109,13 @@ static void toolbar_cb(BudgieControlBar *bar, int action, gboolean toggle, gpoin
 static void seek_cb(BudgieStatusArea *status, gint64 value, gpointer userdata);
 static void media_selected_cb(BudgieMediaView *view, gpointer info, gpointer userdata);
 static void error_dismiss_cb(GtkWidget *widget, gpointer userdata);
+static void library_changed_cb(BudgieIndexerClient *indexer, guint updated,
+                               guint removed, gpointer userdata);
+static void tags_wanted_cb(BudgieMediaView *view, gpointer paths, gpointer userdata);
+static void tags_updated_cb(BudgieIndexerClient *indexer, guint n_tagged, gpointer userdata);
+static void scan_started_cb(BudgieIndexerClient *indexer, gpointer userdata);
+static void scan_progress_cb(BudgieIndexerClient *indexer, gpointer progress, gpointer userdata);
+static void scan_finished_cb(BudgieIndexerClient *indexer, gpointer userdata);
 
 /* MPV callbacks */
 static void wakeup_cb(void *ctx);
@@ -192,6 +199,20 @@ static void budgie_window_init(BudgieWindow *self)
         self->media_dirs = media_dirs;
         self->db = budgie_db_new();
 
+        /* Scanning, tag reading and watching the media directories all
+         * happen in budgie-indexer, which tells us what changed */
+        self->priv->indexer = budgie_indexer_client_new();
+        g_signal_connect(self->priv->indexer, "started",
+                G_CALLBACK(scan_started_cb), self);
+        g_signal_connect(self->priv->indexer, "progress",
+                G_CALLBACK(scan_progress_cb), self);
+        g_signal_connect(self->priv->indexer, "finished",
+                G_CALLBACK(scan_finished_cb), self);
+        g_signal_connect(self->priv->indexer, "tags-updated",
+                G_CALLBACK(tags_updated_cb), self);
+        g_signal_connect(self->priv->indexer, "library-changed",
+                G_CALLBACK(library_changed_cb), self);
+
         init_styles(self);
 
         /* Initialize our window */
@@ -324,6 +345,8 @@ static void budgie_window_init(BudgieWindow *self)
         view = budgie_media_view_new(NULL);
         g_signal_connect(view, "media-selected",
                 G_CALLBACK(media_selected_cb), self);
+        g_signal_connect(view, "tags-wanted",
+                G_CALLBACK(tags_wanted_cb), self);
         self->view = view;
         gtk_stack_add_named(GTK_STACK(stack), view, "view");
 
@@ -374,10 +397,10 @@ static void budgie_window_init(BudgieWindow *self)
         length = g_list_length(tracks);
         g_print("Initial database check: found %d existing tracks\n", length);
         g_list_free_full(tracks, free_media_info);
-        /* Start thread from idle queue */
+        /* The view is handed the database as the scan finds files */
         if (length == 0) {
                 g_print("No existing tracks, starting media scan\n");
-                g_idle_add(load_media_t, self);
+                budgie_indexer_client_scan(self->priv->indexer);
         } else {
                 g_print("Found existing tracks, setting database on view\n");
                 g_object_set(view, "database", self->db, NULL);
@@ -427,6 +450,10 @@ static void budgie_window_dispose(GObject *object)
                 g_object_unref(self->priv->settings);
                 self->priv->settings = NULL;
         }
+        if (self->priv->indexer) {
+                g_object_unref(self->priv->indexer);
+                self->priv->indexer = NULL;
+        }
         if (self->db) {
                 g_object_unref(self->db);
                 self->db = NULL;
@@ -538,6 +565,8 @@ static void play_cb(GtkWidget *widget, gpointer userdata)
                 g_warning("play_cb: No media to play");
                 return;
         }
+        /* Known from the scan, mpv is only asked when it isn't */
+        self->priv->duration = (guint64)media->duration * 1000000;
         
         if (!media->path || !g_file_test(media->path, G_FILE_TEST_EXISTS)) {
                 g_warning("play_cb: Media file does not exist: %s", media->path ? media->path : "(null)");
@@ -748,7 +777,7 @@ static gboolean refresh_cb(gpointer userdata) {
 
 static void reload_cb(GtkWidget *widget, gpointer userdata)
 {
-        g_idle_add(load_media_t, userdata);
+        budgie_indexer_client_scan(BUDGIE_WINDOW(userdata)->priv->indexer);
 }
 
 static void full_screen_cb(GtkWidget *widget, gpointer userdata)
@@ -786,82 +815,84 @@ static void aspect_cb(GtkWidget *widget, gpointer userdata)
         gtk_widget_queue_draw(self->window);
 }
 
-static void store_media(gpointer data1, gpointer data2)
+/* Helper function to update media view on main thread */
+static gboolean update_media_view(gpointer data)
 {
-        MediaInfo *info;
-        BudgieWindow *self;
-
-        info = (MediaInfo*)data1;
-        self = BUDGIE_WINDOW(data2);
+        BudgieWindow *self = BUDGIE_WINDOW(data);
+        g_print("Updating media view on main thread\n");
+        g_object_set(BUDGIE_MEDIA_VIEW(self->view), "database", self->db, NULL);
+        return FALSE; /* Remove from idle queue */
+}
 
-        g_print("    Storing media in DB: %s\n", info->title ? info->title : info->path);
-        budgie_db_store_media(self->db, info);
+static void library_changed_cb(BudgieIndexerClient *indexer, guint updated,
+                               guint removed, gpointer userdata)
+{
+        g_print("Library changed: %u updated, %u removed\n", updated, removed);
+        update_media_view(userdata);
 }
 
-static gboolean load_media_t(gpointer data)
+static void tags_wanted_cb(BudgieMediaView *view, gpointer paths, gpointer userdata)
 {
         BudgieWindow *self;
-        __attribute__((unused)) GThread *thread;
 
-        self = BUDGIE_WINDOW(data);
-        budgie_control_bar_set_action_enabled(BUDGIE_CONTROL_BAR(self->toolbar),
-                BUDGIE_ACTION_RELOAD, FALSE);
+        self = BUDGIE_WINDOW(userdata);
+        budgie_indexer_client_prioritize(self->priv->indexer, (gchar**)paths);
+}
 
-        thread = g_thread_new("reload-media", &load_media, data);
+static void scan_started_cb(BudgieIndexerClient *indexer, gpointer userdata)
+{
+        BudgieWindow *self = BUDGIE_WINDOW(userdata);
 
-        return FALSE;
+        budgie_control_bar_set_action_enabled(BUDGIE_CONTROL_BAR(self->toolbar),
+                BUDGIE_ACTION_RELOAD, FALSE);
+        budgie_control_bar_set_action_enabled(BUDGIE_CONTROL_BAR(self->toolbar),
+                BUDGIE_ACTION_STOP_SCAN, TRUE);
+        self->priv->scan_phase = SCAN_PHASE_WALK;
 }
 
-static gpointer load_media(gpointer data)
+/**
+ * Show how far the scan has come under the window title
+ */
+static void scan_progress_cb(BudgieIndexerClient *indexer, gpointer data, gpointer userdata)
 {
-        BudgieWindow *self;
-        GList *tracks = NULL;
-        guint length, i;
-        const gchar *mimes[2];
+        BudgieWindow *self = BUDGIE_WINDOW(userdata);
+        BudgieScanProgress *progress = data;
+        gchar *subtitle;
 
-        self = BUDGIE_WINDOW(data);
-        if (self->media_dirs) {
-                g_strfreev(self->media_dirs);
-                self->media_dirs = g_settings_get_strv(self->priv->settings, BUDGIE_MEDIA_DIRS);
+        if (progress->phase == SCAN_PHASE_WALK) {
+                subtitle = g_strdup_printf("Found %" G_GUINT64_FORMAT " media files in %"
+                        G_GUINT64_FORMAT " folders", progress->n_media, progress->n_dirs);
+        } else {
+                subtitle = g_strdup_printf("Read tags of %" G_GUINT64_FORMAT " media files",
+                        progress->n_tagged);
         }
-
-        length = g_strv_length(self->media_dirs);
-        g_print("Scanning %d media directories...\n", length);
-        
-        mimes[0] = "audio/";
-        mimes[1] = "video/";
-        for (i=0; i < length; i++) {
-                g_print("Scanning directory: %s\n", self->media_dirs[i]);
-                search_directory(self->media_dirs[i], &tracks, 2, mimes);
+        gtk_header_bar_set_subtitle(GTK_HEADER_BAR(self->header), subtitle);
+        g_free(subtitle);
+
+        /* Every file is listed by name now, show them while the tags
+         * are read in the background */
+        if (progress->phase != self->priv->scan_phase) {
+                self->priv->scan_phase = progress->phase;
+                update_media_view(self);
         }
+}
 
-        g_print("Found %d media files\n", g_list_length(tracks));
-
-        budgie_db_begin_transaction(self->db);
-        g_list_foreach(tracks, store_media, self);
-        g_list_free_full(tracks, free_media_info);
-        budgie_db_end_transaction(self->db);
-
-        g_print("Database transaction completed\n");
+static void scan_finished_cb(BudgieIndexerClient *indexer, gpointer userdata)
+{
+        BudgieWindow *self = BUDGIE_WINDOW(userdata);
 
+        gtk_header_bar_set_subtitle(GTK_HEADER_BAR(self->header), NULL);
         budgie_control_bar_set_action_enabled(BUDGIE_CONTROL_BAR(self->toolbar),
                 BUDGIE_ACTION_RELOAD, TRUE);
-
-        g_print("Setting database on media view\n");
-        /* Use g_idle_add to ensure UI update happens on main thread */
-        g_idle_add((GSourceFunc)update_media_view, self);
-        g_print("Media view database set completed\n");
-
-        return NULL;
+        budgie_control_bar_set_action_enabled(BUDGIE_CONTROL_BAR(self->toolbar),
+                BUDGIE_ACTION_STOP_SCAN, FALSE);
+        update_media_view(self);
 }
 
-/* Helper function to update media view on main thread */
-static gboolean update_media_view(gpointer data)
+/* After each round of tags the indexer committed */
+static void tags_updated_cb(BudgieIndexerClient *indexer, guint n_tagged, gpointer userdata)
 {
-        BudgieWindow *self = BUDGIE_WINDOW(data);
-        g_print("Updating media view on main thread\n");
-        g_object_set(BUDGIE_MEDIA_VIEW(self->view), "database", self->db, NULL);
-        return FALSE; /* Remove from idle queue */
+        budgie_media_view_refresh_tags(BUDGIE_MEDIA_VIEW(BUDGIE_WINDOW(userdata)->view));
 }
 
 /* MPV callback implementations */
@@ -1249,7 +1280,11 @@ static void settings_changed(GSettings *settings, gchar *key, gpointer userdata)
         self = BUDGIE_WINDOW(userdata);
 
         /* Test keys. */
-        if (g_str_equal(key, BUDGIE_RANDOM)) {
+        if (g_str_equal(key, BUDGIE_MEDIA_DIRS)) {
+                /* budgie-indexer follows the change itself */
+                g_strfreev(self->media_dirs);
+                self->media_dirs = g_settings_get_strv(self->priv->settings, BUDGIE_MEDIA_DIRS);
+        } else if (g_str_equal(key, BUDGIE_RANDOM)) {
                 bool_value = g_settings_get_boolean(self->priv->settings, BUDGIE_RANDOM);
                 budgie_control_bar_set_action_state(BUDGIE_CONTROL_BAR(self->toolbar),
                         BUDGIE_ACTION_RANDOM, bool_value);
@@ -1271,6 +1306,9 @@ static void toolbar_cb(BudgieControlBar *bar, int action, gboolean toggle, gpoin
                 case BUDGIE_ACTION_RELOAD:
                         reload_cb(GTK_WIDGET(bar), userdata);
                         break;
+                case BUDGIE_ACTION_STOP_SCAN:
+                        budgie_indexer_client_stop(self->priv->indexer);
+                        break;
                 case BUDGIE_ACTION_RANDOM:
                         self->priv->random = toggle;
                         g_settings_set_boolean(self->priv->settings,
@@ -43,5 +43,17 @@
  * Whether we sport a dark theme or not
  */
 #define BUDGIE_DARK "dark-theme"
+/**
+ * Most files a library scan may look at per second, 0 for no limit
+ */
+#define BUDGIE_SCAN_MAX_FILES "scan-max-files-per-second"
+/**
+ * Most megabytes a library scan may read per second, 0 for no limit
+ */
+#define BUDGIE_SCAN_MAX_MB "scan-max-mb-per-second"
+/**
+ * Files and directories a library scan skips, see BudgieIgnore
+ */
+#define BUDGIE_SCAN_IGNORE "scan-ignore-patterns"
 
 #endif /* common_h */
@@ -39,19 +39,105 @@ struct _BudgieDBPrivate {
         gchar *storage_path;
         sqlite3 *db;
         sqlite3_stmt *insert;
+        sqlite3_stmt *remove;
+        sqlite3_stmt *mark;
+        sqlite3_stmt *prune;
+        sqlite3_stmt *dir_insert;
+        sqlite3_stmt *dir_mark;
+        sqlite3_stmt *dir_prune;
+        sqlite3_stmt *update_tags;
+        sqlite3_stmt *get_one;
+        sqlite3_stmt *get_untagged;
+        sqlite3_stmt *get_untagged_within;
+        sqlite3_stmt *alias_retarget;
+        sqlite3_stmt *alias_drop;
+        sqlite3_stmt *alias_insert;
+        sqlite3_stmt *move_drop;
+        sqlite3_stmt *move;
         sqlite3_stmt *get_all;
         GHashTable *exact_table;
         GHashTable *like_table;
         GHashTable *field_table;
 };
 
+enum {
+        PROP_0, PROP_PATH, N_PROPERTIES
+};
+
+static GParamSpec *obj_properties[N_PROPERTIES] = { NULL, };
+
 G_DEFINE_TYPE_WITH_PRIVATE(BudgieDB, budgie_db, G_TYPE_OBJECT)
 
+/* Schema upgrades, indexed by the user_version they upgrade from */
+static const gchar *migrations[] = {
+        /* 0 -> 1: file fingerprints, for incremental rescans */
+        "ALTER TABLE MEDIA ADD COLUMN MTIME INTEGER DEFAULT 0;"
+        "ALTER TABLE MEDIA ADD COLUMN SIZE INTEGER DEFAULT 0;"
+        "ALTER TABLE MEDIA ADD COLUMN INODE INTEGER DEFAULT 0;",
+        /* 1 -> 2: rows stored before their tags were read. Everything
+         * already stored came from a full scan, so it counts as tagged */
+        "ALTER TABLE MEDIA ADD COLUMN TAGGED INTEGER DEFAULT 1;"
+        "CREATE INDEX IF NOT EXISTS MEDIA_UNTAGGED ON MEDIA (ID) WHERE TAGGED = 0;",
+        /* 2 -> 3: paths reaching media stored under another path, through
+         * a hard link or a symlink */
+        "CREATE TABLE IF NOT EXISTS ALIASES (PATH TEXT PRIMARY KEY, TARGET TEXT);"
+        "CREATE INDEX IF NOT EXISTS ALIASES_TARGET ON ALIASES (TARGET);",
+        /* 3 -> 4: when each file was last seen, so a scan can drop the
+         * rows of files it no longer finds. Older rows were never seen */
+        "ALTER TABLE MEDIA ADD COLUMN GENERATION INTEGER DEFAULT 0;",
+        /* 4 -> 5: numeric tags and audio properties. Every row is read
+         * again in the background to fill them in */
+        "ALTER TABLE MEDIA ADD COLUMN TRACK INTEGER DEFAULT 0;"
+        "ALTER TABLE MEDIA ADD COLUMN DISC INTEGER DEFAULT 0;"
+        "ALTER TABLE MEDIA ADD COLUMN YEAR INTEGER DEFAULT 0;"
+        "ALTER TABLE MEDIA ADD COLUMN DURATION INTEGER DEFAULT 0;"
+        "ALTER TABLE MEDIA ADD COLUMN BITRATE INTEGER DEFAULT 0;"
+        "ALTER TABLE MEDIA ADD COLUMN SAMPLERATE INTEGER DEFAULT 0;"
+        "ALTER TABLE MEDIA ADD COLUMN CHANNELS INTEGER DEFAULT 0;"
+        "UPDATE MEDIA SET TAGGED = 0;",
+        /* 5 -> 6: listed directories, so a rescan can skip those that
+         * have not changed since */
+        "CREATE TABLE IF NOT EXISTS DIRECTORIES (PATH TEXT PRIMARY KEY, MTIME INTEGER, "
+        "ENTRIES INTEGER, SUBDIRS TEXT, GENERATION INTEGER DEFAULT 0);",
+        /* 6 -> 7: media directories already scanned, so a change to
+         * them only costs the roots that were added or removed */
+        "CREATE TABLE IF NOT EXISTS ROOTS (PATH TEXT PRIMARY KEY, GENERATION INTEGER DEFAULT 0);",
+        /* 7 -> 8: a digest of each file's content, so a file that moved
+         * is recognised by it. Rows get one when their tags are read */
+        "ALTER TABLE MEDIA ADD COLUMN DIGEST INTEGER DEFAULT 0;"
+        "CREATE INDEX IF NOT EXISTS MEDIA_SIZE ON MEDIA (SIZE);",
+        /* 8 -> 9: a library update that has yet to run to the end, so
+         * the next indexer resumes it */
+        "CREATE TABLE IF NOT EXISTS CHECKPOINT (ID INTEGER PRIMARY KEY, STARTED INTEGER);",
+        /* 9 -> 10: the last generation given out, so the next is always
+         * newer whatever the clock does. Generations were the time a scan
+         * started before, so it picks up after the newest of those */
+        "CREATE TABLE IF NOT EXISTS GENERATIONS (ID INTEGER PRIMARY KEY, LAST INTEGER);"
+        "INSERT OR IGNORE INTO GENERATIONS (ID, LAST) SELECT 0, MAX("
+        "IFNULL((SELECT MAX(GENERATION) FROM MEDIA), 0), "
+        "IFNULL((SELECT MAX(GENERATION) FROM DIRECTORIES), 0), "
+        "IFNULL((SELECT MAX(GENERATION) FROM ROOTS), 0));",
+};
+
+/* How long a connection waits on another connection's write lock */
+#define BUSY_TIMEOUT_MSEC 5000
+
 /* Boilerplate GObject code */
 static void budgie_db_class_init(BudgieDBClass *klass);
 static void budgie_db_init(BudgieDB *self);
+static void budgie_db_constructed(GObject *object);
 static void budgie_db_dispose(GObject *object);
 
+static void budgie_db_get_property(GObject *object,
+                                   guint prop_id,
+                                   GValue *value,
+                                   GParamSpec *pspec);
+
+static void budgie_db_set_property(GObject *object,
+                                   guint prop_id,
+                                   const GValue *value,
+                                   GParamSpec *pspec);
+
 
 /* MediaInfo API */
 void free_media_info(gpointer p_info)
@@ -80,6 +166,79 @@ void free_media_info(gpointer p_info)
         if (info->mime) {
                 g_free(info->mime);
         }
+        free(info);
+}
+
+/**
+ * Read the schema version of a database
+ * @return the version, or -1 on error
+ */
+static int budgie_db_get_version(sqlite3 *db)
+{
+        sqlite3_stmt *stm = NULL;
+        int version = 0;
+
+        if (sqlite3_prepare_v2(db, "PRAGMA user_version;", -1, &stm, NULL) != SQLITE_OK) {
+                return -1;
+        }
+        if (sqlite3_step(stm) == SQLITE_ROW) {
+                version = sqlite3_column_int(stm, 0);
+        }
+        sqlite3_finalize(stm);
+        return version;
+}
+
+/**
+ * Bring an existing database up to the current schema. The player and
+ * the indexer may open an old database at once, so the version is read
+ * again under the write lock, and steps another connection already
+ * applied are skipped
+ */
+static gboolean budgie_db_migrate(sqlite3 *db)
+{
+        gchar *sql = NULL;
+        char *err = NULL;
+        int version;
+        int rc;
+
+        version = budgie_db_get_version(db);
+        if (version < 0) {
+                return FALSE;
+        }
+        if (version >= (int)G_N_ELEMENTS(migrations)) {
+                return TRUE;
+        }
+
+        rc = sqlite3_exec(db, "BEGIN IMMEDIATE TRANSACTION;", NULL, NULL, &err);
+        if (rc != SQLITE_OK) {
+                goto fail;
+        }
+        version = budgie_db_get_version(db);
+        if (version < 0) {
+                goto fail;
+        }
+        for (; version < (int)G_N_ELEMENTS(migrations); version++) {
+                sql = g_strdup_printf("%s PRAGMA user_version = %d;",
+                        migrations[version], version + 1);
+                rc = sqlite3_exec(db, sql, NULL, NULL, &err);
+                g_free(sql);
+                if (rc != SQLITE_OK) {
+                        goto fail;
+                }
+        }
+        rc = sqlite3_exec(db, "COMMIT;", NULL, NULL, &err);
+        if (rc != SQLITE_OK) {
+                goto fail;
+        }
+        return TRUE;
+fail:
+        g_critical("Unable to upgrade database to version %d: %s",
+                version + 1, err ? err : sqlite3_errmsg(db));
+        if (err) {
+                free(err);
+        }
+        sqlite3_exec(db, "ROLLBACK;", NULL, NULL, NULL);
+        return FALSE;
 }
 
 /* Initialisation */
@@ -88,13 +247,68 @@ static void budgie_db_class_init(BudgieDBClass *klass)
         GObjectClass *g_object_class;
 
         g_object_class = G_OBJECT_CLASS(klass);
+        obj_properties[PROP_PATH] =
+        g_param_spec_string("path", "Path",
+                "Database file, or NULL for the one in the user config directory",
+                NULL, G_PARAM_CONSTRUCT_ONLY | G_PARAM_READWRITE);
+
+        g_object_class->constructed = &budgie_db_constructed;
         g_object_class->dispose = &budgie_db_dispose;
+        g_object_class->set_property = &budgie_db_set_property;
+        g_object_class->get_property = &budgie_db_get_property;
+        g_object_class_install_properties(g_object_class, N_PROPERTIES,
+                obj_properties);
+}
+
+static void budgie_db_set_property(GObject *object,
+                                   guint prop_id,
+                                   const GValue *value,
+                                   GParamSpec *pspec)
+{
+        BudgieDB *self;
+
+        self = BUDGIE_DB(object);
+        switch (prop_id) {
+                case PROP_PATH:
+                        g_free(self->priv->storage_path);
+                        self->priv->storage_path = g_value_dup_string((GValue*)value);
+                        break;
+                default:
+                        G_OBJECT_WARN_INVALID_PROPERTY_ID (object,
+                                prop_id, pspec);
+                        break;
+        }
+}
+
+static void budgie_db_get_property(GObject *object,
+                                   guint prop_id,
+                                   GValue *value,
+                                   GParamSpec *pspec)
+{
+        BudgieDB *self;
+
+        self = BUDGIE_DB(object);
+        switch (prop_id) {
+                case PROP_PATH:
+                        g_value_set_string((GValue *)value, self->priv->storage_path);
+                        break;
+                default:
+                        G_OBJECT_WARN_INVALID_PROPERTY_ID (object,
+                                prop_id, pspec);
+                        break;
+        }
 }
 
 static void budgie_db_init(BudgieDB *self)
 {
-        const gchar *config = NULL;
         self->priv = budgie_db_get_instance_private(self);
+}
+
+/* The database is opened once the path property is known */
+static void budgie_db_constructed(GObject *object)
+{
+        BudgieDB *self = BUDGIE_DB(object);
+        const gchar *config = NULL;
         const char *sql = NULL;
         int rc = 0;
         char *err = NULL;
@@ -106,10 +320,14 @@ static void budgie_db_init(BudgieDB *self)
         };
         
 
+        G_OBJECT_CLASS(budgie_db_parent_class)->constructed(object);
+
         /* Our storage location */
-        config = g_get_user_config_dir();
-        self->priv->storage_path = g_strdup_printf("%s/%s", config,
-                CONFIG_NAME);
+        if (!self->priv->storage_path) {
+                config = g_get_user_config_dir();
+                self->priv->storage_path = g_strdup_printf("%s/%s", config,
+                        CONFIG_NAME);
+        }
 
         rc = sqlite3_open(self->priv->storage_path, &db);
         if (rc != SQLITE_OK) {
@@ -145,6 +363,12 @@ static void budgie_db_init(BudgieDB *self)
                 sqlite3_finalize(test_stmt);
         }
 
+        /* The scanner and library watcher write through their own connections,
+         * and with a write-ahead log their commits never block our readers */
+        sqlite3_busy_timeout(db, BUSY_TIMEOUT_MSEC);
+        sqlite3_exec(db, "PRAGMA journal_mode = WAL; PRAGMA synchronous = NORMAL;",
+                NULL, NULL, NULL);
+
         /* rep */
         sql = "CREATE TABLE IF NOT EXISTS MEDIA (ID TEXT UNIQUE, TITLE TEXT, ARTIST TEXT, ALBUM TEXT, BAND TEXT, GENRE TEXT, MIME TEXT);";
         rc = sqlite3_exec(db, sql, NULL, NULL, &err);
@@ -157,9 +381,16 @@ static void budgie_db_init(BudgieDB *self)
                 self->priv->db = NULL;
                 return;
         }
+        if (!budgie_db_migrate(db)) {
+                sqlite3_close(db);
+                self->priv->db = NULL;
+                return;
+        }
 
         /* statement preparation */
-        sql = "INSERT OR REPLACE INTO MEDIA VALUES (?, ?, ?, ?, ?, ?, ?);";
+        sql = "INSERT OR REPLACE INTO MEDIA (ID, TITLE, ARTIST, ALBUM, BAND, GENRE, MIME, "
+              "MTIME, SIZE, INODE, TAGGED, GENERATION, TRACK, DISC, YEAR, DURATION, BITRATE, "
+              "SAMPLERATE, CHANNELS) VALUES (?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?);";
         rc = sqlite3_prepare_v2(db, sql, -1, &stm, NULL);
         if (rc != SQLITE_OK) {
                 g_critical("DB Error: %s", sqlite3_errmsg(db));
@@ -167,6 +398,145 @@ static void budgie_db_init(BudgieDB *self)
         }
         self->priv->insert = stm;
 
+        /* A path and everything beneath it, as a range over the ID index:
+         * '0' is the character sorting immediately after '/' */
+        sql = "DELETE FROM MEDIA WHERE ID = ?1 OR (ID >= ?1 || '/' AND ID < ?1 || '0');";
+        rc = sqlite3_prepare_v2(db, sql, -1, &stm, NULL);
+        if (rc != SQLITE_OK) {
+                g_critical("DB Error: %s", sqlite3_errmsg(db));
+                return;
+        }
+        self->priv->remove = stm;
+
+        sql = "UPDATE MEDIA SET GENERATION = ?2 WHERE ID = ?1;";
+        rc = sqlite3_prepare_v2(db, sql, -1, &stm, NULL);
+        if (rc != SQLITE_OK) {
+                g_critical("DB Error: %s", sqlite3_errmsg(db));
+                return;
+        }
+        self->priv->mark = stm;
+
+        /* The same range as remove, so a sweep only visits rows beneath
+         * the root rather than the whole table */
+        sql = "DELETE FROM MEDIA WHERE (ID = ?1 OR (ID >= ?1 || '/' AND ID < ?1 || '0')) "
+              "AND GENERATION < ?2;";
+        rc = sqlite3_prepare_v2(db, sql, -1, &stm, NULL);
+        if (rc != SQLITE_OK) {
+                g_critical("DB Error: %s", sqlite3_errmsg(db));
+                return;
+        }
+        self->priv->prune = stm;
+
+        sql = "INSERT OR REPLACE INTO DIRECTORIES (PATH, MTIME, ENTRIES, SUBDIRS, GENERATION) "
+              "VALUES (?1, ?2, ?3, ?4, ?5);";
+        rc = sqlite3_prepare_v2(db, sql, -1, &stm, NULL);
+        if (rc != SQLITE_OK) {
+                g_critical("DB Error: %s", sqlite3_errmsg(db));
+                return;
+        }
+        self->priv->dir_insert = stm;
+
+        sql = "UPDATE DIRECTORIES SET GENERATION = ?2 WHERE PATH = ?1;";
+        rc = sqlite3_prepare_v2(db, sql, -1, &stm, NULL);
+        if (rc != SQLITE_OK) {
+                g_critical("DB Error: %s", sqlite3_errmsg(db));
+                return;
+        }
+        self->priv->dir_mark = stm;
+
+        sql = "DELETE FROM DIRECTORIES WHERE (PATH = ?1 OR (PATH >= ?1 || '/' AND PATH < ?1 || '0')) "
+              "AND GENERATION < ?2;";
+        rc = sqlite3_prepare_v2(db, sql, -1, &stm, NULL);
+        if (rc != SQLITE_OK) {
+                g_critical("DB Error: %s", sqlite3_errmsg(db));
+                return;
+        }
+        self->priv->dir_prune = stm;
+
+        /* Tags read after the row was stored. The fingerprint must still
+         * match, or the file changed under us and is due a rescan anyway */
+        sql = "UPDATE MEDIA SET TITLE = ?2, ARTIST = ?3, ALBUM = ?4, BAND = ?5, GENRE = ?6, "
+              "TRACK = ?9, DISC = ?10, YEAR = ?11, DURATION = ?12, BITRATE = ?13, "
+              "SAMPLERATE = ?14, CHANNELS = ?15, DIGEST = ?16, "
+              "TAGGED = 1 WHERE ID = ?1 AND MTIME = ?7 AND SIZE = ?8;";
+        rc = sqlite3_prepare_v2(db, sql, -1, &stm, NULL);
+        if (rc != SQLITE_OK) {
+                g_critical("DB Error: %s", sqlite3_errmsg(db));
+                return;
+        }
+        self->priv->update_tags = stm;
+
+        sql = "SELECT * FROM MEDIA WHERE ID = ?;";
+        rc = sqlite3_prepare_v2(db, sql, -1, &stm, NULL);
+        if (rc != SQLITE_OK) {
+                g_critical("DB Error: %s", sqlite3_errmsg(db));
+                return;
+        }
+        self->priv->get_one = stm;
+
+        /* Walks the MEDIA_UNTAGGED index, so paths come in directory order */
+        sql = "SELECT * FROM MEDIA WHERE TAGGED = 0 ORDER BY ID LIMIT ?;";
+        rc = sqlite3_prepare_v2(db, sql, -1, &stm, NULL);
+        if (rc != SQLITE_OK) {
+                g_critical("DB Error: %s", sqlite3_errmsg(db));
+                return;
+        }
+        self->priv->get_untagged = stm;
+
+        /* The same, for one directory's range of the index */
+        sql = "SELECT * FROM MEDIA WHERE TAGGED = 0 AND ID >= ?1 || '/' AND ID < ?1 || '0' "
+              "ORDER BY ID LIMIT ?2;";
+        rc = sqlite3_prepare_v2(db, sql, -1, &stm, NULL);
+        if (rc != SQLITE_OK) {
+                g_critical("DB Error: %s", sqlite3_errmsg(db));
+                return;
+        }
+        self->priv->get_untagged_within = stm;
+
+        /* Aliases of a path that is now an alias itself move on to its
+         * target, and the target stops being an alias of anything */
+        sql = "UPDATE ALIASES SET TARGET = ?2 WHERE TARGET = ?1;";
+        rc = sqlite3_prepare_v2(db, sql, -1, &stm, NULL);
+        if (rc != SQLITE_OK) {
+                g_critical("DB Error: %s", sqlite3_errmsg(db));
+                return;
+        }
+        self->priv->alias_retarget = stm;
+
+        sql = "DELETE FROM ALIASES WHERE PATH = ?;";
+        rc = sqlite3_prepare_v2(db, sql, -1, &stm, NULL);
+        if (rc != SQLITE_OK) {
+                g_critical("DB Error: %s", sqlite3_errmsg(db));
+                return;
+        }
+        self->priv->alias_drop = stm;
+
+        sql = "INSERT OR REPLACE INTO ALIASES (PATH, TARGET) VALUES (?1, ?2);";
+        rc = sqlite3_prepare_v2(db, sql, -1, &stm, NULL);
+        if (rc != SQLITE_OK) {
+                g_critical("DB Error: %s", sqlite3_errmsg(db));
+                return;
+        }
+        self->priv->alias_insert = stm;
+
+        /* A file found under a new name takes over the row stored under
+         * its old one, tags and all */
+        sql = "DELETE FROM MEDIA WHERE ID = ?;";
+        rc = sqlite3_prepare_v2(db, sql, -1, &stm, NULL);
+        if (rc != SQLITE_OK) {
+                g_critical("DB Error: %s", sqlite3_errmsg(db));
+                return;
+        }
+        self->priv->move_drop = stm;
+
+        sql = "UPDATE MEDIA SET ID = ?2, MTIME = ?3, INODE = ?4, GENERATION = ?5 WHERE ID = ?1;";
+        rc = sqlite3_prepare_v2(db, sql, -1, &stm, NULL);
+        if (rc != SQLITE_OK) {
+                g_critical("DB Error: %s", sqlite3_errmsg(db));
+                return;
+        }
+        self->priv->move = stm;
+
         /* Get all by field */
         table = g_hash_table_new_full(g_str_hash, g_str_equal, NULL, (GDestroyNotify)sqlite3_finalize);
         for (int i = 0; i < G_N_ELEMENTS(interests); i++) {
@@ -242,6 +612,66 @@ static void budgie_db_dispose(GObject *object)
                 sqlite3_finalize(self->priv->insert);
                 self->priv->insert = NULL;
         }
+        if (self->priv->remove) {
+                sqlite3_finalize(self->priv->remove);
+                self->priv->remove = NULL;
+        }
+        if (self->priv->mark) {
+                sqlite3_finalize(self->priv->mark);
+                self->priv->mark = NULL;
+        }
+        if (self->priv->prune) {
+                sqlite3_finalize(self->priv->prune);
+                self->priv->prune = NULL;
+        }
+        if (self->priv->dir_insert) {
+                sqlite3_finalize(self->priv->dir_insert);
+                self->priv->dir_insert = NULL;
+        }
+        if (self->priv->dir_mark) {
+                sqlite3_finalize(self->priv->dir_mark);
+                self->priv->dir_mark = NULL;
+        }
+        if (self->priv->dir_prune) {
+                sqlite3_finalize(self->priv->dir_prune);
+                self->priv->dir_prune = NULL;
+        }
+        if (self->priv->update_tags) {
+                sqlite3_finalize(self->priv->update_tags);
+                self->priv->update_tags = NULL;
+        }
+        if (self->priv->get_one) {
+                sqlite3_finalize(self->priv->get_one);
+                self->priv->get_one = NULL;
+        }
+        if (self->priv->get_untagged) {
+                sqlite3_finalize(self->priv->get_untagged);
+                self->priv->get_untagged = NULL;
+        }
+        if (self->priv->get_untagged_within) {
+                sqlite3_finalize(self->priv->get_untagged_within);
+                self->priv->get_untagged_within = NULL;
+        }
+        if (self->priv->alias_retarget) {
+                sqlite3_finalize(self->priv->alias_retarget);
+                self->priv->alias_retarget = NULL;
+        }
+        if (self->priv->alias_drop) {
+                sqlite3_finalize(self->priv->alias_drop);
+                self->priv->alias_drop = NULL;
+        }
+        if (self->priv->alias_insert) {
+                sqlite3_finalize(self->priv->alias_insert);
+                self->priv->alias_insert = NULL;
+        }
+        if (self->priv->move_drop) {
+                sqlite3_finalize(self->priv->move_drop);
+                self->priv->move_drop = NULL;
+        }
+        if (self->priv->move) {
+                sqlite3_finalize(self->priv->move);
+                self->priv->move = NULL;
+        }
         if (self->priv->get_all) {
                 sqlite3_finalize(self->priv->get_all);
                 self->priv->get_all = NULL;
@@ -276,7 +706,16 @@ BudgieDB* budgie_db_new(void)
         return BUDGIE_DB(self);
 }
 
-void budgie_db_store_media(BudgieDB *self, MediaInfo *info)
+/* Utility; return a new BudgieDB stored at path */
+BudgieDB* budgie_db_new_for_path(const gchar *path)
+{
+        BudgieDB *self;
+
+        self = g_object_new(BUDGIE_DB_TYPE, "path", path, NULL);
+        return BUDGIE_DB(self);
+}
+
+void budgie_db_store_media(BudgieDB *self, MediaInfo *info, gint64 generation)
 {
         sqlite3_stmt *stm;
         gboolean dwarn = TRUE;
@@ -313,6 +752,30 @@ void budgie_db_store_media(BudgieDB *self, MediaInfo *info)
         if (sqlite3_bind_text(stm, 7, info->mime, -1, SQLITE_STATIC) != SQLITE_OK) {
                 goto end;
         }
+        if (sqlite3_bind_int64(stm, 8, info->mtime) != SQLITE_OK) {
+                goto end;
+        }
+        if (sqlite3_bind_int64(stm, 9, info->size) != SQLITE_OK) {
+                goto end;
+        }
+        if (sqlite3_bind_int64(stm, 10, (sqlite3_int64)info->inode) != SQLITE_OK) {
+                goto end;
+        }
+        if (sqlite3_bind_int(stm, 11, info->tagged ? 1 : 0) != SQLITE_OK) {
+                goto end;
+        }
+        if (sqlite3_bind_int64(stm, 12, generation) != SQLITE_OK) {
+                goto end;
+        }
+        if (sqlite3_bind_int(stm, 13, info->track) != SQLITE_OK ||
+            sqlite3_bind_int(stm, 14, info->disc) != SQLITE_OK ||
+            sqlite3_bind_int(stm, 15, info->year) != SQLITE_OK ||
+            sqlite3_bind_int64(stm, 16, info->duration) != SQLITE_OK ||
+            sqlite3_bind_int(stm, 17, info->bitrate) != SQLITE_OK ||
+            sqlite3_bind_int(stm, 18, info->sample_rate) != SQLITE_OK ||
+            sqlite3_bind_int(stm, 19, info->channels) != SQLITE_OK) {
+                goto end;
+        }
 
         rc = sqlite3_step(stm);
         if (rc != SQLITE_DONE) {
@@ -327,76 +790,469 @@ end:
         }
 }
 
-static inline gchar *name_for_field(MediaQuery query)
+gint budgie_db_remove_media(BudgieDB *self, const gchar *path)
 {
-        switch (query) {
-                case MEDIA_QUERY_ALBUM:
-                        return "ALBUM";
-                case MEDIA_QUERY_ARTIST:
-                        return "ARTIST";
-                case MEDIA_QUERY_GENRE:
-                        return "GENRE";
-                case MEDIA_QUERY_MIME:
-                        return "MIME";
-                case MEDIA_QUERY_TITLE:
-                        return "TITLE";
-                default:
-                        g_assert_not_reached();
-                        return NULL;
+        sqlite3_stmt *stm;
+
+        if (!self->priv->db || !self->priv->remove) {
+                g_warning("Database not initialized - cannot remove media");
+                return -1;
+        }
+
+        stm = self->priv->remove;
+        sqlite3_reset(stm);
+
+        if (sqlite3_bind_text(stm, 1, path, -1, SQLITE_STATIC) != SQLITE_OK) {
+                goto fail;
         }
+        if (sqlite3_step(stm) != SQLITE_DONE) {
+                goto fail;
+        }
+        return sqlite3_changes(self->priv->db);
+fail:
+        g_critical("Error removing media: %s", sqlite3_errmsg(self->priv->db));
+        return -1;
 }
 
-gboolean budgie_db_get_all_by_field(BudgieDB *self,
-                                    MediaQuery query,
-                                    GPtrArray **results)
+gboolean budgie_db_mark_media(BudgieDB *self, const gchar *path, gint64 generation)
 {
-        sqlite3_stmt *stm = NULL;
-        int rc;
-        const char *select = NULL;
-        GPtrArray *res = NULL;
+        sqlite3_stmt *stm;
 
-        /* Check if database is properly initialized */
-        if (!self->priv->db || !self->priv->field_table) {
-                g_warning("Database not initialized - cannot query fields");
-                *results = g_ptr_array_new();
+        if (!self->priv->db || !self->priv->mark) {
+                g_warning("Database not initialized - cannot mark media");
                 return FALSE;
         }
 
-        select = name_for_field(query);
-        stm = g_hash_table_lookup(self->priv->field_table, select);
-        if (!stm) {
-                g_warning("No prepared statement found for field query");
-                *results = g_ptr_array_new();
-                return FALSE;
-        }
+        stm = self->priv->mark;
         sqlite3_reset(stm);
 
-        res = g_ptr_array_new();
-        while ((rc = sqlite3_step(stm)) == SQLITE_ROW) {
-                const gchar *txt = (const gchar*)sqlite3_column_text(stm, 0);
-                if (!txt) {
-                        continue;
-                }
-                g_ptr_array_add(res, g_strdup(txt));
-
+        if (sqlite3_bind_text(stm, 1, path, -1, SQLITE_STATIC) != SQLITE_OK ||
+            sqlite3_bind_int64(stm, 2, generation) != SQLITE_OK) {
+                goto fail;
+        }
+        if (sqlite3_step(stm) != SQLITE_DONE) {
+                goto fail;
         }
-        *results = res;
         return TRUE;
+fail:
+        g_critical("Error marking media: %s", sqlite3_errmsg(self->priv->db));
+        return FALSE;
 }
 
-static inline MediaInfo *media_info_from_statement(sqlite3_stmt *stm)
+gint budgie_db_prune_media(BudgieDB *self, const gchar *root, gint64 generation)
 {
-        MediaInfo *ret = NULL;
-        const unsigned char *txt = NULL;
+        sqlite3_stmt *stm;
+        gint removed;
 
-        ret = calloc(1, sizeof(MediaInfo));
-        if (!ret) {
-                return NULL;
+        if (!self->priv->db || !self->priv->prune || !self->priv->dir_prune) {
+                g_warning("Database not initialized - cannot prune media");
+                return -1;
         }
 
-        txt = sqlite3_column_text(stm, 0);
-        if (txt) {
-                ret->path = g_strdup((const gchar*)txt);
+        stm = self->priv->prune;
+        sqlite3_reset(stm);
+
+        if (sqlite3_bind_text(stm, 1, root, -1, SQLITE_STATIC) != SQLITE_OK ||
+            sqlite3_bind_int64(stm, 2, generation) != SQLITE_OK) {
+                goto fail;
+        }
+        if (sqlite3_step(stm) != SQLITE_DONE) {
+                goto fail;
+        }
+        removed = sqlite3_changes(self->priv->db);
+
+        /* Directories that are gone, or were not recorded this time */
+        stm = self->priv->dir_prune;
+        sqlite3_reset(stm);
+        if (sqlite3_bind_text(stm, 1, root, -1, SQLITE_STATIC) != SQLITE_OK ||
+            sqlite3_bind_int64(stm, 2, generation) != SQLITE_OK) {
+                goto fail;
+        }
+        if (sqlite3_step(stm) != SQLITE_DONE) {
+                goto fail;
+        }
+        return removed;
+fail:
+        g_critical("Error pruning media: %s", sqlite3_errmsg(self->priv->db));
+        return -1;
+}
+
+gboolean budgie_db_store_directory(BudgieDB *self,
+                                   const gchar *path,
+                                   DirectoryInfo *info,
+                                   gint64 generation)
+{
+        sqlite3_stmt *stm;
+        gchar *subdirs;
+        gboolean ret = FALSE;
+
+        if (!self->priv->db || !self->priv->dir_insert) {
+                g_warning("Database not initialized - cannot store directory");
+                return FALSE;
+        }
+
+        stm = self->priv->dir_insert;
+        sqlite3_reset(stm);
+
+        /* No name can hold a '/', which makes it a safe separator */
+        subdirs = g_strjoinv("/", info->subdirs);
+        if (sqlite3_bind_text(stm, 1, path, -1, SQLITE_STATIC) != SQLITE_OK ||
+            sqlite3_bind_int64(stm, 2, info->mtime) != SQLITE_OK ||
+            sqlite3_bind_int(stm, 3, info->n_files) != SQLITE_OK ||
+            sqlite3_bind_text(stm, 4, subdirs, -1, SQLITE_STATIC) != SQLITE_OK ||
+            sqlite3_bind_int64(stm, 5, generation) != SQLITE_OK) {
+                goto end;
+        }
+        if (sqlite3_step(stm) != SQLITE_DONE) {
+                goto end;
+        }
+        ret = TRUE;
+end:
+        if (!ret) {
+                g_critical("Error storing directory: %s", sqlite3_errmsg(self->priv->db));
+        }
+        /* Bound statically, so it must outlive the step */
+        sqlite3_reset(stm);
+        g_free(subdirs);
+        return ret;
+}
+
+gboolean budgie_db_mark_directory(BudgieDB *self, const gchar *path, gint64 generation)
+{
+        sqlite3_stmt *stm;
+
+        if (!self->priv->db || !self->priv->dir_mark) {
+                g_warning("Database not initialized - cannot mark directory");
+                return FALSE;
+        }
+
+        stm = self->priv->dir_mark;
+        sqlite3_reset(stm);
+        if (sqlite3_bind_text(stm, 1, path, -1, SQLITE_STATIC) != SQLITE_OK ||
+            sqlite3_bind_int64(stm, 2, generation) != SQLITE_OK) {
+                goto fail;
+        }
+        if (sqlite3_step(stm) != SQLITE_DONE) {
+                goto fail;
+        }
+        return TRUE;
+fail:
+        g_critical("Error marking directory: %s", sqlite3_errmsg(self->priv->db));
+        return FALSE;
+}
+
+gboolean budgie_db_update_tags(BudgieDB *self, MediaInfo *info)
+{
+        sqlite3_stmt *stm;
+
+        if (!self->priv->db || !self->priv->update_tags) {
+                g_warning("Database not initialized - cannot update tags");
+                return FALSE;
+        }
+
+        stm = self->priv->update_tags;
+        sqlite3_reset(stm);
+
+        if (sqlite3_bind_text(stm, 1, info->path, -1, SQLITE_STATIC) != SQLITE_OK ||
+            sqlite3_bind_text(stm, 2, info->title, -1, SQLITE_STATIC) != SQLITE_OK ||
+            sqlite3_bind_text(stm, 3, info->artist, -1, SQLITE_STATIC) != SQLITE_OK ||
+            sqlite3_bind_text(stm, 4, info->album, -1, SQLITE_STATIC) != SQLITE_OK ||
+            sqlite3_bind_text(stm, 5, info->band, -1, SQLITE_STATIC) != SQLITE_OK ||
+            sqlite3_bind_text(stm, 6, info->genre, -1, SQLITE_STATIC) != SQLITE_OK ||
+            sqlite3_bind_int64(stm, 7, info->mtime) != SQLITE_OK ||
+            sqlite3_bind_int64(stm, 8, info->size) != SQLITE_OK ||
+            sqlite3_bind_int(stm, 9, info->track) != SQLITE_OK ||
+            sqlite3_bind_int(stm, 10, info->disc) != SQLITE_OK ||
+            sqlite3_bind_int(stm, 11, info->year) != SQLITE_OK ||
+            sqlite3_bind_int64(stm, 12, info->duration) != SQLITE_OK ||
+            sqlite3_bind_int(stm, 13, info->bitrate) != SQLITE_OK ||
+            sqlite3_bind_int(stm, 14, info->sample_rate) != SQLITE_OK ||
+            sqlite3_bind_int(stm, 15, info->channels) != SQLITE_OK ||
+            sqlite3_bind_int64(stm, 16, (gint64)info->digest) != SQLITE_OK) {
+                goto fail;
+        }
+        if (sqlite3_step(stm) != SQLITE_DONE) {
+                goto fail;
+        }
+        return sqlite3_changes(self->priv->db) > 0;
+fail:
+        g_critical("Error updating tags: %s", sqlite3_errmsg(self->priv->db));
+        return FALSE;
+}
+
+gboolean budgie_db_get_moves(BudgieDB *self,
+                             const gchar *root,
+                             gint64 generation,
+                             gint64 vanished,
+                             GPtrArray **results)
+{
+        sqlite3_stmt *stm = NULL;
+        GPtrArray *ret;
+        MediaMove *move;
+        const gchar *from, *to;
+        int rc;
+
+        if (!self->priv->db) {
+                g_warning("Database not initialized - cannot find moves");
+                return FALSE;
+        }
+
+        /* New rows come off the MEDIA_UNTAGGED index and their partners
+         * off MEDIA_SIZE, so only rows stored this scan are visited */
+        rc = sqlite3_prepare_v2(self->priv->db,
+                "SELECT V.ID, N.ID, N.MTIME, N.SIZE, N.INODE, "
+                "N.INODE = V.INODE AND N.MTIME = V.MTIME, V.DIGEST "
+                "FROM MEDIA AS N JOIN MEDIA AS V ON V.SIZE = N.SIZE "
+                "WHERE N.TAGGED = 0 AND N.ID >= ?1 || '/' AND N.ID < ?1 || '0' "
+                "AND N.GENERATION >= ?2 AND V.TAGGED = 1 "
+                "AND V.ID >= ?1 || '/' AND V.ID < ?1 || '0' AND V.GENERATION < ?3 "
+                "ORDER BY 6 DESC;", -1, &stm, NULL);
+        if (rc != SQLITE_OK) {
+                g_critical("DB Error: %s", sqlite3_errmsg(self->priv->db));
+                return FALSE;
+        }
+        if (sqlite3_bind_text(stm, 1, root, -1, SQLITE_STATIC) != SQLITE_OK ||
+            sqlite3_bind_int64(stm, 2, generation) != SQLITE_OK ||
+            sqlite3_bind_int64(stm, 3, vanished) != SQLITE_OK) {
+                g_critical("DB Error: %s", sqlite3_errmsg(self->priv->db));
+                sqlite3_finalize(stm);
+                return FALSE;
+        }
+
+        ret = g_ptr_array_new_with_free_func(free_media_move);
+        while ((rc = sqlite3_step(stm)) == SQLITE_ROW) {
+                from = (const gchar*)sqlite3_column_text(stm, 0);
+                to = (const gchar*)sqlite3_column_text(stm, 1);
+                if (!from || !to) {
+                        continue;
+                }
+                move = g_new0(MediaMove, 1);
+                move->from = g_strdup(from);
+                move->to = g_strdup(to);
+                move->mtime = sqlite3_column_int64(stm, 2);
+                move->size = sqlite3_column_int64(stm, 3);
+                move->inode = (guint64)sqlite3_column_int64(stm, 4);
+                move->same_inode = sqlite3_column_int(stm, 5) != 0;
+                move->digest = (guint64)sqlite3_column_int64(stm, 6);
+                g_ptr_array_add(ret, move);
+        }
+        sqlite3_finalize(stm);
+
+        *results = ret;
+        return TRUE;
+}
+
+gboolean budgie_db_move_media(BudgieDB *self, MediaMove *move, gint64 generation)
+{
+        sqlite3_stmt *stm;
+
+        if (!self->priv->db || !self->priv->move_drop || !self->priv->move) {
+                g_warning("Database not initialized - cannot move media");
+                return FALSE;
+        }
+
+        stm = self->priv->move_drop;
+        sqlite3_reset(stm);
+        if (sqlite3_bind_text(stm, 1, move->to, -1, SQLITE_STATIC) != SQLITE_OK) {
+                goto fail;
+        }
+        if (sqlite3_step(stm) != SQLITE_DONE) {
+                goto fail;
+        }
+
+        stm = self->priv->move;
+        sqlite3_reset(stm);
+        if (sqlite3_bind_text(stm, 1, move->from, -1, SQLITE_STATIC) != SQLITE_OK ||
+            sqlite3_bind_text(stm, 2, move->to, -1, SQLITE_STATIC) != SQLITE_OK ||
+            sqlite3_bind_int64(stm, 3, move->mtime) != SQLITE_OK ||
+            sqlite3_bind_int64(stm, 4, (gint64)move->inode) != SQLITE_OK ||
+            sqlite3_bind_int64(stm, 5, generation) != SQLITE_OK) {
+                goto fail;
+        }
+        if (sqlite3_step(stm) != SQLITE_DONE) {
+                goto fail;
+        }
+        return sqlite3_changes(self->priv->db) > 0;
+fail:
+        g_critical("Error moving media: %s", sqlite3_errmsg(self->priv->db));
+        return FALSE;
+}
+
+gint budgie_db_rename_media(BudgieDB *self, const gchar *from, const gchar *to)
+{
+        /* Every path at or beneath from, with its prefix swapped */
+        const gchar *renames[] = {
+                "UPDATE MEDIA SET ID = ?2 || SUBSTR(ID, LENGTH(?1) + 1) "
+                "WHERE ID = ?1 OR (ID >= ?1 || '/' AND ID < ?1 || '0');",
+                "UPDATE DIRECTORIES SET PATH = ?2 || SUBSTR(PATH, LENGTH(?1) + 1) "
+                "WHERE PATH = ?1 OR (PATH >= ?1 || '/' AND PATH < ?1 || '0');",
+                "UPDATE OR REPLACE ALIASES SET PATH = ?2 || SUBSTR(PATH, LENGTH(?1) + 1) "
+                "WHERE PATH = ?1 OR (PATH >= ?1 || '/' AND PATH < ?1 || '0');",
+                "UPDATE ALIASES SET TARGET = ?2 || SUBSTR(TARGET, LENGTH(?1) + 1) "
+                "WHERE TARGET = ?1 OR (TARGET >= ?1 || '/' AND TARGET < ?1 || '0');",
+        };
+        sqlite3_stmt *stm = NULL;
+        gint moved = 0;
+        guint i;
+
+        if (!self->priv->db) {
+                g_warning("Database not initialized - cannot rename media");
+                return -1;
+        }
+        if (g_str_equal(from, to)) {
+                return 0;
+        }
+
+        /* Whatever the new name held before is gone */
+        if (budgie_db_prune_media(self, to, G_MAXINT64) < 0) {
+                return -1;
+        }
+        for (i = 0; i < G_N_ELEMENTS(renames); i++) {
+                if (sqlite3_prepare_v2(self->priv->db, renames[i], -1, &stm, NULL) != SQLITE_OK) {
+                        goto fail;
+                }
+                if (sqlite3_bind_text(stm, 1, from, -1, SQLITE_STATIC) != SQLITE_OK ||
+                    sqlite3_bind_text(stm, 2, to, -1, SQLITE_STATIC) != SQLITE_OK) {
+                        goto fail;
+                }
+                if (sqlite3_step(stm) != SQLITE_DONE) {
+                        goto fail;
+                }
+                if (i == 0) {
+                        moved = sqlite3_changes(self->priv->db);
+                }
+                sqlite3_finalize(stm);
+                stm = NULL;
+        }
+        return moved;
+fail:
+        g_critical("Error renaming media: %s", sqlite3_errmsg(self->priv->db));
+        sqlite3_finalize(stm);
+        return -1;
+}
+
+gboolean budgie_db_set_alias(BudgieDB *self, const gchar *alias, const gchar *target)
+{
+        sqlite3_stmt *stm;
+
+        if (!self->priv->db || !self->priv->alias_retarget ||
+            !self->priv->alias_drop || !self->priv->alias_insert) {
+                g_warning("Database not initialized - cannot store alias");
+                return FALSE;
+        }
+        if (g_str_equal(alias, target)) {
+                return FALSE;
+        }
+
+        /* Stored under its own name by an earlier scan */
+        if (budgie_db_remove_media(self, alias) < 0) {
+                return FALSE;
+        }
+
+        stm = self->priv->alias_retarget;
+        sqlite3_reset(stm);
+        if (sqlite3_bind_text(stm, 1, alias, -1, SQLITE_STATIC) != SQLITE_OK ||
+            sqlite3_bind_text(stm, 2, target, -1, SQLITE_STATIC) != SQLITE_OK) {
+                goto fail;
+        }
+        if (sqlite3_step(stm) != SQLITE_DONE) {
+                goto fail;
+        }
+
+        stm = self->priv->alias_drop;
+        sqlite3_reset(stm);
+        if (sqlite3_bind_text(stm, 1, target, -1, SQLITE_STATIC) != SQLITE_OK) {
+                goto fail;
+        }
+        if (sqlite3_step(stm) != SQLITE_DONE) {
+                goto fail;
+        }
+
+        stm = self->priv->alias_insert;
+        sqlite3_reset(stm);
+        if (sqlite3_bind_text(stm, 1, alias, -1, SQLITE_STATIC) != SQLITE_OK ||
+            sqlite3_bind_text(stm, 2, target, -1, SQLITE_STATIC) != SQLITE_OK) {
+                goto fail;
+        }
+        if (sqlite3_step(stm) != SQLITE_DONE) {
+                goto fail;
+        }
+        return TRUE;
+fail:
+        g_critical("Error storing alias: %s", sqlite3_errmsg(self->priv->db));
+        return FALSE;
+}
+
+static inline gchar *name_for_field(MediaQuery query)
+{
+        switch (query) {
+                case MEDIA_QUERY_ALBUM:
+                        return "ALBUM";
+                case MEDIA_QUERY_ARTIST:
+                        return "ARTIST";
+                case MEDIA_QUERY_GENRE:
+                        return "GENRE";
+                case MEDIA_QUERY_MIME:
+                        return "MIME";
+                case MEDIA_QUERY_TITLE:
+                        return "TITLE";
+                default:
+                        g_assert_not_reached();
+                        return NULL;
+        }
+}
+
+gboolean budgie_db_get_all_by_field(BudgieDB *self,
+                                    MediaQuery query,
+                                    GPtrArray **results)
+{
+        sqlite3_stmt *stm = NULL;
+        int rc;
+        const char *select = NULL;
+        GPtrArray *res = NULL;
+
+        /* Check if database is properly initialized */
+        if (!self->priv->db || !self->priv->field_table) {
+                g_warning("Database not initialized - cannot query fields");
+                *results = g_ptr_array_new();
+                return FALSE;
+        }
+
+        select = name_for_field(query);
+        stm = g_hash_table_lookup(self->priv->field_table, select);
+        if (!stm) {
+                g_warning("No prepared statement found for field query");
+                *results = g_ptr_array_new();
+                return FALSE;
+        }
+        sqlite3_reset(stm);
+
+        res = g_ptr_array_new();
+        while ((rc = sqlite3_step(stm)) == SQLITE_ROW) {
+                const gchar *txt = (const gchar*)sqlite3_column_text(stm, 0);
+                if (!txt) {
+                        continue;
+                }
+                g_ptr_array_add(res, g_strdup(txt));
+
+        }
+        *results = res;
+        return TRUE;
+}
+
+static inline MediaInfo *media_info_from_statement(sqlite3_stmt *stm)
+{
+        MediaInfo *ret = NULL;
+        const unsigned char *txt = NULL;
+
+        ret = calloc(1, sizeof(MediaInfo));
+        if (!ret) {
+                return NULL;
+        }
+
+        txt = sqlite3_column_text(stm, 0);
+        if (txt) {
+                ret->path = g_strdup((const gchar*)txt);
         }
         /* Title */
         txt = sqlite3_column_text(stm, 1);
@@ -428,6 +1284,20 @@ static inline MediaInfo *media_info_from_statement(sqlite3_stmt *stm)
         if (txt) {
                 ret->mime = g_strdup((const gchar*)txt);
         }
+        /* Fingerprint */
+        ret->mtime = sqlite3_column_int64(stm, 7);
+        ret->size = sqlite3_column_int64(stm, 8);
+        ret->inode = (guint64)sqlite3_column_int64(stm, 9);
+        ret->tagged = sqlite3_column_int(stm, 10) != 0;
+        /* 11 is the generation, only of use to the database itself */
+        ret->track = (guint)sqlite3_column_int(stm, 12);
+        ret->disc = (guint)sqlite3_column_int(stm, 13);
+        ret->year = (guint)sqlite3_column_int(stm, 14);
+        ret->duration = (guint)sqlite3_column_int64(stm, 15);
+        ret->bitrate = (guint)sqlite3_column_int(stm, 16);
+        ret->sample_rate = (guint)sqlite3_column_int(stm, 17);
+        ret->channels = (guint)sqlite3_column_int(stm, 18);
+        ret->digest = (guint64)sqlite3_column_int64(stm, 19);
 
         return ret;
 }
@@ -446,6 +1316,92 @@ GList* budgie_db_get_all_media(BudgieDB* self)
         return ret;
 }
 
+MediaInfo* budgie_db_get_media(BudgieDB *self, const gchar *path)
+{
+        sqlite3_stmt *stm;
+        MediaInfo *ret = NULL;
+
+        if (!self->priv->db || !self->priv->get_one) {
+                g_warning("Database not initialized - cannot query media");
+                return NULL;
+        }
+
+        stm = self->priv->get_one;
+        sqlite3_reset(stm);
+
+        if (sqlite3_bind_text(stm, 1, path, -1, SQLITE_STATIC) != SQLITE_OK) {
+                g_critical("Unable to bind sqlite statement: %s", sqlite3_errmsg(self->priv->db));
+                return NULL;
+        }
+        if (sqlite3_step(stm) == SQLITE_ROW) {
+                ret = media_info_from_statement(stm);
+        }
+        sqlite3_reset(stm);
+        return ret;
+}
+
+gboolean budgie_db_get_untagged(BudgieDB *self, guint max, GPtrArray **results)
+{
+        sqlite3_stmt *stm;
+        GPtrArray *ret = NULL;
+
+        if (!self->priv->db || !self->priv->get_untagged) {
+                g_warning("Database not initialized - cannot query untagged media");
+                return FALSE;
+        }
+
+        stm = self->priv->get_untagged;
+        sqlite3_reset(stm);
+
+        if (sqlite3_bind_int64(stm, 1, max) != SQLITE_OK) {
+                g_critical("Unable to bind sqlite statement: %s", sqlite3_errmsg(self->priv->db));
+                return FALSE;
+        }
+
+        ret = g_ptr_array_new();
+        while (sqlite3_step(stm) == SQLITE_ROW) {
+                g_ptr_array_add(ret, media_info_from_statement(stm));
+        }
+        /* Release our read snapshot before the caller starts writing */
+        sqlite3_reset(stm);
+
+        *results = ret;
+        return TRUE;
+}
+
+gboolean budgie_db_get_untagged_within(BudgieDB *self,
+                                       const gchar *root,
+                                       guint max,
+                                       GPtrArray **results)
+{
+        sqlite3_stmt *stm;
+        GPtrArray *ret = NULL;
+
+        if (!self->priv->db || !self->priv->get_untagged_within) {
+                g_warning("Database not initialized - cannot query untagged media");
+                return FALSE;
+        }
+
+        stm = self->priv->get_untagged_within;
+        sqlite3_reset(stm);
+
+        if (sqlite3_bind_text(stm, 1, root, -1, SQLITE_STATIC) != SQLITE_OK ||
+            sqlite3_bind_int64(stm, 2, max) != SQLITE_OK) {
+                g_critical("Unable to bind sqlite statement: %s", sqlite3_errmsg(self->priv->db));
+                return FALSE;
+        }
+
+        ret = g_ptr_array_new();
+        while (sqlite3_step(stm) == SQLITE_ROW) {
+                g_ptr_array_add(ret, media_info_from_statement(stm));
+        }
+        /* Release our read snapshot before the caller starts writing */
+        sqlite3_reset(stm);
+
+        *results = ret;
+        return TRUE;
+}
+
 gboolean budgie_db_search_field(BudgieDB *self,
                                 MediaQuery query,
                                 MatchQuery match,
@@ -498,6 +1454,335 @@ gboolean budgie_db_search_field(BudgieDB *self,
         return TRUE;
 }
 
+gboolean budgie_db_get_fingerprints(BudgieDB *self, GHashTable **results)
+{
+        sqlite3_stmt *stm = NULL;
+        GHashTable *ret = NULL;
+        MediaFingerprint *print;
+        const gchar *path;
+        int rc;
+
+        if (!self->priv->db) {
+                g_warning("Database not initialized - cannot load fingerprints");
+                return FALSE;
+        }
+
+        rc = sqlite3_prepare_v2(self->priv->db,
+                "SELECT ID, MTIME, SIZE, INODE FROM MEDIA;", -1, &stm, NULL);
+        if (rc != SQLITE_OK) {
+                g_critical("DB Error: %s", sqlite3_errmsg(self->priv->db));
+                return FALSE;
+        }
+
+        ret = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, g_free);
+        while ((rc = sqlite3_step(stm)) == SQLITE_ROW) {
+                path = (const gchar*)sqlite3_column_text(stm, 0);
+                if (!path) {
+                        continue;
+                }
+                print = g_new0(MediaFingerprint, 1);
+                print->mtime = sqlite3_column_int64(stm, 1);
+                print->size = sqlite3_column_int64(stm, 2);
+                print->inode = (guint64)sqlite3_column_int64(stm, 3);
+                g_hash_table_insert(ret, g_strdup(path), print);
+        }
+        sqlite3_finalize(stm);
+
+        *results = ret;
+        return TRUE;
+}
+
+void free_media_move(gpointer p_move)
+{
+        MediaMove *move = p_move;
+
+        if (!move) {
+                return;
+        }
+        g_free(move->from);
+        g_free(move->to);
+        g_free(move);
+}
+
+void free_directory_info(gpointer p_info)
+{
+        DirectoryInfo *info = p_info;
+
+        if (!info) {
+                return;
+        }
+        g_strfreev(info->subdirs);
+        g_free(info);
+}
+
+gboolean budgie_db_get_directories(BudgieDB *self, GHashTable **results)
+{
+        sqlite3_stmt *stm = NULL;
+        GHashTable *ret = NULL;
+        DirectoryInfo *info;
+        const gchar *path, *subdirs;
+        int rc;
+
+        if (!self->priv->db) {
+                g_warning("Database not initialized - cannot load directories");
+                return FALSE;
+        }
+
+        rc = sqlite3_prepare_v2(self->priv->db,
+                "SELECT PATH, MTIME, ENTRIES, SUBDIRS FROM DIRECTORIES;", -1, &stm, NULL);
+        if (rc != SQLITE_OK) {
+                g_critical("DB Error: %s", sqlite3_errmsg(self->priv->db));
+                return FALSE;
+        }
+
+        ret = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, free_directory_info);
+        while ((rc = sqlite3_step(stm)) == SQLITE_ROW) {
+                path = (const gchar*)sqlite3_column_text(stm, 0);
+                if (!path) {
+                        continue;
+                }
+                info = g_new0(DirectoryInfo, 1);
+                info->mtime = sqlite3_column_int64(stm, 1);
+                info->n_files = (guint)sqlite3_column_int(stm, 2);
+                subdirs = (const gchar*)sqlite3_column_text(stm, 3);
+                if (subdirs && *subdirs) {
+                        info->subdirs = g_strsplit(subdirs, "/", -1);
+                } else {
+                        info->subdirs = g_new0(gchar*, 1);
+                }
+                g_hash_table_insert(ret, g_strdup(path), info);
+        }
+        sqlite3_finalize(stm);
+
+        *results = ret;
+        return TRUE;
+}
+
+gboolean budgie_db_get_roots(BudgieDB *self, gchar ***results)
+{
+        sqlite3_stmt *stm = NULL;
+        GPtrArray *ret;
+        const gchar *path;
+        int rc;
+
+        if (!self->priv->db) {
+                g_warning("Database not initialized - cannot load roots");
+                return FALSE;
+        }
+
+        rc = sqlite3_prepare_v2(self->priv->db, "SELECT PATH FROM ROOTS;", -1, &stm, NULL);
+        if (rc != SQLITE_OK) {
+                g_critical("DB Error: %s", sqlite3_errmsg(self->priv->db));
+                return FALSE;
+        }
+
+        ret = g_ptr_array_new();
+        while ((rc = sqlite3_step(stm)) == SQLITE_ROW) {
+                path = (const gchar*)sqlite3_column_text(stm, 0);
+                if (path) {
+                        g_ptr_array_add(ret, g_strdup(path));
+                }
+        }
+        sqlite3_finalize(stm);
+        g_ptr_array_add(ret, NULL);
+
+        *results = (gchar**)g_ptr_array_free(ret, FALSE);
+        return TRUE;
+}
+
+gboolean budgie_db_store_root(BudgieDB *self, const gchar *path, gint64 generation)
+{
+        sqlite3_stmt *stm = NULL;
+
+        if (!self->priv->db) {
+                g_warning("Database not initialized - cannot store root");
+                return FALSE;
+        }
+
+        if (sqlite3_prepare_v2(self->priv->db,
+            "INSERT OR REPLACE INTO ROOTS (PATH, GENERATION) VALUES (?1, ?2);",
+            -1, &stm, NULL) != SQLITE_OK) {
+                goto fail;
+        }
+        if (sqlite3_bind_text(stm, 1, path, -1, SQLITE_STATIC) != SQLITE_OK ||
+            sqlite3_bind_int64(stm, 2, generation) != SQLITE_OK) {
+                goto fail;
+        }
+        if (sqlite3_step(stm) != SQLITE_DONE) {
+                goto fail;
+        }
+        sqlite3_finalize(stm);
+        return TRUE;
+fail:
+        g_critical("Error storing root: %s", sqlite3_errmsg(self->priv->db));
+        sqlite3_finalize(stm);
+        return FALSE;
+}
+
+gint64 budgie_db_next_generation(BudgieDB *self)
+{
+        sqlite3_stmt *stm = NULL;
+        gint64 generation = -1;
+
+        if (!self->priv->db) {
+                g_warning("Database not initialized - cannot take a generation");
+                return -1;
+        }
+
+        /* A savepoint nests in any transaction of the caller's, and the
+         * update takes the write lock before the read, so no two
+         * connections are given the same generation */
+        if (sqlite3_exec(self->priv->db, "SAVEPOINT NEXT_GENERATION;"
+            "UPDATE GENERATIONS SET LAST = LAST + 1 WHERE ID = 0;",
+            NULL, NULL, NULL) != SQLITE_OK) {
+                goto fail;
+        }
+        if (sqlite3_prepare_v2(self->priv->db, "SELECT LAST FROM GENERATIONS WHERE ID = 0;",
+            -1, &stm, NULL) != SQLITE_OK) {
+                goto fail;
+        }
+        if (sqlite3_step(stm) != SQLITE_ROW) {
+                goto fail;
+        }
+        generation = sqlite3_column_int64(stm, 0);
+        sqlite3_finalize(stm);
+        if (sqlite3_exec(self->priv->db, "RELEASE NEXT_GENERATION;",
+            NULL, NULL, NULL) != SQLITE_OK) {
+                g_critical("Error taking a generation: %s", sqlite3_errmsg(self->priv->db));
+                return -1;
+        }
+        return generation;
+fail:
+        g_critical("Error taking a generation: %s", sqlite3_errmsg(self->priv->db));
+        sqlite3_finalize(stm);
+        sqlite3_exec(self->priv->db, "ROLLBACK TO NEXT_GENERATION; RELEASE NEXT_GENERATION;",
+                NULL, NULL, NULL);
+        return -1;
+}
+
+gboolean budgie_db_store_checkpoint(BudgieDB *self, gint64 started)
+{
+        sqlite3_stmt *stm = NULL;
+
+        if (!self->priv->db) {
+                g_warning("Database not initialized - cannot store checkpoint");
+                return FALSE;
+        }
+
+        /* An update resumed keeps the time the first attempt started */
+        if (sqlite3_prepare_v2(self->priv->db,
+            "INSERT OR IGNORE INTO CHECKPOINT (ID, STARTED) VALUES (0, ?);",
+            -1, &stm, NULL) != SQLITE_OK) {
+                goto fail;
+        }
+        if (sqlite3_bind_int64(stm, 1, started) != SQLITE_OK) {
+                goto fail;
+        }
+        if (sqlite3_step(stm) != SQLITE_DONE) {
+                goto fail;
+        }
+        sqlite3_finalize(stm);
+        return TRUE;
+fail:
+        g_critical("Error storing checkpoint: %s", sqlite3_errmsg(self->priv->db));
+        sqlite3_finalize(stm);
+        return FALSE;
+}
+
+gboolean budgie_db_get_checkpoint(BudgieDB *self, gint64 *started)
+{
+        sqlite3_stmt *stm = NULL;
+        gboolean found = FALSE;
+
+        if (!self->priv->db) {
+                g_warning("Database not initialized - cannot load checkpoint");
+                return FALSE;
+        }
+
+        if (sqlite3_prepare_v2(self->priv->db, "SELECT STARTED FROM CHECKPOINT WHERE ID = 0;",
+            -1, &stm, NULL) != SQLITE_OK) {
+                g_critical("DB Error: %s", sqlite3_errmsg(self->priv->db));
+                return FALSE;
+        }
+        if (sqlite3_step(stm) == SQLITE_ROW) {
+                if (started) {
+                        *started = sqlite3_column_int64(stm, 0);
+                }
+                found = TRUE;
+        }
+        sqlite3_finalize(stm);
+        return found;
+}
+
+gboolean budgie_db_clear_checkpoint(BudgieDB *self)
+{
+        gchar *err = NULL;
+
+        if (!self->priv->db) {
+                g_warning("Database not initialized - cannot clear checkpoint");
+                return FALSE;
+        }
+
+        if (sqlite3_exec(self->priv->db, "DELETE FROM CHECKPOINT;", NULL, NULL, &err) != SQLITE_OK) {
+                g_critical("Error clearing checkpoint: %s", err);
+                sqlite3_free(err);
+                return FALSE;
+        }
+        return TRUE;
+}
+
+gint budgie_db_remove_root(BudgieDB *self, const gchar *path, gboolean keep_media)
+{
+        sqlite3_stmt *stm = NULL;
+        gint removed = 0;
+
+        if (!self->priv->db) {
+                g_warning("Database not initialized - cannot remove root");
+                return -1;
+        }
+
+        if (sqlite3_prepare_v2(self->priv->db, "DELETE FROM ROOTS WHERE PATH = ?;",
+            -1, &stm, NULL) != SQLITE_OK) {
+                goto fail;
+        }
+        if (sqlite3_bind_text(stm, 1, path, -1, SQLITE_STATIC) != SQLITE_OK) {
+                goto fail;
+        }
+        if (sqlite3_step(stm) != SQLITE_DONE) {
+                goto fail;
+        }
+        sqlite3_finalize(stm);
+        stm = NULL;
+        if (keep_media) {
+                return 0;
+        }
+
+        /* Older than any generation, so the prune takes every row in
+         * range: files and directories alike, by the index alone */
+        removed = budgie_db_prune_media(self, path, G_MAXINT64);
+        if (removed < 0) {
+                return -1;
+        }
+
+        if (sqlite3_prepare_v2(self->priv->db,
+            "DELETE FROM ALIASES WHERE PATH = ?1 OR (PATH >= ?1 || '/' AND PATH < ?1 || '0');",
+            -1, &stm, NULL) != SQLITE_OK) {
+                goto fail;
+        }
+        if (sqlite3_bind_text(stm, 1, path, -1, SQLITE_STATIC) != SQLITE_OK) {
+                goto fail;
+        }
+        if (sqlite3_step(stm) != SQLITE_DONE) {
+                goto fail;
+        }
+        sqlite3_finalize(stm);
+        return removed;
+fail:
+        g_critical("Error removing root: %s", sqlite3_errmsg(self->priv->db));
+        sqlite3_finalize(stm);
+        return -1;
+}
+
 gint budgie_db_sort(gconstpointer a, gconstpointer b)
 {
         MediaInfo* m1 = NULL;
@@ -514,6 +1799,31 @@ gint budgie_db_sort(gconstpointer a, gconstpointer b)
         return g_ascii_strcasecmp(m1->title, m2->title);
 }
 
+gint budgie_db_sort_tracks(gconstpointer a, gconstpointer b)
+{
+        MediaInfo* m1 = NULL;
+        MediaInfo* m2 = NULL;
+
+        m1 = *(MediaInfo**)a;
+        m2 = *(MediaInfo**)b;
+
+        if (!m1 || !m2) {
+                return 0;
+        }
+
+        if (m1->disc != m2->disc) {
+                return m1->disc < m2->disc ? -1 : 1;
+        }
+        /* Tracks without a number go after those with one */
+        if (m1->track != m2->track) {
+                if (m1->track == 0 || m2->track == 0) {
+                        return m1->track == 0 ? 1 : -1;
+                }
+                return m1->track < m2->track ? -1 : 1;
+        }
+        return budgie_db_sort(a, b);
+}
+
 void budgie_db_begin_transaction(BudgieDB *self)
 {
         int rc;
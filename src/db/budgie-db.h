@@ -38,6 +38,12 @@ typedef struct _BudgieDBPrivate BudgieDBPrivate;
 
 #define CONFIG_NAME "budgie-2.db"
 
+/**
+ * Generation of a stored row a scan did not find again. Below that of any
+ * scan, and of rows kept from before generations were recorded
+ */
+#define BUDGIE_DB_VANISHED (-1)
+
 /* BudgieDB object */
 struct _BudgieDB {
         GObject parent;
@@ -70,8 +76,64 @@ typedef struct MediaInfo {
         gchar *genre; /**<Genre */
         gchar *path; /**<File system path */
         gchar *mime; /**<File mime type */
+        gint64 mtime; /**<Modification time of the file, in seconds */
+        gint64 size; /**<Size of the file in bytes */
+        guint64 inode; /**<Inode number of the file */
+        gboolean tagged; /**<Whether the tags have been read, or only the file name */
+        guint track; /**<Track number within the disc, 0 if unknown */
+        guint disc; /**<Disc number within the album, 0 if unknown */
+        guint year; /**<Year of release, 0 if unknown */
+        guint duration; /**<Length in milliseconds, 0 if unknown */
+        guint bitrate; /**<Average bitrate in kbit/s */
+        guint sample_rate; /**<Sample rate in Hz */
+        guint channels; /**<Number of audio channels */
+        guint64 digest; /**<Digest of sampled content, 0 until the tags are read */
 } MediaInfo;
 
+/**
+ * On-disk identity of stored media, used to skip unchanged files
+ */
+typedef struct MediaFingerprint {
+        gint64 mtime; /**<Modification time, in seconds */
+        gint64 size; /**<Size in bytes */
+        guint64 inode; /**<Inode number */
+} MediaFingerprint;
+
+/**
+ * A listed directory, used to skip listing it again while unchanged
+ */
+typedef struct DirectoryInfo {
+        gint64 mtime; /**<Modification time, in nanoseconds */
+        guint n_files; /**<Regular files it held */
+        gchar **subdirs; /**<Names of the directories it held */
+} DirectoryInfo;
+
+/**
+ * A stored file that was not found again, and a file found in its place
+ * that may be the same one under a new name
+ */
+typedef struct MediaMove {
+        gchar *from; /**<Path of the row that was not found again */
+        gchar *to; /**<Path of the untagged row stored in this scan */
+        gint64 mtime; /**<Fingerprint of the file at to */
+        gint64 size;
+        guint64 inode;
+        gboolean same_inode; /**<Same inode and mtime, so surely the same file */
+        guint64 digest; /**<Digest stored for from, 0 if there is none */
+} MediaMove;
+
+/**
+ * Free a MediaMove
+ * @param p_move MediaMove pointer
+ */
+void free_media_move(gpointer p_move);
+
+/**
+ * Free a DirectoryInfo
+ * @param p_info DirectoryInfo pointer
+ */
+void free_directory_info(gpointer p_info);
+
 /**
  * Used to query the database for matches
  */
@@ -103,12 +165,181 @@ GType budgie_db_get_type(void);
  */
 BudgieDB* budgie_db_new(void);
 
+/**
+ * Construct a new BudgieDB using a database file other than the default
+ * @param path Path of the database file, created if missing
+ */
+BudgieDB* budgie_db_new_for_path(const gchar *path);
+
 /**
  * Store media in BudgieDB
+ *
+ * Pass the generation of the scan storing it, or a new one from
+ * budgie_db_next_generation, so that a scan which started earlier
+ * counts the row as seen
  * @param self BudgieDB instance
  * @param info Media to store
+ * @param generation Generation to stamp the row with
+ */
+void budgie_db_store_media(BudgieDB *self, MediaInfo *info, gint64 generation);
+
+/**
+ * Set the generation of a stored file, such as BUDGIE_DB_VANISHED once a
+ * scan did not find it again
+ * @param self BudgieDB instance
+ * @param path Path of the stored file
+ * @param generation The new generation
+ * @return a boolean value, indicating success of the operation
+ */
+gboolean budgie_db_mark_media(BudgieDB *self, const gchar *path, gint64 generation);
+
+/**
+ * Remove the media at or beneath a path with a generation below the one
+ * given, i.e. files the scan did not find again. That is everything not
+ * stored since the scan started, or only what was marked
+ * BUDGIE_DB_VANISHED when the scan skipped unchanged rows
+ *
+ * Stored directories beneath it below that generation go too. Only call
+ * this after a complete walk of root, or files that were merely not
+ * reached are lost too
+ * @param self BudgieDB instance
+ * @param root Path of the directory that was scanned
+ * @param generation Generation of the oldest rows to keep
+ * @return the number of rows removed, or -1 on error
  */
-void budgie_db_store_media(BudgieDB *self, MediaInfo *info);
+gint budgie_db_prune_media(BudgieDB *self, const gchar *root, gint64 generation);
+
+/**
+ * Store a directory as listed by a scan
+ * @param self BudgieDB instance
+ * @param path Path of the directory
+ * @param info What the listing found
+ * @param generation Generation of the scan, from budgie_db_next_generation
+ * @return a boolean value, indicating success of the operation
+ */
+gboolean budgie_db_store_directory(BudgieDB *self,
+                                   const gchar *path,
+                                   DirectoryInfo *info,
+                                   gint64 generation);
+
+/**
+ * Set the generation of a stored directory, such as BUDGIE_DB_VANISHED
+ * once a scan neither found it unchanged nor stored it again. The files
+ * inside it are left as they are
+ * @param self BudgieDB instance
+ * @param path Path of the stored directory
+ * @param generation The new generation
+ * @return a boolean value, indicating success of the operation
+ */
+gboolean budgie_db_mark_directory(BudgieDB *self, const gchar *path, gint64 generation);
+
+/**
+ * Remove media from BudgieDB
+ *
+ * When path names a directory, all media stored beneath it is removed
+ * as well
+ * @param self BudgieDB instance
+ * @param path Path of the file or directory that went away
+ * @return the number of rows removed, or -1 on error
+ */
+gint budgie_db_remove_media(BudgieDB *self, const gchar *path);
+
+/**
+ * Fill in the tags of media stored before they were read
+ *
+ * Nothing is written if the stored file has changed since info was
+ * loaded, i.e. its mtime or size no longer match
+ * @param self BudgieDB instance
+ * @param info Media with its tags read
+ * @return a boolean value, indicating whether the row was updated
+ */
+gboolean budgie_db_update_tags(BudgieDB *self, MediaInfo *info);
+
+/**
+ * Follow a file or directory renamed in place, moving the rows stored at
+ * or beneath the old path, directories and aliases included, under the
+ * new one with their tags. Anything stored under the new path before
+ * is dropped
+ * @param self BudgieDB instance
+ * @param from Path it was renamed from
+ * @param to Path it was renamed to
+ * @return the number of media rows moved, or -1 on error
+ */
+gint budgie_db_rename_media(BudgieDB *self, const gchar *from, const gchar *to);
+
+/**
+ * Record that a path reaches media stored under another path, through a
+ * hard link or a symlink, and drop anything stored under the alias
+ *
+ * Earlier aliases of alias become aliases of target
+ * @param self BudgieDB instance
+ * @param alias Path of the duplicate, file or directory
+ * @param target Path the media is stored under
+ * @return a boolean value, indicating success of the operation
+ */
+gboolean budgie_db_set_alias(BudgieDB *self, const gchar *alias, const gchar *target);
+
+/**
+ * Pair up the stored files beneath a root that a scan did not find again
+ * with the untagged files it stored in their place, where both have the
+ * same size. Pairs sharing an inode and mtime come first. Call this
+ * after a complete walk of root, before budgie_db_prune_media
+ * You must free the result of this call using g_ptr_array_unref
+ * @param self BudgieDB instance
+ * @param root Path of the directory that was scanned
+ * @param generation Generation of the scan, from budgie_db_next_generation
+ * @param vanished Generation below which rows were not found again, as
+ *                 passed to budgie_db_prune_media
+ * @param results Pointer to store MediaMove candidates in
+ * @return a boolean value, indicating success of the operation
+ */
+gboolean budgie_db_get_moves(BudgieDB *self,
+                             const gchar *root,
+                             gint64 generation,
+                             gint64 vanished,
+                             GPtrArray **results);
+
+/**
+ * Move a stored file's row to the path it was found under, keeping its
+ * tags. The untagged row stored there is dropped
+ * @param self BudgieDB instance
+ * @param move The confirmed move
+ * @param generation Generation of the scan, from budgie_db_next_generation
+ * @return a boolean value, indicating whether the row was moved
+ */
+gboolean budgie_db_move_media(BudgieDB *self, MediaMove *move, gint64 generation);
+
+/**
+ * Get a single stored file
+ * You must free the result of this call using free_media_info
+ * @param self BudgieDB instance
+ * @param path File system path of the media
+ * @return the stored media, or NULL
+ */
+MediaInfo* budgie_db_get_media(BudgieDB *self, const gchar *path);
+
+/**
+ * Get media whose tags have not been read yet, in path order
+ * @param self BudgieDB instance
+ * @param max Maximum results to return
+ * @param results Pointer to store results in
+ * @return a boolean value, indicating success of the operation
+ */
+gboolean budgie_db_get_untagged(BudgieDB *self, guint max, GPtrArray **results);
+
+/**
+ * Get media beneath a directory whose tags have not been read yet, in
+ * path order
+ * @param self BudgieDB instance
+ * @param root Path of the directory
+ * @param max Maximum results to return
+ * @param results Pointer to store results in
+ * @return a boolean value, indicating success of the operation
+ */
+gboolean budgie_db_get_untagged_within(BudgieDB *self,
+                                       const gchar *root,
+                                       guint max,
+                                       GPtrArray **results);
 
 /**
  * Get all media known to BudgieDB
@@ -146,11 +377,100 @@ gboolean budgie_db_search_field(BudgieDB *self,
                                 guint max,
                                 GPtrArray **results);
 
+/**
+ * Load the fingerprint of every stored file, keyed by path
+ * You must free the result of this call using g_hash_table_unref
+ * @param self BudgieDB instance
+ * @param results Pointer to store results in
+ * @return a boolean value, indicating success of the operation
+ */
+gboolean budgie_db_get_fingerprints(BudgieDB *self, GHashTable **results);
+
+/**
+ * Load every stored directory, keyed by path
+ * You must free the result of this call using g_hash_table_unref
+ * @param self BudgieDB instance
+ * @param results Pointer to store results in
+ * @return a boolean value, indicating success of the operation
+ */
+gboolean budgie_db_get_directories(BudgieDB *self, GHashTable **results);
+
+/**
+ * Get the media directories whose scan has run to the end at least once
+ * You must free the result of this call using g_strfreev
+ * @param self BudgieDB instance
+ * @param results Pointer to store the NULL terminated list in
+ * @return a boolean value, indicating success of the operation
+ */
+gboolean budgie_db_get_roots(BudgieDB *self, gchar ***results);
+
+/**
+ * Record that a scan of a media directory has run to the end
+ * @param self BudgieDB instance
+ * @param path The directory, as configured
+ * @param generation Generation of the scan, from budgie_db_next_generation
+ * @return a boolean value, indicating success of the operation
+ */
+gboolean budgie_db_store_root(BudgieDB *self, const gchar *path, gint64 generation);
+
+/**
+ * Take a new generation for a scan or a batch of changes to stamp its
+ * rows with. Each is above every generation given out before, from
+ * any connection, and above BUDGIE_DB_VANISHED
+ * @param self BudgieDB instance
+ * @return the generation, or -1 on error
+ */
+gint64 budgie_db_next_generation(BudgieDB *self);
+
+/**
+ * Record that a library update has started, and is not finished until
+ * budgie_db_clear_checkpoint is called. Rows and directories are
+ * committed as a scan goes, so the next scan skips what this one got
+ * through. A checkpoint already stored is kept
+ * @param self BudgieDB instance
+ * @param started When the update started, from g_get_real_time
+ * @return a boolean value, indicating success of the operation
+ */
+gboolean budgie_db_store_checkpoint(BudgieDB *self, gint64 started);
+
+/**
+ * Whether a library update was cut short and should be resumed
+ * @param self BudgieDB instance
+ * @param started Where to store when it started, or NULL
+ * @return TRUE if a checkpoint is stored
+ */
+gboolean budgie_db_get_checkpoint(BudgieDB *self, gint64 *started);
+
+/**
+ * Record that the library update ran to the end
+ * @param self BudgieDB instance
+ * @return a boolean value, indicating success of the operation
+ */
+gboolean budgie_db_clear_checkpoint(BudgieDB *self);
+
+/**
+ * Forget a media directory that is no longer configured
+ *
+ * Everything stored beneath it goes too, as one range over each index,
+ * unless keep_media is set because another media directory still
+ * covers it
+ * @param self BudgieDB instance
+ * @param path The directory, as configured
+ * @param keep_media Only forget the directory itself
+ * @return the number of media rows removed, or -1 on error
+ */
+gint budgie_db_remove_root(BudgieDB *self, const gchar *path, gboolean keep_media);
+
 /**
  * Default sort mechanism for BudgieDB arrays
  */
 gint budgie_db_sort(gconstpointer a, gconstpointer b);
 
+/**
+ * Album order for BudgieDB arrays: by disc, then track number, then title
+ */
+gint budgie_db_sort_tracks(gconstpointer a, gconstpointer b);
+
 void budgie_db_begin_transaction(BudgieDB *self);
 void budgie_db_end_transaction(BudgieDB *self);
 #endif /* budgie_db_h */
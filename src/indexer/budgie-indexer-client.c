@@ -0,0 +1,397 @@
+/*
+ * budgie-indexer-client.c
+ *
+ * Copyright 2013 Ikey Doherty <ikey.doherty@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ *
+ *
+ */
+#include <gio/gio.h>
+#include <gio/gunixsocketaddress.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "config.h"
+#include "budgie-indexer-client.h"
+#include "budgie-indexer-protocol.h"
+
+/* While an indexer we started is coming up, look for it this often.. */
+#define CONNECT_RETRY_MSEC 100
+/* ..and give up on it after this many tries */
+#define CONNECT_RETRIES 50
+
+/* Private storage */
+struct _BudgieIndexerClientPrivate {
+        gchar *path;
+        GSocketClient *client;
+        GSocketConnection *connection;
+        GDataInputStream *input;
+        GCancellable *cancel;
+        guint retry_id;
+        guint n_retries;
+        gboolean connecting;
+        gboolean spawned; /**<We started an indexer and are waiting on it */
+        gboolean scan_pending; /**<Asked for a scan while not connected */
+        gboolean scanning;
+};
+
+enum {
+        SIGNAL_STARTED,
+        SIGNAL_PROGRESS,
+        SIGNAL_TAGS_UPDATED,
+        SIGNAL_LIBRARY_CHANGED,
+        SIGNAL_FINISHED,
+        N_SIGNALS
+};
+
+static guint signals[N_SIGNALS] = { 0, };
+
+G_DEFINE_TYPE_WITH_PRIVATE(BudgieIndexerClient, budgie_indexer_client, G_TYPE_OBJECT)
+
+/* Boilerplate GObject code */
+static void budgie_indexer_client_class_init(BudgieIndexerClientClass *klass);
+static void budgie_indexer_client_init(BudgieIndexerClient *self);
+static void budgie_indexer_client_dispose(GObject *object);
+
+static void client_connect(BudgieIndexerClient *self);
+
+/* Initialisation */
+static void budgie_indexer_client_class_init(BudgieIndexerClientClass *klass)
+{
+        GObjectClass *g_object_class;
+
+        g_object_class = G_OBJECT_CLASS(klass);
+        g_object_class->dispose = &budgie_indexer_client_dispose;
+
+        signals[SIGNAL_STARTED] = g_signal_new("started",
+                G_TYPE_FROM_CLASS(klass), G_SIGNAL_RUN_FIRST,
+                0, NULL, NULL, NULL, G_TYPE_NONE, 0);
+        /* Emitted with a BudgieScanProgress, only valid during emission */
+        signals[SIGNAL_PROGRESS] = g_signal_new("progress",
+                G_TYPE_FROM_CLASS(klass), G_SIGNAL_RUN_FIRST,
+                0, NULL, NULL, NULL, G_TYPE_NONE,
+                1, G_TYPE_POINTER);
+        signals[SIGNAL_TAGS_UPDATED] = g_signal_new("tags-updated",
+                G_TYPE_FROM_CLASS(klass), G_SIGNAL_RUN_FIRST,
+                0, NULL, NULL, NULL, G_TYPE_NONE,
+                1, G_TYPE_UINT);
+        signals[SIGNAL_LIBRARY_CHANGED] = g_signal_new("library-changed",
+                G_TYPE_FROM_CLASS(klass), G_SIGNAL_RUN_FIRST,
+                0, NULL, NULL, NULL, G_TYPE_NONE,
+                2, G_TYPE_UINT, G_TYPE_UINT);
+        signals[SIGNAL_FINISHED] = g_signal_new("finished",
+                G_TYPE_FROM_CLASS(klass), G_SIGNAL_RUN_FIRST,
+                0, NULL, NULL, NULL, G_TYPE_NONE, 0);
+}
+
+static void budgie_indexer_client_init(BudgieIndexerClient *self)
+{
+        self->priv = budgie_indexer_client_get_instance_private(self);
+        self->priv->path = budgie_indexer_socket_path();
+        self->priv->client = g_socket_client_new();
+        self->priv->cancel = g_cancellable_new();
+
+        client_connect(self);
+}
+
+static void budgie_indexer_client_dispose(GObject *object)
+{
+        BudgieIndexerClient *self;
+
+        self = BUDGIE_INDEXER_CLIENT(object);
+        if (self->priv->retry_id > 0) {
+                g_source_remove(self->priv->retry_id);
+                self->priv->retry_id = 0;
+        }
+        /* Pending callbacks see this and leave us alone */
+        if (self->priv->cancel) {
+                g_cancellable_cancel(self->priv->cancel);
+                g_object_unref(self->priv->cancel);
+                self->priv->cancel = NULL;
+        }
+        if (self->priv->input) {
+                g_object_unref(self->priv->input);
+                self->priv->input = NULL;
+        }
+        if (self->priv->connection) {
+                g_io_stream_close(G_IO_STREAM(self->priv->connection), NULL, NULL);
+                g_object_unref(self->priv->connection);
+                self->priv->connection = NULL;
+        }
+        if (self->priv->client) {
+                g_object_unref(self->priv->client);
+                self->priv->client = NULL;
+        }
+        if (self->priv->path) {
+                g_free(self->priv->path);
+                self->priv->path = NULL;
+        }
+
+        /* Destruct */
+        G_OBJECT_CLASS(budgie_indexer_client_parent_class)->dispose(object);
+}
+
+/* Utility; return a new BudgieIndexerClient */
+BudgieIndexerClient* budgie_indexer_client_new(void)
+{
+        BudgieIndexerClient *self;
+
+        self = g_object_new(BUDGIE_INDEXER_CLIENT_TYPE, NULL);
+        return BUDGIE_INDEXER_CLIENT(self);
+}
+
+/* Runs in the child; detach it, so it outlives the player */
+static void indexer_child_setup(gpointer data)
+{
+        setsid();
+}
+
+/**
+ * Start budgie-indexer. It removes itself once idle, and takes its lock
+ * before listening, so starting one while another comes up is harmless
+ */
+static void client_spawn(BudgieIndexerClient *self)
+{
+        gchar *argv[2];
+        const gchar *program;
+        GError *error = NULL;
+
+        program = g_getenv("BUDGIE_INDEXER");
+        if (program && *program) {
+                argv[0] = g_strdup(program);
+        } else {
+                argv[0] = g_build_filename(BINDIR, BUDGIE_INDEXER, NULL);
+        }
+        argv[1] = NULL;
+
+        if (!g_spawn_async(NULL, argv, NULL, G_SPAWN_STDOUT_TO_DEV_NULL,
+                indexer_child_setup, NULL, NULL, &error)) {
+                g_warning("Unable to start %s: %s", argv[0], error->message);
+                g_error_free(error);
+        }
+        g_free(argv[0]);
+}
+
+static gboolean retry_cb(gpointer userdata)
+{
+        BudgieIndexerClient *self = userdata;
+
+        self->priv->retry_id = 0;
+        client_connect(self);
+        return FALSE;
+}
+
+/**
+ * Nothing answered; start an indexer the first time round, then keep
+ * looking for it a little while
+ */
+static void client_retry(BudgieIndexerClient *self)
+{
+        if (!self->priv->spawned) {
+                self->priv->spawned = TRUE;
+                self->priv->n_retries = 0;
+                client_spawn(self);
+        }
+        if (++self->priv->n_retries > CONNECT_RETRIES) {
+                g_warning("Unable to reach %s, the library will not be updated",
+                        BUDGIE_INDEXER);
+                /* The next request starts over */
+                self->priv->spawned = FALSE;
+                self->priv->scan_pending = FALSE;
+                return;
+        }
+        self->priv->retry_id = g_timeout_add(CONNECT_RETRY_MSEC, retry_cb, self);
+}
+
+static void client_write(BudgieIndexerClient *self, const gchar *verb, const gchar * const *args)
+{
+        GOutputStream *output;
+        GError *error = NULL;
+        gchar *message;
+
+        /* Messages are small and the indexer reads them as they come,
+         * so a blocking write doesn't hold up the main loop */
+        message = budgie_indexer_message_new(verb, args);
+        output = g_io_stream_get_output_stream(G_IO_STREAM(self->priv->connection));
+        if (!g_output_stream_write_all(output, message, strlen(message), NULL, NULL, &error)) {
+                g_warning("Unable to write to %s: %s", BUDGIE_INDEXER, error->message);
+                g_error_free(error);
+        }
+        g_free(message);
+}
+
+static void client_set_scanning(BudgieIndexerClient *self, gboolean scanning)
+{
+        if (self->priv->scanning == scanning) {
+                return;
+        }
+        self->priv->scanning = scanning;
+        g_signal_emit(self, signals[scanning ? SIGNAL_STARTED : SIGNAL_FINISHED], 0);
+}
+
+static void client_handle(BudgieIndexerClient *self, const gchar *line)
+{
+        BudgieScanProgress progress;
+        gchar **fields;
+        guint n_fields;
+
+        fields = budgie_indexer_message_parse(line);
+        n_fields = g_strv_length(fields);
+        if (n_fields == 0) {
+                g_strfreev(fields);
+                return;
+        }
+
+        if (g_str_equal(fields[0], BUDGIE_INDEXER_STATE) && n_fields > 1) {
+                client_set_scanning(self, g_str_equal(fields[1], "scanning"));
+        } else if (g_str_equal(fields[0], BUDGIE_INDEXER_STARTED)) {
+                client_set_scanning(self, TRUE);
+        } else if (g_str_equal(fields[0], BUDGIE_INDEXER_PROGRESS) && n_fields > 4) {
+                memset(&progress, 0, sizeof(progress));
+                progress.phase = atoi(fields[1]);
+                progress.n_dirs = g_ascii_strtoull(fields[2], NULL, 10);
+                progress.n_media = g_ascii_strtoull(fields[3], NULL, 10);
+                progress.n_tagged = g_ascii_strtoull(fields[4], NULL, 10);
+                g_signal_emit(self, signals[SIGNAL_PROGRESS], 0, &progress);
+        } else if (g_str_equal(fields[0], BUDGIE_INDEXER_TAGS) && n_fields > 1) {
+                g_signal_emit(self, signals[SIGNAL_TAGS_UPDATED], 0,
+                        (guint)g_ascii_strtoull(fields[1], NULL, 10));
+        } else if (g_str_equal(fields[0], BUDGIE_INDEXER_CHANGED) && n_fields > 2) {
+                g_signal_emit(self, signals[SIGNAL_LIBRARY_CHANGED], 0,
+                        (guint)g_ascii_strtoull(fields[1], NULL, 10),
+                        (guint)g_ascii_strtoull(fields[2], NULL, 10));
+        } else if (g_str_equal(fields[0], BUDGIE_INDEXER_DONE)) {
+                client_set_scanning(self, FALSE);
+        }
+        g_strfreev(fields);
+}
+
+static void read_cb(GObject *source, GAsyncResult *res, gpointer userdata)
+{
+        BudgieIndexerClient *self;
+        GError *error = NULL;
+        gchar *line;
+
+        line = g_data_input_stream_read_line_finish(G_DATA_INPUT_STREAM(source),
+                res, NULL, &error);
+        if (g_error_matches(error, G_IO_ERROR, G_IO_ERROR_CANCELLED)) {
+                /* Disposed */
+                g_error_free(error);
+                return;
+        }
+        self = BUDGIE_INDEXER_CLIENT(userdata);
+        if (!line) {
+                /* The indexer went away; a scan it was running is over,
+                 * and anything still wanted needs a new one */
+                if (error) {
+                        g_warning("Lost %s: %s", BUDGIE_INDEXER, error->message);
+                        g_error_free(error);
+                }
+                g_clear_object(&self->priv->input);
+                g_io_stream_close(G_IO_STREAM(self->priv->connection), NULL, NULL);
+                g_clear_object(&self->priv->connection);
+                client_set_scanning(self, FALSE);
+                client_connect(self);
+                return;
+        }
+
+        client_handle(self, line);
+        g_free(line);
+        g_data_input_stream_read_line_async(self->priv->input, G_PRIORITY_DEFAULT,
+                self->priv->cancel, read_cb, self);
+}
+
+static void connect_cb(GObject *source, GAsyncResult *res, gpointer userdata)
+{
+        BudgieIndexerClient *self;
+        GSocketConnection *connection;
+        GError *error = NULL;
+
+        connection = g_socket_client_connect_finish(G_SOCKET_CLIENT(source), res, &error);
+        if (g_error_matches(error, G_IO_ERROR, G_IO_ERROR_CANCELLED)) {
+                /* Disposed */
+                g_error_free(error);
+                return;
+        }
+        self = BUDGIE_INDEXER_CLIENT(userdata);
+        self->priv->connecting = FALSE;
+        if (!connection) {
+                g_error_free(error);
+                client_retry(self);
+                return;
+        }
+
+        self->priv->connection = connection;
+        self->priv->input = g_data_input_stream_new(
+                g_io_stream_get_input_stream(G_IO_STREAM(connection)));
+        self->priv->spawned = FALSE;
+        self->priv->n_retries = 0;
+        if (self->priv->scan_pending) {
+                self->priv->scan_pending = FALSE;
+                client_write(self, BUDGIE_INDEXER_SCAN, NULL);
+        }
+        g_data_input_stream_read_line_async(self->priv->input, G_PRIORITY_DEFAULT,
+                self->priv->cancel, read_cb, self);
+}
+
+static void client_connect(BudgieIndexerClient *self)
+{
+        GSocketAddress *address;
+
+        if (self->priv->connecting || self->priv->connection) {
+                return;
+        }
+        self->priv->connecting = TRUE;
+        address = g_unix_socket_address_new(self->priv->path);
+        g_socket_client_connect_async(self->priv->client, G_SOCKET_CONNECTABLE(address),
+                self->priv->cancel, connect_cb, self);
+        g_object_unref(address);
+}
+
+void budgie_indexer_client_scan(BudgieIndexerClient *self)
+{
+        g_return_if_fail(IS_BUDGIE_INDEXER_CLIENT(self));
+
+        if (!self->priv->connection) {
+                self->priv->scan_pending = TRUE;
+                if (self->priv->retry_id == 0) {
+                        client_connect(self);
+                }
+                return;
+        }
+        client_write(self, BUDGIE_INDEXER_SCAN, NULL);
+}
+
+void budgie_indexer_client_stop(BudgieIndexerClient *self)
+{
+        g_return_if_fail(IS_BUDGIE_INDEXER_CLIENT(self));
+
+        self->priv->scan_pending = FALSE;
+        if (self->priv->connection) {
+                client_write(self, BUDGIE_INDEXER_STOP, NULL);
+        }
+}
+
+void budgie_indexer_client_prioritize(BudgieIndexerClient *self, gchar **paths)
+{
+        g_return_if_fail(IS_BUDGIE_INDEXER_CLIENT(self));
+
+        if (self->priv->connection && paths && paths[0]) {
+                client_write(self, BUDGIE_INDEXER_PRIORITIZE, (const gchar * const *)paths);
+        }
+}
@@ -0,0 +1,92 @@
+/*
+ * budgie-indexer-client.h
+ *
+ * Copyright 2013 Ikey Doherty <ikey.doherty@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ *
+ *
+ */
+#ifndef budgie_indexer_client_h
+#define budgie_indexer_client_h
+
+#include <glib-object.h>
+
+#include "scanner/budgie-scan-stats.h"
+
+typedef struct _BudgieIndexerClient BudgieIndexerClient;
+typedef struct _BudgieIndexerClientClass   BudgieIndexerClientClass;
+typedef struct _BudgieIndexerClientPrivate BudgieIndexerClientPrivate;
+
+#define BUDGIE_INDEXER_CLIENT_TYPE (budgie_indexer_client_get_type())
+#define BUDGIE_INDEXER_CLIENT(obj)                  (G_TYPE_CHECK_INSTANCE_CAST ((obj), BUDGIE_INDEXER_CLIENT_TYPE, BudgieIndexerClient))
+#define IS_BUDGIE_INDEXER_CLIENT(obj)               (G_TYPE_CHECK_INSTANCE_TYPE ((obj), BUDGIE_INDEXER_CLIENT_TYPE))
+#define BUDGIE_INDEXER_CLIENT_CLASS(klass)          (G_TYPE_CHECK_CLASS_CAST ((klass), BUDGIE_INDEXER_CLIENT_TYPE, BudgieIndexerClientClass))
+#define IS_BUDGIE_INDEXER_CLIENT_CLASS(klass)       (G_TYPE_CHECK_CLASS_TYPE ((klass), BUDGIE_INDEXER_CLIENT_TYPE))
+#define BUDGIE_INDEXER_CLIENT_GET_CLASS(obj)        (G_TYPE_INSTANCE_GET_CLASS ((obj), BUDGIE_INDEXER_CLIENT_TYPE, BudgieIndexerClientClass))
+
+/* BudgieIndexerClient object */
+struct _BudgieIndexerClient {
+        GObject parent;
+
+        BudgieIndexerClientPrivate *priv;
+};
+
+/* BudgieIndexerClient class definition */
+struct _BudgieIndexerClientClass {
+        GObjectClass parent_class;
+};
+
+GType budgie_indexer_client_get_type(void);
+
+/* BudgieIndexerClient methods */
+
+/**
+ * Construct a new BudgieIndexerClient
+ *
+ * The client connects to budgie-indexer, starting it when nothing is
+ * listening, and reconnects should it go away. Signals are emitted in
+ * the main loop: "started" and "finished" around each scan, "progress"
+ * with a BudgieScanProgress (only the phase and counts of directories,
+ * media and tagged files are filled), "tags-updated" with the size of
+ * each committed round of tags, and "library-changed" with the rows the
+ * watcher updated and removed.
+ * @return A new BudgieIndexerClient
+ */
+BudgieIndexerClient* budgie_indexer_client_new(void);
+
+/**
+ * Ask the indexer to rescan the media directories. Kept until the
+ * indexer can be reached
+ * @param self BudgieIndexerClient instance
+ */
+void budgie_indexer_client_scan(BudgieIndexerClient *self);
+
+/**
+ * Ask the indexer to stop its running scan
+ * @param self BudgieIndexerClient instance
+ */
+void budgie_indexer_client_stop(BudgieIndexerClient *self);
+
+/**
+ * Ask the indexer to read the tags of these paths next. Dropped when
+ * the indexer can't be reached, as it reads everything in the end
+ * @param self BudgieIndexerClient instance
+ * @param paths NULL terminated list of paths
+ */
+void budgie_indexer_client_prioritize(BudgieIndexerClient *self, gchar **paths);
+
+#endif /* budgie_indexer_client_h */
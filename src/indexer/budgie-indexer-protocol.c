@@ -0,0 +1,67 @@
+/*
+ * budgie-indexer-protocol.c
+ *
+ * Copyright 2013 Ikey Doherty <ikey.doherty@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ *
+ *
+ */
+#include "budgie-indexer-protocol.h"
+
+gchar *budgie_indexer_socket_path(void)
+{
+        return g_build_filename(g_get_user_runtime_dir(), BUDGIE_INDEXER_SOCKET, NULL);
+}
+
+gchar *budgie_indexer_lock_path(void)
+{
+        return g_build_filename(g_get_user_runtime_dir(), BUDGIE_INDEXER_LOCK, NULL);
+}
+
+gchar *budgie_indexer_message_new(const gchar *verb, const gchar * const *args)
+{
+        GString *line;
+        gchar *escaped;
+        guint i;
+
+        line = g_string_new(verb);
+        for (i = 0; args && args[i]; i++) {
+                /* Tabs and newlines included, so neither is left bare */
+                escaped = g_strescape(args[i], NULL);
+                g_string_append_c(line, '\t');
+                g_string_append(line, escaped);
+                g_free(escaped);
+        }
+        g_string_append_c(line, '\n');
+        return g_string_free(line, FALSE);
+}
+
+gchar **budgie_indexer_message_parse(const gchar *line)
+{
+        gchar **fields;
+        gchar *field;
+        guint i;
+
+        /* An empty line splits into no fields at all */
+        fields = g_strsplit(line, "\t", -1);
+        for (i = 1; fields[0] && fields[i]; i++) {
+                field = g_strcompress(fields[i]);
+                g_free(fields[i]);
+                fields[i] = field;
+        }
+        return fields;
+}
@@ -0,0 +1,93 @@
+/*
+ * budgie-indexer-protocol.h
+ *
+ * Copyright 2013 Ikey Doherty <ikey.doherty@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ *
+ *
+ */
+#ifndef budgie_indexer_protocol_h
+#define budgie_indexer_protocol_h
+
+#include <glib.h>
+
+/**
+ * Name of the indexer program, installed in BINDIR so systemd units and
+ * users can run it too. Setting the BUDGIE_INDEXER environment variable
+ * to a path overrides it, to run from a build tree
+ */
+#define BUDGIE_INDEXER "budgie-indexer"
+
+/**
+ * The player and budgie-indexer talk over a Unix socket in the user's
+ * runtime directory, one message per line. A message is a verb and its
+ * arguments, separated by tabs and escaped with g_strescape, so paths
+ * survive whatever bytes they hold
+ */
+#define BUDGIE_INDEXER_SOCKET "budgie-indexer.sock"
+
+/* Held by the running indexer, so only one ever writes the library */
+#define BUDGIE_INDEXER_LOCK "budgie-indexer.lock"
+
+/* Player to indexer: rescan the media directories and read new tags */
+#define BUDGIE_INDEXER_SCAN "SCAN"
+/* Player to indexer: stop the running scan */
+#define BUDGIE_INDEXER_STOP "STOP"
+/* Player to indexer: read the tags of these paths next */
+#define BUDGIE_INDEXER_PRIORITIZE "PRIORITIZE"
+
+/* Indexer to player, on connecting: "idle" or "scanning" */
+#define BUDGIE_INDEXER_STATE "STATE"
+/* Indexer to player: a scan started */
+#define BUDGIE_INDEXER_STARTED "STARTED"
+/* Indexer to player: phase, directories, media files found and tagged */
+#define BUDGIE_INDEXER_PROGRESS "PROGRESS"
+/* Indexer to player: a round of tags was committed, with its size */
+#define BUDGIE_INDEXER_TAGS "TAGS"
+/* Indexer to player: the watcher stored rows updated and removed */
+#define BUDGIE_INDEXER_CHANGED "CHANGED"
+/* Indexer to player: the scan finished or was stopped */
+#define BUDGIE_INDEXER_DONE "DONE"
+
+/**
+ * Where the indexer listens
+ * @return a newly allocated path
+ */
+gchar *budgie_indexer_socket_path(void);
+
+/**
+ * Where the indexer keeps its lock
+ * @return a newly allocated path
+ */
+gchar *budgie_indexer_lock_path(void);
+
+/**
+ * Build one message, ready to write
+ * @param verb What the message says
+ * @param args NULL terminated arguments, or NULL for none
+ * @return a newly allocated line, with its newline
+ */
+gchar *budgie_indexer_message_new(const gchar *verb, const gchar * const *args);
+
+/**
+ * Split a line read from the other side
+ * @param line Line without its newline
+ * @return a newly allocated NULL terminated array, the verb first
+ */
+gchar **budgie_indexer_message_parse(const gchar *line);
+
+#endif /* budgie_indexer_protocol_h */
@@ -57,10 +57,10 @@ static void perform_migration(void)
 int main(int argc, char **argv)
 {
         BudgieWindow *window;
-        
+
         /* Set locale to fix MPV initialization issues */
         setlocale(LC_NUMERIC, "C");
-        
+
         gtk_init(&argc, &argv);
 
         perform_migration();
@@ -71,4 +71,3 @@ int main(int argc, char **argv)
 
         return EXIT_SUCCESS;
 }
-
@@ -0,0 +1,190 @@
+/*
+ * budgie-device-limits.c
+ *
+ * Copyright 2013 Ikey Doherty <ikey.doherty@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ *
+ *
+ */
+#define _GNU_SOURCE
+#include "budgie-device-limits.h"
+
+#ifdef __linux__
+#include <sys/statfs.h>
+#include <sys/sysmacros.h>
+#endif
+
+/* Threads a network mount is read with. Enough to hide the round trips,
+ * few enough not to swamp the server */
+#define NETWORK_SLOTS 4
+
+/* Threads a spinning disk is read with. Any more and the heads spend
+ * their time seeking between the directories of different threads */
+#define ROTATIONAL_SLOTS 1
+
+#ifdef __linux__
+/* From linux/magic.h and the kernel sources; not all of them are public */
+static const long network_magics[] = {
+        0x6969, /* NFS */
+        0x517b, /* SMB */
+        0xff534d42, /* CIFS */
+        0xfe534d42, /* SMB2 */
+        0x73757245, /* Coda */
+        0x5346414f, /* AFS */
+        0x6b414653, /* kAFS */
+        0x01021997, /* 9P */
+        0x00c36400, /* Ceph */
+        0x47504653, /* GPFS */
+        0x0bd00bd0, /* Lustre */
+};
+#endif
+
+typedef struct DeviceSlots {
+        guint limit;
+        guint used;
+} DeviceSlots;
+
+struct BudgieDeviceLimits {
+        GMutex lock;
+        GHashTable *devices; /**<DeviceSlots, by st_dev */
+        guint n_threads;
+};
+
+#ifdef __linux__
+/**
+ * Read the rotational flag of a block device, from the whole disk when
+ * the device is a partition
+ */
+static gboolean read_rotational(guint64 device, gboolean *rotational)
+{
+        static const gchar *paths[] = {
+                "/sys/dev/block/%u:%u/queue/rotational",
+                "/sys/dev/block/%u:%u/../queue/rotational",
+        };
+        gchar *path, *contents = NULL;
+        gboolean found = FALSE;
+        guint i;
+
+        for (i = 0; i < G_N_ELEMENTS(paths) && !found; i++) {
+                path = g_strdup_printf(paths[i], major(device), minor(device));
+                if (g_file_get_contents(path, &contents, NULL, NULL)) {
+                        *rotational = contents[0] == '1';
+                        found = TRUE;
+                        g_free(contents);
+                }
+                g_free(path);
+        }
+        return found;
+}
+#endif
+
+BudgieStorageKind budgie_storage_detect(const gchar *path, guint64 device)
+{
+#ifdef __linux__
+        struct statfs fs;
+        gboolean rotational;
+        guint i;
+
+        if (statfs(path, &fs) == 0) {
+                for (i = 0; i < G_N_ELEMENTS(network_magics); i++) {
+                        if ((unsigned long)fs.f_type == (unsigned long)network_magics[i]) {
+                                return BUDGIE_STORAGE_NETWORK;
+                        }
+                }
+        }
+        /* Btrfs and other anonymous devices have no sysfs entry */
+        if (read_rotational(device, &rotational)) {
+                return rotational ? BUDGIE_STORAGE_ROTATIONAL : BUDGIE_STORAGE_SOLID;
+        }
+#endif
+        return BUDGIE_STORAGE_UNKNOWN;
+}
+
+static guint storage_slots(BudgieStorageKind kind, guint n_threads)
+{
+        switch (kind) {
+                case BUDGIE_STORAGE_ROTATIONAL:
+                        return MIN(ROTATIONAL_SLOTS, n_threads);
+                case BUDGIE_STORAGE_NETWORK:
+                        return MIN(NETWORK_SLOTS, n_threads);
+                default:
+                        return n_threads;
+        }
+}
+
+BudgieDeviceLimits* budgie_device_limits_new(guint n_threads)
+{
+        BudgieDeviceLimits *limits;
+
+        limits = g_new0(BudgieDeviceLimits, 1);
+        g_mutex_init(&limits->lock);
+        limits->devices = g_hash_table_new_full(g_int64_hash, g_int64_equal,
+                g_free, g_free);
+        limits->n_threads = MAX(n_threads, 1);
+        return limits;
+}
+
+void budgie_device_limits_free(BudgieDeviceLimits *limits)
+{
+        g_mutex_clear(&limits->lock);
+        g_hash_table_unref(limits->devices);
+        g_free(limits);
+}
+
+gboolean budgie_device_limits_acquire(BudgieDeviceLimits *limits,
+                                      guint64 device,
+                                      const gchar *path)
+{
+        DeviceSlots *slots;
+        BudgieStorageKind kind;
+        guint64 *key;
+        gboolean acquired = FALSE;
+
+        g_mutex_lock(&limits->lock);
+        slots = g_hash_table_lookup(limits->devices, &device);
+        if (!slots) {
+                /* Only ever once per device and scan, so it's fine to
+                 * hold everyone else up for it */
+                kind = budgie_storage_detect(path, device);
+                slots = g_new0(DeviceSlots, 1);
+                slots->limit = storage_slots(kind, limits->n_threads);
+                key = g_new(guint64, 1);
+                *key = device;
+                g_hash_table_insert(limits->devices, key, slots);
+                g_debug("Scanning device %" G_GUINT64_FORMAT " with %u threads",
+                        device, slots->limit);
+        }
+        if (slots->used < slots->limit) {
+                slots->used++;
+                acquired = TRUE;
+        }
+        g_mutex_unlock(&limits->lock);
+
+        return acquired;
+}
+
+void budgie_device_limits_release(BudgieDeviceLimits *limits, guint64 device)
+{
+        DeviceSlots *slots;
+
+        g_mutex_lock(&limits->lock);
+        slots = g_hash_table_lookup(limits->devices, &device);
+        if (slots && slots->used > 0) {
+                slots->used--;
+        }
+        g_mutex_unlock(&limits->lock);
+}
@@ -0,0 +1,88 @@
+/*
+ * budgie-device-limits.h
+ *
+ * Copyright 2013 Ikey Doherty <ikey.doherty@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ *
+ *
+ */
+#ifndef budgie_device_limits_h
+#define budgie_device_limits_h
+
+#include <glib.h>
+
+/**
+ * What kind of storage a device is, which decides how many threads may
+ * list it at once
+ */
+typedef enum {
+        BUDGIE_STORAGE_UNKNOWN = 0, /**<Treated as solid state */
+        BUDGIE_STORAGE_SOLID, /**<SSD or NVMe, no seek penalty */
+        BUDGIE_STORAGE_ROTATIONAL, /**<Spinning disk, seeks dominate */
+        BUDGIE_STORAGE_NETWORK, /**<NFS, SMB and friends, latency dominates */
+} BudgieStorageKind;
+
+/**
+ * Per device concurrency budgets for one scan. Threads take a slot on a
+ * directory's device before listing it, and give it back afterwards, so
+ * a spinning disk is read by one thread at a time while an SSD next to
+ * it is read by all of them.
+ */
+typedef struct BudgieDeviceLimits BudgieDeviceLimits;
+
+/**
+ * Work out what kind of storage a path lives on
+ * @param path Path of a file or directory on the device
+ * @param device st_dev of the path
+ * @return the kind of storage, BUDGIE_STORAGE_UNKNOWN if it can't be told
+ */
+BudgieStorageKind budgie_storage_detect(const gchar *path, guint64 device);
+
+/**
+ * Construct a new BudgieDeviceLimits
+ * @param n_threads Number of threads that may want slots, the budget of
+ *                  devices that don't need one
+ * @return A new BudgieDeviceLimits
+ */
+BudgieDeviceLimits* budgie_device_limits_new(guint n_threads);
+
+/**
+ * Free a BudgieDeviceLimits, which no thread may be using
+ * @param limits BudgieDeviceLimits instance
+ */
+void budgie_device_limits_free(BudgieDeviceLimits *limits);
+
+/**
+ * Take a slot on a device without waiting. The first time a device is
+ * seen, its storage kind is detected through path
+ * @param limits BudgieDeviceLimits instance
+ * @param device st_dev of the directory about to be read
+ * @param path Path of that directory
+ * @return TRUE if a slot was taken, and must be released later
+ */
+gboolean budgie_device_limits_acquire(BudgieDeviceLimits *limits,
+                                      guint64 device,
+                                      const gchar *path);
+
+/**
+ * Give back a slot taken with budgie_device_limits_acquire
+ * @param limits BudgieDeviceLimits instance
+ * @param device Device the slot was taken on
+ */
+void budgie_device_limits_release(BudgieDeviceLimits *limits, guint64 device);
+
+#endif /* budgie_device_limits_h */
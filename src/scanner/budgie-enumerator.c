@@ -0,0 +1,420 @@
+/*
+ * budgie-enumerator.c
+ *
+ * Copyright 2013 Ikey Doherty <ikey.doherty@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ *
+ *
+ */
+#define _GNU_SOURCE
+#include <errno.h>
+#include <fcntl.h>
+#include <gio/gio.h>
+#include <glib/gstdio.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#ifdef __linux__
+#include <dirent.h>
+#include <sys/syscall.h>
+#endif
+
+#include "budgie-enumerator.h"
+
+/* Everything the scanner needs to know about an entry, and no more */
+#define GIO_ATTRIBUTES G_FILE_ATTRIBUTE_STANDARD_NAME "," \
+        G_FILE_ATTRIBUTE_STANDARD_TYPE "," \
+        G_FILE_ATTRIBUTE_STANDARD_SIZE "," \
+        G_FILE_ATTRIBUTE_STANDARD_IS_SYMLINK "," \
+        G_FILE_ATTRIBUTE_TIME_MODIFIED "," \
+        G_FILE_ATTRIBUTE_UNIX_DEVICE "," \
+        G_FILE_ATTRIBUTE_UNIX_INODE "," \
+        G_FILE_ATTRIBUTE_UNIX_NLINK
+
+/* Sampled at the start, middle and end of a file for its content digest */
+#define DIGEST_BLOCK_SIZE 4096
+#define DIGEST_BLOCKS 3
+
+/* Identity of the directory itself */
+#define GIO_DIR_ATTRIBUTES G_FILE_ATTRIBUTE_UNIX_DEVICE "," \
+        G_FILE_ATTRIBUTE_UNIX_INODE
+
+/* Room for a few hundred entries per getdents64 call */
+#define GETDENTS_BUFFER (32 * 1024)
+
+typedef struct EnumeratorBackend {
+        gboolean (*open)(BudgieEnumerator *self, const gchar *path);
+        gboolean (*next)(BudgieEnumerator *self, ScanEntry *entry);
+        gboolean (*stat)(BudgieEnumerator *self, ScanEntry *entry);
+        void (*close)(BudgieEnumerator *self);
+} EnumeratorBackend;
+
+struct BudgieEnumerator {
+        const EnumeratorBackend *backend;
+        guint64 device; /**<Of the directory, filled in by open */
+        guint64 inode;
+        gboolean failed; /**<Whether next stopped on an error, not the end */
+
+        /* GIO */
+        GFileEnumerator *listing;
+        GFileInfo *info;
+
+        /* getdents64 */
+        int fd;
+        glong length;
+        glong offset;
+        guint64 buffer[]; /**<Kept 8-byte aligned for linux_dirent64 */
+};
+
+static inline void entry_from_stat(struct stat *st, ScanEntry *entry)
+{
+        entry->print.mtime = (gint64)st->st_mtime;
+        entry->print.size = (gint64)st->st_size;
+        entry->print.inode = (guint64)st->st_ino;
+        entry->device = (guint64)st->st_dev;
+        entry->n_links = (guint)st->st_nlink;
+        entry->have_print = TRUE;
+}
+
+static inline ScanEntryType entry_type_for_file_type(GFileType type)
+{
+        switch (type) {
+                case G_FILE_TYPE_REGULAR:
+                        return SCAN_ENTRY_FILE;
+                case G_FILE_TYPE_DIRECTORY:
+                        return SCAN_ENTRY_DIRECTORY;
+                default:
+                        return SCAN_ENTRY_OTHER;
+        }
+}
+
+/* GFileEnumerator backend */
+static gboolean gio_open(BudgieEnumerator *self, const gchar *path)
+{
+        GFile *file;
+        GFileInfo *info;
+
+        file = g_file_new_for_path(path);
+        self->listing = g_file_enumerate_children(file, GIO_ATTRIBUTES,
+                G_FILE_QUERY_INFO_NONE, NULL, NULL);
+        if (self->listing) {
+                info = g_file_query_info(file, GIO_DIR_ATTRIBUTES,
+                        G_FILE_QUERY_INFO_NONE, NULL, NULL);
+                if (info) {
+                        self->device = g_file_info_get_attribute_uint32(info,
+                                G_FILE_ATTRIBUTE_UNIX_DEVICE);
+                        self->inode = g_file_info_get_attribute_uint64(info,
+                                G_FILE_ATTRIBUTE_UNIX_INODE);
+                        g_object_unref(info);
+                }
+        }
+        g_object_unref(file);
+
+        return self->listing != NULL;
+}
+
+static gboolean gio_next(BudgieEnumerator *self, ScanEntry *entry)
+{
+        GFileInfo *info;
+        GError *error = NULL;
+
+        if (self->info) {
+                g_object_unref(self->info);
+        }
+        self->info = info = g_file_enumerator_next_file(self->listing, NULL, &error);
+        if (!info) {
+                if (error) {
+                        g_message("Unable to list a directory: %s", error->message);
+                        g_error_free(error);
+                        self->failed = TRUE;
+                }
+                return FALSE;
+        }
+
+        /* One query gets us everything up front */
+        entry->name = g_file_info_get_name(info);
+        entry->type = entry_type_for_file_type(g_file_info_get_file_type(info));
+        entry->print.mtime = (gint64)g_file_info_get_attribute_uint64(info,
+                G_FILE_ATTRIBUTE_TIME_MODIFIED);
+        entry->print.size = g_file_info_get_size(info);
+        entry->print.inode = g_file_info_get_attribute_uint64(info,
+                G_FILE_ATTRIBUTE_UNIX_INODE);
+        entry->device = g_file_info_get_attribute_uint32(info,
+                G_FILE_ATTRIBUTE_UNIX_DEVICE);
+        entry->n_links = g_file_info_get_attribute_uint32(info,
+                G_FILE_ATTRIBUTE_UNIX_NLINK);
+        entry->via_link = g_file_info_get_is_symlink(info);
+        entry->have_print = TRUE;
+
+        return TRUE;
+}
+
+static gboolean gio_stat(BudgieEnumerator *self, ScanEntry *entry)
+{
+        return entry->have_print;
+}
+
+static void gio_close(BudgieEnumerator *self)
+{
+        if (self->info) {
+                g_object_unref(self->info);
+        }
+        g_file_enumerator_close(self->listing, NULL, NULL);
+        g_object_unref(self->listing);
+}
+
+static const EnumeratorBackend gio_backend = {
+        gio_open, gio_next, gio_stat, gio_close
+};
+
+#ifdef __linux__
+/* getdents64 backend. One buffer per directory instead of a GFileInfo
+ * per entry, and d_type spares us a stat for anything we don't read */
+
+struct linux_dirent64 {
+        guint64 d_ino;
+        gint64 d_off;
+        unsigned short d_reclen;
+        unsigned char d_type;
+        char d_name[];
+};
+
+static gboolean getdents_open(BudgieEnumerator *self, const gchar *path)
+{
+        struct stat st;
+
+        self->fd = open(path, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+        if (self->fd < 0) {
+                return FALSE;
+        }
+        if (fstat(self->fd, &st) == 0) {
+                self->device = (guint64)st.st_dev;
+                self->inode = (guint64)st.st_ino;
+        }
+        return TRUE;
+}
+
+static gboolean getdents_next(BudgieEnumerator *self, ScanEntry *entry)
+{
+        struct linux_dirent64 *dent;
+        struct stat st;
+
+        for (;;) {
+                if (self->offset >= self->length) {
+                        self->length = syscall(SYS_getdents64, self->fd,
+                                (gchar*)self->buffer, GETDENTS_BUFFER);
+                        self->offset = 0;
+                        if (self->length < 0) {
+                                g_message("Unable to list a directory: %s",
+                                        g_strerror(errno));
+                                self->failed = TRUE;
+                        }
+                        if (self->length <= 0) {
+                                return FALSE;
+                        }
+                }
+                dent = (struct linux_dirent64*)((gchar*)self->buffer + self->offset);
+                self->offset += dent->d_reclen;
+
+                if (dent->d_name[0] == '.' && (dent->d_name[1] == '\0' ||
+                    (dent->d_name[1] == '.' && dent->d_name[2] == '\0'))) {
+                        continue;
+                }
+                break;
+        }
+
+        entry->name = dent->d_name;
+        entry->have_print = FALSE;
+        entry->via_link = dent->d_type == DT_LNK;
+        entry->print.inode = dent->d_ino;
+
+        switch (dent->d_type) {
+                case DT_REG:
+                        entry->type = SCAN_ENTRY_FILE;
+                        break;
+                case DT_DIR:
+                        entry->type = SCAN_ENTRY_DIRECTORY;
+                        break;
+                case DT_LNK:
+                case DT_UNKNOWN:
+                        /* Follow links, like GIO does, and cope with
+                         * filesystems that don't fill in d_type */
+                        if (fstatat(self->fd, dent->d_name, &st, 0) != 0) {
+                                entry->type = SCAN_ENTRY_OTHER;
+                                break;
+                        }
+                        entry->type = S_ISDIR(st.st_mode) ? SCAN_ENTRY_DIRECTORY :
+                                S_ISREG(st.st_mode) ? SCAN_ENTRY_FILE : SCAN_ENTRY_OTHER;
+                        entry_from_stat(&st, entry);
+                        break;
+                default:
+                        entry->type = SCAN_ENTRY_OTHER;
+                        break;
+        }
+        return TRUE;
+}
+
+static gboolean getdents_stat(BudgieEnumerator *self, ScanEntry *entry)
+{
+        struct stat st;
+
+        if (fstatat(self->fd, entry->name, &st, 0) != 0) {
+                return FALSE;
+        }
+        entry_from_stat(&st, entry);
+
+        return TRUE;
+}
+
+static void getdents_close(BudgieEnumerator *self)
+{
+        close(self->fd);
+}
+
+static const EnumeratorBackend getdents_backend = {
+        getdents_open, getdents_next, getdents_stat, getdents_close
+};
+#endif
+
+BudgieEnumerator* budgie_enumerator_open(BudgieEnumeratorBackend backend,
+                                         const gchar *path)
+{
+        BudgieEnumerator *self;
+
+#ifdef __linux__
+        if (backend == BUDGIE_ENUMERATOR_GETDENTS) {
+                self = g_malloc0(sizeof(BudgieEnumerator) + GETDENTS_BUFFER);
+                self->backend = &getdents_backend;
+        } else
+#endif
+        {
+                self = g_new0(BudgieEnumerator, 1);
+                self->backend = &gio_backend;
+        }
+
+        if (!self->backend->open(self, path)) {
+                g_free(self);
+                return NULL;
+        }
+        return self;
+}
+
+gboolean budgie_enumerator_next(BudgieEnumerator *self, ScanEntry *entry)
+{
+        entry->owner = self;
+        return self->backend->next(self, entry);
+}
+
+gboolean budgie_scan_entry_stat(ScanEntry *entry)
+{
+        if (entry->have_print) {
+                return TRUE;
+        }
+        if (!entry->owner) {
+                return FALSE;
+        }
+        return entry->owner->backend->stat(entry->owner, entry);
+}
+
+gboolean budgie_enumerator_failed(BudgieEnumerator *self)
+{
+        return self->failed;
+}
+
+void budgie_enumerator_get_identity(BudgieEnumerator *self,
+                                    guint64 *device,
+                                    guint64 *inode)
+{
+        *device = self->device;
+        *inode = self->inode;
+}
+
+void budgie_enumerator_close(BudgieEnumerator *self)
+{
+        self->backend->close(self);
+        g_free(self);
+}
+
+gboolean budgie_scan_entry_for_path(const gchar *path, ScanEntry *entry)
+{
+        GStatBuf st;
+        const gchar *name;
+
+        memset(entry, 0, sizeof(*entry));
+        if (g_stat(path, &st) != 0) {
+                return FALSE;
+        }
+
+        name = strrchr(path, G_DIR_SEPARATOR);
+        entry->name = name ? name + 1 : path;
+        entry->type = S_ISDIR(st.st_mode) ? SCAN_ENTRY_DIRECTORY :
+                S_ISREG(st.st_mode) ? SCAN_ENTRY_FILE : SCAN_ENTRY_OTHER;
+        entry_from_stat(&st, entry);
+
+        return TRUE;
+}
+
+gboolean budgie_scan_dir_stamp(const gchar *path, ScanDirStamp *stamp)
+{
+        struct stat st;
+
+        if (stat(path, &st) != 0 || !S_ISDIR(st.st_mode)) {
+                return FALSE;
+        }
+        stamp->device = (guint64)st.st_dev;
+        stamp->inode = (guint64)st.st_ino;
+#if defined(__APPLE__)
+        stamp->mtime = (gint64)st.st_mtimespec.tv_sec * 1000000000 + st.st_mtimespec.tv_nsec;
+#else
+        stamp->mtime = (gint64)st.st_mtim.tv_sec * 1000000000 + st.st_mtim.tv_nsec;
+#endif
+        return TRUE;
+}
+
+guint64 budgie_scan_content_digest(const gchar *path, gint64 size)
+{
+        guint8 block[DIGEST_BLOCK_SIZE];
+        /* FNV-1a, 64 bit */
+        guint64 hash = 0xcbf29ce484222325ULL;
+        gint64 offset;
+        ssize_t len, j;
+        guint i;
+        int fd;
+
+        fd = open(path, O_RDONLY | O_CLOEXEC);
+        if (fd < 0) {
+                return 0;
+        }
+        for (i = 0; i < DIGEST_BLOCKS; i++) {
+                offset = (size - DIGEST_BLOCK_SIZE) * i / (DIGEST_BLOCKS - 1);
+                offset = MAX(offset, 0);
+                len = pread(fd, block, sizeof(block), offset);
+                if (len < 0) {
+                        close(fd);
+                        return 0;
+                }
+                for (j = 0; j < len; j++) {
+                        hash = (hash ^ block[j]) * 0x100000001b3ULL;
+                }
+        }
+        close(fd);
+
+        hash ^= (guint64)size;
+        /* 0 means no digest */
+        return hash ? hash : 1;
+}
@@ -0,0 +1,157 @@
+/*
+ * budgie-enumerator.h
+ *
+ * Copyright 2013 Ikey Doherty <ikey.doherty@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ *
+ *
+ */
+#ifndef budgie_enumerator_h
+#define budgie_enumerator_h
+
+#include <glib.h>
+
+#include "db/budgie-db.h"
+
+/**
+ * Ways of listing a directory
+ */
+typedef enum {
+        BUDGIE_ENUMERATOR_GIO = 0, /**<GFileEnumerator, works everywhere */
+        BUDGIE_ENUMERATOR_GETDENTS, /**<openat and getdents64, Linux only */
+        BUDGIE_ENUMERATOR_MAX
+} BudgieEnumeratorBackend;
+
+/* getdents stays opt-in, through --backend, until enumerator_benchmark.sh
+ * has numbers showing it ahead */
+#define BUDGIE_ENUMERATOR_DEFAULT BUDGIE_ENUMERATOR_GIO
+
+/**
+ * What a directory entry is, after following symlinks
+ */
+typedef enum {
+        SCAN_ENTRY_OTHER = 0, /**<Anything we don't descend into or read */
+        SCAN_ENTRY_FILE, /**<Regular file */
+        SCAN_ENTRY_DIRECTORY /**<Directory */
+} ScanEntryType;
+
+typedef struct BudgieEnumerator BudgieEnumerator;
+
+/**
+ * Where a directory is and when its entries last changed
+ */
+typedef struct ScanDirStamp {
+        guint64 device; /**<Device holding the directory */
+        guint64 inode; /**<Inode of the directory */
+        gint64 mtime; /**<Modification time, in nanoseconds */
+} ScanDirStamp;
+
+/**
+ * One directory entry. Its name and fingerprint are only valid until
+ * the next entry is read
+ */
+typedef struct ScanEntry {
+        const gchar *name; /**<File name, not the full path */
+        ScanEntryType type; /**<What the entry is */
+        gboolean via_link; /**<Whether the entry is a symlink we followed */
+        gboolean have_print; /**<Whether print and the fields below are filled in */
+        MediaFingerprint print; /**<mtime, size and inode */
+        guint64 device; /**<Device holding the file */
+        guint n_links; /**<Number of hard links to the file */
+        BudgieEnumerator *owner; /**<Enumerator it came from, or NULL */
+} ScanEntry;
+
+/**
+ * Start listing a directory
+ * @param backend How to list it
+ * @param path Path of the directory
+ * @return a new BudgieEnumerator, or NULL if the directory can't be read
+ */
+BudgieEnumerator* budgie_enumerator_open(BudgieEnumeratorBackend backend,
+                                         const gchar *path);
+
+/**
+ * Read the next entry, skipping "." and ".."
+ * @param self BudgieEnumerator instance
+ * @param entry Entry to fill in
+ * @return FALSE once the directory is exhausted, or could not be read
+ *         further, which budgie_enumerator_failed tells apart
+ */
+gboolean budgie_enumerator_next(BudgieEnumerator *self, ScanEntry *entry);
+
+/**
+ * Whether the listing stopped on a read error rather than at its end.
+ * Such a listing is incomplete, and must not stand in for the directory
+ * @param self BudgieEnumerator instance
+ * @return TRUE if budgie_enumerator_next failed
+ */
+gboolean budgie_enumerator_failed(BudgieEnumerator *self);
+
+/**
+ * Make sure the fingerprint of an entry is filled in. Backends that
+ * learn the type of an entry without a stat only stat here, so call it
+ * only for entries that need it
+ * @param entry Entry from budgie_enumerator_next or budgie_scan_entry_for_path
+ * @return FALSE if the file could not be examined
+ */
+gboolean budgie_scan_entry_stat(ScanEntry *entry);
+
+/**
+ * Identify the directory being listed, as in whether it was seen before
+ * @param self BudgieEnumerator instance
+ * @param device Set to the device holding the directory
+ * @param inode Set to the inode of the directory, or 0 if unknown
+ */
+void budgie_enumerator_get_identity(BudgieEnumerator *self,
+                                    guint64 *device,
+                                    guint64 *inode);
+
+/**
+ * Stop listing and free the enumerator
+ * @param self BudgieEnumerator instance
+ */
+void budgie_enumerator_close(BudgieEnumerator *self);
+
+/**
+ * Examine a single file outside of any enumeration
+ * @param path Path of the file, which must outlive the entry
+ * @param entry Entry to fill in, with its fingerprint
+ * @return FALSE if the file could not be examined
+ */
+gboolean budgie_scan_entry_for_path(const gchar *path, ScanEntry *entry);
+
+/**
+ * Examine a directory without listing it. Its mtime changes whenever an
+ * entry is added, removed or renamed, but not when a file inside it is
+ * merely rewritten
+ * @param path Path of the directory
+ * @param stamp Stamp to fill in
+ * @return FALSE if the directory could not be examined
+ */
+gboolean budgie_scan_dir_stamp(const gchar *path, ScanDirStamp *stamp);
+
+/**
+ * Digest a few blocks sampled across a file, at its start, middle and
+ * end. Together with the size this recognises a file that was moved or
+ * copied, without reading all of it
+ * @param path Path of the file
+ * @param size Size of the file in bytes
+ * @return the digest, or 0 if the file could not be read
+ */
+guint64 budgie_scan_content_digest(const gchar *path, gint64 size);
+
+#endif /* budgie_enumerator_h */
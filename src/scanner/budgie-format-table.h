@@ -0,0 +1,93 @@
+/* Generated by mkformats.py, do not edit */
+#define FORMAT_HASH_SEED 3245127054U
+#define FORMAT_SLOT_BITS 8
+#define FORMAT_MAX_EXTENSION 8
+#define FORMAT_SLOT_EMPTY 255
+
+static const MediaFormat formats[] = {
+        { "mp3", "audio/mpeg", MEDIA_KIND_AUDIO },
+        { "mp2", "audio/mpeg", MEDIA_KIND_AUDIO },
+        { "flac", "audio/flac", MEDIA_KIND_AUDIO },
+        { "ogg", "audio/ogg", MEDIA_KIND_AUDIO },
+        { "oga", "audio/ogg", MEDIA_KIND_AUDIO },
+        { "opus", "audio/x-opus+ogg", MEDIA_KIND_AUDIO },
+        { "spx", "audio/x-speex", MEDIA_KIND_AUDIO },
+        { "m4a", "audio/mp4", MEDIA_KIND_AUDIO },
+        { "m4b", "audio/mp4", MEDIA_KIND_AUDIO },
+        { "aac", "audio/aac", MEDIA_KIND_AUDIO },
+        { "wav", "audio/x-wav", MEDIA_KIND_AUDIO },
+        { "wma", "audio/x-ms-wma", MEDIA_KIND_AUDIO },
+        { "aif", "audio/x-aiff", MEDIA_KIND_AUDIO },
+        { "aiff", "audio/x-aiff", MEDIA_KIND_AUDIO },
+        { "ape", "audio/x-ape", MEDIA_KIND_AUDIO },
+        { "wv", "audio/x-wavpack", MEDIA_KIND_AUDIO },
+        { "mpc", "audio/x-musepack", MEDIA_KIND_AUDIO },
+        { "mka", "audio/x-matroska", MEDIA_KIND_AUDIO },
+        { "dsf", "audio/x-dsf", MEDIA_KIND_AUDIO },
+        { "mkv", "video/x-matroska", MEDIA_KIND_VIDEO },
+        { "mp4", "video/mp4", MEDIA_KIND_VIDEO },
+        { "m4v", "video/mp4", MEDIA_KIND_VIDEO },
+        { "avi", "video/x-msvideo", MEDIA_KIND_VIDEO },
+        { "mov", "video/quicktime", MEDIA_KIND_VIDEO },
+        { "wmv", "video/x-ms-wmv", MEDIA_KIND_VIDEO },
+        { "asf", "video/x-ms-asf", MEDIA_KIND_VIDEO },
+        { "flv", "video/x-flv", MEDIA_KIND_VIDEO },
+        { "webm", "video/webm", MEDIA_KIND_VIDEO },
+        { "mpg", "video/mpeg", MEDIA_KIND_VIDEO },
+        { "mpeg", "video/mpeg", MEDIA_KIND_VIDEO },
+        { "vob", "video/mpeg", MEDIA_KIND_VIDEO },
+        { "3gp", "video/3gpp", MEDIA_KIND_VIDEO },
+        { "ts", "video/mp2t", MEDIA_KIND_VIDEO },
+        { "m2ts", "video/mp2t", MEDIA_KIND_VIDEO },
+        { "ogv", "video/ogg", MEDIA_KIND_VIDEO },
+        { "jpg", "image/jpeg", MEDIA_KIND_NONE },
+        { "jpeg", "image/jpeg", MEDIA_KIND_NONE },
+        { "png", "image/png", MEDIA_KIND_NONE },
+        { "gif", "image/gif", MEDIA_KIND_NONE },
+        { "bmp", "image/bmp", MEDIA_KIND_NONE },
+        { "webp", "image/webp", MEDIA_KIND_NONE },
+        { "txt", "text/plain", MEDIA_KIND_NONE },
+        { "nfo", "text/plain", MEDIA_KIND_NONE },
+        { "log", "text/plain", MEDIA_KIND_NONE },
+        { "cue", "application/x-cue", MEDIA_KIND_NONE },
+        { "m3u", "audio/x-mpegurl", MEDIA_KIND_NONE },
+        { "m3u8", "audio/x-mpegurl", MEDIA_KIND_NONE },
+        { "pls", "audio/x-scpls", MEDIA_KIND_NONE },
+        { "lrc", "text/plain", MEDIA_KIND_NONE },
+        { "srt", "application/x-subrip", MEDIA_KIND_NONE },
+        { "sub", "text/plain", MEDIA_KIND_NONE },
+        { "ass", "text/x-ssa", MEDIA_KIND_NONE },
+        { "pdf", "application/pdf", MEDIA_KIND_NONE },
+        { "sfv", "text/plain", MEDIA_KIND_NONE },
+        { "md5", "text/plain", MEDIA_KIND_NONE },
+        { "accurip", "text/plain", MEDIA_KIND_NONE },
+        { "db", "application/octet-stream", MEDIA_KIND_NONE },
+        { "ini", "text/plain", MEDIA_KIND_NONE },
+        { "xml", "application/xml", MEDIA_KIND_NONE },
+        { "html", "text/html", MEDIA_KIND_NONE },
+        { "htm", "text/html", MEDIA_KIND_NONE },
+        { "url", "text/plain", MEDIA_KIND_NONE },
+        { "zip", "application/zip", MEDIA_KIND_NONE },
+        { "rar", "application/x-rar", MEDIA_KIND_NONE },
+        { "7z", "application/x-7z-compressed", MEDIA_KIND_NONE },
+        { "ds_store", "application/octet-stream", MEDIA_KIND_NONE },
+};
+
+static const guint8 format_slots[1 << FORMAT_SLOT_BITS] = {
+        255, 255, 255, 255,  32, 255, 255, 255, 255,  18, 255, 255, 255, 255,  17, 255,
+        255, 255,  63, 255, 255, 255,  54, 255, 255, 255,  39, 255,  21,  14,  23,  27,
+         24,  30,  36, 255, 255,   3, 255, 255,  31, 255,  48,   9,   5, 255, 255, 255,
+        255, 255, 255, 255, 255,  38, 255, 255,  19,  34, 255, 255, 255, 255, 255, 255,
+        255, 255, 255, 255, 255, 255,   4,  47,  61, 255, 255, 255, 255, 255, 255, 255,
+        255,  64, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255,   8,  41, 255,
+         26,   0, 255, 255,  44,  20,  52, 255, 255, 255,  62, 255,  42,  35, 255, 255,
+        255,  57, 255, 255, 255, 255,  22, 255, 255, 255,  53, 255, 255,  55, 255,  11,
+        255, 255,  46, 255, 255, 255, 255, 255,  13, 255,  29, 255,   2, 255, 255, 255,
+        255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255,
+         51, 255, 255, 255, 255,  43, 255, 255, 255, 255, 255,  45, 255, 255,  59,   7,
+        255,  58, 255, 255, 255,  25,  15, 255, 255, 255, 255,  65,  56, 255, 255, 255,
+        255,   6, 255, 255, 255, 255, 255, 255, 255, 255, 255,  40,  50,  37, 255, 255,
+        255, 255, 255,  16, 255,  12, 255,   1, 255, 255, 255, 255,  28,  10, 255, 255,
+        255, 255, 255, 255, 255, 255, 255, 255,  33, 255,  60, 255, 255, 255, 255, 255,
+        255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255,  49, 255, 255, 255, 255,
+};
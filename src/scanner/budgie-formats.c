@@ -0,0 +1,280 @@
+/*
+ * budgie-formats.c
+ *
+ * Copyright 2013 Ikey Doherty <ikey.doherty@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ *
+ *
+ */
+#include <glib/gstdio.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "config.h"
+#include "budgie-formats.h"
+
+/* formats[] and format_slots[], from mkformats.py at build time where
+ * Python is around */
+#ifdef HAVE_FORMAT_TABLE_GEN
+#include "budgie-format-table-gen.h"
+#else
+#include "budgie-format-table.h"
+#endif
+
+/* Enough for every signature below, and for the second frame of the
+ * largest MPEG audio frame */
+#define SNIFF_LENGTH 4096
+
+/**
+ * Must match fnv() in mkformats.py
+ */
+static inline guint format_slot(const gchar *ext, gsize length)
+{
+        guint32 h = FORMAT_HASH_SEED;
+        gsize i;
+
+        for (i = 0; i < length; i++) {
+                h = (h ^ (guint8)ext[i]) * 16777619U;
+        }
+        h ^= h >> 16;
+        h *= 0x85ebca6bU;
+        h ^= h >> 13;
+        return h >> (32 - FORMAT_SLOT_BITS);
+}
+
+static const MediaFormat* format_for_extension(const gchar *ext, gsize length)
+{
+        guint8 index;
+
+        index = format_slots[format_slot(ext, length)];
+        if (index == FORMAT_SLOT_EMPTY) {
+                return NULL;
+        }
+        /* Another extension may share the slot */
+        if (strncmp(formats[index].extension, ext, length) != 0 ||
+            formats[index].extension[length] != '\0') {
+                return NULL;
+        }
+        return &formats[index];
+}
+
+const MediaFormat* budgie_format_lookup(const gchar *path)
+{
+        gchar ext[FORMAT_MAX_EXTENSION];
+        const gchar *dot = NULL;
+        const gchar *c;
+        gsize length = 0;
+
+        /* Last dot of the final component, found in one pass */
+        for (c = path; *c; c++) {
+                if (*c == '.') {
+                        dot = c;
+                } else if (*c == '/') {
+                        dot = NULL;
+                }
+        }
+        if (!dot) {
+                return NULL;
+        }
+
+        for (c = dot + 1; *c; c++) {
+                if (length == FORMAT_MAX_EXTENSION) {
+                        return NULL;
+                }
+                ext[length++] = g_ascii_tolower(*c);
+        }
+        if (length == 0) {
+                return NULL;
+        }
+        return format_for_extension(ext, length);
+}
+
+#define MAGIC(data, offset, str) \
+        (memcmp((data) + (offset), (str), sizeof(str) - 1) == 0)
+
+/* Bitrates in kbit/s by table and index, the free and bad indices aside */
+static const guint16 mpeg_bitrates[5][14] = {
+        /* MPEG 1 layers I, II and III */
+        { 32, 64, 96, 128, 160, 192, 224, 256, 288, 320, 352, 384, 416, 448 },
+        { 32, 48, 56, 64, 80, 96, 112, 128, 160, 192, 224, 256, 320, 384 },
+        { 32, 40, 48, 56, 64, 80, 96, 112, 128, 160, 192, 224, 256, 320 },
+        /* MPEG 2 and 2.5 layer I, then layers II and III */
+        { 32, 48, 56, 64, 80, 96, 112, 128, 144, 160, 176, 192, 224, 256 },
+        { 8, 16, 24, 32, 40, 48, 56, 64, 80, 96, 112, 128, 144, 160 },
+};
+
+/* Sample rates in Hz of MPEG 1, by index */
+static const guint32 mpeg_rates[3] = { 44100, 48000, 32000 };
+
+/**
+ * Check an MPEG audio frame header
+ * @param h Four bytes of the header
+ * @return the length of the frame, or 0 where any field is reserved or
+ *         invalid, or the bitrate is free and the length unknown
+ */
+static gsize mpeg_frame_length(const guint8 *h)
+{
+        guint version, layer, bitrate, rate, padding, table;
+        guint32 hz;
+
+        if (h[0] != 0xff || (h[1] & 0xe0) != 0xe0) {
+                return 0;
+        }
+        version = (h[1] >> 3) & 0x3;   /* 0 is MPEG 2.5, 2 MPEG 2, 3 MPEG 1 */
+        layer = 4 - ((h[1] >> 1) & 0x3); /* 1 to 3, 4 is reserved */
+        bitrate = h[2] >> 4;
+        rate = (h[2] >> 2) & 0x3;
+        padding = (h[2] >> 1) & 0x1;
+        if (version == 1 || layer == 4 || bitrate == 0 || bitrate == 0xf ||
+            rate == 3 || (h[3] & 0x3) == 2) {
+                return 0;
+        }
+
+        if (version == 3) {
+                table = layer - 1;
+        } else {
+                table = layer == 1 ? 3 : 4;
+        }
+        hz = mpeg_rates[rate] >> (version == 3 ? 0 : version == 2 ? 1 : 2);
+        bitrate = mpeg_bitrates[table][bitrate - 1] * 1000U;
+
+        if (layer == 1) {
+                return (12 * bitrate / hz + padding) * 4;
+        }
+        if (layer == 3 && version != 3) {
+                return 72 * bitrate / hz + padding;
+        }
+        return 144 * bitrate / hz + padding;
+}
+
+/**
+ * A lone frame sync matches text in UTF-16LE and all manner of binary
+ * data, so an MPEG audio stream must show a valid header and, where the
+ * first frame ends, another of the same version, layer and sample rate
+ */
+static gboolean mpeg_audio_sniff(const guint8 *data, gsize length)
+{
+        const guint8 *next;
+        gsize frame;
+
+        frame = mpeg_frame_length(data);
+        if (frame == 0 || frame + 4 > length) {
+                return FALSE;
+        }
+        next = data + frame;
+        if (mpeg_frame_length(next) == 0) {
+                return FALSE;
+        }
+        /* Version, layer and sample rate hold for the whole stream */
+        return (next[1] & 0xfe) == (data[1] & 0xfe) &&
+                (next[2] & 0x0c) == (data[2] & 0x0c);
+}
+
+const MediaFormat* budgie_format_sniff(const guint8 *data, gsize length)
+{
+        const gchar *ext = NULL;
+        gsize i;
+
+        if (length < 12) {
+                return NULL;
+        }
+
+        if (MAGIC(data, 0, "ID3")) {
+                ext = "mp3";
+        } else if (MAGIC(data, 0, "fLaC")) {
+                ext = "flac";
+        } else if (MAGIC(data, 0, "OggS")) {
+                /* The first packet names the codec */
+                if (length >= 36 && MAGIC(data, 28, "OpusHead")) {
+                        ext = "opus";
+                } else if (length >= 35 && MAGIC(data, 28, "\x80theora")) {
+                        ext = "ogv";
+                } else {
+                        ext = "ogg";
+                }
+        } else if (MAGIC(data, 0, "RIFF") && MAGIC(data, 8, "WAVE")) {
+                ext = "wav";
+        } else if (MAGIC(data, 0, "RIFF") && MAGIC(data, 8, "AVI ")) {
+                ext = "avi";
+        } else if (MAGIC(data, 0, "FORM") && (MAGIC(data, 8, "AIFF") || MAGIC(data, 8, "AIFC"))) {
+                ext = "aiff";
+        } else if (MAGIC(data, 4, "ftyp")) {
+                /* ISO media, the major brand tells audio from video */
+                if (MAGIC(data, 8, "M4A ")) {
+                        ext = "m4a";
+                } else if (MAGIC(data, 8, "M4B ")) {
+                        ext = "m4b";
+                } else if (MAGIC(data, 8, "qt  ")) {
+                        ext = "mov";
+                } else if (MAGIC(data, 8, "3gp")) {
+                        ext = "3gp";
+                } else {
+                        ext = "mp4";
+                }
+        } else if (MAGIC(data, 0, "\x1a\x45\xdf\xa3")) {
+                /* EBML, look for the DocType */
+                ext = "mkv";
+                for (i = 4; i + 4 <= length; i++) {
+                        if (MAGIC(data, i, "webm")) {
+                                ext = "webm";
+                                break;
+                        }
+                }
+        } else if (MAGIC(data, 0, "\x30\x26\xb2\x75\x8e\x66\xcf\x11")) {
+                ext = "asf";
+        } else if (MAGIC(data, 0, "FLV\x01")) {
+                ext = "flv";
+        } else if (MAGIC(data, 0, "\x00\x00\x01\xba") || MAGIC(data, 0, "\x00\x00\x01\xb3")) {
+                ext = "mpg";
+        } else if (MAGIC(data, 0, "MAC ")) {
+                ext = "ape";
+        } else if (MAGIC(data, 0, "wvpk")) {
+                ext = "wv";
+        } else if (MAGIC(data, 0, "MPCK") || MAGIC(data, 0, "MP+")) {
+                ext = "mpc";
+        } else if (MAGIC(data, 0, "DSD ")) {
+                ext = "dsf";
+        } else if (data[0] == 0xff && (data[1] & 0xf6) == 0xf0) {
+                /* ADTS, checked before the MPEG frame sync it overlaps */
+                ext = "aac";
+        } else if (mpeg_audio_sniff(data, length)) {
+                ext = "mp3";
+        }
+
+        if (!ext) {
+                return NULL;
+        }
+        return format_for_extension(ext, strlen(ext));
+}
+
+#undef MAGIC
+
+const MediaFormat* budgie_format_sniff_file(const gchar *path)
+{
+        guint8 data[SNIFF_LENGTH];
+        gsize length;
+        FILE *file;
+
+        file = g_fopen(path, "rb");
+        if (!file) {
+                return NULL;
+        }
+        length = fread(data, 1, sizeof(data), file);
+        fclose(file);
+
+        return budgie_format_sniff(data, length);
+}
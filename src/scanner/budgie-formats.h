@@ -0,0 +1,80 @@
+/*
+ * budgie-formats.h
+ *
+ * Copyright 2013 Ikey Doherty <ikey.doherty@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ *
+ *
+ */
+#ifndef budgie_formats_h
+#define budgie_formats_h
+
+#include <glib.h>
+
+/**
+ * Broad classification of a file format
+ */
+typedef enum {
+        MEDIA_KIND_NONE = 0, /**<Known not to be media */
+        MEDIA_KIND_AUDIO, /**<Audio we can play */
+        MEDIA_KIND_VIDEO /**<Video we can play */
+} MediaKind;
+
+/**
+ * A file format known to the registry
+ */
+typedef struct MediaFormat {
+        const gchar *extension; /**<Lower case extension, without the dot */
+        const gchar *mime; /**<MIME type stored for the file */
+        MediaKind kind; /**<Whether, and how, we play it */
+} MediaFormat;
+
+/**
+ * Look a file up by its extension, ignoring case
+ * @param path Path or name of the file
+ * @return the format, or NULL when the extension is unknown
+ */
+const MediaFormat* budgie_format_lookup(const gchar *path);
+
+/**
+ * Identify a format from the first bytes of a file. MPEG audio without
+ * an ID3 tag is only recognised by two consecutive frames, so needs up to
+ * the first two kilobytes or so
+ * @param data Start of the file
+ * @param length Number of bytes available
+ * @return the format, or NULL when nothing matched
+ */
+const MediaFormat* budgie_format_sniff(const guint8 *data, gsize length);
+
+/**
+ * Read the first bytes of a file and identify its format from them
+ * @param path Path of the file
+ * @return the format, or NULL when nothing matched
+ */
+const MediaFormat* budgie_format_sniff_file(const gchar *path);
+
+/**
+ * Whether files of this format belong in the library
+ * @param format A format, which may be NULL
+ * @return a boolean value, TRUE for audio and video
+ */
+static inline gboolean budgie_format_is_media(const MediaFormat *format)
+{
+        return format && format->kind != MEDIA_KIND_NONE;
+}
+
+#endif /* budgie_formats_h */
@@ -0,0 +1,300 @@
+/*
+ * budgie-head-reader.c
+ *
+ * Copyright 2013 Ikey Doherty <ikey.doherty@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ *
+ *
+ */
+#define _GNU_SOURCE
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "config.h"
+#include "budgie-head-reader.h"
+
+#ifdef HAVE_LIBURING
+#include <liburing.h>
+
+/* The operation a completion is for, in the low bits of its user data.
+ * The rest is the index of the file in its batch */
+enum {
+        HEAD_OP_OPEN = 0,
+        HEAD_OP_STATX,
+        HEAD_OP_READ,
+};
+
+#define HEAD_OP_BITS 2
+#define HEAD_OP_MASK ((1 << HEAD_OP_BITS) - 1)
+
+struct BudgieHeadReader {
+        struct io_uring ring;
+        guint batch;
+        struct statx *stx; /**<One per file of a batch */
+        guint8 **buffers; /**<One per file of a batch, while its read is in flight */
+        gboolean broken; /**<The ring failed, and may still hold our requests */
+};
+
+BudgieHeadReader *budgie_head_reader_new(guint batch)
+{
+        BudgieHeadReader *reader;
+        struct io_uring_probe *probe;
+        gboolean supported;
+        gint ret;
+
+        g_return_val_if_fail(batch > 0, NULL);
+
+        reader = g_new0(BudgieHeadReader, 1);
+        /* An open and a stat for every file of a batch */
+        ret = io_uring_queue_init(batch * 2, &reader->ring, 0);
+        if (ret < 0) {
+                g_message("io_uring is unavailable: %s", g_strerror(-ret));
+                g_free(reader);
+                return NULL;
+        }
+        /* Older kernels have the ring, but not these operations */
+        probe = io_uring_get_probe_ring(&reader->ring);
+        supported = probe &&
+                io_uring_opcode_supported(probe, IORING_OP_OPENAT) &&
+                io_uring_opcode_supported(probe, IORING_OP_STATX) &&
+                io_uring_opcode_supported(probe, IORING_OP_READ);
+        if (probe) {
+                io_uring_free_probe(probe);
+        }
+        if (!supported) {
+                g_message("io_uring lacks openat, statx or read on this kernel");
+                io_uring_queue_exit(&reader->ring);
+                g_free(reader);
+                return NULL;
+        }
+
+        reader->batch = batch;
+        reader->stx = g_new0(struct statx, batch);
+        reader->buffers = g_new0(guint8*, batch);
+        return reader;
+}
+
+static struct io_uring_sqe *head_sqe(BudgieHeadReader *reader, guint index, guint op)
+{
+        struct io_uring_sqe *sqe;
+
+        /* Never empty, a batch fits in the ring */
+        sqe = io_uring_get_sqe(&reader->ring);
+        g_assert(sqe != NULL);
+        sqe->user_data = (guint64)index << HEAD_OP_BITS | op;
+        return sqe;
+}
+
+/**
+ * Submit what was queued and handle its completions. Nothing may return
+ * before every one is in, as the kernel still holds our buffers
+ *
+ * Should the ring fail, the reader is marked broken and never used again.
+ * Requests may be left queued or in flight then, so the buffers of any
+ * read not seen through are leaked rather than freed under the kernel
+ * @return FALSE if the ring failed
+ */
+static gboolean head_reader_complete(BudgieHeadReader *reader, guint count, BudgieTagHead **heads)
+{
+        struct io_uring_cqe *cqe;
+        BudgieTagHead *head;
+        struct statx *stx;
+        guint index;
+        gint ret;
+
+        if (count == 0) {
+                return TRUE;
+        }
+        ret = io_uring_submit(&reader->ring);
+        if (ret < 0) {
+                g_warning("Unable to submit to io_uring: %s", g_strerror(-ret));
+                reader->broken = TRUE;
+                count = 0;
+        } else if ((guint)ret < count) {
+                /* Only wait for what the kernel took */
+                g_warning("io_uring took %d of %u requests", ret, count);
+                reader->broken = TRUE;
+                count = (guint)ret;
+        }
+        while (count > 0) {
+                ret = io_uring_wait_cqe(&reader->ring, &cqe);
+                if (ret == -EINTR || ret == -EAGAIN) {
+                        continue;
+                }
+                if (ret < 0) {
+                        g_warning("Unable to wait on io_uring: %s", g_strerror(-ret));
+                        reader->broken = TRUE;
+                        break;
+                }
+                index = (guint)(cqe->user_data >> HEAD_OP_BITS);
+                head = heads[index];
+                switch (cqe->user_data & HEAD_OP_MASK) {
+                        case HEAD_OP_OPEN:
+                                head->fd = cqe->res;
+                                break;
+                        case HEAD_OP_STATX:
+                                stx = &reader->stx[index];
+                                if (cqe->res == 0 && S_ISREG(stx->stx_mode)) {
+                                        head->size = (gint64)stx->stx_size;
+                                } else {
+                                        head->size = -1;
+                                }
+                                break;
+                        case HEAD_OP_READ:
+                                if (cqe->res > 0) {
+                                        head->data = g_bytes_new_take(reader->buffers[index],
+                                                (gsize)cqe->res);
+                                } else {
+                                        g_free(reader->buffers[index]);
+                                }
+                                reader->buffers[index] = NULL;
+                                break;
+                        default:
+                                break;
+                }
+                io_uring_cqe_seen(&reader->ring, cqe);
+                count--;
+        }
+        if (reader->broken) {
+                /* Whatever is left may yet be written to */
+                for (index = 0; index < reader->batch; index++) {
+                        reader->buffers[index] = NULL;
+                }
+        }
+        return !reader->broken;
+}
+
+/* Drop the heads of a batch the ring failed under */
+static void head_reader_discard(guint n, BudgieTagHead **heads)
+{
+        guint i;
+
+        for (i = 0; i < n; i++) {
+                budgie_tag_head_free(heads[i]);
+                heads[i] = NULL;
+        }
+}
+
+/* Read one batch, no larger than reader->batch */
+static gboolean head_reader_batch(BudgieHeadReader *reader,
+                              const gchar **paths,
+                              guint n,
+                              BudgieTagHead **heads)
+{
+        struct io_uring_sqe *sqe;
+        BudgieTagHead *head;
+        gsize len;
+        guint i, count = 0;
+
+        for (i = 0; i < n; i++) {
+                heads[i] = g_new0(BudgieTagHead, 1);
+                heads[i]->fd = -1;
+
+                sqe = head_sqe(reader, i, HEAD_OP_OPEN);
+                io_uring_prep_openat(sqe, AT_FDCWD, paths[i], O_RDONLY | O_CLOEXEC, 0);
+                sqe = head_sqe(reader, i, HEAD_OP_STATX);
+                io_uring_prep_statx(sqe, AT_FDCWD, paths[i], 0,
+                        STATX_TYPE | STATX_SIZE, &reader->stx[i]);
+        }
+        if (!head_reader_complete(reader, n * 2, heads)) {
+                head_reader_discard(n, heads);
+                return FALSE;
+        }
+
+        for (i = 0; i < n; i++) {
+                head = heads[i];
+                if (head->fd < 0) {
+                        head->fd = -1;
+                        continue;
+                }
+                if (head->size < 0) {
+                        close(head->fd);
+                        head->fd = -1;
+                        continue;
+                }
+                len = (gsize)MIN(head->size, BUDGIE_HEAD_SIZE);
+                if (len == 0) {
+                        continue;
+                }
+                reader->buffers[i] = g_malloc(len);
+                sqe = head_sqe(reader, i, HEAD_OP_READ);
+                io_uring_prep_read(sqe, head->fd, reader->buffers[i], (guint)len, 0);
+                count++;
+        }
+        if (!head_reader_complete(reader, count, heads)) {
+                head_reader_discard(n, heads);
+                return FALSE;
+        }
+        return TRUE;
+}
+
+gboolean budgie_head_reader_read(BudgieHeadReader *reader,
+                                 const gchar **paths,
+                                 guint n,
+                                 BudgieTagHead **heads)
+{
+        guint i;
+
+        g_return_val_if_fail(reader != NULL, FALSE);
+
+        memset(heads, 0, n * sizeof(BudgieTagHead*));
+        if (reader->broken) {
+                return FALSE;
+        }
+        for (i = 0; i < n; i += reader->batch) {
+                if (!head_reader_batch(reader, paths + i, MIN(reader->batch, n - i), heads + i)) {
+                        return FALSE;
+                }
+        }
+        return TRUE;
+}
+
+void budgie_head_reader_free(BudgieHeadReader *reader)
+{
+        if (!reader) {
+                return;
+        }
+        io_uring_queue_exit(&reader->ring);
+        g_free(reader->stx);
+        g_free(reader->buffers);
+        g_free(reader);
+}
+
+#else /* HAVE_LIBURING */
+
+BudgieHeadReader *budgie_head_reader_new(__attribute__((unused)) guint batch)
+{
+        g_message("Built without io_uring support");
+        return NULL;
+}
+
+gboolean budgie_head_reader_read(__attribute__((unused)) BudgieHeadReader *reader,
+                                 __attribute__((unused)) const gchar **paths,
+                                 __attribute__((unused)) guint n,
+                                 __attribute__((unused)) BudgieTagHead **heads)
+{
+        g_return_val_if_reached(FALSE);
+}
+
+void budgie_head_reader_free(__attribute__((unused)) BudgieHeadReader *reader)
+{
+}
+
+#endif /* HAVE_LIBURING */
@@ -0,0 +1,85 @@
+/*
+ * budgie-head-reader.h
+ *
+ * Copyright 2013 Ikey Doherty <ikey.doherty@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ *
+ *
+ */
+#ifndef budgie_head_reader_h
+#define budgie_head_reader_h
+
+#include <glib.h>
+
+#include "budgie-tag-reader.h"
+
+/**
+ * How the taggers get at the files they read
+ */
+typedef enum {
+        BUDGIE_TAG_IO_PREAD = 0, /**<Each tagger opens and reads its own files */
+        BUDGIE_TAG_IO_URING, /**<Batched through io_uring ahead of the taggers, Linux only */
+        BUDGIE_TAG_IO_MAX
+} BudgieTagIO;
+
+/* io_uring stays opt-in until the backfill benchmark shows it ahead */
+#define BUDGIE_TAG_IO_DEFAULT BUDGIE_TAG_IO_PREAD
+
+/* How much of the start of each file is read */
+#define BUDGIE_HEAD_SIZE (64 * 1024)
+
+/**
+ * Opens files and reads their first BUDGIE_HEAD_SIZE bytes in batches
+ * through io_uring: the opens and stats of a batch in one submission,
+ * then its reads in another. Two waits per batch rather than three
+ * system calls per file, which matters most where each call is a round
+ * trip to a server. Not safe to share between threads
+ */
+typedef struct BudgieHeadReader BudgieHeadReader;
+
+/**
+ * Construct a new BudgieHeadReader
+ * @param batch Most files in flight at once
+ * @return a new BudgieHeadReader, or NULL where io_uring or the
+ *         operations it needs are unavailable, and the files are to be
+ *         read the usual way
+ */
+BudgieHeadReader *budgie_head_reader_new(guint batch);
+
+/**
+ * Open and read the start of some files
+ * @param reader BudgieHeadReader instance
+ * @param paths Paths of the files
+ * @param n Number of paths
+ * @param heads Where to store a new BudgieTagHead for each path, with no
+ *              fd if the file could not be opened or is not a regular file
+ * @return FALSE if io_uring failed, leaving the heads from there on NULL.
+ *         The reader is of no further use then, and the files are to be
+ *         read the usual way
+ */
+gboolean budgie_head_reader_read(BudgieHeadReader *reader,
+                                 const gchar **paths,
+                                 guint n,
+                                 BudgieTagHead **heads);
+
+/**
+ * Free a BudgieHeadReader
+ * @param reader BudgieHeadReader instance, may be NULL
+ */
+void budgie_head_reader_free(BudgieHeadReader *reader);
+
+#endif /* budgie_head_reader_h */
@@ -0,0 +1,171 @@
+/*
+ * budgie-ignore.c
+ *
+ * Copyright 2013 Ikey Doherty <ikey.doherty@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ *
+ *
+ */
+#include <string.h>
+
+#include "budgie-ignore.h"
+
+#if !GLIB_CHECK_VERSION(2, 70, 0)
+#define g_pattern_spec_match_string g_pattern_match_string
+#endif
+
+struct BudgieIgnore {
+        GHashTable *names; /**<Literal names */
+        GHashTable *suffixes; /**<What follows the '*' of "*suffix" */
+        GArray *suffix_lengths; /**<Each distinct length in suffixes, as guint */
+        GPtrArray *prefixes; /**<What comes before the '*' of "prefix*" */
+        GPtrArray *globs; /**<GPatternSpec for the remaining names */
+        GHashTable *paths; /**<Literal paths */
+        GPtrArray *path_globs; /**<GPatternSpec for the remaining paths */
+};
+
+static inline gboolean is_literal(const gchar *s, gsize len)
+{
+        gsize i;
+
+        for (i = 0; i < len; i++) {
+                if (s[i] == '*' || s[i] == '?') {
+                        return FALSE;
+                }
+        }
+        return TRUE;
+}
+
+static void ignore_add_suffix(BudgieIgnore *ignore, const gchar *suffix)
+{
+        guint len, i;
+
+        len = strlen(suffix);
+        g_hash_table_add(ignore->suffixes, g_strdup(suffix));
+        for (i = 0; i < ignore->suffix_lengths->len; i++) {
+                if (g_array_index(ignore->suffix_lengths, guint, i) == len) {
+                        return;
+                }
+        }
+        g_array_append_val(ignore->suffix_lengths, len);
+}
+
+static void ignore_add(BudgieIgnore *ignore, const gchar *pattern)
+{
+        gsize len;
+
+        len = strlen(pattern);
+        if (strchr(pattern, '/')) {
+                if (is_literal(pattern, len)) {
+                        g_hash_table_add(ignore->paths, g_strdup(pattern));
+                } else {
+                        g_ptr_array_add(ignore->path_globs, g_pattern_spec_new(pattern));
+                }
+        } else if (is_literal(pattern, len)) {
+                g_hash_table_add(ignore->names, g_strdup(pattern));
+        } else if (len > 1 && pattern[0] == '*' && is_literal(pattern + 1, len - 1)) {
+                ignore_add_suffix(ignore, pattern + 1);
+        } else if (len > 1 && pattern[len - 1] == '*' && is_literal(pattern, len - 1)) {
+                g_ptr_array_add(ignore->prefixes, g_strndup(pattern, len - 1));
+        } else {
+                g_ptr_array_add(ignore->globs, g_pattern_spec_new(pattern));
+        }
+}
+
+BudgieIgnore* budgie_ignore_new(gchar **patterns)
+{
+        BudgieIgnore *ignore;
+        gchar *pattern;
+        guint i;
+
+        ignore = g_new0(BudgieIgnore, 1);
+        ignore->names = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
+        ignore->suffixes = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
+        ignore->suffix_lengths = g_array_new(FALSE, FALSE, sizeof(guint));
+        ignore->prefixes = g_ptr_array_new_with_free_func(g_free);
+        ignore->globs = g_ptr_array_new_with_free_func((GDestroyNotify)g_pattern_spec_free);
+        ignore->paths = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
+        ignore->path_globs = g_ptr_array_new_with_free_func((GDestroyNotify)g_pattern_spec_free);
+
+        for (i = 0; patterns && patterns[i]; i++) {
+                pattern = g_strstrip(g_strdup(patterns[i]));
+                if (*pattern) {
+                        ignore_add(ignore, pattern);
+                }
+                g_free(pattern);
+        }
+        return ignore;
+}
+
+void budgie_ignore_free(BudgieIgnore *ignore)
+{
+        if (!ignore) {
+                return;
+        }
+        g_hash_table_unref(ignore->names);
+        g_hash_table_unref(ignore->suffixes);
+        g_array_free(ignore->suffix_lengths, TRUE);
+        g_ptr_array_free(ignore->prefixes, TRUE);
+        g_ptr_array_free(ignore->globs, TRUE);
+        g_hash_table_unref(ignore->paths);
+        g_ptr_array_free(ignore->path_globs, TRUE);
+        g_free(ignore);
+}
+
+gboolean budgie_ignore_match(BudgieIgnore *ignore, const gchar *dir, const gchar *name)
+{
+        const gchar *prefix;
+        gchar *path;
+        gsize len;
+        guint i, suffix_len;
+        gboolean ret = FALSE;
+
+        if (g_hash_table_contains(ignore->names, name)) {
+                return TRUE;
+        }
+        len = strlen(name);
+        for (i = 0; i < ignore->suffix_lengths->len; i++) {
+                suffix_len = g_array_index(ignore->suffix_lengths, guint, i);
+                if (suffix_len <= len &&
+                    g_hash_table_contains(ignore->suffixes, name + len - suffix_len)) {
+                        return TRUE;
+                }
+        }
+        for (i = 0; i < ignore->prefixes->len; i++) {
+                prefix = ignore->prefixes->pdata[i];
+                if (g_str_has_prefix(name, prefix)) {
+                        return TRUE;
+                }
+        }
+        for (i = 0; i < ignore->globs->len; i++) {
+                if (g_pattern_spec_match_string(ignore->globs->pdata[i], name)) {
+                        return TRUE;
+                }
+        }
+
+        /* Only built when some pattern needs it */
+        if (g_hash_table_size(ignore->paths) == 0 && ignore->path_globs->len == 0) {
+                return FALSE;
+        }
+        path = g_build_filename(dir, name, NULL);
+        ret = g_hash_table_contains(ignore->paths, path);
+        for (i = 0; i < ignore->path_globs->len && !ret; i++) {
+                ret = g_pattern_spec_match_string(ignore->path_globs->pdata[i], path);
+        }
+        g_free(path);
+        return ret;
+}
@@ -0,0 +1,71 @@
+/*
+ * budgie-ignore.h
+ *
+ * Copyright 2013 Ikey Doherty <ikey.doherty@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ *
+ *
+ */
+#ifndef budgie_ignore_h
+#define budgie_ignore_h
+
+#include <glib.h>
+
+/**
+ * A directory holding a file of this name is not scanned, nor is
+ * anything beneath it
+ */
+#define BUDGIE_IGNORE_MARKER ".nomedia"
+
+/**
+ * A set of ignore patterns, compiled once for a scan and then matched
+ * against every entry it lists. Matching only reads, so any number of
+ * threads may share one.
+ *
+ * Patterns without a '/' match entry names at any depth: ".git",
+ * "*.bak", "Backup*" or "*Stems*". Those with one match whole paths,
+ * e.g. "/home/me/Music/Samples". '*' matches any run of characters and
+ * '?' any single one. Literal names, "*suffix" and "prefix*" patterns
+ * are looked up by hash or compared directly; only the rest fall back to
+ * GPatternSpec.
+ */
+typedef struct BudgieIgnore BudgieIgnore;
+
+/**
+ * Compile a list of patterns
+ * @param patterns NULL terminated list of patterns, or NULL. Blank ones
+ *                 are skipped
+ * @return A new BudgieIgnore
+ */
+BudgieIgnore* budgie_ignore_new(gchar **patterns);
+
+/**
+ * Free a BudgieIgnore, which no thread may be using
+ * @param ignore BudgieIgnore instance
+ */
+void budgie_ignore_free(BudgieIgnore *ignore);
+
+/**
+ * Test a directory entry against the patterns
+ * @param ignore BudgieIgnore instance
+ * @param dir Path of the directory holding the entry
+ * @param name Name of the entry
+ * @return TRUE if the entry is to be skipped
+ */
+gboolean budgie_ignore_match(BudgieIgnore *ignore, const gchar *dir, const gchar *name);
+
+#endif /* budgie_ignore_h */
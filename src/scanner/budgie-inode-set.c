@@ -0,0 +1,141 @@
+/*
+ * budgie-inode-set.c
+ *
+ * Copyright 2013 Ikey Doherty <ikey.doherty@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ *
+ *
+ */
+#include "budgie-inode-set.h"
+
+/* Shards are picked by the top bits of the hash, slots by the bottom */
+#define INODE_SET_SHARD_BITS 4
+#define INODE_SET_SHARDS (1 << INODE_SET_SHARD_BITS)
+
+/* Initial slots per shard, always a power of two */
+#define INODE_SET_MIN_SLOTS 64
+
+/* An inode of 0 marks a free slot, no file has it */
+typedef struct InodeKey {
+        guint64 device;
+        guint64 inode;
+} InodeKey;
+
+typedef struct InodeShard {
+        GMutex lock;
+        InodeKey *slots;
+        guint n_slots;
+        guint n_used;
+} InodeShard;
+
+struct BudgieInodeSet {
+        InodeShard shards[INODE_SET_SHARDS];
+};
+
+BudgieInodeSet* budgie_inode_set_new(void)
+{
+        BudgieInodeSet *set;
+        guint i;
+
+        set = g_new0(BudgieInodeSet, 1);
+        for (i = 0; i < INODE_SET_SHARDS; i++) {
+                g_mutex_init(&set->shards[i].lock);
+                set->shards[i].n_slots = INODE_SET_MIN_SLOTS;
+                set->shards[i].slots = g_new0(InodeKey, INODE_SET_MIN_SLOTS);
+        }
+        return set;
+}
+
+void budgie_inode_set_free(BudgieInodeSet *set)
+{
+        guint i;
+
+        for (i = 0; i < INODE_SET_SHARDS; i++) {
+                g_mutex_clear(&set->shards[i].lock);
+                g_free(set->shards[i].slots);
+        }
+        g_free(set);
+}
+
+/**
+ * Find the slot holding a key, or the free slot it belongs in
+ */
+static InodeKey *shard_find(InodeShard *shard, guint64 hash,
+                            guint64 device, guint64 inode)
+{
+        guint mask = shard->n_slots - 1;
+        guint i = (guint)hash & mask;
+        InodeKey *slot;
+
+        /* Linear probing; the table is never more than half full */
+        for (;;) {
+                slot = &shard->slots[i];
+                if (slot->inode == 0 ||
+                    (slot->inode == inode && slot->device == device)) {
+                        return slot;
+                }
+                i = (i + 1) & mask;
+        }
+}
+
+static void shard_grow(InodeShard *shard)
+{
+        InodeKey *old = shard->slots;
+        guint n_old = shard->n_slots, i;
+        InodeKey *slot;
+
+        shard->n_slots *= 2;
+        shard->slots = g_new0(InodeKey, shard->n_slots);
+        for (i = 0; i < n_old; i++) {
+                if (old[i].inode == 0) {
+                        continue;
+                }
+                slot = shard_find(shard, budgie_inode_hash(old[i].device, old[i].inode),
+                        old[i].device, old[i].inode);
+                *slot = old[i];
+        }
+        g_free(old);
+}
+
+gboolean budgie_inode_set_add(BudgieInodeSet *set, guint64 device, guint64 inode)
+{
+        InodeShard *shard;
+        InodeKey *slot;
+        guint64 hash;
+        gboolean added = FALSE;
+
+        if (inode == 0) {
+                return TRUE;
+        }
+
+        hash = budgie_inode_hash(device, inode);
+        shard = &set->shards[hash >> (64 - INODE_SET_SHARD_BITS)];
+
+        g_mutex_lock(&shard->lock);
+        slot = shard_find(shard, hash, device, inode);
+        if (slot->inode == 0) {
+                slot->device = device;
+                slot->inode = inode;
+                added = TRUE;
+                if (++shard->n_used * 2 > shard->n_slots) {
+                        shard_grow(shard);
+                }
+        }
+        g_mutex_unlock(&shard->lock);
+
+        return added;
+}
@@ -0,0 +1,73 @@
+/*
+ * budgie-inode-set.h
+ *
+ * Copyright 2013 Ikey Doherty <ikey.doherty@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ *
+ *
+ */
+#ifndef budgie_inode_set_h
+#define budgie_inode_set_h
+
+#include <glib.h>
+
+/**
+ * A thread-safe set of (st_dev, st_ino) pairs. Entries are stored inline
+ * in open addressed tables, 16 bytes each, split over a number of
+ * independently locked shards so scan threads rarely wait on each other.
+ */
+typedef struct BudgieInodeSet BudgieInodeSet;
+
+/**
+ * Mix a file identity into a hash value
+ * @param device Device number of the file
+ * @param inode Inode number of the file
+ * @return a well distributed hash of both
+ */
+static inline guint64 budgie_inode_hash(guint64 device, guint64 inode)
+{
+        guint64 h = inode ^ (device * 0x9e3779b97f4a7c15ULL);
+
+        h ^= h >> 33;
+        h *= 0xff51afd7ed558ccdULL;
+        h ^= h >> 33;
+        return h;
+}
+
+/**
+ * Construct a new, empty BudgieInodeSet
+ * @return A new BudgieInodeSet
+ */
+BudgieInodeSet* budgie_inode_set_new(void);
+
+/**
+ * Free a BudgieInodeSet, which no thread may be using
+ * @param set BudgieInodeSet instance
+ */
+void budgie_inode_set_free(BudgieInodeSet *set);
+
+/**
+ * Add a file identity to the set
+ * @param set BudgieInodeSet instance
+ * @param device Device number of the file
+ * @param inode Inode number of the file. 0 means unknown, and is never
+ *              considered seen
+ * @return TRUE if the identity was not in the set yet
+ */
+gboolean budgie_inode_set_add(BudgieInodeSet *set, guint64 device, guint64 inode);
+
+#endif /* budgie_inode_set_h */
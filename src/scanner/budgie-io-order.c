@@ -0,0 +1,179 @@
+/*
+ * budgie-io-order.c
+ *
+ * Copyright 2013 Ikey Doherty <ikey.doherty@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ *
+ *
+ */
+#define _GNU_SOURCE
+#include <glib/gstdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef __linux__
+#include <fcntl.h>
+#include <linux/fiemap.h>
+#include <linux/fs.h>
+#include <sys/ioctl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include "db/budgie-db.h"
+#include "budgie-device-limits.h"
+#include "budgie-io-order.h"
+
+/* Where a file is to be read, compared as (device, offset, index) */
+typedef struct IOKey {
+        guint64 device;
+        guint64 offset;
+        guint index;
+        gpointer media;
+} IOKey;
+
+static gint io_key_compare(gconstpointer a, gconstpointer b)
+{
+        const IOKey *x = a, *y = b;
+
+        if (x->device != y->device) {
+                return x->device < y->device ? -1 : 1;
+        }
+        if (x->offset != y->offset) {
+                return x->offset < y->offset ? -1 : 1;
+        }
+        /* Ties keep path order */
+        return x->index < y->index ? -1 : (x->index > y->index);
+}
+
+/**
+ * Find the disk offset of the first extent of a file
+ * @return FALSE if the filesystem can't tell, an empty file is at 0
+ */
+static gboolean io_first_extent(const gchar *path, guint64 *device, guint64 *offset)
+{
+#ifdef __linux__
+        union {
+                struct fiemap map;
+                guint8 storage[sizeof(struct fiemap) + sizeof(struct fiemap_extent)];
+        } buf;
+        struct stat st;
+        gboolean ret = FALSE;
+        int fd;
+
+        fd = open(path, O_RDONLY | O_CLOEXEC);
+        if (fd < 0) {
+                return FALSE;
+        }
+        memset(&buf, 0, sizeof(buf));
+        buf.map.fm_start = 0;
+        buf.map.fm_length = FIEMAP_MAX_OFFSET;
+        buf.map.fm_extent_count = 1;
+        if (fstat(fd, &st) == 0 && ioctl(fd, FS_IOC_FIEMAP, &buf.map) == 0) {
+                *device = st.st_dev;
+                *offset = buf.map.fm_mapped_extents > 0 ? buf.map.fm_extents[0].fe_physical : 0;
+                ret = TRUE;
+        }
+        close(fd);
+        return ret;
+#else
+        return FALSE;
+#endif
+}
+
+/**
+ * Fill in where each file lies, by inode or by first extent
+ * @return FALSE if extents were asked for and the filesystem has none
+ */
+static gboolean io_locate(IOKey *keys, guint n_keys, BudgieIOOrder order)
+{
+        MediaInfo *media;
+        GStatBuf st;
+        guint i;
+
+        for (i = 0; i < n_keys; i++) {
+                media = keys[i].media;
+                keys[i].device = 0;
+                if (order == BUDGIE_IO_ORDER_EXTENT) {
+                        /* The first file decides for the lot, a later one
+                         * failing was most likely deleted meanwhile */
+                        if (!io_first_extent(media->path, &keys[i].device, &keys[i].offset)) {
+                                if (i == 0) {
+                                        return FALSE;
+                                }
+                                keys[i].offset = 0;
+                        }
+                        continue;
+                }
+                /* Stored by the walk, the device is not */
+                keys[i].offset = media->inode;
+                if (media->inode == 0 && g_stat(media->path, &st) == 0) {
+                        keys[i].offset = st.st_ino;
+                }
+        }
+        return TRUE;
+}
+
+/**
+ * Physical order where seeks cost, path order elsewhere
+ */
+static BudgieIOOrder io_order_detect(MediaInfo *media)
+{
+        GStatBuf st;
+
+        if (g_stat(media->path, &st) != 0) {
+                return BUDGIE_IO_ORDER_PATH;
+        }
+        if (budgie_storage_detect(media->path, st.st_dev) == BUDGIE_STORAGE_ROTATIONAL) {
+                return BUDGIE_IO_ORDER_EXTENT;
+        }
+        return BUDGIE_IO_ORDER_PATH;
+}
+
+BudgieIOOrder budgie_io_order_sort(GPtrArray *media, guint from, BudgieIOOrder order)
+{
+        IOKey *keys;
+        guint i, n_keys;
+
+        if (from >= media->len) {
+                return order == BUDGIE_IO_ORDER_AUTO ? BUDGIE_IO_ORDER_PATH : order;
+        }
+        if (order == BUDGIE_IO_ORDER_AUTO) {
+                order = io_order_detect(media->pdata[from]);
+        }
+        if (order == BUDGIE_IO_ORDER_PATH) {
+                return order;
+        }
+
+        n_keys = media->len - from;
+        keys = g_new0(IOKey, n_keys);
+        for (i = 0; i < n_keys; i++) {
+                keys[i].index = i;
+                keys[i].media = media->pdata[from + i];
+        }
+        if (!io_locate(keys, n_keys, order)) {
+                order = BUDGIE_IO_ORDER_INODE;
+                io_locate(keys, n_keys, order);
+        }
+        qsort(keys, n_keys, sizeof(IOKey), io_key_compare);
+        for (i = 0; i < n_keys; i++) {
+                media->pdata[from + i] = keys[i].media;
+        }
+        g_free(keys);
+
+        return order;
+}
@@ -0,0 +1,57 @@
+/*
+ * budgie-io-order.h
+ *
+ * Copyright 2013 Ikey Doherty <ikey.doherty@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ *
+ *
+ */
+#ifndef budgie_io_order_h
+#define budgie_io_order_h
+
+#include <glib.h>
+
+/**
+ * The order files are opened in for their tags. On a spinning disk a
+ * cold backfill spends most of its time seeking, and path order jumps
+ * all over the platter; the physical orders let the head sweep across
+ */
+typedef enum {
+        BUDGIE_IO_ORDER_AUTO = 0, /**<EXTENT on rotational storage, PATH elsewhere */
+        BUDGIE_IO_ORDER_PATH, /**<As stored, by path */
+        BUDGIE_IO_ORDER_INODE, /**<By inode number, which roughly follows disk position */
+        BUDGIE_IO_ORDER_EXTENT, /**<By where each file's first extent lies on disk */
+        BUDGIE_IO_ORDER_MAX
+} BudgieIOOrder;
+
+#define BUDGIE_IO_ORDER_DEFAULT BUDGIE_IO_ORDER_AUTO
+
+/**
+ * Sort part of an array of MediaInfo into the order to read it in.
+ * EXTENT asks the filesystem through FIEMAP, which costs an open per
+ * file, and falls back to INODE where that is not supported
+ *
+ * @param media Array of MediaInfo, sorted in place
+ * @param from Index of the first element to sort, those before it keep
+ *             their place
+ * @param order How to sort. AUTO looks at the storage of the first file
+ *              to sort
+ * @return the order the elements are in now, never AUTO
+ */
+BudgieIOOrder budgie_io_order_sort(GPtrArray *media, guint from, BudgieIOOrder order);
+
+#endif /* budgie_io_order_h */
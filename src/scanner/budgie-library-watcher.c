@@ -0,0 +1,708 @@
+/*
+ * budgie-library-watcher.c
+ *
+ * Copyright 2013 Ikey Doherty <ikey.doherty@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ *
+ *
+ */
+#include <gio/gio.h>
+#include <string.h>
+
+#include "budgie-formats.h"
+#include "budgie-library-watcher.h"
+#include "budgie-scanner.h"
+#include "db/budgie-db.h"
+
+/* Apply a batch once no events have arrived for this long */
+#define DEBOUNCE_MSEC 750
+
+/* ..but never hold back a steady stream of events for longer than this */
+#define MAX_LATENCY_MSEC 5000
+
+typedef enum {
+        WATCH_UPDATE = 1, /**<Path was created or modified */
+        WATCH_REMOVE /**<Path went away */
+} WatchAction;
+
+/* One set of changes, applied in a worker thread */
+typedef struct WatchBatch {
+        GHashTable *changes; /**<WatchAction, by path */
+        GPtrArray *renames; /**<Paths renamed in place, as pairs of old and new */
+        GPtrArray *new_dirs; /**<Directories found that need a monitor */
+        guint n_updated;
+        guint n_removed;
+} WatchBatch;
+
+/* Private storage */
+struct _BudgieLibraryWatcherPrivate {
+        gchar **roots;
+        GHashTable *monitors; /**<GFileMonitor, by directory path */
+        GHashTable *pending; /**<Changes not yet handed to a worker */
+        GPtrArray *renames; /**<Renames not yet handed to a worker, in order */
+        gint64 first_event;
+        gint64 last_event;
+        guint debounce_id;
+        gboolean applying;
+        gboolean exhausted;
+        GCancellable *cancel;
+        BudgieDB *db;
+        BudgieScanner *scanner;
+};
+
+enum {
+        SIGNAL_CHANGED, N_SIGNALS
+};
+
+static guint signals[N_SIGNALS] = { 0, };
+
+G_DEFINE_TYPE_WITH_PRIVATE(BudgieLibraryWatcher, budgie_library_watcher, G_TYPE_OBJECT)
+
+/* Boilerplate GObject code */
+static void budgie_library_watcher_class_init(BudgieLibraryWatcherClass *klass);
+static void budgie_library_watcher_init(BudgieLibraryWatcher *self);
+static void budgie_library_watcher_dispose(GObject *object);
+
+static void monitor_cb(GFileMonitor *monitor,
+                       GFile *file,
+                       GFile *other,
+                       GFileMonitorEvent event,
+                       gpointer userdata);
+static gboolean flush_cb(gpointer userdata);
+
+/* Initialisation */
+static void budgie_library_watcher_class_init(BudgieLibraryWatcherClass *klass)
+{
+        GObjectClass *g_object_class;
+
+        g_object_class = G_OBJECT_CLASS(klass);
+        g_object_class->dispose = &budgie_library_watcher_dispose;
+
+        signals[SIGNAL_CHANGED] = g_signal_new("changed",
+                G_TYPE_FROM_CLASS(klass), G_SIGNAL_RUN_FIRST,
+                0, NULL, NULL, NULL, G_TYPE_NONE,
+                2, G_TYPE_UINT, G_TYPE_UINT);
+}
+
+static void monitor_free(gpointer data)
+{
+        GFileMonitor *monitor = data;
+
+        g_signal_handlers_disconnect_matched(monitor, G_SIGNAL_MATCH_FUNC,
+                0, 0, NULL, monitor_cb, NULL);
+        g_file_monitor_cancel(monitor);
+        g_object_unref(monitor);
+}
+
+static void budgie_library_watcher_init(BudgieLibraryWatcher *self)
+{
+        self->priv = budgie_library_watcher_get_instance_private(self);
+        self->priv->monitors = g_hash_table_new_full(g_str_hash, g_str_equal,
+                g_free, monitor_free);
+        self->priv->pending = g_hash_table_new_full(g_str_hash, g_str_equal,
+                g_free, NULL);
+        self->priv->renames = g_ptr_array_new_with_free_func(g_free);
+        self->priv->db = budgie_db_new();
+        /* Nothing beneath a new path can be in the database yet */
+        self->priv->scanner = g_object_new(BUDGIE_SCANNER_TYPE,
+                "workers", 0, "incremental", FALSE, "background", TRUE, NULL);
+}
+
+static void budgie_library_watcher_dispose(GObject *object)
+{
+        BudgieLibraryWatcher *self;
+
+        self = BUDGIE_LIBRARY_WATCHER(object);
+        if (self->priv->debounce_id > 0) {
+                g_source_remove(self->priv->debounce_id);
+                self->priv->debounce_id = 0;
+        }
+        if (self->priv->cancel) {
+                g_cancellable_cancel(self->priv->cancel);
+                g_object_unref(self->priv->cancel);
+                self->priv->cancel = NULL;
+        }
+        if (self->priv->monitors) {
+                g_hash_table_unref(self->priv->monitors);
+                self->priv->monitors = NULL;
+        }
+        if (self->priv->pending) {
+                g_hash_table_unref(self->priv->pending);
+                self->priv->pending = NULL;
+        }
+        if (self->priv->renames) {
+                g_ptr_array_free(self->priv->renames, TRUE);
+                self->priv->renames = NULL;
+        }
+        if (self->priv->roots) {
+                g_strfreev(self->priv->roots);
+                self->priv->roots = NULL;
+        }
+        if (self->priv->scanner) {
+                g_object_unref(self->priv->scanner);
+                self->priv->scanner = NULL;
+        }
+        if (self->priv->db) {
+                g_object_unref(self->priv->db);
+                self->priv->db = NULL;
+        }
+        /* Destruct */
+        G_OBJECT_CLASS(budgie_library_watcher_parent_class)->dispose(object);
+}
+
+/* Utility; return a new BudgieLibraryWatcher */
+BudgieLibraryWatcher* budgie_library_watcher_new(void)
+{
+        BudgieLibraryWatcher *self;
+
+        self = g_object_new(BUDGIE_LIBRARY_WATCHER_TYPE, NULL);
+        return BUDGIE_LIBRARY_WATCHER(self);
+}
+
+/**
+ * Whether path is dir itself, or lies somewhere beneath it
+ */
+static inline gboolean path_within(const gchar *path, const gchar *dir)
+{
+        size_t len = strlen(dir);
+
+        return strncmp(path, dir, len) == 0 &&
+                (path[len] == '\0' || path[len] == '/');
+}
+
+/**
+ * Walk a tree and collect every directory in it, including the root.
+ * Symlinks are not followed, so loops can't trap us.
+ */
+static void collect_directories(const gchar *root,
+                                GPtrArray *dirs,
+                                GCancellable *cancel)
+{
+        GQueue queue = G_QUEUE_INIT;
+        GFileEnumerator *listing;
+        GFileInfo *info;
+        GFile *file;
+        gchar *path;
+
+        g_queue_push_tail(&queue, g_strdup(root));
+        while ((path = g_queue_pop_head(&queue)) != NULL) {
+                if (g_cancellable_is_cancelled(cancel)) {
+                        g_free(path);
+                        continue;
+                }
+                file = g_file_new_for_path(path);
+                listing = g_file_enumerate_children(file,
+                        G_FILE_ATTRIBUTE_STANDARD_NAME "," G_FILE_ATTRIBUTE_STANDARD_TYPE,
+                        G_FILE_QUERY_INFO_NOFOLLOW_SYMLINKS, cancel, NULL);
+                g_object_unref(file);
+                if (!listing) {
+                        g_free(path);
+                        continue;
+                }
+                while ((info = g_file_enumerator_next_file(listing, cancel, NULL)) != NULL) {
+                        if (g_file_info_get_file_type(info) == G_FILE_TYPE_DIRECTORY) {
+                                g_queue_push_tail(&queue, g_build_filename(path,
+                                        g_file_info_get_name(info), NULL));
+                        }
+                        g_object_unref(info);
+                }
+                g_file_enumerator_close(listing, NULL, NULL);
+                g_object_unref(listing);
+                /* Ownership passes to the array */
+                g_ptr_array_add(dirs, path);
+        }
+}
+
+static void watch_directory(BudgieLibraryWatcher *self, const gchar *path)
+{
+        GFileMonitor *monitor;
+        GFile *file;
+        GError *error = NULL;
+
+        if (g_hash_table_contains(self->priv->monitors, path)) {
+                return;
+        }
+
+        file = g_file_new_for_path(path);
+        monitor = g_file_monitor_directory(file, G_FILE_MONITOR_WATCH_MOVES,
+                NULL, &error);
+        g_object_unref(file);
+        if (!monitor) {
+                /* Usually the inotify watch limit, no sense repeating it */
+                if (!self->priv->exhausted) {
+                        g_warning("Unable to watch %s: %s", path, error->message);
+                        self->priv->exhausted = TRUE;
+                }
+                g_error_free(error);
+                return;
+        }
+        g_signal_connect(monitor, "changed", G_CALLBACK(monitor_cb), self);
+        g_hash_table_insert(self->priv->monitors, g_strdup(path), monitor);
+}
+
+/**
+ * Drop the monitors for a directory and everything beneath it
+ */
+static void unwatch_tree(BudgieLibraryWatcher *self, const gchar *path)
+{
+        GHashTableIter iter;
+        gpointer key;
+
+        /* Files never have monitors, so skip the walk for them */
+        if (!g_hash_table_contains(self->priv->monitors, path)) {
+                return;
+        }
+        g_hash_table_iter_init(&iter, self->priv->monitors);
+        while (g_hash_table_iter_next(&iter, &key, NULL)) {
+                if (path_within(key, path)) {
+                        g_hash_table_iter_remove(&iter);
+                }
+        }
+}
+
+static void schedule_flush(BudgieLibraryWatcher *self)
+{
+        gint64 now;
+
+        now = g_get_monotonic_time();
+        self->priv->last_event = now;
+        if (self->priv->first_event == 0) {
+                self->priv->first_event = now;
+        }
+        /* A running batch reschedules us when it completes */
+        if (self->priv->debounce_id == 0 && !self->priv->applying) {
+                self->priv->debounce_id = g_timeout_add(DEBOUNCE_MSEC, flush_cb, self);
+        }
+}
+
+static void queue_change(BudgieLibraryWatcher *self,
+                         const gchar *path,
+                         WatchAction action)
+{
+        /* Only the final state of a path matters */
+        g_hash_table_insert(self->priv->pending, g_strdup(path),
+                GINT_TO_POINTER(action));
+        schedule_flush(self);
+}
+
+/**
+ * Whether changes to path, or to anything beneath it, are pending
+ */
+static gboolean pending_within(BudgieLibraryWatcher *self, const gchar *path)
+{
+        GHashTableIter iter;
+        gpointer key;
+
+        g_hash_table_iter_init(&iter, self->priv->pending);
+        while (g_hash_table_iter_next(&iter, &key, NULL)) {
+                if (path_within(key, path)) {
+                        return TRUE;
+                }
+        }
+        return FALSE;
+}
+
+/**
+ * Follow a rename in place. The stored rows move to the new path with
+ * their tags, rather than being dropped and read again. Where changes
+ * made under the old path are still pending, their paths no longer
+ * exist, and a file renamed to another format is another file, so the
+ * new path is read as if new instead
+ */
+static void queue_rename(BudgieLibraryWatcher *self,
+                         const gchar *path,
+                         const gchar *other_path,
+                         gboolean is_dir)
+{
+        if (pending_within(self, path) ||
+            (!is_dir && budgie_format_lookup(path) != budgie_format_lookup(other_path))) {
+                queue_change(self, path, WATCH_REMOVE);
+                queue_change(self, other_path, WATCH_UPDATE);
+                return;
+        }
+        g_ptr_array_add(self->priv->renames, g_strdup(path));
+        g_ptr_array_add(self->priv->renames, g_strdup(other_path));
+        schedule_flush(self);
+}
+
+static void monitor_cb(GFileMonitor *monitor,
+                       GFile *file,
+                       GFile *other,
+                       GFileMonitorEvent event,
+                       gpointer userdata)
+{
+        BudgieLibraryWatcher *self;
+        gchar *path;
+        gchar *other_path;
+        gboolean is_dir;
+
+        self = BUDGIE_LIBRARY_WATCHER(userdata);
+        path = g_file_get_path(file);
+        if (!path) {
+                return;
+        }
+
+        switch (event) {
+                case G_FILE_MONITOR_EVENT_CREATED:
+                case G_FILE_MONITOR_EVENT_MOVED_IN:
+                        /* Watch new directories right away, so we see what
+                         * lands in them while the batch is pending */
+                        if (g_file_query_file_type(file, G_FILE_QUERY_INFO_NOFOLLOW_SYMLINKS,
+                                NULL) == G_FILE_TYPE_DIRECTORY) {
+                                watch_directory(self, path);
+                        }
+                        queue_change(self, path, WATCH_UPDATE);
+                        break;
+                case G_FILE_MONITOR_EVENT_CHANGES_DONE_HINT:
+                        queue_change(self, path, WATCH_UPDATE);
+                        break;
+                case G_FILE_MONITOR_EVENT_CHANGED:
+                        /* Still being written, wait for CHANGES_DONE_HINT */
+                        self->priv->last_event = g_get_monotonic_time();
+                        break;
+                case G_FILE_MONITOR_EVENT_DELETED:
+                case G_FILE_MONITOR_EVENT_MOVED_OUT:
+                        unwatch_tree(self, path);
+                        queue_change(self, path, WATCH_REMOVE);
+                        break;
+                case G_FILE_MONITOR_EVENT_RENAMED:
+                        unwatch_tree(self, path);
+                        other_path = other ? g_file_get_path(other) : NULL;
+                        if (!other_path) {
+                                queue_change(self, path, WATCH_REMOVE);
+                                break;
+                        }
+                        /* Directories beneath it are watched once the
+                         * rename is applied */
+                        is_dir = g_file_query_file_type(other, G_FILE_QUERY_INFO_NOFOLLOW_SYMLINKS,
+                                NULL) == G_FILE_TYPE_DIRECTORY;
+                        if (is_dir) {
+                                watch_directory(self, other_path);
+                        }
+                        queue_rename(self, path, other_path, is_dir);
+                        g_free(other_path);
+                        break;
+                default:
+                        break;
+        }
+        g_free(path);
+}
+
+static void watch_batch_free(gpointer data)
+{
+        WatchBatch *batch = data;
+
+        g_hash_table_unref(batch->changes);
+        g_ptr_array_free(batch->renames, TRUE);
+        g_ptr_array_free(batch->new_dirs, TRUE);
+        g_free(batch);
+}
+
+/* Store everything found beneath a new directory */
+static void apply_directory(BudgieLibraryWatcher *self,
+                            WatchBatch *batch,
+                            gchar *path,
+                            GCancellable *cancel)
+{
+        gchar *roots[] = { path, NULL };
+
+        collect_directories(path, batch->new_dirs, cancel);
+        batch->n_updated += budgie_scanner_scan(self->priv->scanner,
+                self->priv->db, roots, cancel);
+}
+
+/**
+ * Move the rows of renamed paths, in the order the renames happened.
+ * Where nothing was stored under the old path, say a download renamed
+ * once complete, the new path is read as if new
+ */
+static void apply_renames(BudgieLibraryWatcher *self,
+                          WatchBatch *batch,
+                          GCancellable *cancel)
+{
+        const gchar *from, *to;
+        gint moved;
+        guint i;
+
+        if (batch->renames->len == 0) {
+                return;
+        }
+        budgie_db_begin_transaction(self->priv->db);
+        for (i = 0; i + 1 < batch->renames->len; i += 2) {
+                from = batch->renames->pdata[i];
+                to = batch->renames->pdata[i + 1];
+                moved = budgie_db_rename_media(self->priv->db, from, to);
+                if (moved > 0) {
+                        batch->n_updated += moved;
+                } else if (!g_hash_table_contains(batch->changes, to)) {
+                        g_hash_table_insert(batch->changes, g_strdup(to),
+                                GINT_TO_POINTER(WATCH_UPDATE));
+                }
+        }
+        budgie_db_end_transaction(self->priv->db);
+
+        /* Whatever is beneath a renamed directory needs watching again */
+        for (i = 1; i < batch->renames->len; i += 2) {
+                to = batch->renames->pdata[i];
+                if (g_file_test(to, G_FILE_TEST_IS_DIR) && !g_file_test(to, G_FILE_TEST_IS_SYMLINK)) {
+                        collect_directories(to, batch->new_dirs, cancel);
+                }
+        }
+}
+
+static void apply_batch(GTask *task,
+                        gpointer source,
+                        gpointer data,
+                        GCancellable *cancel)
+{
+        BudgieLibraryWatcher *self;
+        WatchBatch *batch;
+        GList *paths, *elem;
+        GPtrArray *dirs, *stored, *removals;
+        const gchar *walked = NULL;
+        gchar *path;
+        GFile *file;
+        GFileType type;
+        MediaInfo *media;
+        gint64 generation;
+        gint removed;
+        guint i;
+
+        self = BUDGIE_LIBRARY_WATCHER(source);
+        batch = data;
+
+        apply_renames(self, batch, cancel);
+
+        /* Sorted, so a new directory comes before the events of the
+         * files copied into it, which its walk covers anyway */
+        paths = g_list_sort(g_hash_table_get_keys(batch->changes),
+                (GCompareFunc)strcmp);
+
+        /* Tags are read before the transaction opens, as a helper may
+         * take a while over each file, and the indexer's scan would wait
+         * on our write lock all along */
+        dirs = g_ptr_array_new();
+        stored = g_ptr_array_new_with_free_func(free_media_info);
+        removals = g_ptr_array_new();
+        for (elem = paths; elem; elem = elem->next) {
+                path = elem->data;
+                if (GPOINTER_TO_INT(g_hash_table_lookup(batch->changes, path)) == WATCH_REMOVE) {
+                        g_ptr_array_add(removals, path);
+                        continue;
+                }
+                if (walked && path_within(path, walked)) {
+                        continue;
+                }
+
+                file = g_file_new_for_path(path);
+                type = g_file_query_file_type(file, G_FILE_QUERY_INFO_NOFOLLOW_SYMLINKS, NULL);
+                g_object_unref(file);
+
+                switch (type) {
+                        case G_FILE_TYPE_DIRECTORY:
+                                g_ptr_array_add(dirs, path);
+                                walked = path;
+                                break;
+                        case G_FILE_TYPE_REGULAR:
+                                if (g_cancellable_is_cancelled(cancel)) {
+                                        break;
+                                }
+                                media = budgie_scanner_read_file(self->priv->scanner, path);
+                                if (media) {
+                                        g_ptr_array_add(stored, media);
+                                }
+                                break;
+                        case G_FILE_TYPE_UNKNOWN:
+                                /* Gone again before we got to it */
+                                g_ptr_array_add(removals, path);
+                                break;
+                        default:
+                                break;
+                }
+        }
+
+        if (removals->len > 0 || stored->len > 0) {
+                budgie_db_begin_transaction(self->priv->db);
+                for (i = 0; i < removals->len; i++) {
+                        removed = budgie_db_remove_media(self->priv->db, removals->pdata[i]);
+                        if (removed > 0) {
+                                batch->n_removed += removed;
+                        }
+                }
+                /* Newer than that of any scan already running, which then
+                 * counts these rows as seen */
+                generation = budgie_db_next_generation(self->priv->db);
+                for (i = 0; generation >= 0 && i < stored->len; i++) {
+                        budgie_db_store_media(self->priv->db, stored->pdata[i], generation);
+                        batch->n_updated++;
+                }
+                budgie_db_end_transaction(self->priv->db);
+        }
+        g_ptr_array_free(removals, TRUE);
+        g_ptr_array_free(stored, TRUE);
+
+        /* The scanner commits as it goes, so it runs outside of ours */
+        for (i = 0; i < dirs->len; i++) {
+                apply_directory(self, batch, dirs->pdata[i], cancel);
+        }
+        /* Only the new directories, any other untagged rows are the
+         * indexer's own backfill to read, within its limits */
+        if (dirs->len > 0) {
+                g_ptr_array_add(dirs, NULL);
+                budgie_scanner_backfill_within(self->priv->scanner, self->priv->db,
+                        (gchar**)dirs->pdata, cancel);
+        }
+        g_ptr_array_free(dirs, TRUE);
+        g_list_free(paths);
+
+        g_task_return_boolean(task, TRUE);
+}
+
+static void apply_done(GObject *source, GAsyncResult *result, gpointer userdata)
+{
+        BudgieLibraryWatcher *self;
+        WatchBatch *batch;
+        guint i;
+
+        self = BUDGIE_LIBRARY_WATCHER(source);
+        batch = g_task_get_task_data(G_TASK(result));
+        self->priv->applying = FALSE;
+
+        /* Roots may have changed under us, don't watch stale trees */
+        if (!g_cancellable_is_cancelled(g_task_get_cancellable(G_TASK(result)))) {
+                for (i = 0; i < batch->new_dirs->len; i++) {
+                        watch_directory(self, batch->new_dirs->pdata[i]);
+                }
+        }
+
+        if (batch->n_updated > 0 || batch->n_removed > 0) {
+                g_signal_emit(self, signals[SIGNAL_CHANGED], 0,
+                        batch->n_updated, batch->n_removed);
+        }
+
+        /* Events that arrived while we were busy */
+        if ((g_hash_table_size(self->priv->pending) > 0 || self->priv->renames->len > 0) &&
+            self->priv->debounce_id == 0) {
+                self->priv->debounce_id = g_timeout_add(DEBOUNCE_MSEC, flush_cb, self);
+        }
+}
+
+static gboolean flush_cb(gpointer userdata)
+{
+        BudgieLibraryWatcher *self;
+        WatchBatch *batch;
+        GTask *task;
+        gint64 now, quiet, waited;
+
+        self = BUDGIE_LIBRARY_WATCHER(userdata);
+        self->priv->debounce_id = 0;
+
+        now = g_get_monotonic_time();
+        quiet = (now - self->priv->last_event) / G_TIME_SPAN_MILLISECOND;
+        waited = (now - self->priv->first_event) / G_TIME_SPAN_MILLISECOND;
+        if (quiet < DEBOUNCE_MSEC && waited < MAX_LATENCY_MSEC) {
+                /* Still busy, wait for the burst to settle */
+                self->priv->debounce_id = g_timeout_add(DEBOUNCE_MSEC - quiet,
+                        flush_cb, self);
+                return FALSE;
+        }
+        if (g_hash_table_size(self->priv->pending) == 0 && self->priv->renames->len == 0) {
+                return FALSE;
+        }
+
+        batch = g_new0(WatchBatch, 1);
+        batch->changes = self->priv->pending;
+        batch->renames = self->priv->renames;
+        batch->new_dirs = g_ptr_array_new_with_free_func(g_free);
+        self->priv->pending = g_hash_table_new_full(g_str_hash, g_str_equal,
+                g_free, NULL);
+        self->priv->renames = g_ptr_array_new_with_free_func(g_free);
+        self->priv->first_event = 0;
+        self->priv->applying = TRUE;
+
+        task = g_task_new(self, self->priv->cancel, apply_done, NULL);
+        g_task_set_task_data(task, batch, watch_batch_free);
+        g_task_run_in_thread(task, apply_batch);
+        g_object_unref(task);
+
+        return FALSE;
+}
+
+static void walk_roots(GTask *task,
+                       gpointer source,
+                       gpointer data,
+                       GCancellable *cancel)
+{
+        gchar **roots = data;
+        GPtrArray *dirs;
+        guint i;
+
+        dirs = g_ptr_array_new_with_free_func(g_free);
+        for (i = 0; roots[i]; i++) {
+                collect_directories(roots[i], dirs, cancel);
+        }
+        g_task_return_pointer(task, dirs, (GDestroyNotify)g_ptr_array_unref);
+}
+
+static void walk_roots_done(GObject *source, GAsyncResult *result, gpointer userdata)
+{
+        BudgieLibraryWatcher *self;
+        GPtrArray *dirs;
+        guint i;
+
+        self = BUDGIE_LIBRARY_WATCHER(source);
+        if (g_cancellable_is_cancelled(g_task_get_cancellable(G_TASK(result)))) {
+                return;
+        }
+        dirs = g_task_propagate_pointer(G_TASK(result), NULL);
+        for (i = 0; i < dirs->len; i++) {
+                watch_directory(self, dirs->pdata[i]);
+        }
+        g_print("Watching %u directories for changes\n",
+                g_hash_table_size(self->priv->monitors));
+        g_ptr_array_unref(dirs);
+}
+
+void budgie_library_watcher_set_roots(BudgieLibraryWatcher *self, gchar **roots)
+{
+        GTask *task;
+
+        g_return_if_fail(IS_BUDGIE_LIBRARY_WATCHER(self));
+
+        /* Forget the old trees, and any walk still in flight */
+        if (self->priv->cancel) {
+                g_cancellable_cancel(self->priv->cancel);
+                g_object_unref(self->priv->cancel);
+        }
+        self->priv->cancel = g_cancellable_new();
+        g_hash_table_remove_all(self->priv->monitors);
+        self->priv->exhausted = FALSE;
+
+        if (self->priv->roots) {
+                g_strfreev(self->priv->roots);
+        }
+        self->priv->roots = g_strdupv(roots);
+        if (!roots || !roots[0]) {
+                return;
+        }
+
+        /* Walking a large library takes a while, keep it off the main loop */
+        task = g_task_new(self, self->priv->cancel, walk_roots_done, NULL);
+        g_task_set_task_data(task, g_strdupv(roots), (GDestroyNotify)g_strfreev);
+        g_task_run_in_thread(task, walk_roots);
+        g_object_unref(task);
+}
@@ -0,0 +1,76 @@
+/*
+ * budgie-library-watcher.h
+ *
+ * Copyright 2013 Ikey Doherty <ikey.doherty@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ *
+ *
+ */
+#ifndef budgie_library_watcher_h
+#define budgie_library_watcher_h
+
+#include <glib-object.h>
+
+typedef struct _BudgieLibraryWatcher BudgieLibraryWatcher;
+typedef struct _BudgieLibraryWatcherClass   BudgieLibraryWatcherClass;
+typedef struct _BudgieLibraryWatcherPrivate BudgieLibraryWatcherPrivate;
+
+#define BUDGIE_LIBRARY_WATCHER_TYPE (budgie_library_watcher_get_type())
+#define BUDGIE_LIBRARY_WATCHER(obj)                  (G_TYPE_CHECK_INSTANCE_CAST ((obj), BUDGIE_LIBRARY_WATCHER_TYPE, BudgieLibraryWatcher))
+#define IS_BUDGIE_LIBRARY_WATCHER(obj)               (G_TYPE_CHECK_INSTANCE_TYPE ((obj), BUDGIE_LIBRARY_WATCHER_TYPE))
+#define BUDGIE_LIBRARY_WATCHER_CLASS(klass)          (G_TYPE_CHECK_CLASS_CAST ((klass), BUDGIE_LIBRARY_WATCHER_TYPE, BudgieLibraryWatcherClass))
+#define IS_BUDGIE_LIBRARY_WATCHER_CLASS(klass)       (G_TYPE_CHECK_CLASS_TYPE ((klass), BUDGIE_LIBRARY_WATCHER_TYPE))
+#define BUDGIE_LIBRARY_WATCHER_GET_CLASS(obj)        (G_TYPE_INSTANCE_GET_CLASS ((obj), BUDGIE_LIBRARY_WATCHER_TYPE, BudgieLibraryWatcherClass))
+
+/* BudgieLibraryWatcher object */
+struct _BudgieLibraryWatcher {
+        GObject parent;
+
+        BudgieLibraryWatcherPrivate *priv;
+};
+
+/* BudgieLibraryWatcher class definition */
+struct _BudgieLibraryWatcherClass {
+        GObjectClass parent_class;
+};
+
+GType budgie_library_watcher_get_type(void);
+
+/* BudgieLibraryWatcher methods */
+
+/**
+ * Construct a new BudgieLibraryWatcher
+ *
+ * The watcher writes through its own database connection. Once a batch
+ * of changes has been stored it emits "changed", with the number of
+ * rows updated and removed.
+ * @return A new BudgieLibraryWatcher
+ */
+BudgieLibraryWatcher* budgie_library_watcher_new(void);
+
+/**
+ * Watch the given directory trees for changes
+ *
+ * Any previously watched trees are dropped. Bursts of events are
+ * collected and applied together once the trees have been quiet for a
+ * moment, touching only the affected rows.
+ * @param self BudgieLibraryWatcher instance
+ * @param roots NULL terminated list of directories to watch
+ */
+void budgie_library_watcher_set_roots(BudgieLibraryWatcher *self, gchar **roots);
+
+#endif /* budgie_library_watcher_h */
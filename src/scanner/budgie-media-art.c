@@ -0,0 +1,321 @@
+/*
+ * budgie-media-art.c
+ *
+ * Copyright 2013 Ikey Doherty <ikey.doherty@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ *
+ *
+ */
+#include <glib/gstdio.h>
+#include <string.h>
+
+#include "budgie-media-art.h"
+
+/* Largest folder image we take, anything bigger is not a cover */
+#define FOLDER_IMAGE_MAX (16 * 1024 * 1024)
+
+/* Names of folder images, most telling first */
+static const gchar *folder_names[] = {
+        "cover", "folder", "front", "album", "albumart",
+};
+
+gboolean
+strip_find_next_block (const gchar    *original,
+                       const gunichar  open_char,
+                       const gunichar  close_char,
+                       gint           *open_pos,
+                       gint           *close_pos)
+{
+        const gchar *p1, *p2;
+
+        if (open_pos) {
+                *open_pos = -1;
+        }
+
+        if (close_pos) {
+                *close_pos = -1;
+        }
+
+        p1 = g_utf8_strchr (original, -1, open_char);
+        if (p1) {
+                if (open_pos) {
+                        *open_pos = p1 - original;
+                }
+
+                p2 = g_utf8_strchr (g_utf8_next_char (p1), -1, close_char);
+                if (p2) {
+                        if (close_pos) {
+                                *close_pos = p2 - original;
+                        }
+                        
+                        return TRUE;
+                }
+        }
+
+        return FALSE;
+}
+
+gchar *
+albumart_strip_invalid_entities (const gchar *original)
+{
+        GString         *str_no_blocks;
+        gchar          **strv;
+        gchar           *str;
+        gboolean         blocks_done = FALSE;
+        const gchar     *p;
+        const gchar     *invalid_chars = "()[]<>{}_!@#$^&*+=|\\/\"'?~";
+        const gchar     *invalid_chars_delimiter = "*";
+        const gchar     *convert_chars = "\t";
+        const gchar     *convert_chars_delimiter = " ";
+        const gunichar   blocks[5][2] = {
+                { '(', ')' },
+                { '{', '}' }, 
+                { '[', ']' }, 
+                { '<', '>' }, 
+                {  0,   0  }
+        };
+
+        str_no_blocks = g_string_new ("");
+
+        p = original;
+
+        while (!blocks_done) {
+                gint pos1, pos2, i;
+
+                pos1 = -1;
+                pos2 = -1;
+        
+                for (i = 0; blocks[i][0] != 0; i++) {
+                        gint start, end;
+                        
+                        /* Go through blocks, find the earliest block we can */
+                        if (strip_find_next_block (p, blocks[i][0], blocks[i][1], &start, &end)) {
+                                if (pos1 == -1 || start < pos1) {
+                                        pos1 = start;
+                                        pos2 = end;
+                                }
+                        }
+                }
+                
+                /* If either are -1 we didn't find any */
+                if (pos1 == -1) {
+                        /* This means no blocks were found */
+                        g_string_append (str_no_blocks, p);
+                        blocks_done = TRUE;
+                } else {
+                        /* Append the test BEFORE the block */
+                        if (pos1 > 0) {
+                                g_string_append_len (str_no_blocks, p, pos1);
+                        }
+
+                        p = g_utf8_next_char (p + pos2);
+
+                        /* Do same again for position AFTER block */
+                        if (*p == '\0') {
+                                blocks_done = TRUE;
+                        }
+                }       
+        }
+
+        str = g_string_free (str_no_blocks, FALSE);
+
+        /* Now strip invalid chars */
+        g_strdelimit (str, invalid_chars, *invalid_chars_delimiter);
+        strv = g_strsplit (str, invalid_chars_delimiter, -1);
+        g_free (str);
+        str = g_strjoinv (NULL, strv);
+        g_strfreev (strv);
+
+        /* Now convert chars */
+        g_strdelimit (str, convert_chars, *convert_chars_delimiter);
+        strv = g_strsplit (str, convert_chars_delimiter, -1);
+        g_free (str);
+        str = g_strjoinv (convert_chars_delimiter, strv);
+        g_strfreev (strv);
+
+        /* Now remove double spaces */
+        strv = g_strsplit (str, "  ", -1);
+        g_free (str);
+        str = g_strjoinv (" ", strv);
+        g_strfreev (strv);
+        
+        /* Now strip leading/trailing white space */
+        g_strstrip (str);
+
+        return str;
+}
+
+gchar *cleaned_string(gchar *string)
+{
+        gchar *stripped, *normalized, *lower;
+
+        stripped = albumart_strip_invalid_entities(string);
+        normalized = g_utf8_normalize(stripped, -1, G_NORMALIZE_ALL);
+        g_free(stripped);
+        lower = g_utf8_strdown(normalized, -1);
+        g_free(normalized);
+
+        return lower;
+}
+
+gchar *albumart_name_for_media(MediaInfo *info, gchar *extension)
+{
+        if (!info->album || ! info->artist) {
+                return NULL;
+        }
+
+        char *album = cleaned_string(info->album);
+        gchar *artist = cleaned_string(info->artist);
+        gchar *artist_md5, *album_md5;
+        gchar *album_string = NULL;
+
+        artist_md5 = g_compute_checksum_for_string(G_CHECKSUM_MD5, artist, -1);
+        album_md5 = g_compute_checksum_for_string(G_CHECKSUM_MD5, album, -1);
+
+        album_string = g_strdup_printf("album-%s-%s.%s", artist_md5,
+                album_md5, extension);
+
+        g_free(artist_md5);
+        g_free(artist);
+        g_free(album_md5);
+        g_free(album);
+
+        return album_string;
+}
+
+gchar *budgie_media_art_path(MediaInfo *info, const gchar *extension)
+{
+        gchar *name, *ret;
+
+        name = albumart_name_for_media(info, (gchar*)extension);
+        if (!name) {
+                return NULL;
+        }
+        ret = g_build_filename(g_get_user_cache_dir(), BUDGIE_MEDIA_ART_DIR, name, NULL);
+        g_free(name);
+        return ret;
+}
+
+gboolean budgie_media_art_exists(MediaInfo *info)
+{
+        static const gchar *extensions[] = { "png", "jpeg" };
+        gchar *path;
+        gboolean ret = FALSE;
+        guint i;
+
+        for (i = 0; i < G_N_ELEMENTS(extensions) && !ret; i++) {
+                path = budgie_media_art_path(info, extensions[i]);
+                ret = path && g_file_test(path, G_FILE_TEST_EXISTS);
+                g_free(path);
+        }
+        return ret;
+}
+
+/**
+ * Rank of a file name as a folder image, lower being better
+ * @return the rank, or -1 if it is not one
+ */
+static gint folder_image_rank(const gchar *name)
+{
+        const gchar *dot;
+        gsize len;
+        guint i;
+
+        dot = strrchr(name, '.');
+        if (!dot || (g_ascii_strcasecmp(dot, ".jpg") != 0 &&
+            g_ascii_strcasecmp(dot, ".jpeg") != 0 && g_ascii_strcasecmp(dot, ".png") != 0)) {
+                return -1;
+        }
+        len = dot - name;
+        for (i = 0; i < G_N_ELEMENTS(folder_names); i++) {
+                if (strlen(folder_names[i]) == len &&
+                    g_ascii_strncasecmp(name, folder_names[i], len) == 0) {
+                        return (gint)i;
+                }
+        }
+        return -1;
+}
+
+GBytes *budgie_media_art_from_folder(const gchar *dir)
+{
+        GDir *listing;
+        GStatBuf st;
+        const gchar *name;
+        gchar *best = NULL, *path, *contents;
+        gint rank, best_rank = -1;
+        gsize len;
+
+        /* Listed rather than probed, as the case of the names varies */
+        listing = g_dir_open(dir, 0, NULL);
+        if (!listing) {
+                return NULL;
+        }
+        while ((name = g_dir_read_name(listing)) != NULL) {
+                rank = folder_image_rank(name);
+                if (rank < 0 || (best && rank >= best_rank)) {
+                        continue;
+                }
+                g_free(best);
+                best = g_strdup(name);
+                best_rank = rank;
+        }
+        g_dir_close(listing);
+        if (!best) {
+                return NULL;
+        }
+
+        path = g_build_filename(dir, best, NULL);
+        g_free(best);
+        if (g_stat(path, &st) != 0 || st.st_size > FOLDER_IMAGE_MAX ||
+            !g_file_get_contents(path, &contents, &len, NULL)) {
+                g_free(path);
+                return NULL;
+        }
+        g_free(path);
+        return g_bytes_new_take(contents, len);
+}
+
+gboolean budgie_media_art_store(MediaInfo *info, GBytes *image)
+{
+        const guint8 *data;
+        const gchar *extension;
+        gchar *path, *dir;
+        gsize len;
+        gboolean ret;
+
+        data = g_bytes_get_data(image, &len);
+        if (len >= 3 && memcmp(data, "\xff\xd8\xff", 3) == 0) {
+                extension = "jpeg";
+        } else if (len >= 8 && memcmp(data, "\x89PNG\r\n\x1a\n", 8) == 0) {
+                extension = "png";
+        } else {
+                return FALSE;
+        }
+
+        path = budgie_media_art_path(info, extension);
+        if (!path) {
+                return FALSE;
+        }
+        dir = g_path_get_dirname(path);
+        /* Written to a temporary file and renamed, so a reader never
+         * sees half an image */
+        ret = g_mkdir_with_parents(dir, 0755) == 0 &&
+                g_file_set_contents(path, (const gchar*)data, len, NULL);
+        g_free(dir);
+        g_free(path);
+        return ret;
+}
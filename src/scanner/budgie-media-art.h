@@ -0,0 +1,96 @@
+/*
+ * budgie-media-art.h
+ *
+ * Copyright 2013 Ikey Doherty <ikey.doherty@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ *
+ *
+ */
+#ifndef budgie_media_art_h
+#define budgie_media_art_h
+
+#include <glib.h>
+
+#include "db/budgie-db.h"
+
+/* Where album art lives, beneath the user cache directory */
+#define BUDGIE_MEDIA_ART_DIR "media-art"
+
+/**
+ * Get the albumart name for the given MediaInfo
+ * Note this is deliberately designed to adhere to the spec put forth
+ * by GNOME: https://wiki.gnome.org/MediaArtStorageSpec
+ *
+ * @param info MediaInfo to query
+ * @param extension "jpeg" or "png", JPEG being more common
+ * @return The albumart (allocated), or NULL
+ */
+gchar *albumart_name_for_media(MediaInfo *info, gchar *extension);
+
+/**
+ * Following are taken from GNOME Wiki/Tracker code to ensure we stay
+ * compatible in our mediaart spec
+ */
+gboolean
+strip_find_next_block (const gchar    *original,
+                       const gunichar  open_char,
+                       const gunichar  close_char,
+                       gint           *open_pos,
+                       gint           *close_pos);
+
+gchar *
+albumart_strip_invalid_entities (const gchar *original);
+
+/**
+ * Utility of mine to clean the album string before processing
+ */
+gchar *cleaned_string(gchar *string);
+
+/**
+ * Full path of the cached art for the album of a track
+ *
+ * @param info MediaInfo of any track of the album
+ * @param extension "jpeg" or "png"
+ * @return The path (allocated), or NULL if the album can't be named
+ */
+gchar *budgie_media_art_path(MediaInfo *info, const gchar *extension);
+
+/**
+ * Whether art for the album of a track is cached, in either format
+ * @param info MediaInfo of any track of the album
+ * @return TRUE if there is nothing left to extract
+ */
+gboolean budgie_media_art_exists(MediaInfo *info);
+
+/**
+ * Find the cover image kept alongside an album, such as cover.jpg or
+ * Folder.png, preferring the more telling names
+ * @param dir Directory holding the album's tracks
+ * @return the contents of the image, or NULL if there is none
+ */
+GBytes *budgie_media_art_from_folder(const gchar *dir);
+
+/**
+ * Store the art of an album in the cache, as is. Only JPEG and PNG are
+ * accepted, those being the formats the spec names files for
+ * @param info MediaInfo of any track of the album
+ * @param image Contents of the image
+ * @return a boolean value, indicating success of the operation
+ */
+gboolean budgie_media_art_store(MediaInfo *info, GBytes *image);
+
+#endif /* budgie_media_art_h */
@@ -0,0 +1,117 @@
+/*
+ * budgie-queue.c
+ *
+ * Copyright 2013 Ikey Doherty <ikey.doherty@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ *
+ *
+ */
+#include "budgie-queue.h"
+
+struct BudgieQueue {
+        GMutex lock;
+        GCond not_empty;
+        GCond not_full;
+        GQueue items;
+        guint capacity;
+        gboolean closed;
+};
+
+BudgieQueue* budgie_queue_new(guint capacity)
+{
+        BudgieQueue *queue;
+
+        queue = g_new0(BudgieQueue, 1);
+        g_mutex_init(&queue->lock);
+        g_cond_init(&queue->not_empty);
+        g_cond_init(&queue->not_full);
+        g_queue_init(&queue->items);
+        queue->capacity = MAX(capacity, 1);
+
+        return queue;
+}
+
+void budgie_queue_free(BudgieQueue *queue)
+{
+        g_warn_if_fail(g_queue_is_empty(&queue->items));
+
+        g_queue_clear(&queue->items);
+        g_cond_clear(&queue->not_full);
+        g_cond_clear(&queue->not_empty);
+        g_mutex_clear(&queue->lock);
+        g_free(queue);
+}
+
+gboolean budgie_queue_push(BudgieQueue *queue, gpointer item)
+{
+        g_return_val_if_fail(item != NULL, FALSE);
+
+        g_mutex_lock(&queue->lock);
+        while (!queue->closed && queue->items.length >= queue->capacity) {
+                g_cond_wait(&queue->not_full, &queue->lock);
+        }
+        if (queue->closed) {
+                g_mutex_unlock(&queue->lock);
+                return FALSE;
+        }
+        g_queue_push_tail(&queue->items, item);
+        g_cond_signal(&queue->not_empty);
+        g_mutex_unlock(&queue->lock);
+
+        return TRUE;
+}
+
+gpointer budgie_queue_pop(BudgieQueue *queue, gint64 end_time)
+{
+        gpointer item;
+
+        g_mutex_lock(&queue->lock);
+        while (!queue->closed && g_queue_is_empty(&queue->items)) {
+                if (end_time < 0) {
+                        g_cond_wait(&queue->not_empty, &queue->lock);
+                } else if (!g_cond_wait_until(&queue->not_empty, &queue->lock, end_time)) {
+                        break;
+                }
+        }
+        item = g_queue_pop_head(&queue->items);
+        if (item) {
+                g_cond_signal(&queue->not_full);
+        }
+        g_mutex_unlock(&queue->lock);
+
+        return item;
+}
+
+void budgie_queue_close(BudgieQueue *queue)
+{
+        g_mutex_lock(&queue->lock);
+        queue->closed = TRUE;
+        g_cond_broadcast(&queue->not_empty);
+        g_cond_broadcast(&queue->not_full);
+        g_mutex_unlock(&queue->lock);
+}
+
+gboolean budgie_queue_is_drained(BudgieQueue *queue)
+{
+        gboolean ret;
+
+        g_mutex_lock(&queue->lock);
+        ret = queue->closed && g_queue_is_empty(&queue->items);
+        g_mutex_unlock(&queue->lock);
+
+        return ret;
+}
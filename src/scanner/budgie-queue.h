@@ -0,0 +1,77 @@
+/*
+ * budgie-queue.h
+ *
+ * Copyright 2013 Ikey Doherty <ikey.doherty@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ *
+ *
+ */
+#ifndef budgie_queue_h
+#define budgie_queue_h
+
+#include <glib.h>
+
+/**
+ * A thread-safe FIFO with a fixed capacity. Producers block while it is
+ * full, which is what keeps the memory use of a scan flat.
+ */
+typedef struct BudgieQueue BudgieQueue;
+
+/**
+ * Construct a new BudgieQueue
+ * @param capacity Maximum number of items held at once
+ * @return A new BudgieQueue
+ */
+BudgieQueue* budgie_queue_new(guint capacity);
+
+/**
+ * Free a BudgieQueue. It must be empty, and no thread may be using it
+ * @param queue BudgieQueue instance
+ */
+void budgie_queue_free(BudgieQueue *queue);
+
+/**
+ * Append an item, waiting for room if the queue is full
+ * @param queue BudgieQueue instance
+ * @param item Item to append, which must not be NULL
+ * @return FALSE if the queue was closed, and the item not taken
+ */
+gboolean budgie_queue_push(BudgieQueue *queue, gpointer item);
+
+/**
+ * Take the oldest item, waiting for one if the queue is empty
+ * @param queue BudgieQueue instance
+ * @param end_time Monotonic time to give up at, or -1 to wait until closed
+ * @return the item, or NULL on timeout or once the queue is drained
+ */
+gpointer budgie_queue_pop(BudgieQueue *queue, gint64 end_time);
+
+/**
+ * Close the queue. Pending items can still be popped, new ones are
+ * refused and waiting consumers are woken once it runs empty
+ * @param queue BudgieQueue instance
+ */
+void budgie_queue_close(BudgieQueue *queue);
+
+/**
+ * Whether the queue has been closed and emptied
+ * @param queue BudgieQueue instance
+ * @return a boolean value, TRUE when nothing more will arrive
+ */
+gboolean budgie_queue_is_drained(BudgieQueue *queue);
+
+#endif /* budgie_queue_h */
@@ -0,0 +1,247 @@
+/*
+ * budgie-scan-stats.c
+ *
+ * Copyright 2013 Ikey Doherty <ikey.doherty@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ *
+ *
+ */
+#define _GNU_SOURCE
+#include <string.h>
+#include <sys/resource.h>
+
+#include "budgie-scan-stats.h"
+
+/* ru_inblock counts in units of 512 bytes */
+#define INBLOCK_SIZE 512
+
+#define LOAD(counter) atomic_load_explicit(&(counter), memory_order_relaxed)
+
+void budgie_scan_stats_reset(BudgieScanStats *stats, ScanPhase phase)
+{
+        guint i;
+
+        atomic_store(&stats->n_dirs, 0);
+        atomic_store(&stats->n_skipped, 0);
+        atomic_store(&stats->n_ignored, 0);
+        atomic_store(&stats->n_files, 0);
+        atomic_store(&stats->n_media, 0);
+        atomic_store(&stats->n_unchanged, 0);
+        atomic_store(&stats->n_aliases, 0);
+        atomic_store(&stats->n_moved, 0);
+        atomic_store(&stats->n_pruned, 0);
+        atomic_store(&stats->n_stored, 0);
+        atomic_store(&stats->n_tagged, 0);
+        atomic_store(&stats->n_native, 0);
+        atomic_store(&stats->n_batched, 0);
+        atomic_store(&stats->n_art, 0);
+        atomic_store(&stats->bytes_read, 0);
+        for (i = 0; i < SCAN_HISTOGRAM_BUCKETS; i++) {
+                atomic_store(&stats->parse.buckets[i], 0);
+                atomic_store(&stats->commit.buckets[i], 0);
+        }
+        atomic_store(&stats->parse.count, 0);
+        atomic_store(&stats->parse.total_usec, 0);
+        atomic_store(&stats->parse.max_usec, 0);
+        atomic_store(&stats->commit.count, 0);
+        atomic_store(&stats->commit.total_usec, 0);
+        atomic_store(&stats->commit.max_usec, 0);
+
+        stats->phase = phase;
+        stats->start = g_get_monotonic_time();
+}
+
+/**
+ * Shared by both histograms, which only differ in their field
+ */
+#define HISTOGRAM_ADD(hist, usec) do { \
+        guint64 sample = MAX((usec), 0); \
+        guint64 seen; \
+        guint bucket = sample > 1 ? g_bit_storage(sample) - 1 : 0; \
+        SCAN_STAT_ADD((hist).buckets[MIN(bucket, SCAN_HISTOGRAM_BUCKETS - 1)], 1); \
+        SCAN_STAT_ADD((hist).count, 1); \
+        SCAN_STAT_ADD((hist).total_usec, sample); \
+        seen = LOAD((hist).max_usec); \
+        while (sample > seen && !atomic_compare_exchange_weak(&(hist).max_usec, \
+                &seen, sample)) \
+                ; \
+} while (0)
+
+void budgie_scan_stats_add_parse(BudgieScanStats *stats, gint64 usec)
+{
+        HISTOGRAM_ADD(stats->parse, usec);
+}
+
+void budgie_scan_stats_add_commit(BudgieScanStats *stats, gint64 usec)
+{
+        HISTOGRAM_ADD(stats->commit, usec);
+}
+
+guint64 budgie_scan_stats_thread_io(void)
+{
+#ifdef RUSAGE_THREAD
+        struct rusage usage;
+
+        if (getrusage(RUSAGE_THREAD, &usage) == 0) {
+                return (guint64)usage.ru_inblock * INBLOCK_SIZE;
+        }
+#endif
+        return 0;
+}
+
+void budgie_scan_stats_add_thread_io(BudgieScanStats *stats, guint64 start)
+{
+        guint64 now = budgie_scan_stats_thread_io();
+
+        if (now > start) {
+                SCAN_STAT_ADD(stats->bytes_read, now - start);
+        }
+}
+
+#define HISTOGRAM_COPY(dest, hist) do { \
+        guint _i; \
+        for (_i = 0; _i < SCAN_HISTOGRAM_BUCKETS; _i++) { \
+                (dest).buckets[_i] = LOAD((hist).buckets[_i]); \
+        } \
+        (dest).count = LOAD((hist).count); \
+        (dest).total_usec = LOAD((hist).total_usec); \
+        (dest).max_usec = LOAD((hist).max_usec); \
+} while (0)
+
+void budgie_scan_stats_snapshot(BudgieScanStats *stats,
+                                BudgieScanProgress *progress)
+{
+        memset(progress, 0, sizeof(BudgieScanProgress));
+        progress->phase = stats->phase;
+        progress->elapsed_usec = g_get_monotonic_time() - stats->start;
+        progress->n_dirs = LOAD(stats->n_dirs);
+        progress->n_skipped = LOAD(stats->n_skipped);
+        progress->n_ignored = LOAD(stats->n_ignored);
+        progress->n_files = LOAD(stats->n_files);
+        progress->n_media = LOAD(stats->n_media);
+        progress->n_unchanged = LOAD(stats->n_unchanged);
+        progress->n_aliases = LOAD(stats->n_aliases);
+        progress->n_moved = LOAD(stats->n_moved);
+        progress->n_pruned = LOAD(stats->n_pruned);
+        progress->n_stored = LOAD(stats->n_stored);
+        progress->n_tagged = LOAD(stats->n_tagged);
+        progress->n_native = LOAD(stats->n_native);
+        progress->n_batched = LOAD(stats->n_batched);
+        progress->n_art = LOAD(stats->n_art);
+        progress->bytes_read = LOAD(stats->bytes_read);
+        HISTOGRAM_COPY(progress->parse, stats->parse);
+        HISTOGRAM_COPY(progress->commit, stats->commit);
+}
+
+/**
+ * Human readable duration, written to a buffer of the caller
+ */
+static const gchar *format_usec(gchar *buf, gsize len, guint64 usec)
+{
+        if (usec < 1000) {
+                g_snprintf(buf, len, "%uus", (guint)usec);
+        } else if (usec < G_USEC_PER_SEC) {
+                g_snprintf(buf, len, "%.1fms", usec / 1000.0);
+        } else {
+                g_snprintf(buf, len, "%.2fs", (gdouble)usec / G_USEC_PER_SEC);
+        }
+        return buf;
+}
+
+/**
+ * Upper bound of the bucket holding the given fraction of samples
+ */
+static guint64 histogram_percentile(const ScanHistogram *hist, gdouble fraction)
+{
+        guint64 want, seen = 0;
+        guint i;
+
+        want = (guint64)(hist->count * fraction);
+        for (i = 0; i < SCAN_HISTOGRAM_BUCKETS - 1; i++) {
+                seen += hist->buckets[i];
+                if (seen > want) {
+                        return (guint64)1 << (i + 1);
+                }
+        }
+        return hist->max_usec;
+}
+
+static void histogram_dump(const gchar *name, const ScanHistogram *hist)
+{
+        gchar a[16], b[16], c[16], d[16];
+        guint i;
+
+        if (hist->count == 0) {
+                return;
+        }
+        g_print("  %s: %" G_GUINT64_FORMAT " samples, mean %s, p50 < %s, p99 < %s, max %s\n",
+                name, hist->count,
+                format_usec(a, sizeof(a), hist->total_usec / hist->count),
+                format_usec(b, sizeof(b), histogram_percentile(hist, 0.5)),
+                format_usec(c, sizeof(c), histogram_percentile(hist, 0.99)),
+                format_usec(d, sizeof(d), hist->max_usec));
+        for (i = 0; i < SCAN_HISTOGRAM_BUCKETS; i++) {
+                if (hist->buckets[i] == 0) {
+                        continue;
+                }
+                if (i == SCAN_HISTOGRAM_BUCKETS - 1) {
+                        g_print("    >= %-8s %10" G_GUINT64_FORMAT "\n",
+                                format_usec(a, sizeof(a), (guint64)1 << i),
+                                hist->buckets[i]);
+                        continue;
+                }
+                g_print("    < %-9s %10" G_GUINT64_FORMAT "\n",
+                        format_usec(a, sizeof(a), (guint64)1 << (i + 1)),
+                        hist->buckets[i]);
+        }
+}
+
+void budgie_scan_progress_dump(const BudgieScanProgress *progress)
+{
+        gchar *read;
+        gdouble secs;
+
+        secs = MAX(progress->elapsed_usec, 1) / (gdouble)G_USEC_PER_SEC;
+        read = g_format_size(progress->bytes_read);
+
+        switch (progress->phase) {
+                case SCAN_PHASE_WALK:
+                        g_print("Walk: %" G_GUINT64_FORMAT " directories (%" G_GUINT64_FORMAT
+                                " unchanged), %" G_GUINT64_FORMAT " entries ignored, %" G_GUINT64_FORMAT
+                                " files classified (%.0f/s), %" G_GUINT64_FORMAT " new or changed, %"
+                                G_GUINT64_FORMAT " unchanged, %" G_GUINT64_FORMAT " stored, %"
+                                G_GUINT64_FORMAT " aliases, %" G_GUINT64_FORMAT " moved, %"
+                                G_GUINT64_FORMAT " pruned, %s read in %.2fs\n",
+                                progress->n_dirs, progress->n_skipped, progress->n_ignored,
+                                progress->n_files,
+                                progress->n_files / secs,
+                                progress->n_media, progress->n_unchanged, progress->n_stored,
+                                progress->n_aliases, progress->n_moved, progress->n_pruned, read, secs);
+                        break;
+                case SCAN_PHASE_TAGS:
+                        g_print("Tags: %" G_GUINT64_FORMAT " files read (%.0f/s), %" G_GUINT64_FORMAT
+                                " without TagLib, %" G_GUINT64_FORMAT " read ahead through io_uring, %"
+                                G_GUINT64_FORMAT " album covers, %s read in %.2fs\n",
+                                progress->n_tagged, progress->n_tagged / secs,
+                                progress->n_native, progress->n_batched, progress->n_art, read, secs);
+                        break;
+        }
+        histogram_dump("Tag parse", &progress->parse);
+        histogram_dump("DB commit", &progress->commit);
+
+        g_free(read);
+}
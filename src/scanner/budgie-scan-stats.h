@@ -0,0 +1,162 @@
+/*
+ * budgie-scan-stats.h
+ *
+ * Copyright 2013 Ikey Doherty <ikey.doherty@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ *
+ *
+ */
+#ifndef budgie_scan_stats_h
+#define budgie_scan_stats_h
+
+#include <glib.h>
+#include <stdatomic.h>
+
+/* Histogram bucket i counts samples of 2^i to 2^(i+1) microseconds, the
+ * last one everything from half a second up */
+#define SCAN_HISTOGRAM_BUCKETS 20
+
+/**
+ * Which phase of a scan a BudgieScanProgress describes
+ */
+typedef enum {
+        SCAN_PHASE_WALK = 0, /**<Listing directories, storing files by name */
+        SCAN_PHASE_TAGS, /**<Reading the tags of stored files */
+} ScanPhase;
+
+/**
+ * Distribution of how long one kind of operation took
+ */
+typedef struct ScanHistogram {
+        guint64 buckets[SCAN_HISTOGRAM_BUCKETS];
+        guint64 count; /**<Number of samples */
+        guint64 total_usec; /**<Sum of all samples */
+        guint64 max_usec; /**<Longest sample */
+} ScanHistogram;
+
+/**
+ * A consistent copy of the scan counters, as handed to the UI
+ */
+typedef struct BudgieScanProgress {
+        ScanPhase phase;
+        gint64 elapsed_usec; /**<Time since the phase started */
+        guint64 n_dirs; /**<Directories listed or skipped */
+        guint64 n_skipped; /**<Of those, skipped as unchanged */
+        guint64 n_ignored; /**<Entries skipped by ignore patterns or a .nomedia marker */
+        guint64 n_files; /**<Regular files classified */
+        guint64 n_media; /**<New or changed media files found */
+        guint64 n_unchanged; /**<Media files skipped as unchanged */
+        guint64 n_aliases; /**<Links to media stored under another path */
+        guint64 n_moved; /**<Rows handed to a file found under a new name */
+        guint64 n_pruned; /**<Rows dropped as their file was not found again */
+        guint64 n_stored; /**<Rows written */
+        guint64 n_tagged; /**<Files whose tags were read */
+        guint64 n_native; /**<Of those, read without TagLib */
+        guint64 n_batched; /**<Of those, opened and read ahead through io_uring */
+        guint64 n_art; /**<Album covers added to the media-art cache */
+        guint64 bytes_read; /**<Read from storage, page cache hits excluded */
+        ScanHistogram parse; /**<Time spent reading the tags of each file */
+        ScanHistogram commit; /**<Latency of each database commit */
+} BudgieScanProgress;
+
+/**
+ * Counters shared by all threads of a scan. Each is updated on its own,
+ * without locks, so a snapshot may be a few operations out of step
+ * between fields but never tears a single one.
+ */
+typedef struct BudgieScanStats {
+        ScanPhase phase;
+        gint64 start;
+        atomic_uint_fast64_t n_dirs;
+        atomic_uint_fast64_t n_skipped;
+        atomic_uint_fast64_t n_ignored;
+        atomic_uint_fast64_t n_files;
+        atomic_uint_fast64_t n_media;
+        atomic_uint_fast64_t n_unchanged;
+        atomic_uint_fast64_t n_aliases;
+        atomic_uint_fast64_t n_moved;
+        atomic_uint_fast64_t n_pruned;
+        atomic_uint_fast64_t n_stored;
+        atomic_uint_fast64_t n_tagged;
+        atomic_uint_fast64_t n_native;
+        atomic_uint_fast64_t n_batched;
+        atomic_uint_fast64_t n_art;
+        atomic_uint_fast64_t bytes_read;
+        struct {
+                atomic_uint_fast64_t buckets[SCAN_HISTOGRAM_BUCKETS];
+                atomic_uint_fast64_t count;
+                atomic_uint_fast64_t total_usec;
+                atomic_uint_fast64_t max_usec;
+        } parse, commit;
+} BudgieScanStats;
+
+/**
+ * Bump a counter of a BudgieScanStats
+ */
+#define SCAN_STAT_ADD(counter, n) \
+        atomic_fetch_add_explicit(&(counter), (n), memory_order_relaxed)
+
+/**
+ * Zero all counters and start the clock on a new phase
+ * @param stats BudgieScanStats instance
+ * @param phase Phase being started
+ */
+void budgie_scan_stats_reset(BudgieScanStats *stats, ScanPhase phase);
+
+/**
+ * Record how long reading the tags of one file took
+ * @param stats BudgieScanStats instance
+ * @param usec Duration in microseconds
+ */
+void budgie_scan_stats_add_parse(BudgieScanStats *stats, gint64 usec);
+
+/**
+ * Record how long one database commit took
+ * @param stats BudgieScanStats instance
+ * @param usec Duration in microseconds
+ */
+void budgie_scan_stats_add_commit(BudgieScanStats *stats, gint64 usec);
+
+/**
+ * Sample the storage reads of the calling thread so far, for
+ * budgie_scan_stats_add_thread_io
+ * @return bytes read by this thread, 0 where unsupported
+ */
+guint64 budgie_scan_stats_thread_io(void);
+
+/**
+ * Account the storage reads of the calling thread since start
+ * @param stats BudgieScanStats instance
+ * @param start Reading taken by budgie_scan_stats_thread_io earlier
+ */
+void budgie_scan_stats_add_thread_io(BudgieScanStats *stats, guint64 start);
+
+/**
+ * Copy out the current counters
+ * @param stats BudgieScanStats instance
+ * @param progress Where to store the copy
+ */
+void budgie_scan_stats_snapshot(BudgieScanStats *stats,
+                                BudgieScanProgress *progress);
+
+/**
+ * Print a summary of a finished phase
+ * @param progress Snapshot taken at the end of the phase
+ */
+void budgie_scan_progress_dump(const BudgieScanProgress *progress);
+
+#endif /* budgie_scan_stats_h */
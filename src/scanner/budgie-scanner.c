@@ -0,0 +1,2470 @@
+/*
+ * budgie-scanner.c
+ *
+ * Copyright 2013 Ikey Doherty <ikey.doherty@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ *
+ *
+ */
+#define _GNU_SOURCE
+#include <gio/gio.h>
+#include <glib/gstdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef __linux__
+#include <sched.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+#include "budgie-scanner.h"
+#include "budgie-device-limits.h"
+#include "budgie-enumerator.h"
+#include "budgie-formats.h"
+#include "budgie-head-reader.h"
+#include "budgie-ignore.h"
+#include "budgie-inode-set.h"
+#include "budgie-io-order.h"
+#include "budgie-media-art.h"
+#include "budgie-queue.h"
+#include "budgie-scan-stats.h"
+#include "budgie-tag-pool.h"
+#include "budgie-tag-reader.h"
+
+#include <taglib/tag_c.h>
+
+/* How long an idle worker sleeps before trying to steal again */
+#define IDLE_WAIT_USEC (10 * G_TIME_SPAN_MILLISECOND)
+
+/* Full devices remembered while searching a deque for work */
+#define SCAN_BUSY_DEVICES 8
+
+/* Files in flight between two stages of the pipeline */
+#define SCAN_QUEUE_LENGTH 256
+
+/* Commit a chunk after this many rows, or this long after its first row */
+#define SCAN_COMMIT_ROWS 500
+#define SCAN_COMMIT_USEC (500 * G_TIME_SPAN_MILLISECOND)
+
+/* Files tagged per backfill round. Fits in the queues, so a round never
+ * blocks on itself, and is short enough that a prioritized row waits for
+ * at most the round being tagged and the one read ahead */
+#define BACKFILL_ROUND_ROWS SCAN_QUEUE_LENGTH
+
+/* Threads fetching album art during a backfill. Each album is looked up
+ * once, so they see far less work than the taggers */
+#define BACKFILL_ART_THREADS 2
+
+/* Files whose heads are read in one go with io_uring. A round is read
+ * ahead while the one before it is tagged, and a batch is kept well
+ * below a round so the first round gets going early */
+#define BACKFILL_HEAD_BATCH 32
+
+/* "progress" is emitted at most this often, about once a frame */
+#define PROGRESS_INTERVAL_USEC (G_USEC_PER_SEC / 60)
+
+/* A throttled thread checks for cancellation at least this often */
+#define THROTTLE_SLICE_USEC (100 * G_TIME_SPAN_MILLISECOND)
+
+/* A directory changed this shortly before a scan may change again within
+ * the same mtime tick, unnoticed. It is not stored, so the next scan
+ * lists it rather than trusting its mtime */
+#define DIR_RACY_NSEC (2 * G_TIME_SPAN_SECOND * 1000)
+
+#ifdef __linux__
+/* From linux/ioprio.h, which not every system ships */
+#define IOPRIO_WHO_PROCESS 1
+#define IOPRIO_CLASS_IDLE 3
+#define IOPRIO_CLASS_SHIFT 13
+#endif
+
+typedef struct ScanContext ScanContext;
+
+/* A media path as configured, and where it really is */
+typedef struct ScanRoot {
+        gchar *path;
+        gchar *real;
+} ScanRoot;
+
+/**
+ * A directory waiting to be listed, with the device it is expected on.
+ * That is its parent's device, until the listing says otherwise
+ */
+typedef struct ScanDir {
+        gchar *path;
+        guint64 device;
+} ScanDir;
+
+/* Identity of a file with more than one hard link */
+typedef struct LinkKey {
+        guint64 device;
+        guint64 inode;
+} LinkKey;
+
+/**
+ * Every path seen for one hard linked file. Only the canonical path, the
+ * one sorting first, is stored. As the walk visits the paths in no
+ * particular order, the canonical one may change along the way.
+ */
+typedef struct LinkGroup {
+        gchar *canonical;
+        GPtrArray *aliases;
+} LinkGroup;
+
+/**
+ * One directory walking thread of the scan. Each worker owns a deque of
+ * directories, popping from the tail itself while idle workers steal
+ * from the head, i.e. the shallowest (and usually largest) subtrees.
+ */
+typedef struct ScanWorker {
+        ScanContext *ctx;
+        guint index;
+        GThread *thread;
+        GMutex lock;
+        GQueue dirs;
+        gint64 busy_time;
+} ScanWorker;
+
+/**
+ * What the walkers hand the writer: a new or changed file, or a directory
+ * done with. A directory goes down the queue behind every file found in
+ * it, so it is never committed ahead of them. That makes each committed
+ * directory a checkpoint: a scan cut short by a crash or a stop leaves
+ * it stored, and the next scan skips it rather than listing it again
+ */
+typedef struct ScanFound {
+        MediaInfo *media;
+        gchar *dir; /**<Directory to store.. */
+        DirectoryInfo *info; /**<..with its listing */
+        const gchar *skipped; /**<Stored directory found unchanged, borrowed from dir_index */
+        GPtrArray *unchanged; /**<Stored paths found again, borrowed from the index */
+} ScanFound;
+
+/* One tag reading thread of the backfill */
+typedef struct ScanTagger {
+        ScanContext *ctx;
+        GThread *thread;
+        gint64 busy_time;
+} ScanTagger;
+
+/* One album art thread of the backfill */
+typedef struct ScanArtist {
+        ScanContext *ctx;
+        GThread *thread;
+} ScanArtist;
+
+/**
+ * Shared state for one budgie_scanner_scan or budgie_scanner_backfill
+ * call. During a scan, walkers push ScanFound items onto found and the
+ * calling thread writes them out in chunks. During a backfill, the calling
+ * thread feeds found, taggers move it to tagged and the calling thread
+ * writes their tags back. The first track of each album the taggers see
+ * also goes onto art, for the artists to fill the media-art cache. The
+ * queues are bounded, so a slow stage holds
+ * back the ones before it rather than piling up results.
+ */
+struct ScanContext {
+        BudgieScanner *scanner;
+        BudgieScanStats stats;
+        ScanWorker *workers;
+        guint n_workers;
+        ScanTagger *taggers;
+        ScanArtist artists[BACKFILL_ART_THREADS];
+        BudgieEnumeratorBackend backend;
+        BudgieTagMode tag_mode;
+        gboolean background; /**<Run our threads at idle priority */
+        GCancellable *cancellable;
+        guint files_rate; /**<Files per second, 0 for no limit */
+        guint64 bytes_rate; /**<Bytes per second, 0 for no limit */
+        GMutex throttle_lock;
+        gint64 throttle_next; /**<When the next file may start */
+        GHashTable *index; /**<Fingerprints of stored files, by path */
+        GHashTable *dir_index; /**<DirectoryInfo of stored directories, by path */
+        GHashTable *seen; /**<Keys of index and dir_index found again or stored */
+        GHashTable *skipped; /**<Keys of dir_index found unchanged, and not listed */
+        BudgieIgnore *ignore; /**<Entries not to scan */
+        gint pending; /**<Directories queued or being processed */
+        gint n_idle;
+        GMutex idle_lock;
+        GCond idle_cond;
+        BudgieQueue *found;
+        BudgieQueue *tagged;
+        BudgieQueue *art;
+        BudgieQueue *prefetch; /**<Rounds to read ahead, as pairs of path and MIME type */
+        gchar **within; /**<Directories the backfill keeps to, or NULL for all */
+        GThread *prefetcher;
+        BudgieHeadReader *head_reader; /**<Reads ahead through io_uring, if in use */
+        GMutex heads_lock;
+        GHashTable *heads; /**<BudgieTagHead read ahead for the taggers, by path */
+        GMutex art_lock;
+        GHashTable *albums; /**<Albums already sent to art, by artist and album */
+        gint n_walking; /**<Walkers still running, the last closes found */
+        gint n_tagging; /**<Taggers still running, the last closes tagged */
+        GArray *roots; /**<ScanRoot, with nested and duplicate roots dropped */
+        BudgieInodeSet *dirs_seen; /**<Directories already listed */
+        BudgieDeviceLimits *devices; /**<How many walkers may list each device */
+        GMutex alias_lock;
+        GHashTable *links; /**<LinkGroup, by LinkKey */
+        GPtrArray *aliases; /**<Symlink aliases, as pairs of alias and target */
+        gint64 generation; /**<From budgie_db_next_generation, given to the rows it stores */
+        gint64 started; /**<Wall clock time the scan started at */
+        GMutex unlisted_lock;
+        GPtrArray *unlisted; /**<Directories that could not be listed */
+};
+
+/* Private storage */
+struct _BudgieScannerPrivate {
+        guint n_workers;
+        gboolean incremental;
+        BudgieEnumeratorBackend backend;
+        BudgieTagMode tag_mode;
+        BudgieIOOrder io_order;
+        BudgieTagIO tag_io;
+        gboolean background;
+        guint max_files_rate;
+        guint max_mb_rate;
+        GMutex priority_lock;
+        GQueue *priority; /**<Paths to tag ahead of the rest, newest first */
+        GMutex ignore_lock;
+        gchar **ignore_patterns; /**<Set from the main thread, read as a scan starts */
+        gboolean isolate_tags;
+        GMutex tag_pool_lock;
+        BudgieTagPool *tag_pool; /**<Started on the first file read with isolate_tags */
+};
+
+enum {
+        PROP_0, PROP_WORKERS, PROP_INCREMENTAL, PROP_BACKEND, PROP_TAG_MODE, PROP_IO_ORDER,
+        PROP_BACKGROUND, PROP_MAX_FILES_RATE, PROP_MAX_MB_RATE, PROP_IGNORE_PATTERNS,
+        PROP_ISOLATE_TAGS, PROP_TAG_IO, N_PROPERTIES
+};
+
+static GParamSpec *obj_properties[N_PROPERTIES] = { NULL, };
+
+G_DEFINE_TYPE_WITH_PRIVATE(BudgieScanner, budgie_scanner, G_TYPE_OBJECT)
+
+/* Boilerplate GObject code */
+static void budgie_scanner_class_init(BudgieScannerClass *klass);
+static void budgie_scanner_init(BudgieScanner *self);
+static void budgie_scanner_dispose(GObject *object);
+static void budgie_scanner_finalize(GObject *object);
+
+static void budgie_scanner_get_property(GObject *object,
+                                        guint prop_id,
+                                        GValue *value,
+                                        GParamSpec *pspec);
+
+static void budgie_scanner_set_property(GObject *object,
+                                        guint prop_id,
+                                        const GValue *value,
+                                        GParamSpec *pspec);
+
+static gpointer scan_worker_run(gpointer data);
+
+/* Initialisation */
+static void budgie_scanner_class_init(BudgieScannerClass *klass)
+{
+        GObjectClass *g_object_class;
+
+        g_object_class = G_OBJECT_CLASS(klass);
+        obj_properties[PROP_WORKERS] =
+        g_param_spec_uint("workers", "Workers", "Number of scan threads",
+                0, G_MAXUINT, 0, G_PARAM_CONSTRUCT_ONLY | G_PARAM_READWRITE);
+        obj_properties[PROP_INCREMENTAL] =
+        g_param_spec_boolean("incremental", "Incremental",
+                "Skip files that are unchanged since the last scan",
+                TRUE, G_PARAM_CONSTRUCT | G_PARAM_READWRITE);
+        obj_properties[PROP_BACKEND] =
+        g_param_spec_uint("backend", "Backend",
+                "How directories are listed, a BudgieEnumeratorBackend",
+                0, BUDGIE_ENUMERATOR_MAX - 1, BUDGIE_ENUMERATOR_DEFAULT,
+                G_PARAM_CONSTRUCT | G_PARAM_READWRITE);
+        obj_properties[PROP_TAG_MODE] =
+        g_param_spec_uint("tag-mode", "Tag mode",
+                "How tags are read, a BudgieTagMode",
+                0, BUDGIE_TAGS_MAX - 1, BUDGIE_TAGS_DEFAULT,
+                G_PARAM_CONSTRUCT | G_PARAM_READWRITE);
+        obj_properties[PROP_IO_ORDER] =
+        g_param_spec_uint("io-order", "I/O order",
+                "Order files are opened in for their tags, a BudgieIOOrder",
+                0, BUDGIE_IO_ORDER_MAX - 1, BUDGIE_IO_ORDER_DEFAULT,
+                G_PARAM_CONSTRUCT | G_PARAM_READWRITE);
+        obj_properties[PROP_TAG_IO] =
+        g_param_spec_uint("tag-io", "Tag I/O",
+                "How files are read for their tags, a BudgieTagIO",
+                0, BUDGIE_TAG_IO_MAX - 1, BUDGIE_TAG_IO_DEFAULT,
+                G_PARAM_CONSTRUCT | G_PARAM_READWRITE);
+        obj_properties[PROP_BACKGROUND] =
+        g_param_spec_boolean("background", "Background",
+                "Run scan threads at idle CPU and I/O priority",
+                FALSE, G_PARAM_CONSTRUCT | G_PARAM_READWRITE);
+        obj_properties[PROP_MAX_FILES_RATE] =
+        g_param_spec_uint("max-files-per-second", "Maximum files per second",
+                "Limit on files scanned or tagged per second, 0 for none",
+                0, G_MAXUINT, 0, G_PARAM_CONSTRUCT | G_PARAM_READWRITE);
+        obj_properties[PROP_MAX_MB_RATE] =
+        g_param_spec_uint("max-mb-per-second", "Maximum MB per second",
+                "Limit on megabytes read from storage per second, 0 for none",
+                0, G_MAXUINT, 0, G_PARAM_CONSTRUCT | G_PARAM_READWRITE);
+        obj_properties[PROP_IGNORE_PATTERNS] =
+        g_param_spec_boxed("ignore-patterns", "Ignore patterns",
+                "Files and directories not to scan, as BudgieIgnore patterns",
+                G_TYPE_STRV, G_PARAM_READWRITE);
+        obj_properties[PROP_ISOLATE_TAGS] =
+        g_param_spec_boolean("isolate-tags", "Isolate tags",
+                "Read tags in helper processes, so a bad file can't crash the scanner",
+                TRUE, G_PARAM_CONSTRUCT | G_PARAM_READWRITE);
+
+        g_object_class->dispose = &budgie_scanner_dispose;
+        g_object_class->finalize = &budgie_scanner_finalize;
+        g_object_class->set_property = &budgie_scanner_set_property;
+        g_object_class->get_property = &budgie_scanner_get_property;
+        g_object_class_install_properties(g_object_class, N_PROPERTIES,
+                obj_properties);
+
+        /* Emitted from the scanning thread with a BudgieScanProgress,
+         * which is only valid for the duration of the emission */
+        g_signal_new("progress",
+                G_TYPE_FROM_CLASS(klass), G_SIGNAL_RUN_FIRST,
+                0, NULL, NULL, NULL, G_TYPE_NONE,
+                1, G_TYPE_POINTER);
+
+        /* Emitted from the backfilling thread after every committed round */
+        g_signal_new("tags-updated",
+                G_TYPE_FROM_CLASS(klass), G_SIGNAL_RUN_FIRST,
+                0, NULL, NULL, NULL, G_TYPE_NONE,
+                1, G_TYPE_UINT);
+
+        /* The C binding keeps every returned string on one global list
+         * for taglib_tag_free_strings(), which is not safe to share
+         * between threads. We free our own strings instead. */
+        taglib_set_string_management_enabled(FALSE);
+}
+
+static void budgie_scanner_init(BudgieScanner *self)
+{
+        self->priv = budgie_scanner_get_instance_private(self);
+        g_mutex_init(&self->priv->priority_lock);
+        self->priv->priority = g_queue_new();
+        g_mutex_init(&self->priv->ignore_lock);
+        g_mutex_init(&self->priv->tag_pool_lock);
+}
+
+static void budgie_scanner_set_property(GObject *object,
+                                        guint prop_id,
+                                        const GValue *value,
+                                        GParamSpec *pspec)
+{
+        BudgieScanner *self;
+
+        self = BUDGIE_SCANNER(object);
+        switch (prop_id) {
+                case PROP_WORKERS:
+                        self->priv->n_workers = g_value_get_uint((GValue*)value);
+                        if (self->priv->n_workers == 0) {
+                                self->priv->n_workers = g_get_num_processors();
+                        }
+                        break;
+                case PROP_INCREMENTAL:
+                        self->priv->incremental = g_value_get_boolean((GValue*)value);
+                        break;
+                case PROP_BACKEND:
+                        self->priv->backend = g_value_get_uint((GValue*)value);
+                        break;
+                case PROP_TAG_MODE:
+                        self->priv->tag_mode = g_value_get_uint((GValue*)value);
+                        break;
+                case PROP_IO_ORDER:
+                        self->priv->io_order = g_value_get_uint((GValue*)value);
+                        break;
+                case PROP_TAG_IO:
+                        self->priv->tag_io = g_value_get_uint((GValue*)value);
+                        break;
+                case PROP_BACKGROUND:
+                        self->priv->background = g_value_get_boolean((GValue*)value);
+                        break;
+                case PROP_MAX_FILES_RATE:
+                        self->priv->max_files_rate = g_value_get_uint((GValue*)value);
+                        break;
+                case PROP_MAX_MB_RATE:
+                        self->priv->max_mb_rate = g_value_get_uint((GValue*)value);
+                        break;
+                case PROP_IGNORE_PATTERNS:
+                        g_mutex_lock(&self->priv->ignore_lock);
+                        g_strfreev(self->priv->ignore_patterns);
+                        self->priv->ignore_patterns = g_value_dup_boxed(value);
+                        g_mutex_unlock(&self->priv->ignore_lock);
+                        break;
+                case PROP_ISOLATE_TAGS:
+                        g_mutex_lock(&self->priv->tag_pool_lock);
+                        self->priv->isolate_tags = g_value_get_boolean((GValue*)value);
+                        g_mutex_unlock(&self->priv->tag_pool_lock);
+                        break;
+                default:
+                        G_OBJECT_WARN_INVALID_PROPERTY_ID (object,
+                                prop_id, pspec);
+                        break;
+        }
+}
+
+static void budgie_scanner_get_property(GObject *object,
+                                        guint prop_id,
+                                        GValue *value,
+                                        GParamSpec *pspec)
+{
+        BudgieScanner *self;
+
+        self = BUDGIE_SCANNER(object);
+        switch (prop_id) {
+                case PROP_WORKERS:
+                        g_value_set_uint((GValue *)value, self->priv->n_workers);
+                        break;
+                case PROP_INCREMENTAL:
+                        g_value_set_boolean((GValue *)value, self->priv->incremental);
+                        break;
+                case PROP_BACKEND:
+                        g_value_set_uint((GValue *)value, self->priv->backend);
+                        break;
+                case PROP_TAG_MODE:
+                        g_value_set_uint((GValue *)value, self->priv->tag_mode);
+                        break;
+                case PROP_IO_ORDER:
+                        g_value_set_uint((GValue *)value, self->priv->io_order);
+                        break;
+                case PROP_TAG_IO:
+                        g_value_set_uint((GValue *)value, self->priv->tag_io);
+                        break;
+                case PROP_BACKGROUND:
+                        g_value_set_boolean((GValue *)value, self->priv->background);
+                        break;
+                case PROP_MAX_FILES_RATE:
+                        g_value_set_uint((GValue *)value, self->priv->max_files_rate);
+                        break;
+                case PROP_MAX_MB_RATE:
+                        g_value_set_uint((GValue *)value, self->priv->max_mb_rate);
+                        break;
+                case PROP_IGNORE_PATTERNS:
+                        g_mutex_lock(&self->priv->ignore_lock);
+                        g_value_set_boxed((GValue *)value, self->priv->ignore_patterns);
+                        g_mutex_unlock(&self->priv->ignore_lock);
+                        break;
+                case PROP_ISOLATE_TAGS:
+                        g_value_set_boolean((GValue *)value, self->priv->isolate_tags);
+                        break;
+                default:
+                        G_OBJECT_WARN_INVALID_PROPERTY_ID (object,
+                                prop_id, pspec);
+                        break;
+        }
+}
+
+static void budgie_scanner_dispose(GObject *object)
+{
+        BudgieScanner *self;
+
+        self = BUDGIE_SCANNER(object);
+        if (self->priv->priority) {
+                g_queue_free_full(self->priv->priority, g_free);
+                self->priv->priority = NULL;
+        }
+        g_clear_pointer(&self->priv->tag_pool, budgie_tag_pool_free);
+        /* Destruct */
+        G_OBJECT_CLASS(budgie_scanner_parent_class)->dispose(object);
+}
+
+static void budgie_scanner_finalize(GObject *object)
+{
+        BudgieScanner *self;
+
+        self = BUDGIE_SCANNER(object);
+        g_mutex_clear(&self->priv->priority_lock);
+        g_strfreev(self->priv->ignore_patterns);
+        g_mutex_clear(&self->priv->ignore_lock);
+        g_mutex_clear(&self->priv->tag_pool_lock);
+        G_OBJECT_CLASS(budgie_scanner_parent_class)->finalize(object);
+}
+
+/* Utility; return a new BudgieScanner */
+BudgieScanner* budgie_scanner_new(guint n_workers)
+{
+        BudgieScanner *self;
+
+        self = g_object_new(BUDGIE_SCANNER_TYPE, "workers", n_workers, NULL);
+        return BUDGIE_SCANNER(self);
+}
+
+/**
+ * Create the untagged MediaInfo for a file, titled after its name until
+ * the tags say otherwise
+ */
+static MediaInfo* media_from_file(const gchar *path, const gchar *name, const gchar *file_mime)
+{
+        MediaInfo* media = NULL;
+
+        media = malloc(sizeof(MediaInfo));
+        if (!media) {
+                g_error("Failed to allocate memory for MediaInfo");
+                return NULL;
+        }
+        memset(media, 0, sizeof(MediaInfo));
+
+        media->title = g_filename_display_name(name);
+        media->path = g_strdup(path);
+        media->mime = g_strdup(file_mime);
+
+        return media;
+}
+
+/**
+ * The helpers to read tags in, or NULL to read them in this process
+ */
+static BudgieTagPool *scanner_tag_pool(BudgieScanner *self)
+{
+        BudgieTagPool *pool = NULL;
+
+        g_mutex_lock(&self->priv->tag_pool_lock);
+        if (self->priv->isolate_tags) {
+                /* One more than the taggers, so a file read for the UI
+                 * never waits behind a backfill */
+                if (!self->priv->tag_pool) {
+                        self->priv->tag_pool = budgie_tag_pool_new(self->priv->n_workers + 1);
+                }
+                pool = self->priv->tag_pool;
+        }
+        g_mutex_unlock(&self->priv->tag_pool_lock);
+        return pool;
+}
+
+/**
+ * Read the tags of a file, natively where possible
+ * @param head The file as read ahead, or NULL
+ * @return TRUE if TagLib was not needed
+ */
+static gboolean media_read_tags(BudgieScanner *self,
+                                MediaInfo *media,
+                                BudgieTagMode mode,
+                                const BudgieTagHead *head)
+{
+        BudgieTagPool *pool;
+        BudgieTags tags = { 0 };
+        gboolean native = FALSE, ok;
+
+        /* Even when the file can't be read, so the backfill never
+         * comes back for it */
+        media->tagged = TRUE;
+
+        pool = scanner_tag_pool(self);
+        if (pool) {
+                ok = budgie_tag_pool_read(pool, media->path, media->mime, mode, &tags, &native);
+        } else {
+                ok = budgie_tags_read_mode(media->path, media->mime, head, mode,
+                        &tags, &native);
+        }
+        if (!ok) {
+                return FALSE;
+        }
+
+        if (tags.title) {
+                g_free(media->title);
+                media->title = tags.title;
+        }
+        g_free(media->album);
+        media->album = tags.album;
+        g_free(media->artist);
+        media->artist = tags.artist;
+        g_free(media->genre);
+        media->genre = tags.genre;
+        media->track = tags.track;
+        media->disc = tags.disc;
+        media->year = tags.year;
+        media->duration = tags.duration;
+        media->bitrate = tags.bitrate;
+        media->sample_rate = tags.sample_rate;
+        media->channels = tags.channels;
+
+        return native;
+}
+
+/**
+ * Whether this file is already stored, and has not changed since
+ * @return the stored path, owned by the index, if the file is unchanged
+ */
+static const gchar *find_unchanged(ScanContext *ctx, const gchar *path, MediaFingerprint *print)
+{
+        MediaFingerprint *known;
+        gpointer key;
+
+        if (!ctx->index) {
+                return NULL;
+        }
+        if (!g_hash_table_lookup_extended(ctx->index, path, &key, (gpointer*)&known)) {
+                return NULL;
+        }
+        if (known->mtime != print->mtime || known->size != print->size ||
+            known->inode != print->inode) {
+                return NULL;
+        }
+        return key;
+}
+
+static inline gboolean scan_cancelled(ScanContext *ctx)
+{
+        return g_cancellable_is_cancelled(ctx->cancellable);
+}
+
+/**
+ * Move the calling thread out of the way of playback, to idle CPU and
+ * I/O priority. On Linux both apply to the calling thread alone.
+ */
+static void scan_thread_background(ScanContext *ctx)
+{
+#ifdef __linux__
+        struct sched_param param = { 0 };
+
+        if (!ctx->background) {
+                return;
+        }
+        if (syscall(SYS_ioprio_set, IOPRIO_WHO_PROCESS, 0,
+            IOPRIO_CLASS_IDLE << IOPRIO_CLASS_SHIFT) != 0) {
+                g_debug("Unable to lower scan I/O priority");
+        }
+        if (sched_setscheduler(0, SCHED_IDLE, &param) != 0) {
+                g_debug("Unable to lower scan CPU priority");
+        }
+#endif
+}
+
+/**
+ * Hold a thread back to the configured rates. Every file and byte books
+ * its share of a second on one clock shared by all threads, and the
+ * thread sleeps until its booking comes up
+ */
+static void scan_throttle(ScanContext *ctx, guint64 n_files, guint64 n_bytes)
+{
+        gint64 cost = 0, now, start;
+
+        if (ctx->files_rate) {
+                cost = n_files * G_USEC_PER_SEC / ctx->files_rate;
+        }
+        if (ctx->bytes_rate) {
+                cost = MAX(cost, (gint64)(n_bytes * G_USEC_PER_SEC / ctx->bytes_rate));
+        }
+        if (cost == 0) {
+                return;
+        }
+
+        g_mutex_lock(&ctx->throttle_lock);
+        now = g_get_monotonic_time();
+        start = MAX(now, ctx->throttle_next);
+        ctx->throttle_next = start + cost;
+        g_mutex_unlock(&ctx->throttle_lock);
+
+        while (now < start && !scan_cancelled(ctx)) {
+                g_usleep(MIN(start - now, THROTTLE_SLICE_USEC));
+                now = g_get_monotonic_time();
+        }
+}
+
+static ScanDir *scan_dir_new(gchar *path, guint64 device)
+{
+        ScanDir *dir;
+
+        dir = g_new(ScanDir, 1);
+        dir->path = path;
+        dir->device = device;
+        return dir;
+}
+
+static void scan_dir_free(ScanDir *dir)
+{
+        g_free(dir->path);
+        g_free(dir);
+}
+
+/* Let an idle worker look again */
+static void scan_wake_idle(ScanContext *ctx)
+{
+        if (g_atomic_int_get(&ctx->n_idle) > 0) {
+                g_mutex_lock(&ctx->idle_lock);
+                g_cond_signal(&ctx->idle_cond);
+                g_mutex_unlock(&ctx->idle_lock);
+        }
+}
+
+/**
+ * Queue a directory on the given worker, waking an idle thief if needed.
+ * Ownership of the path passes to the queue
+ */
+static void scan_worker_push(ScanWorker *worker, gchar *path, guint64 device)
+{
+        ScanContext *ctx = worker->ctx;
+
+        g_atomic_int_inc(&ctx->pending);
+
+        g_mutex_lock(&worker->lock);
+        g_queue_push_tail(&worker->dirs, scan_dir_new(path, device));
+        g_mutex_unlock(&worker->lock);
+
+        scan_wake_idle(ctx);
+}
+
+/**
+ * Take the first directory of a deque whose device has a slot free,
+ * searching from the tail or the head. Directories on busy devices stay
+ * queued for whoever frees one. The caller holds the deque's lock
+ */
+static ScanDir *scan_dirs_take(ScanContext *ctx, GQueue *dirs, gboolean from_tail)
+{
+        guint64 busy[SCAN_BUSY_DEVICES];
+        guint n_busy = 0, i;
+        ScanDir *dir;
+        GList *link;
+
+        link = from_tail ? dirs->tail : dirs->head;
+        for (; link; link = from_tail ? link->prev : link->next) {
+                dir = link->data;
+                /* Most directories share a few devices, so remember
+                 * which are full rather than asking again */
+                for (i = 0; i < n_busy && busy[i] != dir->device; i++)
+                        ;
+                if (i < n_busy) {
+                        continue;
+                }
+                if (budgie_device_limits_acquire(ctx->devices, dir->device, dir->path)) {
+                        g_queue_delete_link(dirs, link);
+                        return dir;
+                }
+                if (n_busy < SCAN_BUSY_DEVICES) {
+                        busy[n_busy++] = dir->device;
+                }
+        }
+        return NULL;
+}
+
+/**
+ * Take the most recently queued directory from our own deque
+ */
+static ScanDir *scan_worker_pop(ScanWorker *worker)
+{
+        ScanDir *ret;
+
+        g_mutex_lock(&worker->lock);
+        ret = scan_dirs_take(worker->ctx, &worker->dirs, TRUE);
+        g_mutex_unlock(&worker->lock);
+
+        return ret;
+}
+
+/**
+ * Take the oldest queued directory from another worker
+ */
+static ScanDir *scan_worker_steal(ScanWorker *worker)
+{
+        ScanContext *ctx = worker->ctx;
+        ScanWorker *victim;
+        ScanDir *ret = NULL;
+        guint i;
+
+        for (i = 1; i < ctx->n_workers && !ret; i++) {
+                victim = &ctx->workers[(worker->index + i) % ctx->n_workers];
+                if (!g_mutex_trylock(&victim->lock)) {
+                        continue;
+                }
+                ret = scan_dirs_take(ctx, &victim->dirs, FALSE);
+                g_mutex_unlock(&victim->lock);
+        }
+        return ret;
+}
+
+static guint link_key_hash(gconstpointer v)
+{
+        const LinkKey *key = v;
+
+        return (guint)budgie_inode_hash(key->device, key->inode);
+}
+
+static gboolean link_key_equal(gconstpointer a, gconstpointer b)
+{
+        const LinkKey *ka = a, *kb = b;
+
+        return ka->device == kb->device && ka->inode == kb->inode;
+}
+
+static void link_group_free(gpointer p)
+{
+        LinkGroup *group = p;
+
+        g_free(group->canonical);
+        g_ptr_array_free(group->aliases, TRUE);
+        g_free(group);
+}
+
+/**
+ * Register one path of a hard linked file
+ * @return TRUE if the path is the canonical one, so far
+ */
+static gboolean link_group_claim(ScanContext *ctx, const gchar *path, ScanEntry *entry)
+{
+        LinkKey lookup = { entry->device, entry->print.inode };
+        LinkKey *key;
+        LinkGroup *group;
+        gboolean ret = TRUE;
+
+        g_mutex_lock(&ctx->alias_lock);
+        group = g_hash_table_lookup(ctx->links, &lookup);
+        if (!group) {
+                key = g_new(LinkKey, 1);
+                *key = lookup;
+                group = g_new0(LinkGroup, 1);
+                group->canonical = g_strdup(path);
+                group->aliases = g_ptr_array_new_with_free_func(g_free);
+                g_hash_table_insert(ctx->links, key, group);
+        } else if (strcmp(path, group->canonical) < 0) {
+                /* Stored already, the alias will replace that row */
+                g_ptr_array_add(group->aliases, group->canonical);
+                group->canonical = g_strdup(path);
+        } else {
+                g_ptr_array_add(group->aliases, g_strdup(path));
+                ret = FALSE;
+        }
+        g_mutex_unlock(&ctx->alias_lock);
+
+        return ret;
+}
+
+/**
+ * Whether path is base, or beneath it
+ */
+static inline gboolean path_is_within(const gchar *path, const gchar *base)
+{
+        gsize len = strlen(base);
+
+        if (strncmp(path, base, len) != 0) {
+                return FALSE;
+        }
+        return path[len] == '\0' || path[len] == '/' || (len > 0 && base[len - 1] == '/');
+}
+
+/**
+ * Where a resolved path lives, spelled the way the walk reaches it
+ * @return a newly allocated path beneath one of the roots, or NULL
+ */
+static gchar *scan_map_into_roots(ScanContext *ctx, const gchar *real)
+{
+        ScanRoot *root;
+        guint i;
+
+        for (i = 0; i < ctx->roots->len; i++) {
+                root = &g_array_index(ctx->roots, ScanRoot, i);
+                if (path_is_within(real, root->real)) {
+                        return g_strconcat(root->path, real + strlen(root->real), NULL);
+                }
+        }
+        return NULL;
+}
+
+/**
+ * A symlink to something within the roots is not followed. The walk gets
+ * there by the real path, and the link is recorded as an alias of it.
+ * @return TRUE if the entry is an alias, and must be skipped
+ */
+static gboolean scan_symlink(ScanContext *ctx, const gchar *path)
+{
+        gchar *real, *target;
+
+        real = realpath(path, NULL);
+        if (!real) {
+                return FALSE;
+        }
+        target = scan_map_into_roots(ctx, real);
+        free(real);
+        if (!target) {
+                return FALSE;
+        }
+        if (g_str_equal(target, path)) {
+                g_free(target);
+                return FALSE;
+        }
+
+        g_mutex_lock(&ctx->alias_lock);
+        g_ptr_array_add(ctx->aliases, g_strdup(path));
+        g_ptr_array_add(ctx->aliases, target);
+        g_mutex_unlock(&ctx->alias_lock);
+
+        return TRUE;
+}
+
+/**
+ * Classify a single file, without reading its tags
+ * @param ctx Scan context holding the previous index, or NULL
+ * @param dir Directory holding the file
+ * @param entry Directory entry of the file
+ * @param unchanged Set to the stored path, owned by the index, when the file
+ *                  was skipped as unchanged
+ * @return a newly allocated, untagged MediaInfo, or NULL
+ */
+static MediaInfo* media_for_entry(ScanContext *ctx,
+                                  const gchar *dir,
+                                  ScanEntry *entry,
+                                  const gchar **unchanged)
+{
+        MediaInfo *media = NULL;
+        const MediaFormat *format;
+        const gchar *known;
+        gchar *path;
+
+        if (unchanged) {
+                *unchanged = NULL;
+        }
+
+        /* Covers, playlists and the like are known by name alone, and
+         * never cost us a stat */
+        format = budgie_format_lookup(entry->name);
+        if (format && !budgie_format_is_media(format)) {
+                return NULL;
+        }
+        if (!budgie_scan_entry_stat(entry)) {
+                return NULL;
+        }
+
+        path = g_strdup_printf("%s/%s", dir, entry->name);
+
+        /* Only one path of a hard linked file is stored. This goes first,
+         * so the group is complete even when the file is unchanged */
+        if (ctx && entry->n_links > 1 && !link_group_claim(ctx, path, entry)) {
+                g_free(path);
+                return NULL;
+        }
+
+        /* Known and untouched since the last scan, skip the tags */
+        if (ctx && (known = find_unchanged(ctx, path, &entry->print))) {
+                if (unchanged) {
+                        *unchanged = known;
+                }
+                g_free(path);
+                return NULL;
+        }
+
+        /* Unknown extension, let the contents decide */
+        if (!format) {
+                format = budgie_format_sniff_file(path);
+        }
+        if (budgie_format_is_media(format)) {
+                media = media_from_file(path, entry->name, format->mime);
+                media->mtime = entry->print.mtime;
+                media->size = entry->print.size;
+                media->inode = entry->print.inode;
+        }
+        g_free(path);
+        return media;
+}
+
+/**
+ * Claim a directory about to be walked. A mount point answers to the
+ * budget of its own device, and when that is spent it is queued again to
+ * wait its turn. One reached again through a symlink loop or a bind
+ * mount is dropped, as the first path to get there wins
+ * @return FALSE if the directory is not to be walked now
+ */
+static gboolean scan_dir_enter(ScanWorker *worker, ScanDir *dir, guint64 device, guint64 inode)
+{
+        ScanContext *ctx = worker->ctx;
+
+        if (device != dir->device && inode != 0) {
+                if (!budgie_device_limits_acquire(ctx->devices, device, dir->path)) {
+                        scan_worker_push(worker, g_strdup(dir->path), device);
+                        return FALSE;
+                }
+                budgie_device_limits_release(ctx->devices, dir->device);
+                dir->device = device;
+        }
+        if (!budgie_inode_set_add(ctx->dirs_seen, device, inode)) {
+                return FALSE;
+        }
+        SCAN_STAT_ADD(ctx->stats.n_dirs, 1);
+        return TRUE;
+}
+
+static void scan_found_free(ScanFound *found)
+{
+        if (found->media) {
+                free_media_info(found->media);
+        }
+        g_free(found->dir);
+        if (found->info) {
+                free_directory_info(found->info);
+        }
+        if (found->unchanged) {
+                g_ptr_array_free(found->unchanged, TRUE);
+        }
+        g_free(found);
+}
+
+/**
+ * Queue an item for the writer, blocking while it is behind
+ * @return FALSE if the queue was closed, and the item freed
+ */
+static gboolean scan_found_push(ScanContext *ctx, ScanFound *found)
+{
+        if (!budgie_queue_push(ctx->found, found)) {
+                scan_found_free(found);
+                return FALSE;
+        }
+        return TRUE;
+}
+
+/**
+ * Stand in for listing an unchanged directory: queue the directories it
+ * held when last listed, and count its files as seen
+ */
+static void scan_directory_skip(ScanWorker *worker,
+                                ScanDir *dir,
+                                const gchar *stored,
+                                DirectoryInfo *known)
+{
+        ScanContext *ctx = worker->ctx;
+        ScanFound *found;
+        guint i;
+
+        SCAN_STAT_ADD(ctx->stats.n_skipped, 1);
+        SCAN_STAT_ADD(ctx->stats.n_files, known->n_files);
+        for (i = 0; known->subdirs[i]; i++) {
+                if (budgie_ignore_match(ctx->ignore, dir->path, known->subdirs[i])) {
+                        SCAN_STAT_ADD(ctx->stats.n_ignored, 1);
+                        continue;
+                }
+                scan_worker_push(worker, g_strdup_printf("%s/%s", dir->path,
+                        known->subdirs[i]), dir->device);
+        }
+        found = g_new0(ScanFound, 1);
+        found->skipped = stored;
+        scan_found_push(ctx, found);
+}
+
+/**
+ * Record a directory that could not be listed in full. Whatever is
+ * stored beneath it is not known to be gone, so its root is not pruned
+ */
+static void scan_add_unlisted(ScanContext *ctx, const gchar *path)
+{
+        g_mutex_lock(&ctx->unlisted_lock);
+        g_ptr_array_add(ctx->unlisted, g_strdup(path));
+        g_mutex_unlock(&ctx->unlisted_lock);
+}
+
+/**
+ * Enumerate one directory, unless it is stored and has not changed
+ * since. Subdirectories are queued on this worker rather than recursed
+ * into, so that other workers may steal them.
+ * The caller holds a slot on dir->device, which is updated should the
+ * directory turn out to be a mount point.
+ */
+static void scan_directory(ScanWorker *worker, ScanDir *dir)
+{
+        ScanContext *ctx = worker->ctx;
+        BudgieEnumerator *listing;
+        ScanEntry entry;
+        ScanDirStamp stamp;
+        DirectoryInfo *known;
+        ScanFound *found;
+        GPtrArray *subdirs, *unchanged_paths;
+        const gchar *path = dir->path;
+        const gchar *unchanged;
+        gchar *full_path = NULL;
+        gpointer stored;
+        MediaInfo *media;
+        gboolean alias, storable;
+        guint64 device, inode;
+        guint n_files = 0;
+
+        /* Drain the queues without touching the disk */
+        if (scan_cancelled(ctx)) {
+                return;
+        }
+
+        /* Taken before listing, so that a change made while we list
+         * shows up as a newer mtime next time */
+        storable = budgie_scan_dir_stamp(path, &stamp);
+        if (storable && ctx->dir_index &&
+            g_hash_table_lookup_extended(ctx->dir_index, path, &stored, (gpointer*)&known) &&
+            known->mtime == stamp.mtime) {
+                if (scan_dir_enter(worker, dir, stamp.device, stamp.inode)) {
+                        scan_directory_skip(worker, dir, stored, known);
+                }
+                return;
+        }
+        storable = storable && stamp.mtime < ctx->started * 1000 - DIR_RACY_NSEC;
+
+        /* Marked as holding no media, and neither does anything beneath
+         * it. Never stored, so the marker is looked for on every walk */
+        full_path = g_build_filename(path, BUDGIE_IGNORE_MARKER, NULL);
+        if (g_file_test(full_path, G_FILE_TEST_EXISTS)) {
+                SCAN_STAT_ADD(ctx->stats.n_ignored, 1);
+                g_free(full_path);
+                return;
+        }
+        g_free(full_path);
+
+        listing = budgie_enumerator_open(ctx->backend, path);
+        if (!listing) {
+                scan_add_unlisted(ctx, path);
+                return;
+        }
+
+        budgie_enumerator_get_identity(listing, &device, &inode);
+        if (!scan_dir_enter(worker, dir, device, inode)) {
+                budgie_enumerator_close(listing);
+                return;
+        }
+
+        subdirs = g_ptr_array_new_with_free_func(g_free);
+        unchanged_paths = g_ptr_array_new();
+
+        /* Lets go through them */
+        while (!scan_cancelled(ctx) && budgie_enumerator_next(listing, &entry)) {
+                if (entry.type != SCAN_ENTRY_DIRECTORY && entry.type != SCAN_ENTRY_FILE) {
+                        continue;
+                }
+                if (budgie_ignore_match(ctx->ignore, path, entry.name)) {
+                        SCAN_STAT_ADD(ctx->stats.n_ignored, 1);
+                        /* Kept among the subdirectories, so a skipped listing
+                         * still finds it should the patterns change. Files
+                         * are not kept, so their directory is listed again */
+                        if (entry.type == SCAN_ENTRY_DIRECTORY && !entry.via_link) {
+                                g_ptr_array_add(subdirs, g_strdup(entry.name));
+                        } else {
+                                storable = FALSE;
+                        }
+                        continue;
+                }
+                if (entry.via_link) {
+                        /* Links are resolved on every walk, never stored */
+                        storable = FALSE;
+                        full_path = g_strdup_printf("%s/%s", path, entry.name);
+                        alias = scan_symlink(ctx, full_path);
+                        g_free(full_path);
+                        if (alias) {
+                                continue;
+                        }
+                }
+                if (entry.type == SCAN_ENTRY_DIRECTORY) {
+                        g_ptr_array_add(subdirs, g_strdup(entry.name));
+                        full_path = g_strdup_printf("%s/%s", path, entry.name);
+                        /* Ownership passes to the queue */
+                        scan_worker_push(worker, full_path, dir->device);
+                        continue;
+                }
+                SCAN_STAT_ADD(ctx->stats.n_files, 1);
+                n_files++;
+                scan_throttle(ctx, 1, 0);
+
+                media = media_for_entry(ctx, path, &entry, &unchanged);
+                /* Which path of a hard linked file is stored depends on
+                 * all of them being seen, so they are never skipped */
+                if (entry.have_print && entry.n_links > 1) {
+                        storable = FALSE;
+                }
+                if (media) {
+                        SCAN_STAT_ADD(ctx->stats.n_media, 1);
+                        found = g_new0(ScanFound, 1);
+                        found->media = media;
+                        if (!scan_found_push(ctx, found)) {
+                                storable = FALSE;
+                        }
+                } else if (unchanged) {
+                        SCAN_STAT_ADD(ctx->stats.n_unchanged, 1);
+                        g_ptr_array_add(unchanged_paths, (gpointer)unchanged);
+                }
+        }
+        /* Cut short by a read error, say on a network share that went
+         * away, the listing would have everything after it pruned */
+        if (budgie_enumerator_failed(listing)) {
+                storable = FALSE;
+                scan_add_unlisted(ctx, path);
+        }
+        budgie_enumerator_close(listing);
+
+        /* Only a complete listing can stand in for the next one */
+        found = g_new0(ScanFound, 1);
+        found->unchanged = unchanged_paths;
+        if (storable && !scan_cancelled(ctx)) {
+                found->dir = g_strdup(path);
+                found->info = g_new0(DirectoryInfo, 1);
+                found->info->mtime = stamp.mtime;
+                found->info->n_files = n_files;
+                g_ptr_array_add(subdirs, NULL);
+                found->info->subdirs = (gchar**)g_ptr_array_free(subdirs, FALSE);
+        } else {
+                g_ptr_array_free(subdirs, TRUE);
+        }
+        if (found->dir || unchanged_paths->len > 0) {
+                scan_found_push(ctx, found);
+        } else {
+                scan_found_free(found);
+        }
+}
+
+static gpointer scan_worker_run(gpointer data)
+{
+        ScanWorker *worker = data;
+        ScanContext *ctx = worker->ctx;
+        ScanDir *dir;
+        gint64 start;
+        guint64 io, read, last_read;
+
+        scan_thread_background(ctx);
+        io = last_read = budgie_scan_stats_thread_io();
+        for (;;) {
+                dir = scan_worker_pop(worker);
+                if (!dir) {
+                        dir = scan_worker_steal(worker);
+                }
+                if (!dir) {
+                        /* Nothing to steal, or only directories on busy
+                         * devices. Finished once nobody is left holding
+                         * a directory that may yield more */
+                        g_mutex_lock(&ctx->idle_lock);
+                        if (g_atomic_int_get(&ctx->pending) == 0) {
+                                g_mutex_unlock(&ctx->idle_lock);
+                                break;
+                        }
+                        g_atomic_int_inc(&ctx->n_idle);
+                        g_cond_wait_until(&ctx->idle_cond, &ctx->idle_lock,
+                                g_get_monotonic_time() + IDLE_WAIT_USEC);
+                        g_atomic_int_add(&ctx->n_idle, -1);
+                        g_mutex_unlock(&ctx->idle_lock);
+                        continue;
+                }
+
+                start = g_get_monotonic_time();
+                scan_directory(worker, dir);
+                worker->busy_time += g_get_monotonic_time() - start;
+                budgie_device_limits_release(ctx->devices, dir->device);
+                scan_dir_free(dir);
+                /* Someone may be waiting on that device */
+                scan_wake_idle(ctx);
+
+                /* Directory reads count against the byte rate */
+                read = budgie_scan_stats_thread_io();
+                scan_throttle(ctx, 0, read - last_read);
+                last_read = read;
+
+                if (g_atomic_int_dec_and_test(&ctx->pending)) {
+                        g_mutex_lock(&ctx->idle_lock);
+                        g_cond_broadcast(&ctx->idle_cond);
+                        g_mutex_unlock(&ctx->idle_lock);
+                }
+        }
+        budgie_scan_stats_add_thread_io(&ctx->stats, io);
+
+        if (g_atomic_int_dec_and_test(&ctx->n_walking)) {
+                budgie_queue_close(ctx->found);
+        }
+        return NULL;
+}
+
+/**
+ * Hand a head read ahead to the tagger of its file. Once that tagger
+ * went ahead without it, or where taggers can't use it, the read only
+ * served to fill the page cache
+ */
+static void scan_offer_head(ScanContext *ctx, const gchar *path, BudgieTagHead *head)
+{
+        if (!ctx->heads) {
+                budgie_tag_head_free(head);
+                return;
+        }
+        g_mutex_lock(&ctx->heads_lock);
+        if (g_hash_table_contains(ctx->heads, path)) {
+                g_hash_table_remove(ctx->heads, path);
+                budgie_tag_head_free(head);
+        } else {
+                g_hash_table_insert(ctx->heads, g_strdup(path), head);
+        }
+        g_mutex_unlock(&ctx->heads_lock);
+}
+
+/**
+ * Take the head read ahead for a file, or leave word for the prefetcher
+ * that it is no longer wanted
+ * @return the head, or NULL if it is not in yet
+ */
+static BudgieTagHead *scan_take_head(ScanContext *ctx, const gchar *path)
+{
+        BudgieTagHead *head = NULL;
+        gpointer key;
+
+        if (!ctx->heads) {
+                return NULL;
+        }
+        g_mutex_lock(&ctx->heads_lock);
+        if (g_hash_table_lookup_extended(ctx->heads, path, &key, (gpointer*)&head)) {
+                g_hash_table_steal(ctx->heads, path);
+                g_free(key);
+        } else {
+                g_hash_table_insert(ctx->heads, g_strdup(path), NULL);
+        }
+        g_mutex_unlock(&ctx->heads_lock);
+        return head;
+}
+
+/**
+ * Open and read the heads of a round through io_uring, a batch at a time
+ * @return FALSE if io_uring failed, and the round is to be read ahead the
+ *         usual way
+ */
+static gboolean scan_prefetch_heads(ScanContext *ctx, GPtrArray *round)
+{
+        const gchar *paths[BACKFILL_HEAD_BATCH];
+        BudgieTagHead *heads[BACKFILL_HEAD_BATCH];
+        gboolean ok;
+        guint i, j, n, n_files;
+
+        n_files = round->len / 2;
+        for (i = 0; i < n_files && !scan_cancelled(ctx); i += n) {
+                n = MIN(BACKFILL_HEAD_BATCH, n_files - i);
+                for (j = 0; j < n; j++) {
+                        paths[j] = round->pdata[(i + j) * 2];
+                }
+                ok = budgie_head_reader_read(ctx->head_reader, paths, n, heads);
+                /* Without a head, the tagger reads the file itself */
+                for (j = 0; j < n; j++) {
+                        if (heads[j]) {
+                                scan_offer_head(ctx, paths[j], heads[j]);
+                        }
+                }
+                if (!ok) {
+                        return FALSE;
+                }
+        }
+        return TRUE;
+}
+
+/**
+ * Have the kernel read ahead of the taggers, a round at a time. Every
+ * request of a round is in flight at once, so the disk can serve them in
+ * one sweep rather than one seek per tagger. With io_uring the heads are
+ * read into memory instead, and handed to the taggers
+ */
+static gpointer scan_prefetch_run(gpointer data)
+{
+        ScanContext *ctx = data;
+        GPtrArray *round;
+        gboolean use_heads = ctx->head_reader != NULL;
+        guint i;
+
+        /* The reads are charged to us, so lower our I/O priority */
+        scan_thread_background(ctx);
+        while ((round = budgie_queue_pop(ctx->prefetch, -1)) != NULL) {
+                if (use_heads && scan_prefetch_heads(ctx, round)) {
+                        g_ptr_array_free(round, TRUE);
+                        continue;
+                }
+                if (use_heads) {
+                        g_message("Reading ahead without io_uring from now on");
+                        use_heads = FALSE;
+                }
+                for (i = 0; i + 1 < round->len && !scan_cancelled(ctx); i += 2) {
+                        budgie_tags_prefetch(round->pdata[i], round->pdata[i + 1]);
+                }
+                g_ptr_array_free(round, TRUE);
+        }
+        return NULL;
+}
+
+/**
+ * Send the first track of each album to the artists. Art is named after
+ * both artist and album, so a compilation is looked up once per artist
+ */
+static void scan_request_art(ScanContext *ctx, MediaInfo *media)
+{
+        MediaInfo *track;
+        gchar *key;
+        gboolean first;
+
+        if (!media->artist || !media->album) {
+                return;
+        }
+        key = g_strdup_printf("%s\n%s", media->artist, media->album);
+        g_mutex_lock(&ctx->art_lock);
+        first = g_hash_table_add(ctx->albums, key);
+        g_mutex_unlock(&ctx->art_lock);
+        if (!first) {
+                return;
+        }
+
+        track = g_new0(MediaInfo, 1);
+        track->path = g_strdup(media->path);
+        track->mime = g_strdup(media->mime);
+        track->artist = g_strdup(media->artist);
+        track->album = g_strdup(media->album);
+        if (!budgie_queue_push(ctx->art, track)) {
+                free_media_info(track);
+        }
+}
+
+static gpointer scan_tagger_run(gpointer data)
+{
+        ScanTagger *tagger = data;
+        ScanContext *ctx = tagger->ctx;
+        MediaInfo *media;
+        BudgieTagHead *head;
+        gint64 start, spent;
+        guint64 io, read, last_read;
+
+        scan_thread_background(ctx);
+        io = last_read = budgie_scan_stats_thread_io();
+        while ((media = budgie_queue_pop(ctx->found, -1)) != NULL) {
+                /* Passed back untagged, for a later backfill */
+                if (scan_cancelled(ctx)) {
+                        if (!budgie_queue_push(ctx->tagged, media)) {
+                                free_media_info(media);
+                        }
+                        continue;
+                }
+                start = g_get_monotonic_time();
+                head = scan_take_head(ctx, media->path);
+                if (head && head->data) {
+                        SCAN_STAT_ADD(ctx->stats.n_batched, 1);
+                }
+                if (media_read_tags(ctx->scanner, media, ctx->tag_mode, head)) {
+                        SCAN_STAT_ADD(ctx->stats.n_native, 1);
+                }
+                budgie_tag_head_free(head);
+                /* The head is in the cache by now, and usually the tail */
+                media->digest = budgie_scan_content_digest(media->path, media->size);
+                spent = g_get_monotonic_time() - start;
+                tagger->busy_time += spent;
+                budgie_scan_stats_add_parse(&ctx->stats, spent);
+                scan_request_art(ctx, media);
+
+                read = budgie_scan_stats_thread_io();
+                scan_throttle(ctx, 1, read - last_read);
+                last_read = read;
+
+                /* Blocks while the writer is behind */
+                if (!budgie_queue_push(ctx->tagged, media)) {
+                        free_media_info(media);
+                }
+        }
+        budgie_scan_stats_add_thread_io(&ctx->stats, io);
+
+        if (g_atomic_int_dec_and_test(&ctx->n_tagging)) {
+                budgie_queue_close(ctx->tagged);
+        }
+        return NULL;
+}
+
+/**
+ * Fetch the cover of each album not yet in the media-art cache, from the
+ * track's own tags or else an image next to it
+ */
+static gpointer scan_artist_run(gpointer data)
+{
+        ScanArtist *artist = data;
+        ScanContext *ctx = artist->ctx;
+        MediaInfo *media;
+        GBytes *image;
+        gchar *dir;
+        guint64 io, read, last_read;
+
+        scan_thread_background(ctx);
+        io = last_read = budgie_scan_stats_thread_io();
+        while ((media = budgie_queue_pop(ctx->art, -1)) != NULL) {
+                if (scan_cancelled(ctx) || budgie_media_art_exists(media)) {
+                        free_media_info(media);
+                        continue;
+                }
+                image = budgie_tags_read_cover(media->path, media->mime);
+                if (!image) {
+                        dir = g_path_get_dirname(media->path);
+                        image = budgie_media_art_from_folder(dir);
+                        g_free(dir);
+                }
+                if (image) {
+                        if (budgie_media_art_store(media, image)) {
+                                SCAN_STAT_ADD(ctx->stats.n_art, 1);
+                        }
+                        g_bytes_unref(image);
+                }
+                free_media_info(media);
+
+                read = budgie_scan_stats_thread_io();
+                scan_throttle(ctx, 0, read - last_read);
+                last_read = read;
+        }
+        budgie_scan_stats_add_thread_io(&ctx->stats, io);
+
+        return NULL;
+}
+
+/**
+ * Publish the counters, unless that was done less than a frame ago
+ */
+static void scan_report(ScanContext *ctx, gint64 *next_report)
+{
+        BudgieScanProgress progress;
+        gint64 now;
+
+        now = g_get_monotonic_time();
+        if (now < *next_report) {
+                return;
+        }
+        *next_report = now + PROGRESS_INTERVAL_USEC;
+
+        budgie_scan_stats_snapshot(&ctx->stats, &progress);
+        g_signal_emit_by_name(ctx->scanner, "progress", &progress);
+}
+
+/**
+ * Commit the open transaction, timing it
+ */
+static void scan_commit(ScanContext *ctx, BudgieDB *db)
+{
+        gint64 start;
+
+        start = g_get_monotonic_time();
+        budgie_db_end_transaction(db);
+        budgie_scan_stats_add_commit(&ctx->stats, g_get_monotonic_time() - start);
+}
+
+/**
+ * Note what the walk found of the stored rows, so scan_prune can tell
+ * those gone without a write for every one still there
+ */
+static void scan_note_found(ScanContext *ctx, ScanFound *found)
+{
+        gpointer key;
+        guint i;
+
+        if (!ctx->seen) {
+                return;
+        }
+        for (i = 0; found->unchanged && i < found->unchanged->len; i++) {
+                g_hash_table_add(ctx->seen, found->unchanged->pdata[i]);
+        }
+        if (found->skipped) {
+                g_hash_table_add(ctx->skipped, (gpointer)found->skipped);
+        }
+        /* Stored again, so newer than anything scan_prune marks */
+        if (found->media &&
+            g_hash_table_lookup_extended(ctx->index, found->media->path, &key, NULL)) {
+                g_hash_table_add(ctx->seen, key);
+        }
+        if (found->dir &&
+            g_hash_table_lookup_extended(ctx->dir_index, found->dir, &key, NULL)) {
+                g_hash_table_add(ctx->seen, key);
+        }
+}
+
+/**
+ * Write out one item from the walkers
+ * @return the number of rows it touched
+ */
+static guint scan_write_found(ScanContext *ctx, BudgieDB *db, ScanFound *found)
+{
+        if (found->media) {
+                budgie_db_store_media(db, found->media, ctx->generation);
+                SCAN_STAT_ADD(ctx->stats.n_stored, 1);
+                return 1;
+        }
+        if (found->dir) {
+                budgie_db_store_directory(db, found->dir, found->info, ctx->generation);
+                return 1;
+        }
+        return 0;
+}
+
+/**
+ * Store media as the walkers find it, along with the directories they
+ * are done with, committing in chunks so rows become visible to other
+ * connections while the scan is still running, and survive it
+ */
+static guint scan_write(ScanContext *ctx, BudgieDB *db)
+{
+        ScanFound *found;
+        gint64 deadline = -1, next_report = 0;
+        guint n_batch = 0, n_stored = 0;
+        gboolean drained;
+
+        for (;;) {
+                /* Wake up for the commit deadline or the next report,
+                 * whichever comes first */
+                found = budgie_queue_pop(ctx->found,
+                        deadline == -1 ? next_report : MIN(deadline, next_report));
+                if (found) {
+                        scan_note_found(ctx, found);
+                        /* The clock for a chunk starts with its first row */
+                        if (n_batch == 0 && (found->media || found->dir)) {
+                                budgie_db_begin_transaction(db);
+                                deadline = g_get_monotonic_time() + SCAN_COMMIT_USEC;
+                        }
+                        if (found->media) {
+                                n_stored++;
+                        }
+                        n_batch += scan_write_found(ctx, db, found);
+                        scan_found_free(found);
+                }
+                drained = !found && budgie_queue_is_drained(ctx->found);
+                if (n_batch > 0 && (drained || n_batch >= SCAN_COMMIT_ROWS ||
+                    g_get_monotonic_time() >= deadline)) {
+                        scan_commit(ctx, db);
+                        n_batch = 0;
+                        deadline = -1;
+                }
+                scan_report(ctx, &next_report);
+                if (drained) {
+                        break;
+                }
+        }
+        return n_stored;
+}
+
+/**
+ * Whether another root already walks the given one. Of two roots that
+ * resolve to the same place, the one listed first is kept
+ */
+static gboolean root_is_covered(ScanContext *ctx, guint index)
+{
+        ScanRoot *root, *other;
+        guint i;
+
+        root = &g_array_index(ctx->roots, ScanRoot, index);
+        for (i = 0; i < ctx->roots->len; i++) {
+                other = &g_array_index(ctx->roots, ScanRoot, i);
+                if (i == index || !path_is_within(root->real, other->real)) {
+                        continue;
+                }
+                if (i < index || !g_str_equal(root->real, other->real)) {
+                        return TRUE;
+                }
+        }
+        return FALSE;
+}
+
+/**
+ * Resolve the roots, dropping any that another root already covers.
+ * A root that only reaches its media through a symlink becomes an alias
+ * of where the covering root stores it.
+ */
+static void scan_add_roots(ScanContext *ctx, gchar **roots)
+{
+        ScanRoot root;
+        gchar *target;
+        guint i;
+
+        for (i = 0; roots && roots[i]; i++) {
+                if (!g_file_test(roots[i], G_FILE_TEST_IS_DIR)) {
+                        g_warning("Media path is not a directory: %s", roots[i]);
+                        continue;
+                }
+                root.real = realpath(roots[i], NULL);
+                if (!root.real) {
+                        continue;
+                }
+                root.path = g_strdup(roots[i]);
+                g_array_append_val(ctx->roots, root);
+        }
+
+        for (i = 0; i < ctx->roots->len; i++) {
+                if (!root_is_covered(ctx, i)) {
+                        continue;
+                }
+                /* Ours now, not the clear function's */
+                root = g_array_index(ctx->roots, ScanRoot, i);
+                g_array_index(ctx->roots, ScanRoot, i).path = NULL;
+                g_array_index(ctx->roots, ScanRoot, i).real = NULL;
+                g_array_remove_index(ctx->roots, i--);
+                target = scan_map_into_roots(ctx, root.real);
+                if (target && !g_str_equal(target, root.path)) {
+                        g_ptr_array_add(ctx->aliases, root.path);
+                        g_ptr_array_add(ctx->aliases, target);
+                } else {
+                        g_free(root.path);
+                        g_free(target);
+                }
+                free(root.real);
+        }
+}
+
+static void scan_root_clear(gpointer p)
+{
+        ScanRoot *root = p;
+
+        g_free(root->path);
+        free(root->real);
+}
+
+/**
+ * Store every alias found by the walk, dropping rows stored under them
+ */
+static void scan_write_aliases(ScanContext *ctx, BudgieDB *db)
+{
+        GHashTableIter iter;
+        LinkGroup *group;
+        guint i;
+
+        budgie_db_begin_transaction(db);
+        for (i = 0; i + 1 < ctx->aliases->len; i += 2) {
+                if (budgie_db_set_alias(db, ctx->aliases->pdata[i], ctx->aliases->pdata[i + 1])) {
+                        SCAN_STAT_ADD(ctx->stats.n_aliases, 1);
+                }
+        }
+        g_hash_table_iter_init(&iter, ctx->links);
+        while (g_hash_table_iter_next(&iter, NULL, (gpointer*)&group)) {
+                for (i = 0; i < group->aliases->len; i++) {
+                        if (budgie_db_set_alias(db, group->aliases->pdata[i], group->canonical)) {
+                                SCAN_STAT_ADD(ctx->stats.n_aliases, 1);
+                        }
+                }
+        }
+        scan_commit(ctx, db);
+}
+
+/**
+ * Whether every directory beneath a root was listed
+ */
+static gboolean root_is_complete(ScanContext *ctx, const gchar *root)
+{
+        guint i;
+
+        for (i = 0; i < ctx->unlisted->len; i++) {
+                if (path_is_within(ctx->unlisted->pdata[i], root)) {
+                        return FALSE;
+                }
+        }
+        return TRUE;
+}
+
+/**
+ * Hand the rows of files that were not found again beneath a root to
+ * the files that took their place under a new name, so that moving a
+ * folder neither loses nor re-reads the tags of what is in it. The same
+ * inode and mtime settle it, else the content digest does
+ * @return the number of rows moved
+ */
+static guint scan_match_moves(ScanContext *ctx,
+                              BudgieDB *db,
+                              const gchar *root,
+                              gint64 vanished)
+{
+        GPtrArray *moves = NULL;
+        GHashTable *taken, *digests;
+        MediaMove *move;
+        gpointer value;
+        guint64 digest, *cached;
+        guint i, n_moved = 0;
+
+        if (!budgie_db_get_moves(db, root, ctx->generation, vanished, &moves)) {
+                return 0;
+        }
+        /* Paths already claimed on either side, borrowed from moves */
+        taken = g_hash_table_new(g_str_hash, g_str_equal);
+        digests = g_hash_table_new_full(g_str_hash, g_str_equal, NULL, g_free);
+
+        for (i = 0; i < moves->len; i++) {
+                move = moves->pdata[i];
+                if (g_hash_table_contains(taken, move->from) ||
+                    g_hash_table_contains(taken, move->to)) {
+                        continue;
+                }
+                if (!move->same_inode) {
+                        if (move->digest == 0) {
+                                continue;
+                        }
+                        /* A new file may pair up with several of the same size */
+                        if (g_hash_table_lookup_extended(digests, move->to, NULL, &value)) {
+                                digest = *(guint64*)value;
+                        } else {
+                                digest = budgie_scan_content_digest(move->to, move->size);
+                                cached = g_new(guint64, 1);
+                                *cached = digest;
+                                g_hash_table_insert(digests, move->to, cached);
+                        }
+                        if (digest != move->digest) {
+                                continue;
+                        }
+                }
+                if (budgie_db_move_media(db, move, ctx->generation)) {
+                        g_hash_table_add(taken, move->from);
+                        g_hash_table_add(taken, move->to);
+                        n_moved++;
+                }
+        }
+
+        g_hash_table_unref(digests);
+        g_hash_table_unref(taken);
+        g_ptr_array_unref(moves);
+        return n_moved;
+}
+
+/**
+ * Mark the stored rows beneath a root that the walk neither found again
+ * nor stored as vanished. The files of a directory skipped as unchanged
+ * were never looked at, and are taken to be there still. This costs a
+ * pass over the index in memory, and a write for each row gone only
+ */
+static void scan_mark_vanished(ScanContext *ctx, BudgieDB *db, const gchar *root)
+{
+        GHashTableIter iter;
+        GString *parent;
+        gpointer key, stored;
+        const gchar *path, *slash;
+        gboolean kept;
+
+        g_hash_table_iter_init(&iter, ctx->dir_index);
+        while (g_hash_table_iter_next(&iter, &key, NULL)) {
+                if (!path_is_within(key, root) || g_hash_table_contains(ctx->seen, key) ||
+                    g_hash_table_contains(ctx->skipped, key)) {
+                        continue;
+                }
+                budgie_db_mark_directory(db, key, BUDGIE_DB_VANISHED);
+        }
+
+        parent = g_string_new(NULL);
+        g_hash_table_iter_init(&iter, ctx->index);
+        while (g_hash_table_iter_next(&iter, &key, NULL)) {
+                path = key;
+                if (!path_is_within(path, root) || g_hash_table_contains(ctx->seen, key)) {
+                        continue;
+                }
+                slash = strrchr(path, '/');
+                if (slash) {
+                        g_string_truncate(parent, 0);
+                        g_string_append_len(parent, path, slash - path);
+                        kept = g_hash_table_lookup_extended(ctx->dir_index, parent->str,
+                                &stored, NULL) && g_hash_table_contains(ctx->skipped, stored);
+                        if (kept) {
+                                continue;
+                        }
+                }
+                budgie_db_mark_media(db, path, BUDGIE_DB_VANISHED);
+        }
+        g_string_free(parent, TRUE);
+}
+
+/**
+ * Beneath each completely walked root, move the rows of files found under
+ * a new name and drop the rows of every other file not seen, as it no
+ * longer exists. Without an index every file seen was stored again, so
+ * rows older than the scan go. With one, rows found unchanged were left
+ * alone, and only those marked vanished here go
+ */
+static void scan_prune(ScanContext *ctx, BudgieDB *db)
+{
+        ScanRoot *root;
+        gint64 vanished;
+        gint removed;
+        guint i;
+
+        vanished = ctx->index ? BUDGIE_DB_VANISHED + 1 : ctx->generation;
+        budgie_db_begin_transaction(db);
+        for (i = 0; i < ctx->roots->len; i++) {
+                root = &g_array_index(ctx->roots, ScanRoot, i);
+                if (!root_is_complete(ctx, root->path)) {
+                        g_message("Not pruning %s, parts of it could not be read", root->path);
+                        continue;
+                }
+                if (ctx->index) {
+                        scan_mark_vanished(ctx, db, root->path);
+                }
+                /* Nothing new, so nothing can have moved */
+                if (atomic_load_explicit(&ctx->stats.n_stored, memory_order_relaxed) > 0) {
+                        SCAN_STAT_ADD(ctx->stats.n_moved,
+                                scan_match_moves(ctx, db, root->path, vanished));
+                }
+                removed = budgie_db_prune_media(db, root->path, vanished);
+                if (removed > 0) {
+                        SCAN_STAT_ADD(ctx->stats.n_pruned, removed);
+                }
+        }
+        scan_commit(ctx, db);
+}
+
+/**
+ * Record the roots as scanned, so budgie_scanner_sync_roots leaves them
+ * be. Roots another root covers count too, their media was walked
+ */
+static void scan_store_roots(ScanContext *ctx, BudgieDB *db, gchar **roots)
+{
+        guint i;
+
+        budgie_db_begin_transaction(db);
+        for (i = 0; roots && roots[i]; i++) {
+                if (g_file_test(roots[i], G_FILE_TEST_IS_DIR)) {
+                        budgie_db_store_root(db, roots[i], ctx->generation);
+                }
+        }
+        scan_commit(ctx, db);
+}
+
+/**
+ * Copy the settings shared by both phases into a new context
+ */
+static void scan_context_init(ScanContext *ctx,
+                              BudgieScanner *self,
+                              GCancellable *cancellable)
+{
+        memset(ctx, 0, sizeof(*ctx));
+        ctx->scanner = self;
+        ctx->n_workers = self->priv->n_workers;
+        ctx->background = self->priv->background;
+        ctx->cancellable = cancellable;
+        ctx->files_rate = self->priv->max_files_rate;
+        ctx->bytes_rate = (guint64)self->priv->max_mb_rate * 1000 * 1000;
+        g_mutex_init(&ctx->throttle_lock);
+}
+
+guint budgie_scanner_scan(BudgieScanner *self,
+                          BudgieDB *db,
+                          gchar **roots,
+                          GCancellable *cancellable)
+{
+        ScanContext ctx;
+        ScanWorker *worker;
+        ScanRoot *root;
+        GStatBuf st;
+        BudgieScanProgress progress;
+        gint64 generation, wall, busy = 0;
+        guint i, n_stored;
+        gchar *name;
+
+        g_return_val_if_fail(IS_BUDGIE_SCANNER(self), 0);
+        g_return_val_if_fail(db != NULL, 0);
+
+        /* Without one, nothing it stores could be told from older rows */
+        generation = budgie_db_next_generation(db);
+        if (generation < 0) {
+                return 0;
+        }
+
+        scan_context_init(&ctx, self, cancellable);
+        budgie_scan_stats_reset(&ctx.stats, SCAN_PHASE_WALK);
+        ctx.generation = generation;
+        ctx.started = g_get_real_time();
+        /* Without an index every file is treated as new */
+        if (self->priv->incremental && !budgie_db_get_fingerprints(db, &ctx.index)) {
+                ctx.index = NULL;
+        }
+        /* And every directory is listed. Pruning needs both to tell what
+         * is gone, so one is no use without the other */
+        if (ctx.index && !budgie_db_get_directories(db, &ctx.dir_index)) {
+                g_hash_table_unref(ctx.index);
+                ctx.index = NULL;
+                ctx.dir_index = NULL;
+        }
+        if (ctx.index) {
+                ctx.seen = g_hash_table_new(NULL, NULL);
+                ctx.skipped = g_hash_table_new(NULL, NULL);
+        }
+        ctx.backend = self->priv->backend;
+        g_mutex_lock(&self->priv->ignore_lock);
+        ctx.ignore = budgie_ignore_new(self->priv->ignore_patterns);
+        g_mutex_unlock(&self->priv->ignore_lock);
+        ctx.workers = g_new0(ScanWorker, ctx.n_workers);
+        ctx.n_walking = ctx.n_workers;
+        ctx.found = budgie_queue_new(SCAN_QUEUE_LENGTH);
+        g_mutex_init(&ctx.idle_lock);
+        g_cond_init(&ctx.idle_cond);
+        ctx.dirs_seen = budgie_inode_set_new();
+        ctx.devices = budgie_device_limits_new(ctx.n_workers);
+        g_mutex_init(&ctx.unlisted_lock);
+        ctx.unlisted = g_ptr_array_new_with_free_func(g_free);
+        g_mutex_init(&ctx.alias_lock);
+        ctx.links = g_hash_table_new_full(link_key_hash, link_key_equal,
+                g_free, link_group_free);
+        ctx.aliases = g_ptr_array_new_with_free_func(g_free);
+        ctx.roots = g_array_new(FALSE, FALSE, sizeof(ScanRoot));
+        g_array_set_clear_func(ctx.roots, scan_root_clear);
+
+        for (i = 0; i < ctx.n_workers; i++) {
+                worker = &ctx.workers[i];
+                worker->ctx = &ctx;
+                worker->index = i;
+                g_mutex_init(&worker->lock);
+                g_queue_init(&worker->dirs);
+        }
+
+        /* Deal the roots out so every worker starts with something */
+        scan_add_roots(&ctx, roots);
+        for (i = 0; i < ctx.roots->len; i++) {
+                root = &g_array_index(ctx.roots, ScanRoot, i);
+                if (g_stat(root->real, &st) != 0) {
+                        st.st_dev = 0;
+                }
+                scan_worker_push(&ctx.workers[i % ctx.n_workers],
+                        g_strdup(root->path), st.st_dev);
+        }
+
+        for (i = 0; i < ctx.n_workers; i++) {
+                name = g_strdup_printf("scan-worker-%u", i);
+                ctx.workers[i].thread = g_thread_new(name, scan_worker_run,
+                        &ctx.workers[i]);
+                g_free(name);
+        }
+
+        /* We are the last stage */
+        n_stored = scan_write(&ctx, db);
+
+        for (i = 0; i < ctx.n_workers; i++) {
+                worker = &ctx.workers[i];
+                g_thread_join(worker->thread);
+
+                busy += worker->busy_time;
+                g_mutex_clear(&worker->lock);
+        }
+        scan_write_aliases(&ctx, db);
+        /* Only a walk that ran to the end saw everything that is left */
+        if (!scan_cancelled(&ctx)) {
+                scan_prune(&ctx, db);
+                scan_store_roots(&ctx, db, roots);
+        }
+        budgie_scan_stats_snapshot(&ctx.stats, &progress);
+        g_signal_emit_by_name(self, "progress", &progress);
+        budgie_scan_progress_dump(&progress);
+
+        /* Busy time summed over all threads over wall time: how many were
+         * working at once on average. Only an estimate of the speedup, a
+         * single thread would not contend for the disk or the locks */
+        wall = MAX(progress.elapsed_usec, 1);
+        g_print("  %u workers, %.2fx estimated parallelism (busy time over wall time)\n",
+                ctx.n_workers, (gdouble)busy / wall);
+
+        if (ctx.index) {
+                g_hash_table_unref(ctx.index);
+        }
+        if (ctx.dir_index) {
+                g_hash_table_unref(ctx.dir_index);
+        }
+        if (ctx.seen) {
+                g_hash_table_unref(ctx.seen);
+                g_hash_table_unref(ctx.skipped);
+        }
+        budgie_queue_free(ctx.found);
+        budgie_ignore_free(ctx.ignore);
+        g_mutex_clear(&ctx.idle_lock);
+        g_cond_clear(&ctx.idle_cond);
+        budgie_inode_set_free(ctx.dirs_seen);
+        budgie_device_limits_free(ctx.devices);
+        g_mutex_clear(&ctx.unlisted_lock);
+        g_ptr_array_free(ctx.unlisted, TRUE);
+        g_mutex_clear(&ctx.alias_lock);
+        g_hash_table_unref(ctx.links);
+        g_ptr_array_free(ctx.aliases, TRUE);
+        g_array_free(ctx.roots, TRUE);
+        g_free(ctx.workers);
+        g_mutex_clear(&ctx.throttle_lock);
+
+        return n_stored;
+}
+
+/**
+ * Whether any of roots, other than path itself, covers path
+ */
+static gboolean path_is_within_any(const gchar *path, gchar **roots)
+{
+        guint i;
+
+        for (i = 0; roots[i]; i++) {
+                if (!g_str_equal(path, roots[i]) && path_is_within(path, roots[i])) {
+                        return TRUE;
+                }
+        }
+        return FALSE;
+}
+
+guint budgie_scanner_sync_roots(BudgieScanner *self,
+                                BudgieDB *db,
+                                gchar **roots,
+                                GCancellable *cancellable)
+{
+        static gchar *no_roots[] = { NULL };
+        gchar **indexed = NULL;
+        GPtrArray *kept, *dropped, *added;
+        gint removed, n_removed = 0;
+        guint i, n_stored = 0;
+
+        g_return_val_if_fail(IS_BUDGIE_SCANNER(self), 0);
+        g_return_val_if_fail(db != NULL, 0);
+
+        if (!roots) {
+                roots = no_roots;
+        }
+        if (!budgie_db_get_roots(db, &indexed)) {
+                return budgie_scanner_scan(self, db, roots, cancellable);
+        }
+
+        kept = g_ptr_array_new();
+        dropped = g_ptr_array_new();
+        for (i = 0; indexed[i]; i++) {
+                if (g_strv_contains((const gchar* const*)roots, indexed[i])) {
+                        g_ptr_array_add(kept, indexed[i]);
+                }
+        }
+        g_ptr_array_add(kept, NULL);
+
+        /* Removed roots take their rows along, unless a kept root still
+         * covers them */
+        budgie_db_begin_transaction(db);
+        for (i = 0; indexed[i]; i++) {
+                if (g_strv_contains((const gchar* const*)roots, indexed[i])) {
+                        continue;
+                }
+                if (path_is_within_any(indexed[i], (gchar**)kept->pdata)) {
+                        budgie_db_remove_root(db, indexed[i], TRUE);
+                        continue;
+                }
+                removed = budgie_db_remove_root(db, indexed[i], FALSE);
+                if (removed > 0) {
+                        n_removed += removed;
+                }
+                g_ptr_array_add(dropped, indexed[i]);
+        }
+        g_ptr_array_add(dropped, NULL);
+        budgie_db_end_transaction(db);
+
+        /* New roots need a walk, unless a kept root already covers them.
+         * So do kept roots inside a removed one, their rows went with it */
+        added = g_ptr_array_new();
+        budgie_db_begin_transaction(db);
+        for (i = 0; roots[i]; i++) {
+                if (g_strv_contains((const gchar* const*)indexed, roots[i])) {
+                        if (path_is_within_any(roots[i], (gchar**)dropped->pdata)) {
+                                g_ptr_array_add(added, roots[i]);
+                        }
+                } else if (path_is_within_any(roots[i], (gchar**)kept->pdata)) {
+                        budgie_db_store_root(db, roots[i], budgie_db_next_generation(db));
+                } else {
+                        g_ptr_array_add(added, roots[i]);
+                }
+        }
+        g_ptr_array_add(added, NULL);
+        budgie_db_end_transaction(db);
+
+        if (n_removed > 0) {
+                g_print("Removed %d media files of dropped media directories\n", n_removed);
+        }
+        if (added->len > 1) {
+                n_stored = budgie_scanner_scan(self, db, (gchar**)added->pdata, cancellable);
+        }
+
+        g_ptr_array_free(added, TRUE);
+        g_ptr_array_free(dropped, TRUE);
+        g_ptr_array_free(kept, TRUE);
+        g_strfreev(indexed);
+        return n_stored;
+}
+
+/**
+ * Take the prioritized paths that still need their tags, up to max
+ */
+static void backfill_take_priority(BudgieScanner *self,
+                                   BudgieDB *db,
+                                   guint max,
+                                   GPtrArray *round,
+                                   GHashTable *seen)
+{
+        MediaInfo *media;
+        gchar *path;
+
+        while (round->len < max) {
+                g_mutex_lock(&self->priv->priority_lock);
+                path = g_queue_pop_head(self->priv->priority);
+                g_mutex_unlock(&self->priv->priority_lock);
+                if (!path) {
+                        break;
+                }
+                media = budgie_db_get_media(db, path);
+                g_free(path);
+                if (!media) {
+                        continue;
+                }
+                if (media->tagged || g_hash_table_contains(seen, media->path)) {
+                        free_media_info(media);
+                        continue;
+                }
+                g_hash_table_add(seen, media->path);
+                g_ptr_array_add(round, media);
+        }
+}
+
+/**
+ * Gather the next round of media to tag: whatever was prioritized first,
+ * then untagged rows in path order. Those are sorted into the scanner's
+ * io-order, and read ahead of the taggers when that is physical order
+ *
+ * It is gathered while the round before it is tagged, so that is read
+ * ahead of the taggers rather than alongside them. That round's rows are
+ * not stored yet, and are skipped
+ * @param current The round being tagged, or NULL
+ */
+static GPtrArray *backfill_next_round(BudgieScanner *self,
+                                      ScanContext *ctx,
+                                      BudgieDB *db,
+                                      GPtrArray *current)
+{
+        GPtrArray *round, *untagged = NULL, *prefetch;
+        GHashTable *seen;
+        MediaInfo *media;
+        gboolean ok;
+        guint i, j, max, n_priority;
+
+        round = g_ptr_array_new();
+        /* Borrows the paths of the media in round and current */
+        seen = g_hash_table_new(g_str_hash, g_str_equal);
+        for (i = 0; current && i < current->len; i++) {
+                media = current->pdata[i];
+                g_hash_table_add(seen, media->path);
+        }
+        /* Enough rows to fill a round past those of current */
+        max = BACKFILL_ROUND_ROWS + g_hash_table_size(seen);
+
+        backfill_take_priority(self, db, BACKFILL_ROUND_ROWS, round, seen);
+        n_priority = round->len;
+        for (j = 0; round->len < BACKFILL_ROUND_ROWS && (!ctx->within || ctx->within[j]); j++) {
+                if (ctx->within) {
+                        ok = budgie_db_get_untagged_within(db, ctx->within[j],
+                                max - round->len, &untagged);
+                } else {
+                        ok = budgie_db_get_untagged(db, max, &untagged);
+                }
+                if (!ok) {
+                        break;
+                }
+                for (i = 0; i < untagged->len; i++) {
+                        media = untagged->pdata[i];
+                        if (round->len >= BACKFILL_ROUND_ROWS ||
+                            g_hash_table_contains(seen, media->path)) {
+                                free_media_info(media);
+                                continue;
+                        }
+                        g_ptr_array_add(round, media);
+                }
+                g_ptr_array_free(untagged, TRUE);
+                if (!ctx->within) {
+                        break;
+                }
+        }
+        g_hash_table_unref(seen);
+
+        if (budgie_io_order_sort(round, n_priority, self->priv->io_order) == BUDGIE_IO_ORDER_PATH &&
+            !ctx->head_reader) {
+                return round;
+        }
+        prefetch = g_ptr_array_new_full(round->len * 2, g_free);
+        for (i = 0; i < round->len; i++) {
+                media = round->pdata[i];
+                g_ptr_array_add(prefetch, g_strdup(media->path));
+                g_ptr_array_add(prefetch, g_strdup(media->mime));
+        }
+        if (!budgie_queue_push(ctx->prefetch, prefetch)) {
+                g_ptr_array_free(prefetch, TRUE);
+        }
+        return round;
+}
+
+guint budgie_scanner_backfill(BudgieScanner *self,
+                              BudgieDB *db,
+                              GCancellable *cancellable)
+{
+        return budgie_scanner_backfill_within(self, db, NULL, cancellable);
+}
+
+guint budgie_scanner_backfill_within(BudgieScanner *self,
+                                     BudgieDB *db,
+                                     gchar **roots,
+                                     GCancellable *cancellable)
+{
+        ScanContext ctx;
+        BudgieScanProgress progress;
+        GPtrArray *round, *next;
+        MediaInfo *media;
+        gint64 wall, next_report = 0, busy = 0;
+        guint i, n_round, n_tagged = 0;
+        gchar *name;
+
+        g_return_val_if_fail(IS_BUDGIE_SCANNER(self), 0);
+        g_return_val_if_fail(db != NULL, 0);
+
+        scan_context_init(&ctx, self, cancellable);
+        budgie_scan_stats_reset(&ctx.stats, SCAN_PHASE_TAGS);
+        ctx.within = roots;
+        ctx.tag_mode = self->priv->tag_mode;
+        ctx.taggers = g_new0(ScanTagger, ctx.n_workers);
+        ctx.n_tagging = ctx.n_workers;
+        ctx.found = budgie_queue_new(SCAN_QUEUE_LENGTH);
+        ctx.tagged = budgie_queue_new(SCAN_QUEUE_LENGTH);
+        ctx.art = budgie_queue_new(SCAN_QUEUE_LENGTH);
+        /* One round ahead at most, or the cache would evict what it read */
+        ctx.prefetch = budgie_queue_new(1);
+        if (self->priv->tag_io == BUDGIE_TAG_IO_URING) {
+                ctx.head_reader = budgie_head_reader_new(BACKFILL_HEAD_BATCH);
+        }
+        /* Helpers open the files themselves, so there the heads only
+         * warm the page cache */
+        if (ctx.head_reader && !scanner_tag_pool(self)) {
+                ctx.heads = g_hash_table_new_full(g_str_hash, g_str_equal, g_free,
+                        (GDestroyNotify)budgie_tag_head_free);
+                g_mutex_init(&ctx.heads_lock);
+        }
+        ctx.prefetcher = g_thread_new("scan-prefetch", scan_prefetch_run, &ctx);
+        ctx.albums = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
+        g_mutex_init(&ctx.art_lock);
+
+        for (i = 0; i < BACKFILL_ART_THREADS; i++) {
+                ctx.artists[i].ctx = &ctx;
+                name = g_strdup_printf("scan-artist-%u", i);
+                ctx.artists[i].thread = g_thread_new(name, scan_artist_run,
+                        &ctx.artists[i]);
+                g_free(name);
+        }
+        for (i = 0; i < ctx.n_workers; i++) {
+                ctx.taggers[i].ctx = &ctx;
+                name = g_strdup_printf("scan-tagger-%u", i);
+                ctx.taggers[i].thread = g_thread_new(name, scan_tagger_run,
+                        &ctx.taggers[i]);
+                g_free(name);
+        }
+
+        /* Rounds rather than one long stream, so that rows prioritized
+         * while we run are picked up at the start of the next round */
+        round = backfill_next_round(self, &ctx, db, NULL);
+        while (round->len > 0 && !g_cancellable_is_cancelled(cancellable)) {
+                /* Never blocks, a round fits in the queue */
+                for (i = 0; i < round->len; i++) {
+                        budgie_queue_push(ctx.found, round->pdata[i]);
+                }
+                /* Read ahead while this one is tagged */
+                next = backfill_next_round(self, &ctx, db, round);
+
+                n_round = 0;
+                budgie_db_begin_transaction(db);
+                for (i = 0; i < round->len; ) {
+                        media = budgie_queue_pop(ctx.tagged, next_report);
+                        if (media) {
+                                if (media->tagged && budgie_db_update_tags(db, media)) {
+                                        SCAN_STAT_ADD(ctx.stats.n_tagged, 1);
+                                        n_round++;
+                                }
+                                free_media_info(media);
+                                i++;
+                        }
+                        scan_report(&ctx, &next_report);
+                }
+                scan_commit(&ctx, db);
+                g_ptr_array_free(round, TRUE);
+                round = next;
+
+                /* Cancelled part way, keep what was tagged */
+                if (g_cancellable_is_cancelled(cancellable)) {
+                        n_tagged += n_round;
+                        if (n_round > 0) {
+                                g_signal_emit_by_name(self, "tags-updated", n_round);
+                        }
+                        break;
+                }
+                /* Nothing stuck, so the same rows would come back forever */
+                if (n_round == 0) {
+                        g_warning("Unable to store tags, giving up on the backfill");
+                        break;
+                }
+                n_tagged += n_round;
+                g_signal_emit_by_name(self, "tags-updated", n_round);
+        }
+        /* Never handed to the taggers */
+        g_ptr_array_set_free_func(round, (GDestroyNotify)free_media_info);
+        g_ptr_array_free(round, TRUE);
+
+        budgie_queue_close(ctx.found);
+        for (i = 0; i < ctx.n_workers; i++) {
+                g_thread_join(ctx.taggers[i].thread);
+                busy += ctx.taggers[i].busy_time;
+        }
+        budgie_queue_close(ctx.prefetch);
+        g_thread_join(ctx.prefetcher);
+        budgie_head_reader_free(ctx.head_reader);
+        if (ctx.heads) {
+                g_hash_table_unref(ctx.heads);
+                g_mutex_clear(&ctx.heads_lock);
+        }
+        /* Only the taggers push art, so it is complete once they are gone */
+        budgie_queue_close(ctx.art);
+        for (i = 0; i < BACKFILL_ART_THREADS; i++) {
+                g_thread_join(ctx.artists[i].thread);
+        }
+
+        budgie_scan_stats_snapshot(&ctx.stats, &progress);
+        g_signal_emit_by_name(self, "progress", &progress);
+        budgie_scan_progress_dump(&progress);
+
+        wall = MAX(progress.elapsed_usec, 1);
+        g_print("  %u workers, %.2fx estimated parallelism (busy time over wall time)\n",
+                ctx.n_workers, (gdouble)busy / wall);
+
+        budgie_queue_free(ctx.found);
+        budgie_queue_free(ctx.tagged);
+        budgie_queue_free(ctx.art);
+        budgie_queue_free(ctx.prefetch);
+        g_hash_table_unref(ctx.albums);
+        g_mutex_clear(&ctx.art_lock);
+        g_free(ctx.taggers);
+        g_mutex_clear(&ctx.throttle_lock);
+
+        return n_tagged;
+}
+
+void budgie_scanner_prioritize(BudgieScanner *self, gchar **paths)
+{
+        GQueue *priority;
+        guint i;
+
+        g_return_if_fail(IS_BUDGIE_SCANNER(self));
+
+        /* Only what is on screen now matters, forget the last request */
+        g_mutex_lock(&self->priv->priority_lock);
+        priority = self->priv->priority;
+        g_queue_foreach(priority, (GFunc)g_free, NULL);
+        g_queue_clear(priority);
+        for (i = 0; paths && paths[i]; i++) {
+                g_queue_push_tail(priority, g_strdup(paths[i]));
+        }
+        g_mutex_unlock(&self->priv->priority_lock);
+}
+
+MediaInfo* budgie_scanner_read_file(BudgieScanner *self, const gchar *path)
+{
+        ScanEntry entry;
+        MediaInfo *media = NULL;
+        gchar *dir;
+
+        g_return_val_if_fail(IS_BUDGIE_SCANNER(self), NULL);
+
+        if (!budgie_scan_entry_for_path(path, &entry) ||
+            entry.type != SCAN_ENTRY_FILE || entry.name == path) {
+                return NULL;
+        }
+
+        /* Everything before the final separator */
+        dir = g_strndup(path, entry.name - path - 1);
+        media = media_for_entry(NULL, dir, &entry, NULL);
+        if (media) {
+                media_read_tags(self, media, self->priv->tag_mode, NULL);
+        }
+        g_free(dir);
+
+        return media;
+}
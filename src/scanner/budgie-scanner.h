@@ -0,0 +1,175 @@
+/*
+ * budgie-scanner.h
+ *
+ * Copyright 2013 Ikey Doherty <ikey.doherty@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ *
+ *
+ */
+#ifndef budgie_scanner_h
+#define budgie_scanner_h
+
+#include <gio/gio.h>
+
+#include "db/budgie-db.h"
+#include "budgie-scan-stats.h"
+
+typedef struct _BudgieScanner BudgieScanner;
+typedef struct _BudgieScannerClass   BudgieScannerClass;
+typedef struct _BudgieScannerPrivate BudgieScannerPrivate;
+
+#define BUDGIE_SCANNER_TYPE (budgie_scanner_get_type())
+#define BUDGIE_SCANNER(obj)                  (G_TYPE_CHECK_INSTANCE_CAST ((obj), BUDGIE_SCANNER_TYPE, BudgieScanner))
+#define IS_BUDGIE_SCANNER(obj)               (G_TYPE_CHECK_INSTANCE_TYPE ((obj), BUDGIE_SCANNER_TYPE))
+#define BUDGIE_SCANNER_CLASS(klass)          (G_TYPE_CHECK_CLASS_CAST ((klass), BUDGIE_SCANNER_TYPE, BudgieScannerClass))
+#define IS_BUDGIE_SCANNER_CLASS(klass)       (G_TYPE_CHECK_CLASS_TYPE ((klass), BUDGIE_SCANNER_TYPE))
+#define BUDGIE_SCANNER_GET_CLASS(obj)        (G_TYPE_INSTANCE_GET_CLASS ((obj), BUDGIE_SCANNER_TYPE, BudgieScannerClass))
+
+/* BudgieScanner object */
+struct _BudgieScanner {
+        GObject parent;
+
+        BudgieScannerPrivate *priv;
+};
+
+/* BudgieScanner class definition */
+struct _BudgieScannerClass {
+        GObjectClass parent_class;
+};
+
+GType budgie_scanner_get_type(void);
+
+/* BudgieScanner methods */
+
+/**
+ * Construct a new BudgieScanner
+ * @param n_workers Number of threads per scan stage, or 0 for one per CPU
+ * @return A new BudgieScanner
+ */
+BudgieScanner* budgie_scanner_new(guint n_workers);
+
+/**
+ * Search the given directories for media files, and store them
+ *
+ * This is the first of two phases: files are stored with their path, MIME
+ * type and a title taken from the file name, but without reading their
+ * tags. Follow up with budgie_scanner_backfill to read those.
+ *
+ * A pool of worker threads walks the directory trees, stealing whole
+ * subtrees from each other when their own queue runs dry, while the
+ * calling thread writes the results out, committing every few hundred
+ * rows. A bounded queue joins the two, so found media never piles up in
+ * memory.
+ *
+ * Unless the scanner was created with "incremental" set to FALSE, files
+ * whose mtime, size and inode match what the database already holds are
+ * skipped, and so are directories whose mtime matches. Each directory is
+ * committed behind the files found in it, so a walk cut short, even by
+ * a crash, is resumed by the next one rather than repeated.
+ *
+ * Once a walk has run to the end, rows beneath a root for files it did
+ * not find are pruned, unless part of that root could not be listed.
+ * The number pruned is part of the final "progress" emission.
+ * @param self BudgieScanner instance
+ * @param db Database to store results in. Use a connection of its own,
+ *           as the scan opens and commits transactions on it
+ * @param roots NULL terminated list of directories to search
+ * @param cancellable Stops the walk early when cancelled, or NULL. Media
+ *                    and directories found up to then are still stored
+ * @return the number of new or changed files stored
+ */
+guint budgie_scanner_scan(BudgieScanner *self,
+                          BudgieDB *db,
+                          gchar **roots,
+                          GCancellable *cancellable);
+
+/**
+ * Bring the database in line with a changed list of media directories
+ *
+ * Directories that were scanned before but are no longer listed lose
+ * their rows, removed by path range without a walk. Listed directories
+ * that were never scanned to the end are walked as by
+ * budgie_scanner_scan. The rest are left alone, so adding one folder to
+ * a large library costs a walk of that folder only.
+ * @param self BudgieScanner instance
+ * @param db Database to update. Use a connection of its own, as the
+ *           sync opens and commits transactions on it
+ * @param roots NULL terminated list of directories now configured
+ * @param cancellable Stops the walk of new directories early, or NULL
+ * @return the number of new or changed files stored
+ */
+guint budgie_scanner_sync_roots(BudgieScanner *self,
+                                BudgieDB *db,
+                                gchar **roots,
+                                GCancellable *cancellable);
+
+/**
+ * Read the tags of all stored media that lacks them
+ *
+ * This is the second phase of a scan. Tags are read by a pool of threads
+ * in rounds of a few hundred files, each committed as one transaction,
+ * after which "tags-updated" is emitted from the calling thread. Paths
+ * passed to budgie_scanner_prioritize are tagged ahead of the rest.
+ * @param self BudgieScanner instance
+ * @param db Database to update. Use a connection of its own, as the
+ *           backfill opens and commits transactions on it
+ * @param cancellable Stops the backfill after the current round when
+ *                    cancelled, or NULL. Untagged files are left for
+ *                    the next backfill
+ * @return the number of files whose tags were stored
+ */
+guint budgie_scanner_backfill(BudgieScanner *self,
+                              BudgieDB *db,
+                              GCancellable *cancellable);
+
+/**
+ * Read the tags of the stored media beneath some directories that lacks
+ * them, as budgie_scanner_backfill does for the whole library. Use it
+ * after scanning a few new directories, so as not to take on the rest
+ * of the library alongside another backfill
+ * @param self BudgieScanner instance
+ * @param db Database to update, on a connection of its own
+ * @param roots NULL terminated list of directories
+ * @param cancellable Stops the backfill after the current round, or NULL
+ * @return the number of files whose tags were stored
+ */
+guint budgie_scanner_backfill_within(BudgieScanner *self,
+                                     BudgieDB *db,
+                                     gchar **roots,
+                                     GCancellable *cancellable);
+
+/**
+ * Have a running or later backfill tag these files first
+ *
+ * Replaces the paths given in any earlier call. Safe to call from any
+ * thread.
+ * @param self BudgieScanner instance
+ * @param paths NULL terminated list of paths, e.g. the rows on screen
+ */
+void budgie_scanner_prioritize(BudgieScanner *self, gchar **paths);
+
+/**
+ * Classify a single file and read its tags
+ *
+ * You must free the result of this call using free_media_info
+ * @param self BudgieScanner instance
+ * @param path Full path to the file
+ * @return a new MediaInfo, or NULL if the path is not a media file
+ */
+MediaInfo* budgie_scanner_read_file(BudgieScanner *self, const gchar *path);
+
+#endif /* budgie_scanner_h */
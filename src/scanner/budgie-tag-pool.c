@@ -0,0 +1,422 @@
+/*
+ * budgie-tag-pool.c
+ *
+ * Copyright 2013 Ikey Doherty <ikey.doherty@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ *
+ *
+ */
+#define _GNU_SOURCE
+#include <errno.h>
+#include <poll.h>
+#include <signal.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "config.h"
+#include "budgie-tag-pool.h"
+
+/* How long a helper may spend on one file before it is stopped */
+#define TAG_POOL_TIMEOUT_SEC 15
+
+/* A helper hung past this has lost its pool as well, and stops itself */
+#define TAG_POOL_ALARM_SEC (TAG_POOL_TIMEOUT_SEC * 2)
+
+/* Files a helper reads before it is replaced, so that whatever TagLib
+ * leaks goes back to the system now and then */
+#define TAG_POOL_MAX_FILES 5000
+
+/* Largest message either side accepts, far beyond any real set of tags */
+#define TAG_POOL_MAX_MESSAGE (1024 * 1024)
+
+/**
+ * Each message is its size as a native guint32, then a serialized
+ * GVariant. Requests are path, MIME type and BudgieTagMode, the path as
+ * a bytestring as it need not be UTF-8. Replies are whether the file was
+ * read, whether natively, then the BudgieTags fields in order
+ */
+#define TAG_POOL_REQUEST "(^aysu)"
+#define TAG_POOL_REQUEST_TYPE "(aysu)"
+#define TAG_POOL_REPLY "(bbmsmsmsmsuuuuuuu)"
+
+/* One helper process, and our end of its socket */
+typedef struct TagHelper {
+        GPid pid; /**<0 while not running */
+        gint fd;
+        guint n_files;
+} TagHelper;
+
+struct BudgieTagPool {
+        gchar *program;
+        TagHelper *helpers;
+        guint size;
+        GMutex lock;
+        GCond cond;
+        GPtrArray *idle; /**<Helpers not reading a file, borrowed */
+        gboolean broken; /**<No helper could be started, read in process */
+};
+
+static gboolean send_all(gint fd, gconstpointer data, gsize len)
+{
+        const gchar *p = data;
+        gssize n;
+
+        while (len > 0) {
+                /* A helper that died must not take us down with SIGPIPE */
+                n = send(fd, p, len, MSG_NOSIGNAL);
+                if (n < 0) {
+                        if (errno == EINTR) {
+                                continue;
+                        }
+                        return FALSE;
+                }
+                p += n;
+                len -= (gsize)n;
+        }
+        return TRUE;
+}
+
+/**
+ * Receive exactly len bytes, waiting until the deadline at most
+ * @param deadline Monotonic time, or -1 to wait for ever
+ * @return FALSE with errno set, to ETIMEDOUT if the deadline passed and
+ *         EPIPE if the other end went away
+ */
+static gboolean recv_all(gint fd, gpointer data, gsize len, gint64 deadline)
+{
+        struct pollfd pfd = { .fd = fd, .events = POLLIN };
+        gchar *p = data;
+        gint64 remaining;
+        gssize n;
+        gint r;
+
+        while (len > 0) {
+                if (deadline >= 0) {
+                        remaining = deadline - g_get_monotonic_time();
+                        if (remaining <= 0) {
+                                errno = ETIMEDOUT;
+                                return FALSE;
+                        }
+                        r = poll(&pfd, 1, (gint)((remaining + 999) / 1000));
+                        if (r < 0 && errno == EINTR) {
+                                continue;
+                        }
+                        if (r <= 0) {
+                                if (r == 0) {
+                                        errno = ETIMEDOUT;
+                                }
+                                return FALSE;
+                        }
+                }
+                n = recv(fd, p, len, 0);
+                if (n < 0 && errno == EINTR) {
+                        continue;
+                }
+                if (n <= 0) {
+                        if (n == 0) {
+                                errno = EPIPE;
+                        }
+                        return FALSE;
+                }
+                p += n;
+                len -= (gsize)n;
+        }
+        return TRUE;
+}
+
+static gboolean message_send(gint fd, GVariant *message)
+{
+        guint32 size;
+
+        size = (guint32)g_variant_get_size(message);
+        return send_all(fd, &size, sizeof(size)) &&
+                send_all(fd, g_variant_get_data(message), size);
+}
+
+/**
+ * Receive one message. The data is not trusted, a message that does not
+ * match the type reads as its default value
+ * @return a new GVariant, or NULL with errno set as by recv_all
+ */
+static GVariant *message_recv(gint fd, const gchar *type, gint64 deadline)
+{
+        guint32 size;
+        gchar *data;
+
+        if (!recv_all(fd, &size, sizeof(size), deadline)) {
+                return NULL;
+        }
+        if (size > TAG_POOL_MAX_MESSAGE) {
+                errno = EPROTO;
+                return NULL;
+        }
+        data = g_malloc(size);
+        if (!recv_all(fd, data, size, deadline)) {
+                g_free(data);
+                return NULL;
+        }
+        return g_variant_ref_sink(g_variant_new_from_data(G_VARIANT_TYPE(type),
+                data, size, FALSE, g_free, data));
+}
+
+/* GVariant strings must be UTF-8, drop any tag that is not */
+static const gchar *valid_utf8(const gchar *text)
+{
+        return text && g_utf8_validate(text, -1, NULL) ? text : NULL;
+}
+
+static void tag_helper_child_setup(gpointer data)
+{
+        gint fd = GPOINTER_TO_INT(data);
+
+        /* The socket is both its stdin and its stdout */
+        dup2(fd, STDIN_FILENO);
+        dup2(fd, STDOUT_FILENO);
+}
+
+static gboolean tag_helper_start(TagHelper *helper, const gchar *program)
+{
+        gchar *argv[] = { (gchar*)program, NULL };
+        GError *error = NULL;
+        gint fds[2];
+
+        if (socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, fds) != 0) {
+                g_warning("Unable to create a socket for %s: %s", program,
+                        g_strerror(errno));
+                return FALSE;
+        }
+        if (!g_spawn_async(NULL, argv, NULL,
+                           G_SPAWN_DO_NOT_REAP_CHILD | G_SPAWN_CHILD_INHERITS_STDIN,
+                           tag_helper_child_setup, GINT_TO_POINTER(fds[1]),
+                           &helper->pid, &error)) {
+                g_warning("Unable to start %s: %s", program, error->message);
+                g_error_free(error);
+                close(fds[0]);
+                close(fds[1]);
+                helper->pid = 0;
+                return FALSE;
+        }
+        close(fds[1]);
+        helper->fd = fds[0];
+        helper->n_files = 0;
+        return TRUE;
+}
+
+/**
+ * Stop a helper and reap it
+ * @param force Kill it, rather than wait for it to exit on its own once
+ *              its socket is closed
+ * @return its wait status
+ */
+static gint tag_helper_stop(TagHelper *helper, gboolean force)
+{
+        gint status = 0;
+
+        if (force) {
+                kill(helper->pid, SIGKILL);
+        }
+        close(helper->fd);
+        while (waitpid(helper->pid, &status, 0) < 0 && errno == EINTR) {
+                ;
+        }
+        g_spawn_close_pid(helper->pid);
+        helper->pid = 0;
+        helper->fd = -1;
+        return status;
+}
+
+static void tag_pool_release(BudgieTagPool *pool, TagHelper *helper)
+{
+        g_mutex_lock(&pool->lock);
+        g_ptr_array_add(pool->idle, helper);
+        g_cond_signal(&pool->cond);
+        g_mutex_unlock(&pool->lock);
+}
+
+BudgieTagPool *budgie_tag_pool_new(guint size)
+{
+        BudgieTagPool *pool;
+        const gchar *program;
+        guint i;
+
+        g_return_val_if_fail(size > 0, NULL);
+
+        pool = g_new0(BudgieTagPool, 1);
+        program = g_getenv("BUDGIE_TAG_WORKER");
+        if (program && *program) {
+                pool->program = g_strdup(program);
+        } else {
+                pool->program = g_build_filename(LIBEXECDIR, BUDGIE_TAG_WORKER, NULL);
+        }
+        pool->size = size;
+        pool->helpers = g_new0(TagHelper, size);
+        pool->idle = g_ptr_array_sized_new(size);
+        for (i = 0; i < size; i++) {
+                pool->helpers[i].fd = -1;
+                g_ptr_array_add(pool->idle, &pool->helpers[i]);
+        }
+        g_mutex_init(&pool->lock);
+        g_cond_init(&pool->cond);
+
+        return pool;
+}
+
+gboolean budgie_tag_pool_read(BudgieTagPool *pool,
+                              const gchar *path,
+                              const gchar *mime,
+                              BudgieTagMode mode,
+                              BudgieTags *tags,
+                              gboolean *native)
+{
+        TagHelper *helper;
+        GVariant *request, *reply;
+        gboolean ret = FALSE, sent = FALSE;
+        gint attempt, status, error;
+
+        *native = FALSE;
+        g_mutex_lock(&pool->lock);
+        while (pool->idle->len == 0 && !pool->broken) {
+                g_cond_wait(&pool->cond, &pool->lock);
+        }
+        if (pool->broken) {
+                g_mutex_unlock(&pool->lock);
+                return budgie_tags_read_mode(path, mime, NULL, mode, tags, native);
+        }
+        helper = g_ptr_array_remove_index_fast(pool->idle, pool->idle->len - 1);
+        g_mutex_unlock(&pool->lock);
+
+        /* A helper that died while idle is not this file's doing, so the
+         * file gets a fresh one */
+        request = g_variant_ref_sink(g_variant_new(TAG_POOL_REQUEST,
+                path, mime ? mime : "", (guint32)mode));
+        for (attempt = 0; attempt < 2 && !sent; attempt++) {
+                if (helper->pid == 0 && !tag_helper_start(helper, pool->program)) {
+                        break;
+                }
+                sent = message_send(helper->fd, request);
+                if (!sent) {
+                        tag_helper_stop(helper, TRUE);
+                }
+        }
+        g_variant_unref(request);
+
+        if (!sent) {
+                if (helper->pid == 0) {
+                        g_mutex_lock(&pool->lock);
+                        if (!pool->broken) {
+                                g_warning("Reading tags in the indexer process instead");
+                                pool->broken = TRUE;
+                                g_cond_broadcast(&pool->cond);
+                        }
+                        g_mutex_unlock(&pool->lock);
+                        ret = budgie_tags_read_mode(path, mime, NULL, mode, tags, native);
+                }
+                tag_pool_release(pool, helper);
+                return ret;
+        }
+
+        reply = message_recv(helper->fd, TAG_POOL_REPLY,
+                g_get_monotonic_time() + TAG_POOL_TIMEOUT_SEC * G_USEC_PER_SEC);
+        error = errno;
+        if (reply) {
+                g_variant_get(reply, TAG_POOL_REPLY, &ret, native,
+                        &tags->title, &tags->artist, &tags->album, &tags->genre,
+                        &tags->track, &tags->disc, &tags->year, &tags->duration,
+                        &tags->bitrate, &tags->sample_rate, &tags->channels);
+                g_variant_unref(reply);
+                if (++helper->n_files >= TAG_POOL_MAX_FILES) {
+                        tag_helper_stop(helper, FALSE);
+                }
+        } else if (error == ETIMEDOUT) {
+                g_warning("Gave up reading the tags of %s after %d seconds",
+                        path, TAG_POOL_TIMEOUT_SEC);
+                tag_helper_stop(helper, TRUE);
+        } else {
+                status = tag_helper_stop(helper, TRUE);
+                if (WIFSIGNALED(status)) {
+                        g_warning("Reading the tags of %s crashed %s: %s", path,
+                                BUDGIE_TAG_WORKER, g_strsignal(WTERMSIG(status)));
+                } else {
+                        g_warning("Reading the tags of %s failed in %s: %s", path,
+                                BUDGIE_TAG_WORKER, g_strerror(error));
+                }
+        }
+        tag_pool_release(pool, helper);
+
+        return ret;
+}
+
+void budgie_tag_pool_free(BudgieTagPool *pool)
+{
+        guint i;
+
+        if (!pool) {
+                return;
+        }
+        /* Idle helpers exit as soon as they see the socket close */
+        for (i = 0; i < pool->size; i++) {
+                if (pool->helpers[i].pid != 0) {
+                        tag_helper_stop(&pool->helpers[i], FALSE);
+                }
+        }
+        g_ptr_array_free(pool->idle, TRUE);
+        g_free(pool->helpers);
+        g_mutex_clear(&pool->lock);
+        g_cond_clear(&pool->cond);
+        g_free(pool->program);
+        g_free(pool);
+}
+
+gboolean budgie_tag_pool_serve(gint fd)
+{
+        GVariant *request, *reply;
+        BudgieTags tags = { 0 };
+        gchar *path;
+        const gchar *mime;
+        guint32 mode;
+        gboolean ok, native, sent;
+
+        while ((request = message_recv(fd, TAG_POOL_REQUEST_TYPE, -1)) != NULL) {
+                g_variant_get(request, "(^ay&su)", &path, &mime, &mode);
+                if (mode >= BUDGIE_TAGS_MAX) {
+                        mode = BUDGIE_TAGS_DEFAULT;
+                }
+
+                alarm(TAG_POOL_ALARM_SEC);
+                ok = budgie_tags_read_mode(path, *mime ? mime : NULL, NULL, mode,
+                        &tags, &native);
+                alarm(0);
+
+                reply = g_variant_ref_sink(g_variant_new(TAG_POOL_REPLY, ok, native,
+                        valid_utf8(tags.title), valid_utf8(tags.artist),
+                        valid_utf8(tags.album), valid_utf8(tags.genre),
+                        tags.track, tags.disc, tags.year, tags.duration,
+                        tags.bitrate, tags.sample_rate, tags.channels));
+                sent = message_send(fd, reply);
+                g_variant_unref(reply);
+                g_variant_unref(request);
+                budgie_tags_clear(&tags);
+                g_free(path);
+                if (!sent) {
+                        return FALSE;
+                }
+        }
+        /* The pool closing the socket between requests is how we stop */
+        return errno == EPIPE;
+}
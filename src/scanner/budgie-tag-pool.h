@@ -0,0 +1,91 @@
+/*
+ * budgie-tag-pool.h
+ *
+ * Copyright 2013 Ikey Doherty <ikey.doherty@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ *
+ *
+ */
+#ifndef budgie_tag_pool_h
+#define budgie_tag_pool_h
+
+#include <glib.h>
+
+#include "budgie-tag-reader.h"
+
+/**
+ * Name of the helper program, installed in LIBEXECDIR. Setting the
+ * BUDGIE_TAG_WORKER environment variable to a path overrides it, to run
+ * from a build tree
+ */
+#define BUDGIE_TAG_WORKER "budgie-tag-worker"
+
+/**
+ * A pool of helper processes reading tags on behalf of the scanner, so
+ * that a file crashing or hanging TagLib costs that file's tags rather
+ * than the indexer. Each helper reads one file at a time, so the pool
+ * parses as many files in parallel as it has helpers
+ */
+typedef struct BudgieTagPool BudgieTagPool;
+
+/**
+ * Construct a new BudgieTagPool. Helpers are started as they are first
+ * needed, and again whenever one had to be stopped
+ *
+ * @param size Most helpers to run at once
+ * @return a new BudgieTagPool
+ */
+BudgieTagPool *budgie_tag_pool_new(guint size);
+
+/**
+ * Read the tags of a file in a helper, as budgie_tags_read_mode does.
+ * Blocks until a helper is free. A helper that crashes or takes too
+ * long over the file is stopped, and the file reported unreadable.
+ * Where no helper can be started the file is read in this process.
+ * Safe to call from several threads at once
+ *
+ * @param pool BudgieTagPool instance
+ * @param path Path of the file
+ * @param mime MIME type the file was classified as
+ * @param mode Who reads the tags
+ * @param tags Where to store the tags, which must be empty
+ * @param native Set to whether the tags were read without TagLib
+ * @return TRUE if the file could be read at all
+ */
+gboolean budgie_tag_pool_read(BudgieTagPool *pool,
+                              const gchar *path,
+                              const gchar *mime,
+                              BudgieTagMode mode,
+                              BudgieTags *tags,
+                              gboolean *native);
+
+/**
+ * Stop the helpers of a pool and free it. No read may be in progress
+ * @param pool BudgieTagPool instance
+ */
+void budgie_tag_pool_free(BudgieTagPool *pool);
+
+/**
+ * Answer requests from a pool until it goes away. This is the body of
+ * the helper program
+ *
+ * @param fd Socket connected to the pool
+ * @return TRUE if the pool closed the connection, FALSE on an error
+ */
+gboolean budgie_tag_pool_serve(gint fd);
+
+#endif /* budgie_tag_pool_h */
@@ -0,0 +1,1727 @@
+/*
+ * budgie-tag-reader.c
+ *
+ * Copyright 2013 Ikey Doherty <ikey.doherty@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ *
+ *
+ */
+#define _GNU_SOURCE
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "budgie-tag-reader.h"
+
+#include <taglib/tag_c.h>
+
+/* Read ahead of the parser: the tags at the head of a file and the first
+ * audio frames after them, in one request */
+#define PREFETCH_HEAD_SIZE (128 * 1024)
+
+/* Largest single value we read. Anything bigger is left to TagLib */
+#define TAG_VALUE_MAX (64 * 1024)
+
+/* Largest block of Vorbis comments, which in Ogg may embed cover art */
+#define TAG_COMMENT_MAX (1024 * 1024)
+
+/* Largest embedded picture we extract */
+#define TAG_PICTURE_MAX (16 * 1024 * 1024)
+
+/* ID3v2 and FLAC picture type of the front cover */
+#define PICTURE_FRONT_COVER 3
+
+#define ID3V1_SIZE 128
+#define APE_FOOTER_SIZE 32
+
+/* How far past the ID3v2 tag the first MPEG frame is looked for */
+#define MPEG_SYNC_WINDOW (64 * 1024)
+
+/* Enough of an MPEG frame to hold a Xing or VBRI header */
+#define MPEG_HEADER_PEEK 64
+
+/* How much of the end of an Ogg file is searched for its last page */
+#define OGG_TAIL_SIZE (64 * 1024)
+
+/* Opus granule positions always count at 48kHz */
+#define OPUS_RATE 48000
+
+/* Bits of BudgieTags, for remembering which ID3v2 frames were seen */
+#define TAG_TITLE (1 << 0)
+#define TAG_ARTIST (1 << 1)
+#define TAG_ALBUM (1 << 2)
+#define TAG_GENRE (1 << 3)
+#define TAG_TRACK (1 << 4)
+#define TAG_DISC (1 << 5)
+#define TAG_YEAR (1 << 6)
+
+/* Tags stored as numbers rather than text */
+#define TAG_NUMBERS (TAG_TRACK | TAG_DISC | TAG_YEAR)
+
+#define MAGIC(data, offset, str) \
+        (memcmp((data) + (offset), (str), sizeof(str) - 1) == 0)
+
+/* ID3v1 genres, with the Winamp extensions, spelled as TagLib does */
+static const gchar *genres[] = {
+        "Blues", "Classic Rock", "Country", "Dance", "Disco", "Funk",
+        "Grunge", "Hip-Hop", "Jazz", "Metal", "New Age", "Oldies", "Other",
+        "Pop", "R&B", "Rap", "Reggae", "Rock", "Techno", "Industrial",
+        "Alternative", "Ska", "Death Metal", "Pranks", "Soundtrack",
+        "Euro-Techno", "Ambient", "Trip-Hop", "Vocal", "Jazz+Funk", "Fusion",
+        "Trance", "Classical", "Instrumental", "Acid", "House", "Game",
+        "Sound Clip", "Gospel", "Noise", "Alternative Rock", "Bass", "Soul",
+        "Punk", "Space", "Meditative", "Instrumental Pop",
+        "Instrumental Rock", "Ethnic", "Gothic", "Darkwave",
+        "Techno-Industrial", "Electronic", "Pop-Folk", "Eurodance", "Dream",
+        "Southern Rock", "Comedy", "Cult", "Gangsta", "Top 40",
+        "Christian Rap", "Pop/Funk", "Jungle", "Native American", "Cabaret",
+        "New Wave", "Psychedelic", "Rave", "Showtunes", "Trailer", "Lo-Fi",
+        "Tribal", "Acid Punk", "Acid Jazz", "Polka", "Retro", "Musical",
+        "Rock & Roll", "Hard Rock", "Folk", "Folk/Rock", "National Folk",
+        "Swing", "Fusion", "Bebob", "Latin", "Revival", "Celtic",
+        "Bluegrass", "Avantgarde", "Gothic Rock", "Progressive Rock",
+        "Psychedelic Rock", "Symphonic Rock", "Slow Rock", "Big Band",
+        "Chorus", "Easy Listening", "Acoustic", "Humour", "Speech",
+        "Chanson", "Opera", "Chamber Music", "Sonata", "Symphony",
+        "Booty Bass", "Primus", "Porn Groove", "Satire", "Slow Jam", "Club",
+        "Tango", "Samba", "Folklore", "Ballad", "Power Ballad",
+        "Rhythmic Soul", "Freestyle", "Duet", "Punk Rock", "Drum Solo",
+        "A Cappella", "Euro-House", "Dance Hall", "Goa", "Drum & Bass",
+        "Club-House", "Hardcore", "Terror", "Indie", "BritPop", "Negerpunk",
+        "Polsk Punk", "Beat", "Christian Gangsta Rap", "Heavy Metal",
+        "Black Metal", "Crossover", "Contemporary Christian",
+        "Christian Rock", "Merengue", "Salsa", "Thrash Metal", "Anime",
+        "Jpop", "Synthpop", "Abstract", "Art Rock", "Baroque", "Bhangra",
+        "Big Beat", "Breakbeat", "Chillout", "Downtempo", "Dub", "EBM",
+        "Eclectic", "Electro", "Electroclash", "Emo", "Experimental",
+        "Garage", "Global", "IDM", "Illbient", "Industro-Goth", "Jam Band",
+        "Krautrock", "Leftfield", "Lounge", "Math Rock", "New Romantic",
+        "Nu-Breakz", "Post-Punk", "Post-Rock", "Psytrance", "Shoegaze",
+        "Space Rock", "Trop Rock", "World Music", "Neoclassical",
+        "Audiobook", "Audio Theatre", "Neue Deutsche Welle", "Podcast",
+        "Indie Rock", "G-Funk", "Dubstep", "Garage Rock", "Psybient",
+};
+
+/* Bitrates in kbit/s by MPEG-1 or later, layer and index */
+static const guint16 mpeg_bitrates[2][3][16] = {
+        {
+                { 0, 32, 64, 96, 128, 160, 192, 224, 256, 288, 320, 352, 384, 416, 448, 0 },
+                { 0, 32, 48, 56, 64, 80, 96, 112, 128, 160, 192, 224, 256, 320, 384, 0 },
+                { 0, 32, 40, 48, 56, 64, 80, 96, 112, 128, 160, 192, 224, 256, 320, 0 },
+        },
+        {
+                { 0, 32, 48, 56, 64, 80, 96, 112, 128, 144, 160, 176, 192, 224, 256, 0 },
+                { 0, 8, 16, 24, 32, 40, 48, 56, 64, 80, 96, 112, 128, 144, 160, 0 },
+                { 0, 8, 16, 24, 32, 40, 48, 56, 64, 80, 96, 112, 128, 144, 160, 0 },
+        },
+};
+
+/* MPEG-1 sample rates. MPEG-2 halves them and MPEG-2.5 quarters them */
+static const guint mpeg_rates[3] = { 44100, 48000, 32000 };
+
+/* An open file, and how far it may be read */
+typedef struct TagFile {
+        int fd;
+        gint64 size;
+        const guint8 *head; /**<Start of the file, read ahead by the caller */
+        gsize head_len;
+        gboolean want_cover; /**<Whether pictures are read too */
+        gboolean cover_is_front;
+        GBytes *cover;
+} TagFile;
+
+static inline guint32 be16(const guint8 *p)
+{
+        return (guint32)p[0] << 8 | p[1];
+}
+
+static inline guint32 be24(const guint8 *p)
+{
+        return (guint32)p[0] << 16 | (guint32)p[1] << 8 | p[2];
+}
+
+static inline guint32 be32(const guint8 *p)
+{
+        return (guint32)p[0] << 24 | (guint32)p[1] << 16 | (guint32)p[2] << 8 | p[3];
+}
+
+static inline guint64 be64(const guint8 *p)
+{
+        return (guint64)be32(p) << 32 | be32(p + 4);
+}
+
+static inline guint32 le16(const guint8 *p)
+{
+        return (guint32)p[1] << 8 | p[0];
+}
+
+static inline guint32 le32(const guint8 *p)
+{
+        return (guint32)p[3] << 24 | (guint32)p[2] << 16 | (guint32)p[1] << 8 | p[0];
+}
+
+static inline guint64 le64(const guint8 *p)
+{
+        return (guint64)le32(p + 4) << 32 | le32(p);
+}
+
+/* ID3v2 sizes keep the top bit of every byte clear */
+static inline guint32 syncsafe32(const guint8 *p)
+{
+        return (guint32)(p[0] & 0x7f) << 21 | (guint32)(p[1] & 0x7f) << 14 |
+                (guint32)(p[2] & 0x7f) << 7 | (p[3] & 0x7f);
+}
+
+/**
+ * Read exactly len bytes at offset, never past the end of the file
+ */
+static gboolean read_at(TagFile *file, gint64 offset, gpointer buf, gsize len)
+{
+        gsize done = 0;
+        ssize_t r;
+
+        if (offset < 0 || len > (guint64)file->size || offset > file->size - (gint64)len) {
+                return FALSE;
+        }
+        if (len <= file->head_len && (guint64)offset <= file->head_len - len) {
+                memcpy(buf, file->head + offset, len);
+                return TRUE;
+        }
+        while (done < len) {
+                r = pread(file->fd, (guint8*)buf + done, len - done, offset + done);
+                if (r < 0 && errno == EINTR) {
+                        continue;
+                }
+                if (r <= 0) {
+                        return FALSE;
+                }
+                done += r;
+        }
+        return TRUE;
+}
+
+static guint8 *read_alloc(TagFile *file, gint64 offset, gsize len)
+{
+        guint8 *buf;
+
+        buf = g_malloc(MAX(len, 1));
+        if (!read_at(file, offset, buf, len)) {
+                g_free(buf);
+                return NULL;
+        }
+        return buf;
+}
+
+static gchar *text_from_utf8(const guint8 *data, gsize len)
+{
+        if (!g_utf8_validate((const gchar*)data, len, NULL)) {
+                return NULL;
+        }
+        return g_strndup((const gchar*)data, len);
+}
+
+static gchar *text_from_charset(const guint8 *data, gsize len, const gchar *charset)
+{
+        return g_convert((const gchar*)data, len, "UTF-8", charset, NULL, NULL, NULL);
+}
+
+/**
+ * Add one value to a tag, joining multiple values the way TagLib does.
+ * Takes ownership of value
+ */
+static void tag_append(gchar **field, gchar *value, const gchar *separator)
+{
+        gchar *joined;
+
+        if (!value) {
+                return;
+        }
+        if (*value == '\0') {
+                g_free(value);
+                return;
+        }
+        if (!*field) {
+                *field = value;
+                return;
+        }
+        joined = g_strconcat(*field, separator, value, NULL);
+        g_free(*field);
+        g_free(value);
+        *field = joined;
+}
+
+/* Whether a later tag could still add anything */
+static gboolean tags_complete(BudgieTags *tags)
+{
+        return tags->title && tags->artist && tags->album && tags->genre &&
+                tags->track && tags->year;
+}
+
+/**
+ * The number a tag value starts with, such as 3 for a track of "3/12"
+ * or 2004 for a date of "2004-05-01". 0 if there is none
+ */
+static guint tag_number(const gchar *value)
+{
+        guint ret = 0, digits = 0;
+
+        if (!value) {
+                return 0;
+        }
+        while (g_ascii_isspace(*value)) {
+                value++;
+        }
+        /* Nine digits can't overflow */
+        for (; g_ascii_isdigit(*value) && digits < 9; value++, digits++) {
+                ret = ret * 10 + (*value - '0');
+        }
+        return ret;
+}
+
+/**
+ * Store the number of a text value, unless the tag was set already.
+ * Takes ownership of value
+ */
+static void tag_set_number(guint *field, gchar *value)
+{
+        if (*field == 0) {
+                *field = tag_number(value);
+        }
+        g_free(value);
+}
+
+/* Length in milliseconds of a number of samples */
+static inline guint samples_to_msec(guint64 samples, guint rate)
+{
+        if (rate == 0) {
+                return 0;
+        }
+        return (guint)MIN(samples * 1000 / rate, G_MAXUINT);
+}
+
+/* Average kbit/s of a stream, which is bits per millisecond */
+static inline guint stream_bitrate(gint64 bytes, guint duration)
+{
+        if (bytes <= 0 || duration == 0) {
+                return 0;
+        }
+        return (guint)MIN((guint64)bytes * 8 / duration, G_MAXUINT);
+}
+
+/**
+ * Whether a string is a plain ID3v1 genre number
+ */
+static gboolean is_genre_number(const gchar *value, guint *number)
+{
+        gsize len = strlen(value), i;
+
+        if (len == 0 || len > 3) {
+                return FALSE;
+        }
+        for (i = 0; i < len; i++) {
+                if (!g_ascii_isdigit(value[i])) {
+                        return FALSE;
+                }
+        }
+        *number = (guint)atoi(value);
+        return TRUE;
+}
+
+/**
+ * Decode one value of an ID3v2 text frame
+ */
+static gchar *id3v2_value(guint8 encoding, const guint8 *data, gsize len)
+{
+        switch (encoding) {
+                case 0:
+                        return text_from_charset(data, len, "ISO-8859-1");
+                case 1:
+                        /* Every value carries its own byte order mark */
+                        if (len >= 2 && data[0] == 0xff && data[1] == 0xfe) {
+                                return text_from_charset(data + 2, len - 2, "UTF-16LE");
+                        }
+                        if (len >= 2 && data[0] == 0xfe && data[1] == 0xff) {
+                                return text_from_charset(data + 2, len - 2, "UTF-16BE");
+                        }
+                        return text_from_charset(data, len, "UTF-16LE");
+                case 2:
+                        return text_from_charset(data, len, "UTF-16BE");
+                case 3:
+                        return text_from_utf8(data, len);
+                default:
+                        return NULL;
+        }
+}
+
+/**
+ * Split an ID3v2 text frame into its values, which ID3v2.4 separates
+ * with a terminator of the frame's encoding
+ */
+static GPtrArray *id3v2_text(const guint8 *data, gsize len)
+{
+        GPtrArray *values;
+        guint8 encoding;
+        gsize i, start = 0, width;
+        gchar *value;
+
+        values = g_ptr_array_new_with_free_func(g_free);
+        if (len < 1) {
+                return values;
+        }
+        encoding = data[0];
+        data++;
+        len--;
+        width = (encoding == 1 || encoding == 2) ? 2 : 1;
+
+        for (i = 0; i + width <= len; i += width) {
+                if (data[i] != 0 || (width == 2 && data[i + 1] != 0)) {
+                        continue;
+                }
+                value = id3v2_value(encoding, data + start, i - start);
+                if (value) {
+                        g_ptr_array_add(values, value);
+                }
+                start = i + width;
+        }
+        if (start < len) {
+                value = id3v2_value(encoding, data + start, (len - start) / width * width);
+                if (value) {
+                        g_ptr_array_add(values, value);
+                }
+        }
+        return values;
+}
+
+/**
+ * Turn the values of a TCON frame into genre names. Numbers refer to
+ * ID3v1 genres, either bare or as an ID3v2.3 style "(17)" followed by an
+ * optional refinement. Duplicates are dropped, as TagLib does.
+ */
+static void id3v2_genre(GPtrArray *values, gchar **field)
+{
+        GPtrArray *names;
+        const gchar *name, *close;
+        gchar *value, *inner;
+        guint i, j, number;
+
+        names = g_ptr_array_new();
+        for (i = 0; i < values->len; i++) {
+                value = values->pdata[i];
+                name = value;
+                if (value[0] == '(' && (close = strchr(value, ')')) != NULL) {
+                        inner = g_strndup(value + 1, close - value - 1);
+                        name = close + 1;
+                        if (*name == '\0' && is_genre_number(inner, &number)) {
+                                name = budgie_tags_genre_name(number);
+                        }
+                        g_free(inner);
+                } else if (is_genre_number(value, &number)) {
+                        name = budgie_tags_genre_name(number);
+                }
+                if (!name || *name == '\0') {
+                        continue;
+                }
+                for (j = 0; j < names->len; j++) {
+                        if (g_str_equal(names->pdata[j], name)) {
+                                break;
+                        }
+                }
+                if (j == names->len) {
+                        g_ptr_array_add(names, (gpointer)name);
+                }
+        }
+        for (i = 0; i < names->len; i++) {
+                tag_append(field, g_strdup(names->pdata[i]), " ");
+        }
+        g_ptr_array_free(names, TRUE);
+}
+
+/**
+ * The tag an ID3v2 frame fills in, if it is one we store
+ */
+static guint id3v2_frame_tag(const guint8 *id, guint major)
+{
+        if (major == 2) {
+                return MAGIC(id, 0, "TT2") ? TAG_TITLE :
+                        MAGIC(id, 0, "TP1") ? TAG_ARTIST :
+                        MAGIC(id, 0, "TAL") ? TAG_ALBUM :
+                        MAGIC(id, 0, "TCO") ? TAG_GENRE :
+                        MAGIC(id, 0, "TRK") ? TAG_TRACK :
+                        MAGIC(id, 0, "TPA") ? TAG_DISC :
+                        MAGIC(id, 0, "TYE") ? TAG_YEAR : 0;
+        }
+        /* TYER is ID3v2.3, TDRC its ID3v2.4 replacement */
+        return MAGIC(id, 0, "TIT2") ? TAG_TITLE :
+                MAGIC(id, 0, "TPE1") ? TAG_ARTIST :
+                MAGIC(id, 0, "TALB") ? TAG_ALBUM :
+                MAGIC(id, 0, "TCON") ? TAG_GENRE :
+                MAGIC(id, 0, "TRCK") ? TAG_TRACK :
+                MAGIC(id, 0, "TPOS") ? TAG_DISC :
+                MAGIC(id, 0, "TYER") ? TAG_YEAR :
+                MAGIC(id, 0, "TDRC") ? TAG_YEAR : 0;
+}
+
+static guint *tags_number(BudgieTags *tags, guint tag)
+{
+        switch (tag) {
+                case TAG_TRACK:
+                        return &tags->track;
+                case TAG_DISC:
+                        return &tags->disc;
+                default:
+                        return &tags->year;
+        }
+}
+
+static gchar **tags_field(BudgieTags *tags, guint tag)
+{
+        switch (tag) {
+                case TAG_TITLE:
+                        return &tags->title;
+                case TAG_ARTIST:
+                        return &tags->artist;
+                case TAG_ALBUM:
+                        return &tags->album;
+                default:
+                        return &tags->genre;
+        }
+}
+
+/**
+ * Keep a picture as the cover, unless we have one already. A front cover
+ * wins over any other kind of picture
+ */
+static void cover_offer(TagFile *file, guint type, const guint8 *data, gsize len)
+{
+        gboolean front = type == PICTURE_FRONT_COVER;
+
+        if (len == 0 || (file->cover && (file->cover_is_front || !front))) {
+                return;
+        }
+        g_clear_pointer(&file->cover, g_bytes_unref);
+        file->cover = g_bytes_new(data, len);
+        file->cover_is_front = front;
+}
+
+/**
+ * Offset just past a NUL terminated ID3v2 string in the given encoding,
+ * or beyond len if it is not terminated
+ */
+static gsize id3v2_skip_text(const guint8 *data, gsize pos, gsize len, guint encoding)
+{
+        if (encoding == 1 || encoding == 2) {
+                for (; pos + 2 <= len; pos += 2) {
+                        if (data[pos] == 0 && data[pos + 1] == 0) {
+                                return pos + 2;
+                        }
+                }
+                return len + 1;
+        }
+        for (; pos < len; pos++) {
+                if (data[pos] == 0) {
+                        return pos + 1;
+                }
+        }
+        return len + 1;
+}
+
+/**
+ * An APIC frame, or a PIC frame in ID3v2.2: the text encoding, a MIME
+ * type (a three letter format in PIC), the picture type and a
+ * description, then the image itself
+ */
+static void id3v2_picture(TagFile *file, const guint8 *data, gsize len, guint major)
+{
+        const guint8 *end;
+        guint encoding, type;
+        gsize pos = 1;
+
+        if (len < 2) {
+                return;
+        }
+        encoding = data[0];
+        if (major == 2) {
+                pos += 3;
+        } else {
+                end = memchr(data + pos, 0, len - pos);
+                if (!end) {
+                        return;
+                }
+                pos = end - data + 1;
+        }
+        if (pos >= len) {
+                return;
+        }
+        type = data[pos++];
+        pos = id3v2_skip_text(data, pos, len, encoding);
+        if (pos > len) {
+                return;
+        }
+        cover_offer(file, type, data + pos, len - pos);
+}
+
+/**
+ * Read an ID3v2 tag at the start of the file, frame by frame, so that
+ * pictures and other large frames are never read at all
+ * @param audio Set to where the audio starts, after the tag
+ * @return FALSE if the tag needs TagLib
+ */
+static gboolean read_id3v2(TagFile *file, BudgieTags *tags, gint64 *audio)
+{
+        guint8 header[10];
+        guint8 *data;
+        GPtrArray *values;
+        guint major, flags, frame_flags, header_len, id_len, tag, seen = 0, i;
+        gint64 pos, end;
+        guint32 size;
+
+        *audio = 0;
+        if (!read_at(file, 0, header, sizeof(header)) || !MAGIC(header, 0, "ID3")) {
+                return TRUE;
+        }
+        major = header[3];
+        flags = header[5];
+        /* Unsynchronised tags are rare enough to leave to TagLib */
+        if (major < 2 || major > 4 || (flags & 0x80)) {
+                return FALSE;
+        }
+        end = sizeof(header) + (gint64)syncsafe32(header + 6);
+        pos = sizeof(header);
+        /* ID3v2.4 may repeat the header as a footer */
+        *audio = end + (major == 4 && (flags & 0x10) ? sizeof(header) : 0);
+
+        if (flags & 0x40) {
+                /* Compression, in ID3v2.2 */
+                if (major == 2 || !read_at(file, pos, header, 4)) {
+                        return FALSE;
+                }
+                pos += major == 3 ? be32(header) + 4 : syncsafe32(header);
+        }
+
+        header_len = major == 2 ? 6 : 10;
+        id_len = major == 2 ? 3 : 4;
+        while (pos + header_len <= end) {
+                if (!read_at(file, pos, header, header_len)) {
+                        return FALSE;
+                }
+                /* Padding */
+                if (header[0] == 0) {
+                        break;
+                }
+                /* Garbage, such as iTunes' non-syncsafe ID3v2.4 sizes */
+                for (i = 0; i < id_len; i++) {
+                        if (!g_ascii_isupper(header[i]) && !g_ascii_isdigit(header[i])) {
+                                return FALSE;
+                        }
+                }
+                if (major == 2) {
+                        size = be24(header + 3);
+                        frame_flags = 0;
+                } else {
+                        size = major == 4 ? syncsafe32(header + 4) : be32(header + 4);
+                        frame_flags = be16(header + 8);
+                }
+                pos += header_len;
+                if (size > end - pos) {
+                        return FALSE;
+                }
+
+                /* Pictures are only read when asked for, and skipped
+                 * rather than left to TagLib when we can't */
+                if (file->want_cover && (major == 2 ? MAGIC(header, 0, "PIC") : MAGIC(header, 0, "APIC"))) {
+                        if (!(major == 3 && (frame_flags & 0x00c0)) &&
+                            !(major == 4 && (frame_flags & 0x000e)) && size <= TAG_PICTURE_MAX &&
+                            (data = read_alloc(file, pos, size))) {
+                                i = major == 4 && (frame_flags & 0x0001) ? MIN(size, 4) : 0;
+                                id3v2_picture(file, data + i, size - i, major);
+                                g_free(data);
+                        }
+                        pos += size;
+                        continue;
+                }
+
+                /* Only the first frame of each kind counts */
+                tag = id3v2_frame_tag(header, major);
+                if (!tag || (seen & tag)) {
+                        pos += size;
+                        continue;
+                }
+                seen |= tag;
+
+                /* Compressed, encrypted or unsynchronised frames */
+                if ((major == 3 && (frame_flags & 0x00c0)) ||
+                    (major == 4 && (frame_flags & 0x000e)) || size > TAG_VALUE_MAX) {
+                        return FALSE;
+                }
+                data = read_alloc(file, pos, size);
+                if (!data) {
+                        return FALSE;
+                }
+                /* Preceded by a data length indicator */
+                if (major == 4 && (frame_flags & 0x0001)) {
+                        values = id3v2_text(data + MIN(size, 4), size - MIN(size, 4));
+                } else {
+                        values = id3v2_text(data, size);
+                }
+                g_free(data);
+
+                if (tag & TAG_NUMBERS) {
+                        *tags_number(tags, tag) = values->len > 0 ? tag_number(values->pdata[0]) : 0;
+                } else if (tag == TAG_GENRE) {
+                        id3v2_genre(values, &tags->genre);
+                } else {
+                        for (i = 0; i < values->len; i++) {
+                                tag_append(tags_field(tags, tag), g_strdup(values->pdata[i]), " ");
+                        }
+                }
+                g_ptr_array_free(values, TRUE);
+                pos += size;
+        }
+        return TRUE;
+}
+
+/**
+ * One fixed width ID3v1 field, in Latin-1 and padded with NULs or spaces
+ */
+static gchar *id3v1_field(const guint8 *data, gsize len)
+{
+        gchar *value;
+
+        len = strnlen((const gchar*)data, len);
+        value = text_from_charset(data, len, "ISO-8859-1");
+        if (value) {
+                g_strstrip(value);
+        }
+        return value;
+}
+
+static void read_id3v1(const guint8 *data, BudgieTags *tags)
+{
+        const gchar *genre;
+
+        if (!tags->title) {
+                tag_append(&tags->title, id3v1_field(data + 3, 30), " ");
+        }
+        if (!tags->artist) {
+                tag_append(&tags->artist, id3v1_field(data + 33, 30), " ");
+        }
+        if (!tags->album) {
+                tag_append(&tags->album, id3v1_field(data + 63, 30), " ");
+        }
+        genre = budgie_tags_genre_name(data[127]);
+        if (!tags->genre && genre) {
+                tags->genre = g_strdup(genre);
+        }
+        tag_set_number(&tags->year, id3v1_field(data + 93, 4));
+        /* ID3v1.1 takes the last byte of the comment for the track */
+        if (!tags->track && data[125] == 0) {
+                tags->track = data[126];
+        }
+}
+
+/* The parts of an MPEG audio frame header we need */
+typedef struct MpegFrame {
+        gboolean mpeg1;
+        guint layer;
+        guint bitrate; /**<kbit/s */
+        guint sample_rate;
+        guint channels;
+        guint samples; /**<Samples per channel in the frame */
+        guint length; /**<Bytes in the frame, header included */
+} MpegFrame;
+
+static gboolean mpeg_frame_parse(const guint8 *p, MpegFrame *frame)
+{
+        guint version, layer, bitrate, rate, padding;
+
+        if (p[0] != 0xff || (p[1] & 0xe0) != 0xe0) {
+                return FALSE;
+        }
+        /* 0 is MPEG-2.5, 2 MPEG-2 and 3 MPEG-1. Free format bitrates
+         * can't be measured from the header, so they count as invalid */
+        version = (p[1] >> 3) & 0x03;
+        layer = (p[1] >> 1) & 0x03;
+        bitrate = p[2] >> 4;
+        rate = (p[2] >> 2) & 0x03;
+        padding = (p[2] >> 1) & 0x01;
+        if (version == 1 || layer == 0 || bitrate == 0 || bitrate == 15 || rate == 3) {
+                return FALSE;
+        }
+
+        frame->mpeg1 = version == 3;
+        frame->layer = 4 - layer;
+        frame->bitrate = mpeg_bitrates[frame->mpeg1 ? 0 : 1][frame->layer - 1][bitrate];
+        frame->sample_rate = mpeg_rates[rate] >> (version == 3 ? 0 : version == 2 ? 1 : 2);
+        frame->channels = (p[3] >> 6) == 3 ? 1 : 2;
+
+        switch (frame->layer) {
+                case 1:
+                        frame->samples = 384;
+                        frame->length = (12 * frame->bitrate * 1000 / frame->sample_rate + padding) * 4;
+                        break;
+                case 2:
+                        frame->samples = 1152;
+                        frame->length = 144 * frame->bitrate * 1000 / frame->sample_rate + padding;
+                        break;
+                default:
+                        frame->samples = frame->mpeg1 ? 1152 : 576;
+                        frame->length = (frame->mpeg1 ? 144 : 72) * frame->bitrate * 1000 /
+                                frame->sample_rate + padding;
+                        break;
+        }
+        return TRUE;
+}
+
+/**
+ * Find the first MPEG frame at or after pos, taking a frame as real only
+ * when another one follows it, or the stream ends right after it
+ */
+static gboolean mpeg_find_frame(TagFile *file, gint64 pos, gint64 end,
+                                gint64 *found, MpegFrame *frame)
+{
+        guint8 buf[4096], next[4];
+        MpegFrame other;
+        gint64 limit;
+        gsize len, i;
+
+        limit = MIN(end, pos + MPEG_SYNC_WINDOW);
+        while (pos + 4 <= limit) {
+                len = MIN(sizeof(buf), (gsize)(limit - pos));
+                if (!read_at(file, pos, buf, len)) {
+                        return FALSE;
+                }
+                for (i = 0; i + 4 <= len; i++) {
+                        if (!mpeg_frame_parse(buf + i, frame)) {
+                                continue;
+                        }
+                        if (pos + i + frame->length + 4 <= end) {
+                                if (!read_at(file, pos + i + frame->length, next, sizeof(next)) ||
+                                    !mpeg_frame_parse(next, &other)) {
+                                        continue;
+                                }
+                        } else if (pos + i + frame->length != end) {
+                                continue;
+                        }
+                        *found = pos + i;
+                        return TRUE;
+                }
+                /* Overlap, so a header split over two reads is found */
+                pos += len - 3;
+        }
+        return FALSE;
+}
+
+/**
+ * Length, bitrate and format of MPEG audio between start and end. VBR
+ * files carry their frame count in a Xing or VBRI header, which sits in
+ * place of the audio of the first frame. Without one the stream is
+ * taken to be constant bitrate, as TagLib does
+ */
+static void mpeg_properties(TagFile *file, gint64 start, gint64 end, BudgieTags *tags)
+{
+        guint8 peek[MPEG_HEADER_PEEK];
+        MpegFrame frame;
+        guint32 flags, n_frames = 0, n_bytes = 0;
+        gint64 pos;
+        guint xing, i;
+
+        if (!mpeg_find_frame(file, start, end, &pos, &frame)) {
+                return;
+        }
+        tags->sample_rate = frame.sample_rate;
+        tags->channels = frame.channels;
+
+        memset(peek, 0, sizeof(peek));
+        if (!read_at(file, pos, peek, MIN(sizeof(peek), (gsize)(end - pos)))) {
+                return;
+        }
+        /* Xing follows the side information, whose size depends on the
+         * version and channels. VBRI is always at the same place */
+        xing = 4 + (frame.mpeg1 ? (frame.channels == 1 ? 17 : 32) : (frame.channels == 1 ? 9 : 17));
+        if (frame.layer == 3 && (MAGIC(peek, xing, "Xing") || MAGIC(peek, xing, "Info"))) {
+                flags = be32(peek + xing + 4);
+                i = xing + 8;
+                if (flags & 0x01) {
+                        n_frames = be32(peek + i);
+                        i += 4;
+                }
+                if (flags & 0x02) {
+                        n_bytes = be32(peek + i);
+                }
+        } else if (frame.layer == 3 && MAGIC(peek, 36, "VBRI")) {
+                n_bytes = be32(peek + 46);
+                n_frames = be32(peek + 50);
+        }
+
+        if (n_frames > 0) {
+                tags->duration = samples_to_msec((guint64)n_frames * frame.samples, frame.sample_rate);
+                tags->bitrate = stream_bitrate(n_bytes ? n_bytes : end - pos, tags->duration);
+        } else {
+                tags->bitrate = frame.bitrate;
+                tags->duration = (guint)MIN((guint64)(end - pos) * 8 / frame.bitrate, G_MAXUINT);
+        }
+}
+
+/**
+ * MPEG audio, with ID3v2 at the start and ID3v1 at the end. Like TagLib,
+ * each tag is taken from the first of them that has it
+ */
+static gboolean read_mpeg(TagFile *file, BudgieTags *tags)
+{
+        guint8 v1[ID3V1_SIZE], ape[8];
+        gboolean have_v1;
+        gint64 audio, footer;
+
+        if (!read_id3v2(file, tags, &audio)) {
+                return FALSE;
+        }
+        have_v1 = read_at(file, file->size - ID3V1_SIZE, v1, ID3V1_SIZE) && MAGIC(v1, 0, "TAG");
+
+        if (!tags_complete(tags)) {
+                /* An APE tag ranks between the two, and is rare enough on
+                 * MPEG files to leave to TagLib */
+                footer = file->size - APE_FOOTER_SIZE - (have_v1 ? ID3V1_SIZE : 0);
+                if (read_at(file, footer, ape, sizeof(ape)) && MAGIC(ape, 0, "APETAGEX")) {
+                        return FALSE;
+                }
+                if (have_v1) {
+                        read_id3v1(v1, tags);
+                }
+        }
+        mpeg_properties(file, audio, file->size - (have_v1 ? ID3V1_SIZE : 0), tags);
+        return TRUE;
+}
+
+/**
+ * A FLAC PICTURE block, also found base64 encoded in Vorbis comments: the
+ * picture type, MIME type and description, the image dimensions, then
+ * the image itself
+ */
+static void flac_picture(TagFile *file, const guint8 *data, gsize len)
+{
+        guint32 type, length;
+        gsize pos = 4;
+
+        if (len < 8) {
+                return;
+        }
+        type = be32(data);
+        /* MIME type, then description */
+        length = be32(data + pos);
+        if (length > len - pos - 4) {
+                return;
+        }
+        pos += 4 + length;
+        if (len - pos < 4) {
+                return;
+        }
+        length = be32(data + pos);
+        if (length > len - pos - 4) {
+                return;
+        }
+        pos += 4 + length;
+        /* Width, height, depth and colours */
+        if (len - pos < 16 + 4) {
+                return;
+        }
+        pos += 16;
+        length = be32(data + pos);
+        pos += 4;
+        if (length > len - pos) {
+                return;
+        }
+        cover_offer(file, type, data + pos, length);
+}
+
+/**
+ * Parse a Vorbis comment block: a vendor string, then KEY=value pairs
+ * with case insensitive keys. Repeated keys are joined as TagLib does
+ */
+static gboolean read_vorbis_comment(TagFile *file, const guint8 *data, gsize len, BudgieTags *tags)
+{
+        const guint8 *entry, *eq;
+        guchar *picture;
+        gchar *encoded;
+        gsize pos, key_len, picture_len;
+        guint32 length, count, i;
+        gchar **field;
+        guint *number;
+
+        if (len < 8) {
+                return FALSE;
+        }
+        length = le32(data);
+        if (length > len - 8) {
+                return FALSE;
+        }
+        pos = 4 + length;
+        count = le32(data + pos);
+        pos += 4;
+
+        for (i = 0; i < count; i++) {
+                if (len - pos < 4) {
+                        return FALSE;
+                }
+                length = le32(data + pos);
+                pos += 4;
+                if (length > len - pos) {
+                        return FALSE;
+                }
+                entry = data + pos;
+                pos += length;
+
+                eq = memchr(entry, '=', length);
+                if (!eq) {
+                        continue;
+                }
+                key_len = eq - entry;
+                if (file->want_cover && key_len == 22 &&
+                    g_ascii_strncasecmp((const gchar*)entry, "METADATA_BLOCK_PICTURE", 22) == 0) {
+                        encoded = g_strndup((const gchar*)eq + 1, length - key_len - 1);
+                        picture = g_base64_decode(encoded, &picture_len);
+                        flac_picture(file, picture, picture_len);
+                        g_free(picture);
+                        g_free(encoded);
+                        continue;
+                }
+                number = NULL;
+                if (key_len == 11 && g_ascii_strncasecmp((const gchar*)entry, "TRACKNUMBER", 11) == 0) {
+                        number = &tags->track;
+                } else if (key_len == 10 && g_ascii_strncasecmp((const gchar*)entry, "DISCNUMBER", 10) == 0) {
+                        number = &tags->disc;
+                } else if (key_len == 4 && g_ascii_strncasecmp((const gchar*)entry, "DATE", 4) == 0) {
+                        number = &tags->year;
+                }
+                if (number) {
+                        tag_set_number(number, text_from_utf8(eq + 1, length - key_len - 1));
+                        continue;
+                }
+                if (key_len == 5 && g_ascii_strncasecmp((const gchar*)entry, "TITLE", 5) == 0) {
+                        field = &tags->title;
+                } else if (key_len == 6 && g_ascii_strncasecmp((const gchar*)entry, "ARTIST", 6) == 0) {
+                        field = &tags->artist;
+                } else if (key_len == 5 && g_ascii_strncasecmp((const gchar*)entry, "ALBUM", 5) == 0) {
+                        field = &tags->album;
+                } else if (key_len == 5 && g_ascii_strncasecmp((const gchar*)entry, "GENRE", 5) == 0) {
+                        field = &tags->genre;
+                } else {
+                        continue;
+                }
+                tag_append(field, text_from_utf8(eq + 1, length - key_len - 1), " ");
+        }
+        return TRUE;
+}
+
+/**
+ * FLAC keeps its comments in a metadata block ahead of the audio, and
+ * its format in the STREAMINFO block that always comes first
+ */
+static gboolean read_flac(TagFile *file, BudgieTags *tags)
+{
+        guint8 header[4], info[18];
+        guint8 *block;
+        gint64 pos = 4;
+        guint32 length;
+        guint64 n_samples = 0;
+        gboolean have_comment = FALSE;
+
+        for (;;) {
+                if (!read_at(file, pos, header, sizeof(header))) {
+                        return FALSE;
+                }
+                length = be24(header + 1);
+                pos += sizeof(header);
+                /* STREAMINFO: 20 bits of sample rate, 3 of channels less
+                 * one, 5 of bits per sample and 36 of total samples */
+                if ((header[0] & 0x7f) == 0 && length >= sizeof(info)) {
+                        if (!read_at(file, pos, info, sizeof(info))) {
+                                return FALSE;
+                        }
+                        tags->sample_rate = (guint)info[10] << 12 | (guint)info[11] << 4 | info[12] >> 4;
+                        tags->channels = ((info[12] >> 1) & 0x07) + 1;
+                        n_samples = (guint64)(info[13] & 0x0f) << 32 | be32(info + 14);
+                }
+                /* PICTURE */
+                if ((header[0] & 0x7f) == 6 && file->want_cover && length <= TAG_PICTURE_MAX) {
+                        block = read_alloc(file, pos, length);
+                        if (block) {
+                                flac_picture(file, block, length);
+                                g_free(block);
+                        }
+                }
+                /* VORBIS_COMMENT */
+                if ((header[0] & 0x7f) == 4 && !have_comment) {
+                        if (length > TAG_COMMENT_MAX) {
+                                return FALSE;
+                        }
+                        block = read_alloc(file, pos, length);
+                        if (!block) {
+                                return FALSE;
+                        }
+                        have_comment = read_vorbis_comment(file, block, length, tags);
+                        g_free(block);
+                        if (!have_comment) {
+                                return FALSE;
+                        }
+                }
+                pos += length;
+                /* Last block, the audio follows */
+                if (header[0] & 0x80) {
+                        break;
+                }
+        }
+        tags->duration = samples_to_msec(n_samples, tags->sample_rate);
+        tags->bitrate = stream_bitrate(file->size - pos, tags->duration);
+
+        /* Without comments, TagLib may still find ID3 tags */
+        return have_comment;
+}
+
+/**
+ * Ogg Vorbis and Opus put their comments in the second packet of the
+ * stream, which may span pages. Pages are read until it is complete.
+ */
+/**
+ * The granule position of the last page, which counts the samples of
+ * the whole stream
+ */
+static gboolean ogg_last_granule(TagFile *file, guint64 *granule)
+{
+        guint8 *tail;
+        gint64 start;
+        gsize len, i;
+        gboolean found = FALSE;
+
+        start = MAX(0, file->size - OGG_TAIL_SIZE);
+        len = file->size - start;
+        tail = read_alloc(file, start, len);
+        if (!tail) {
+                return FALSE;
+        }
+        for (i = len >= 27 ? len - 27 + 1 : 0; i-- > 0; ) {
+                if (MAGIC(tail, i, "OggS") && tail[i + 4] == 0) {
+                        *granule = le64(tail + i + 6);
+                        /* -1 marks a page on which no packet ends */
+                        if (*granule != G_MAXUINT64) {
+                                found = TRUE;
+                                break;
+                        }
+                }
+        }
+        g_free(tail);
+        return found;
+}
+
+static gboolean read_ogg(TagFile *file, BudgieTags *tags)
+{
+        guint8 header[27], lacing[255];
+        guint8 *page = NULL;
+        GByteArray *packet;
+        gint64 pos = 0;
+        guint n_packet = 0, n_segments, page_len, offset, i;
+        guint granule_rate = 0, pre_skip = 0, nominal = 0;
+        guint64 granule;
+        gsize skip = 0;
+        gboolean ret = FALSE;
+
+        packet = g_byte_array_new();
+        while (n_packet < 2) {
+                if (!read_at(file, pos, header, sizeof(header)) || !MAGIC(header, 0, "OggS")) {
+                        goto done;
+                }
+                n_segments = header[26];
+                if (!read_at(file, pos + sizeof(header), lacing, n_segments)) {
+                        goto done;
+                }
+                for (page_len = 0, i = 0; i < n_segments; i++) {
+                        page_len += lacing[i];
+                }
+                page = g_realloc(page, MAX(page_len, 1));
+                if (!read_at(file, pos + sizeof(header) + n_segments, page, page_len)) {
+                        goto done;
+                }
+                pos += sizeof(header) + n_segments + page_len;
+
+                for (offset = 0, i = 0; i < n_segments && n_packet < 2; i++) {
+                        g_byte_array_append(packet, page + offset, lacing[i]);
+                        offset += lacing[i];
+                        if (packet->len > TAG_COMMENT_MAX) {
+                                goto done;
+                        }
+                        /* The packet goes on in the next segment */
+                        if (lacing[i] == 255) {
+                                continue;
+                        }
+                        if (n_packet == 0) {
+                                /* The identification header names the codec */
+                                if (packet->len >= 28 && MAGIC(packet->data, 0, "\x01vorbis")) {
+                                        skip = 7;
+                                        tags->channels = packet->data[11];
+                                        tags->sample_rate = le32(packet->data + 12);
+                                        granule_rate = tags->sample_rate;
+                                        nominal = le32(packet->data + 20);
+                                } else if (packet->len >= 16 && MAGIC(packet->data, 0, "OpusHead")) {
+                                        skip = 8;
+                                        /* Decoded at 48kHz, whatever the input was */
+                                        tags->channels = packet->data[9];
+                                        tags->sample_rate = OPUS_RATE;
+                                        granule_rate = OPUS_RATE;
+                                        pre_skip = le16(packet->data + 10);
+                                } else {
+                                        goto done;
+                                }
+                        } else {
+                                if (packet->len < skip || !MAGIC(packet->data, 0,
+                                    skip == 7 ? "\x03vorbis" : "OpusTags")) {
+                                        goto done;
+                                }
+                                ret = read_vorbis_comment(file, packet->data + skip, packet->len - skip, tags);
+                        }
+                        n_packet++;
+                        g_byte_array_set_size(packet, 0);
+                }
+        }
+        if (ogg_last_granule(file, &granule) && granule > pre_skip) {
+                tags->duration = samples_to_msec(granule - pre_skip, granule_rate);
+        }
+        tags->bitrate = stream_bitrate(file->size, tags->duration);
+        /* Too short to tell, the encoder's intent will do */
+        if (tags->bitrate == 0 && (gint32)nominal > 0) {
+                tags->bitrate = nominal / 1000;
+        }
+done:
+        g_byte_array_unref(packet);
+        g_free(page);
+        return ret;
+}
+
+/**
+ * Find a box of the given type among those between start and end
+ */
+static gboolean mp4_find(TagFile *file,
+                         gint64 start,
+                         gint64 end,
+                         const gchar *type,
+                         gint64 *body,
+                         gint64 *body_end)
+{
+        guint8 header[16];
+        gint64 pos = start, size;
+        guint header_len;
+
+        while (pos + 8 <= end) {
+                if (!read_at(file, pos, header, 8)) {
+                        return FALSE;
+                }
+                size = be32(header);
+                header_len = 8;
+                if (size == 1) {
+                        /* 64 bit size, as used for large mdat boxes */
+                        if (!read_at(file, pos + 8, header + 8, 8)) {
+                                return FALSE;
+                        }
+                        size = (gint64)be64(header + 8);
+                        header_len = 16;
+                } else if (size == 0) {
+                        /* Runs to the end */
+                        size = end - pos;
+                }
+                if (size < header_len || size > end - pos) {
+                        return FALSE;
+                }
+                if (memcmp(header + 4, type, 4) == 0) {
+                        *body = pos + header_len;
+                        *body_end = pos + size;
+                        return TRUE;
+                }
+                pos += size;
+        }
+        return FALSE;
+}
+
+/**
+ * Read the data boxes of one ilst item. Multiple values are joined
+ * with a comma, as TagLib does for MP4
+ */
+static void mp4_item(TagFile *file, gint64 pos, gint64 end, gchar **field, gboolean gnre)
+{
+        guint8 header[16];
+        guint8 *data;
+        guint32 size;
+        const gchar *genre;
+
+        while (pos + 16 <= end) {
+                if (!read_at(file, pos, header, sizeof(header))) {
+                        return;
+                }
+                size = be32(header);
+                if (size < 16 || size > end - pos) {
+                        return;
+                }
+                /* Size, "data", type, locale, then the value */
+                if (MAGIC(header, 4, "data") && size - 16 <= TAG_VALUE_MAX) {
+                        data = read_alloc(file, pos + 16, size - 16);
+                        if (data && gnre && size - 16 >= 2) {
+                                /* ID3v1 genre number, counting from 1 */
+                                genre = budgie_tags_genre_name(be16(data) - 1);
+                                tag_append(field, g_strdup(genre), ", ");
+                        } else if (data && !gnre) {
+                                tag_append(field, text_from_utf8(data, size - 16), ", ");
+                        }
+                        g_free(data);
+                }
+                pos += size;
+        }
+}
+
+/**
+ * Read the first data box of a numeric ilst item. trkn and disk hold a
+ * number and a total, ©day holds a date as text
+ */
+static void mp4_number(TagFile *file, gint64 pos, gint64 end, guint *number, gboolean text)
+{
+        guint8 header[16], data[32];
+        guint32 size, len;
+
+        if (pos + 16 > end || !read_at(file, pos, header, sizeof(header))) {
+                return;
+        }
+        size = be32(header);
+        if (size < 16 || size > end - pos || !MAGIC(header, 4, "data")) {
+                return;
+        }
+        len = MIN(size - 16, sizeof(data));
+        if (!read_at(file, pos + 16, data, len)) {
+                return;
+        }
+        if (text) {
+                tag_set_number(number, text_from_utf8(data, len));
+        } else if (len >= 4 && *number == 0) {
+                *number = be16(data + 2);
+        }
+}
+
+/**
+ * The image in the first data box of a covr item. MP4 doesn't say which
+ * picture is which, so the first counts as the front cover
+ */
+static void mp4_cover(TagFile *file, gint64 pos, gint64 end)
+{
+        guint8 header[16];
+        guint8 *data;
+        guint32 size;
+
+        if (pos + 16 > end || !read_at(file, pos, header, sizeof(header))) {
+                return;
+        }
+        size = be32(header);
+        if (size < 16 || size > end - pos || !MAGIC(header, 4, "data") ||
+            size - 16 > TAG_PICTURE_MAX) {
+                return;
+        }
+        data = read_alloc(file, pos + 16, size - 16);
+        if (data) {
+                cover_offer(file, PICTURE_FRONT_COVER, data, size - 16);
+                g_free(data);
+        }
+}
+
+/**
+ * Length and format of the first sound track. The duration comes from
+ * the movie header, the format from the first sample description
+ */
+static void mp4_properties(TagFile *file, gint64 moov, gint64 moov_end, BudgieTags *tags)
+{
+        guint8 buf[36];
+        gint64 start, end, trak, trak_end, body, body_end;
+        guint64 duration;
+        guint32 timescale;
+
+        if (!mp4_find(file, moov, moov_end, "mvhd", &body, &body_end) ||
+            !read_at(file, body, buf, MIN(sizeof(buf), (gsize)(body_end - body)))) {
+                return;
+        }
+        /* Version 1 headers have 64 bit times */
+        if (buf[0] == 1 && body_end - body >= 32) {
+                timescale = be32(buf + 20);
+                duration = be64(buf + 24);
+        } else if (body_end - body >= 20) {
+                timescale = be32(buf + 12);
+                duration = be32(buf + 16);
+        } else {
+                return;
+        }
+        tags->duration = samples_to_msec(duration, timescale);
+
+        for (trak = moov; mp4_find(file, trak, moov_end, "trak", &trak, &trak_end); trak = trak_end) {
+                if (!mp4_find(file, trak, trak_end, "mdia", &start, &end) ||
+                    !mp4_find(file, start, end, "hdlr", &body, &body_end) ||
+                    !read_at(file, body, buf, 12) || !MAGIC(buf, 8, "soun")) {
+                        continue;
+                }
+                if (!mp4_find(file, start, end, "minf", &start, &end) ||
+                    !mp4_find(file, start, end, "stbl", &start, &end) ||
+                    !mp4_find(file, start, end, "stsd", &body, &body_end)) {
+                        break;
+                }
+                /* Version, flags and entry count, then an audio sample
+                 * entry with 16.16 fixed point sample rate */
+                if (body_end - body >= 8 + 36 && read_at(file, body + 8, buf, 36)) {
+                        tags->channels = be16(buf + 24);
+                        tags->sample_rate = be32(buf + 32) >> 16;
+                }
+                break;
+        }
+
+        if (mp4_find(file, 0, file->size, "mdat", &body, &body_end)) {
+                tags->bitrate = stream_bitrate(body_end - body, tags->duration);
+        }
+}
+
+/**
+ * iTunes style metadata in moov/udta/meta/ilst, found by walking box
+ * headers only. The audio in mdat is skipped over, wherever it is
+ */
+static gboolean read_mp4(TagFile *file, BudgieTags *tags)
+{
+        guint8 header[8];
+        gint64 start, end, pos;
+        guint32 size;
+        gchar **field;
+        gboolean gnre;
+
+        if (!mp4_find(file, 0, file->size, "moov", &start, &end)) {
+                return FALSE;
+        }
+        mp4_properties(file, start, end, tags);
+
+        if (!mp4_find(file, start, end, "udta", &start, &end) ||
+            !mp4_find(file, start, end, "meta", &start, &end)) {
+                return TRUE;
+        }
+        /* meta is a full box, its version and flags come first */
+        if (!mp4_find(file, start + 4, end, "ilst", &start, &end)) {
+                return TRUE;
+        }
+
+        for (pos = start; pos + 8 <= end; pos += size) {
+                if (!read_at(file, pos, header, sizeof(header))) {
+                        return FALSE;
+                }
+                size = be32(header);
+                if (size < 8 || size > end - pos) {
+                        return FALSE;
+                }
+                gnre = FALSE;
+                if (MAGIC(header, 4, "trkn")) {
+                        mp4_number(file, pos + 8, pos + size, &tags->track, FALSE);
+                        continue;
+                } else if (MAGIC(header, 4, "disk")) {
+                        mp4_number(file, pos + 8, pos + size, &tags->disc, FALSE);
+                        continue;
+                } else if (MAGIC(header, 4, "\xa9" "day")) {
+                        mp4_number(file, pos + 8, pos + size, &tags->year, TRUE);
+                        continue;
+                } else if (MAGIC(header, 4, "covr")) {
+                        if (file->want_cover) {
+                                mp4_cover(file, pos + 8, pos + size);
+                        }
+                        continue;
+                } else if (MAGIC(header, 4, "\xa9nam")) {
+                        field = &tags->title;
+                } else if (MAGIC(header, 4, "\xa9" "ART")) {
+                        field = &tags->artist;
+                } else if (MAGIC(header, 4, "\xa9" "alb")) {
+                        field = &tags->album;
+                } else if (MAGIC(header, 4, "\xa9gen")) {
+                        field = &tags->genre;
+                } else if (MAGIC(header, 4, "gnre")) {
+                        field = &tags->genre;
+                        gnre = TRUE;
+                } else {
+                        continue;
+                }
+                mp4_item(file, pos + 8, pos + size, field, gnre);
+        }
+        return TRUE;
+}
+
+/**
+ * Open a file, unless the caller already did, and hand it to the reader
+ * for its format
+ * @return FALSE if the file was not understood
+ */
+static gboolean read_file(TagFile *file,
+                          const gchar *path,
+                          const gchar *mime,
+                          const BudgieTagHead *head,
+                          BudgieTags *tags)
+{
+        struct stat st;
+        guint8 magic[12];
+        gboolean ret = FALSE;
+
+        if (head && head->fd >= 0) {
+                file->fd = head->fd;
+                file->size = head->size;
+                if (head->data) {
+                        file->head = g_bytes_get_data(head->data, &file->head_len);
+                }
+        } else {
+                head = NULL;
+                file->fd = open(path, O_RDONLY | O_CLOEXEC);
+                if (file->fd < 0) {
+                        return FALSE;
+                }
+                if (fstat(file->fd, &st) != 0 || !S_ISREG(st.st_mode)) {
+                        goto done;
+                }
+                file->size = st.st_size;
+        }
+        if (!read_at(file, 0, magic, sizeof(magic))) {
+                goto done;
+        }
+
+        /* MPEG audio has no magic of its own, so it goes by the MIME type
+         * the file was classified as. The rest must look the part */
+        if (g_strcmp0(mime, "audio/mpeg") == 0) {
+                ret = read_mpeg(file, tags);
+        } else if (MAGIC(magic, 0, "fLaC")) {
+                ret = read_flac(file, tags);
+        } else if (MAGIC(magic, 0, "OggS")) {
+                ret = read_ogg(file, tags);
+        } else if (MAGIC(magic, 4, "ftyp")) {
+                ret = read_mp4(file, tags);
+        }
+done:
+        /* The caller's file stays open for the caller to close */
+        if (!head) {
+                close(file->fd);
+        }
+        return ret;
+}
+
+static gboolean tags_read(const gchar *path,
+                          const gchar *mime,
+                          const BudgieTagHead *head,
+                          BudgieTags *tags)
+{
+        TagFile file = { 0 };
+
+        if (!read_file(&file, path, mime, head, tags)) {
+                budgie_tags_clear(tags);
+                return FALSE;
+        }
+        return TRUE;
+}
+
+gboolean budgie_tags_read(const gchar *path, const gchar *mime, BudgieTags *tags)
+{
+        return tags_read(path, mime, NULL, tags);
+}
+
+/**
+ * Copy a string returned by TagLib, releasing the original
+ */
+static gchar *take_tag_string(char *tag_string)
+{
+        gchar *ret = NULL;
+
+        if (!tag_string) {
+                return NULL;
+        }
+        if (strlen(tag_string) != 0) {
+                ret = g_strdup(tag_string);
+        }
+        taglib_free(tag_string);
+        return ret;
+}
+
+/**
+ * Using taglib we'll query the relevant tags. TagLib's C API has no disc
+ * number, and only gives the length in whole seconds
+ */
+static gboolean taglib_read_tags(const gchar *path, BudgieTags *tags)
+{
+        TagLib_File *tagfile = NULL;
+        TagLib_Tag *tag = NULL;
+        const TagLib_AudioProperties *props = NULL;
+
+        tagfile = taglib_file_new(path);
+        if (!tagfile) {
+                g_warning("TagLib failed to open file: %s", path);
+                return FALSE;
+        }
+
+        tag = taglib_file_tag(tagfile);
+        if (!tag) {
+                g_warning("TagLib failed to get tags for: %s", path);
+                taglib_file_free(tagfile);
+                return FALSE;
+        }
+
+        /* Set fields from taglib */
+        tags->title = take_tag_string(taglib_tag_title(tag));
+        tags->album = take_tag_string(taglib_tag_album(tag));
+        tags->artist = take_tag_string(taglib_tag_artist(tag));
+        tags->genre = take_tag_string(taglib_tag_genre(tag));
+        tags->track = taglib_tag_track(tag);
+        tags->year = taglib_tag_year(tag);
+
+        props = taglib_file_audioproperties(tagfile);
+        if (props) {
+                tags->duration = (guint)taglib_audioproperties_length(props) * 1000;
+                tags->bitrate = (guint)taglib_audioproperties_bitrate(props);
+                tags->sample_rate = (guint)taglib_audioproperties_samplerate(props);
+                tags->channels = (guint)taglib_audioproperties_channels(props);
+        }
+
+        taglib_file_free(tagfile);
+        return TRUE;
+}
+
+static void verify_tag(const gchar *path, const gchar *name,
+                       const gchar *native, const gchar *reference)
+{
+        if (g_strcmp0(native, reference) != 0) {
+                g_warning("%s of %s differs from TagLib: \"%s\", expected \"%s\"",
+                        name, path, native ? native : "", reference ? reference : "");
+        }
+}
+
+static void verify_number(const gchar *path, const gchar *name, guint native, guint reference)
+{
+        if (native != reference) {
+                g_warning("%s of %s differs from TagLib: %u, expected %u",
+                        name, path, native, reference);
+        }
+}
+
+gboolean budgie_tags_read_mode(const gchar *path,
+                               const gchar *mime,
+                               const BudgieTagHead *head,
+                               BudgieTagMode mode,
+                               BudgieTags *tags,
+                               gboolean *native)
+{
+        BudgieTags reference = { 0 };
+
+        *native = FALSE;
+        if (mode != BUDGIE_TAGS_TAGLIB) {
+                *native = tags_read(path, mime, head, tags);
+        }
+        if (mode == BUDGIE_TAGS_VERIFY && *native && taglib_read_tags(path, &reference)) {
+                verify_tag(path, "Title", tags->title, reference.title);
+                verify_tag(path, "Artist", tags->artist, reference.artist);
+                verify_tag(path, "Album", tags->album, reference.album);
+                verify_tag(path, "Genre", tags->genre, reference.genre);
+                verify_number(path, "Track", tags->track, reference.track);
+                verify_number(path, "Year", tags->year, reference.year);
+                verify_number(path, "Sample rate", tags->sample_rate, reference.sample_rate);
+                verify_number(path, "Channels", tags->channels, reference.channels);
+                /* TagLib truncates the length to whole seconds */
+                verify_number(path, "Length", tags->duration / 1000, reference.duration / 1000);
+                /* TagLib stays the reference, for all it can read */
+                reference.disc = tags->disc;
+                budgie_tags_clear(tags);
+                *tags = reference;
+        } else if (!*native && !taglib_read_tags(path, tags)) {
+                return FALSE;
+        }
+        return TRUE;
+}
+
+GBytes *budgie_tags_read_cover(const gchar *path, const gchar *mime)
+{
+        TagFile file = { 0 };
+        BudgieTags tags = { 0 };
+
+        /* The tags come along, and a tag we can't read may still have
+         * given up its pictures */
+        file.want_cover = TRUE;
+        read_file(&file, path, mime, NULL, &tags);
+        budgie_tags_clear(&tags);
+
+        return file.cover;
+}
+
+void budgie_tag_head_free(BudgieTagHead *head)
+{
+        if (!head) {
+                return;
+        }
+        if (head->fd >= 0) {
+                close(head->fd);
+        }
+        if (head->data) {
+                g_bytes_unref(head->data);
+        }
+        g_free(head);
+}
+
+void budgie_tags_clear(BudgieTags *tags)
+{
+        g_clear_pointer(&tags->title, g_free);
+        g_clear_pointer(&tags->artist, g_free);
+        g_clear_pointer(&tags->album, g_free);
+        g_clear_pointer(&tags->genre, g_free);
+        tags->track = tags->disc = tags->year = 0;
+        tags->duration = tags->bitrate = 0;
+        tags->sample_rate = tags->channels = 0;
+}
+
+const gchar *budgie_tags_genre_name(guint index)
+{
+        if (index >= G_N_ELEMENTS(genres)) {
+                return NULL;
+        }
+        return genres[index];
+}
+
+void budgie_tags_prefetch(const gchar *path, const gchar *mime)
+{
+#ifdef POSIX_FADV_WILLNEED
+        struct stat st;
+        off_t tail = 0;
+        int fd;
+
+        fd = open(path, O_RDONLY | O_CLOEXEC);
+        if (fd < 0) {
+                return;
+        }
+        if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode)) {
+                close(fd);
+                return;
+        }
+        posix_fadvise(fd, 0, MIN(st.st_size, PREFETCH_HEAD_SIZE), POSIX_FADV_WILLNEED);
+
+        /* ID3v1 and APE tags live at the end, as does the last Ogg page */
+        if (g_strcmp0(mime, "audio/mpeg") == 0) {
+                tail = ID3V1_SIZE + APE_FOOTER_SIZE;
+        } else if (mime && strstr(mime, "ogg")) {
+                tail = OGG_TAIL_SIZE;
+        }
+        if (tail > 0 && st.st_size > PREFETCH_HEAD_SIZE) {
+                tail = MIN(tail, st.st_size - PREFETCH_HEAD_SIZE);
+                posix_fadvise(fd, st.st_size - tail, tail, POSIX_FADV_WILLNEED);
+        }
+        close(fd);
+#endif
+}
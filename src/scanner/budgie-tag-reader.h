@@ -0,0 +1,144 @@
+/*
+ * budgie-tag-reader.h
+ *
+ * Copyright 2013 Ikey Doherty <ikey.doherty@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ *
+ *
+ */
+#ifndef budgie_tag_reader_h
+#define budgie_tag_reader_h
+
+#include <glib.h>
+
+/**
+ * Who reads the tags of a file
+ */
+typedef enum {
+        BUDGIE_TAGS_NATIVE = 0, /**<Our own reader, TagLib for what it can't handle */
+        BUDGIE_TAGS_TAGLIB, /**<TagLib for everything */
+        BUDGIE_TAGS_VERIFY, /**<Both, warning wherever they disagree */
+        BUDGIE_TAGS_MAX
+} BudgieTagMode;
+
+#define BUDGIE_TAGS_DEFAULT BUDGIE_TAGS_NATIVE
+
+/**
+ * The tags and audio properties we store. Text is UTF-8, and missing or
+ * empty tags are NULL. Missing numbers are 0
+ */
+typedef struct BudgieTags {
+        gchar *title;
+        gchar *artist;
+        gchar *album;
+        gchar *genre;
+        guint track; /**<Track number, without the total */
+        guint disc; /**<Disc number, without the total */
+        guint year; /**<Year of release */
+        guint duration; /**<Length in milliseconds */
+        guint bitrate; /**<Average bitrate in kbit/s */
+        guint sample_rate; /**<Samples per second */
+        guint channels; /**<Number of audio channels */
+} BudgieTags;
+
+/**
+ * The start of a file, opened and read by the caller ahead of time. The
+ * reader takes what it can from data, and reads the rest through fd
+ */
+typedef struct BudgieTagHead {
+        gint fd; /**<The open file, or -1 if it could not be opened */
+        gint64 size; /**<Size of the file */
+        GBytes *data; /**<Its first bytes, or NULL if they could not be read */
+} BudgieTagHead;
+
+/**
+ * Read the tags of a file without TagLib, touching only the bytes that
+ * hold them. Handles ID3v2 and ID3v1 in MPEG audio, Vorbis comments in
+ * FLAC, Ogg Vorbis and Ogg Opus, and iTunes metadata in MP4. The audio
+ * properties come from the stream headers, plus the Xing or VBRI header
+ * of MPEG audio and the last page of Ogg, never by decoding any audio.
+ *
+ * @param path Path of the file
+ * @param mime MIME type the file was classified as
+ * @param tags Where to store the tags, which must be empty
+ * @return TRUE if the file was understood, even if it has no tags. On
+ *         FALSE, tags is left empty and TagLib should be asked instead
+ */
+gboolean budgie_tags_read(const gchar *path, const gchar *mime, BudgieTags *tags);
+
+/**
+ * Read the tags of a file the way mode says: natively, through TagLib,
+ * or both to compare them. Natively read files fall back to TagLib
+ *
+ * @param path Path of the file
+ * @param mime MIME type the file was classified as
+ * @param head The file already opened and partly read, or NULL. TagLib
+ *             always opens the file itself
+ * @param mode Who reads the tags
+ * @param tags Where to store the tags, which must be empty
+ * @param native Set to whether the tags were read without TagLib
+ * @return TRUE if the file could be read at all
+ */
+gboolean budgie_tags_read_mode(const gchar *path,
+                               const gchar *mime,
+                               const BudgieTagHead *head,
+                               BudgieTagMode mode,
+                               BudgieTags *tags,
+                               gboolean *native);
+
+/**
+ * Read the cover art embedded in a file, without TagLib: APIC frames of
+ * ID3v2 in MPEG audio, PICTURE blocks of FLAC, METADATA_BLOCK_PICTURE
+ * comments in Ogg and covr items of MP4. Where the file says which
+ * picture is the front cover that one is taken, else the first
+ *
+ * @param path Path of the file
+ * @param mime MIME type the file was classified as
+ * @return the image as stored in the file, or NULL if there is none
+ */
+GBytes *budgie_tags_read_cover(const gchar *path, const gchar *mime);
+
+/**
+ * Ask the kernel to start reading the parts of a file budgie_tags_read
+ * will look at, without waiting for them. Does nothing where
+ * posix_fadvise is missing
+ *
+ * @param path Path of the file
+ * @param mime MIME type the file was classified as
+ */
+void budgie_tags_prefetch(const gchar *path, const gchar *mime);
+
+/**
+ * Close the file of a BudgieTagHead and free it
+ * @param head BudgieTagHead to free, may be NULL
+ */
+void budgie_tag_head_free(BudgieTagHead *head);
+
+/**
+ * Free the strings of a BudgieTags, leaving it empty
+ * @param tags BudgieTags to clear
+ */
+void budgie_tags_clear(BudgieTags *tags);
+
+/**
+ * Name of an ID3v1 genre, as used by numeric ID3v2 and MP4 genres
+ * @param index Genre number
+ * @return the genre name, or NULL if unknown
+ */
+const gchar *budgie_tags_genre_name(guint index);
+
+#endif /* budgie_tag_reader_h */
@@ -0,0 +1,156 @@
+#!/usr/bin/env python3
+#
+# mkformats.py
+#
+# Copyright 2013 Ikey Doherty <ikey.doherty@gmail.com>
+#
+# This program is free software; you can redistribute it and/or modify
+# it under the terms of the GNU General Public License as published by
+# the Free Software Foundation; either version 2 of the License, or
+# (at your option) any later version.
+#
+# Generates budgie-format-table.h, the extension table behind
+# budgie-formats.c. Edit FORMATS below, then run:
+#
+#   ./mkformats.py > budgie-format-table.h
+#
+# The build regenerates it where Python is found, and "ninja
+# check-format-table" shows how the checked-in copy differs.
+#
+# The script searches for a hash seed under which every extension lands
+# in a slot of its own, so a lookup is one hash and one string compare.
+
+import sys
+
+# Extension, MIME type, kind. NONE entries are files we know are not
+# media, so the scanner never opens them to sniff their contents.
+FORMATS = [
+    # Audio
+    ("mp3", "audio/mpeg", "AUDIO"),
+    ("mp2", "audio/mpeg", "AUDIO"),
+    ("flac", "audio/flac", "AUDIO"),
+    ("ogg", "audio/ogg", "AUDIO"),
+    ("oga", "audio/ogg", "AUDIO"),
+    ("opus", "audio/x-opus+ogg", "AUDIO"),
+    ("spx", "audio/x-speex", "AUDIO"),
+    ("m4a", "audio/mp4", "AUDIO"),
+    ("m4b", "audio/mp4", "AUDIO"),
+    ("aac", "audio/aac", "AUDIO"),
+    ("wav", "audio/x-wav", "AUDIO"),
+    ("wma", "audio/x-ms-wma", "AUDIO"),
+    ("aif", "audio/x-aiff", "AUDIO"),
+    ("aiff", "audio/x-aiff", "AUDIO"),
+    ("ape", "audio/x-ape", "AUDIO"),
+    ("wv", "audio/x-wavpack", "AUDIO"),
+    ("mpc", "audio/x-musepack", "AUDIO"),
+    ("mka", "audio/x-matroska", "AUDIO"),
+    ("dsf", "audio/x-dsf", "AUDIO"),
+    # Video
+    ("mkv", "video/x-matroska", "VIDEO"),
+    ("mp4", "video/mp4", "VIDEO"),
+    ("m4v", "video/mp4", "VIDEO"),
+    ("avi", "video/x-msvideo", "VIDEO"),
+    ("mov", "video/quicktime", "VIDEO"),
+    ("wmv", "video/x-ms-wmv", "VIDEO"),
+    ("asf", "video/x-ms-asf", "VIDEO"),
+    ("flv", "video/x-flv", "VIDEO"),
+    ("webm", "video/webm", "VIDEO"),
+    ("mpg", "video/mpeg", "VIDEO"),
+    ("mpeg", "video/mpeg", "VIDEO"),
+    ("vob", "video/mpeg", "VIDEO"),
+    ("3gp", "video/3gpp", "VIDEO"),
+    ("ts", "video/mp2t", "VIDEO"),
+    ("m2ts", "video/mp2t", "VIDEO"),
+    ("ogv", "video/ogg", "VIDEO"),
+    # Known not to be media
+    ("jpg", "image/jpeg", "NONE"),
+    ("jpeg", "image/jpeg", "NONE"),
+    ("png", "image/png", "NONE"),
+    ("gif", "image/gif", "NONE"),
+    ("bmp", "image/bmp", "NONE"),
+    ("webp", "image/webp", "NONE"),
+    ("txt", "text/plain", "NONE"),
+    ("nfo", "text/plain", "NONE"),
+    ("log", "text/plain", "NONE"),
+    ("cue", "application/x-cue", "NONE"),
+    ("m3u", "audio/x-mpegurl", "NONE"),
+    ("m3u8", "audio/x-mpegurl", "NONE"),
+    ("pls", "audio/x-scpls", "NONE"),
+    ("lrc", "text/plain", "NONE"),
+    ("srt", "application/x-subrip", "NONE"),
+    ("sub", "text/plain", "NONE"),
+    ("ass", "text/x-ssa", "NONE"),
+    ("pdf", "application/pdf", "NONE"),
+    ("sfv", "text/plain", "NONE"),
+    ("md5", "text/plain", "NONE"),
+    ("accurip", "text/plain", "NONE"),
+    ("db", "application/octet-stream", "NONE"),
+    ("ini", "text/plain", "NONE"),
+    ("xml", "application/xml", "NONE"),
+    ("html", "text/html", "NONE"),
+    ("htm", "text/html", "NONE"),
+    ("url", "text/plain", "NONE"),
+    ("zip", "application/zip", "NONE"),
+    ("rar", "application/x-rar", "NONE"),
+    ("7z", "application/x-7z-compressed", "NONE"),
+    ("ds_store", "application/octet-stream", "NONE"),
+]
+
+SLOT_BITS = 8
+MAX_EXTENSION = 8
+
+
+def fnv(seed, ext):
+    h = seed
+    for c in ext.encode("ascii"):
+        h = ((h ^ c) * 16777619) & 0xffffffff
+    # FNV alone mixes the last character poorly into the top bits
+    h ^= h >> 16
+    h = (h * 0x85ebca6b) & 0xffffffff
+    h ^= h >> 13
+    return h >> (32 - SLOT_BITS)
+
+
+def find_seed():
+    seed = 2166136261
+    while True:
+        slots = set()
+        for ext, _, _ in FORMATS:
+            slot = fnv(seed, ext)
+            if slot in slots:
+                break
+            slots.add(slot)
+        else:
+            return seed
+        seed = (seed + 0x9e3779b9) & 0xffffffff
+
+
+def main():
+    exts = [f[0] for f in FORMATS]
+    assert len(set(exts)) == len(exts), "duplicate extension"
+    assert all(len(e) <= MAX_EXTENSION and e == e.lower() for e in exts)
+    assert len(FORMATS) < 255
+
+    seed = find_seed()
+    slots = [255] * (1 << SLOT_BITS)
+    for i, (ext, _, _) in enumerate(FORMATS):
+        slots[fnv(seed, ext)] = i
+
+    out = sys.stdout
+    out.write("/* Generated by mkformats.py, do not edit */\n")
+    out.write("#define FORMAT_HASH_SEED %uU\n" % seed)
+    out.write("#define FORMAT_SLOT_BITS %d\n" % SLOT_BITS)
+    out.write("#define FORMAT_MAX_EXTENSION %d\n" % MAX_EXTENSION)
+    out.write("#define FORMAT_SLOT_EMPTY 255\n\n")
+    out.write("static const MediaFormat formats[] = {\n")
+    for ext, mime, kind in FORMATS:
+        out.write('        { "%s", "%s", MEDIA_KIND_%s },\n' % (ext, mime, kind))
+    out.write("};\n\n")
+    out.write("static const guint8 format_slots[1 << FORMAT_SLOT_BITS] = {\n")
+    for i in range(0, len(slots), 16):
+        out.write("        " + ", ".join("%3d" % s for s in slots[i:i + 16]) + ",\n")
+    out.write("};\n")
+
+
+if __name__ == "__main__":
+    main()
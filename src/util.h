@@ -24,6 +24,7 @@
 #include <glib.h>
 #include <gtk/gtk.h>
 #include "db/budgie-db.h"
+#include "scanner/budgie-media-art.h"
 
 /**
  * Automate button creation
@@ -40,15 +41,6 @@ GtkWidget* new_button_with_icon(GtkIconTheme *theme,
                                 gboolean toggle,
                                 const gchar *description);
 
-/**
- * Search a directory for files, and populate the list
- * @param dir The directory to search
- * @param list A linked list to populate with search results
- * @param n_params Number of following mime type prefixes
- * @param mimes Array of mime prefixes to find (i.e. audio/)
- */
-void search_directory(const gchar *dir, GList **list, int n_params, const gchar **mimes);
-
 /**
  * Convert seconds into human readable time
  *
@@ -58,34 +50,3 @@ void search_directory(const gchar *dir, GList **list, int n_params, const gchar
  * @return a string representation of the time
  */
 gchar *format_seconds(gint64 time, gboolean remaining);
-
-
-/**
- * Get the albumart name for the given MediaInfo
- * Note this is deliberately designed to adhere to the spec put forth
- * by GNOME: https://wiki.gnome.org/MediaArtStorageSpec
- *
- * @param info MediaInfo to query
- * @param extension "jpeg" or "png", JPEG being more common
- * @return The albumart (allocated), or NULL
- */
-gchar *albumart_name_for_media(MediaInfo *info, gchar *extension);
-
-/**
- * Following are taken from GNOME Wiki/Tracker code to ensure we stay
- * compatible in our mediaart spec
- */
-gboolean
-strip_find_next_block (const gchar    *original,
-                       const gunichar  open_char,
-                       const gunichar  close_char,
-                       gint           *open_pos,
-                       gint           *close_pos);
-
-gchar *
-albumart_strip_invalid_entities (const gchar *original);
-
-/**
- * Utility of mine to clean the album string before processing
- */
-gchar *cleaned_string(gchar *string);
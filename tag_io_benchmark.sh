@@ -0,0 +1,37 @@
+#!/bin/bash
+# Time a cold tag backfill reading through pread and through io_uring, as
+# root, for each directory given:
+#   ./tag_io_benchmark.sh /mnt/disk/Music /mnt/nfs/Music
+# Give a local directory and one on network storage to compare the two.
+# For network-like storage on one machine, mount an NFS export of this
+# host on localhost and set NETEM_DELAY (e.g. 2ms) to add latency to lo.
+# Tags are read in process, so io_uring buffers go straight to parsing.
+set -e
+
+runs="${RUNS:-3}"
+bin="${BUDGIE:-budgie-indexer}"
+db=$(mktemp -d)/bench.db
+
+if [ $# -eq 0 ] || [ "$(id -u)" != "0" ]; then
+        echo "Usage: sudo [RUNS=n] [NETEM_DELAY=2ms] $0 DIR..." >&2
+        exit 1
+fi
+
+if [ -n "$NETEM_DELAY" ]; then
+        tc qdisc add dev lo root netem delay "$NETEM_DELAY"
+        trap 'tc qdisc del dev lo root' EXIT
+fi
+
+for dir in "$@"; do
+        for io in pread uring; do
+                for run in $(seq "$runs"); do
+                        rm -f "$db"
+                        sync
+                        echo 3 > /proc/sys/vm/drop_caches
+                        echo -n "$dir $io #$run: "
+                        "$bin" --scan-only --db "$db" --dirs "$dir" --tag-io "$io" \
+                                --in-process --drop-caches | grep "^Scan finished"
+                done
+        done
+done
+rm -rf "$(dirname "$db")"